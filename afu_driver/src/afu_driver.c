@@ -26,6 +26,7 @@
 
 #define CLOCK_EDGE_DELAY 2
 #define CACHELINE_BYTES 128
+#define CACHELINE_WORDS (CACHELINE_BYTES / 4)
 
 struct resp_event {
 	uint32_t tag;
@@ -40,7 +41,7 @@ struct resp_event {
 static unsigned int bw_delay;
 static struct AFU_EVENT event;
 static struct resp_event *resp_list;
-static vpiHandle pclock;
+static vpiHandle pclock, pskip;
 static vpiHandle jval, jcom, jcompar, jea, jeapar, jrunning, jdone, jcack,
     jerror, latency, jyield, timebase_req, parity_enabled;
 static vpiHandle mmval, mmcfg, mmrnw, mmdw, mmad, mmadpar, mmwdata, mmwdatapar,
@@ -52,6 +53,16 @@ static vpiHandle brval, brtag, brtagpar, brdata, brpar, brvalid_out, brtag_out,
 static vpiHandle bwval, bwtag, bwtagpar, bwdata, bwpar;
 static vpiHandle rval, rtag, rtagpar, resp, rcredits;
 static int cl_jval, cl_mmio, cl_br, cl_bw, cl_rval;
+static int sleeping;
+
+// AFU outputs are tracked with value change callbacks so clock edges only
+// read the groups that have something to report
+static uint32_t cvalid_level, mmack_level, brvalid_level;
+static int aux2_dirty = 1;
+
+// Value buffers reused for every vector put and get
+static s_vpi_vecval vec64[2];
+static s_vpi_vecval vec_long[CACHELINE_WORDS];
 
 // Function declaration
 
@@ -83,7 +94,7 @@ static void set_signal64(vpiHandle signal, uint64_t data)
 {
 	s_vpi_value value;
 	value.format = vpiVectorVal;
-	value.value.vector = (s_vpi_vecval *) calloc(2, sizeof(s_vpi_vecval));
+	value.value.vector = vec64;
 	value.value.vector[1].aval = (int)(data >> 32);
 	value.value.vector[1].bval = 0;
 	value.value.vector[0].aval = (int)(data & 0xffffffff);
@@ -91,23 +102,19 @@ static void set_signal64(vpiHandle signal, uint64_t data)
 	vpi_put_value(signal, &value, NULL, vpiNoDelay);
 }
 
+// Put a cacheline as one vector, data[0] is the most significant byte
 static void set_signal_long(vpiHandle signal, uint8_t * data)
 {
 	s_vpi_value value;
-	value.format = vpiVectorVal;
-	unsigned size = vpi_get(vpiSize, signal);
-	unsigned words = (size + 31) / 32;
-	value.value.vector =
-	    (s_vpi_vecval *) calloc(words, sizeof(s_vpi_vecval));
-	int i, j;
 	uint32_t datum;
-	for (i = 0; i < words; i++) {
-		datum = 0;
-		for (j = 0; j < 4; j++) {
-			datum <<= 8;
-			datum += data[i * 4 + j];
-		}
-		value.value.vector[words - (i + 1)].aval = datum;
+	int i;
+
+	value.format = vpiVectorVal;
+	value.value.vector = vec_long;
+	for (i = 0; i < CACHELINE_WORDS; i++) {
+		memcpy(&datum, data + i * 4, sizeof(datum));
+		vec_long[CACHELINE_WORDS - (i + 1)].aval = ntohl(datum);
+		vec_long[CACHELINE_WORDS - (i + 1)].bval = 0;
 	}
 	vpi_put_value(signal, &value, NULL, vpiNoDelay);
 }
@@ -131,23 +138,18 @@ static void get_signal64(vpiHandle signal, uint64_t * data)
 	    ((uint64_t) value.value.vector[0].aval) & ((uint64_t) 0xffffffffll);
 }
 
+// Get a cacheline as one vector, the simulator owns the returned words
 static void get_signal_long(vpiHandle signal, uint8_t * data)
 {
 	s_vpi_value value;
+	uint32_t datum;
+	int i;
+
 	value.format = vpiVectorVal;
-	unsigned size = vpi_get(vpiSize, signal);
-	unsigned words = (size + 31) / 32;
-	value.value.vector =
-	    (s_vpi_vecval *) calloc(words, sizeof(s_vpi_vecval));
 	vpi_get_value(signal, &value);
-	int i;
-	for (i = 0; i < words; i++) {
-		int word = value.value.vector[words - (i + 1)].aval;
-		int8_t *byte = (int8_t *) & word;
-		int j;
-		for (j = 0; j < 4; j++) {
-			data[(i + 1) * 4 - (j + 1)] = byte[j];
-		}
+	for (i = 0; i < CACHELINE_WORDS; i++) {
+		datum = htonl(value.value.vector[CACHELINE_WORDS - (i + 1)].aval);
+		memcpy(data + i * 4, &datum, sizeof(datum));
 	}
 }
 
@@ -168,14 +170,15 @@ static void get_signal_long(vpiHandle signal, uint8_t * data)
 //  return vpi_register_cb(&cb);
 //}
 
-static vpiHandle set_callback_signal(void *func, vpiHandle signal)
+static vpiHandle set_callback_signal(void *func, vpiHandle signal,
+				     int format, void *data)
 {
 	s_vpi_time time;
-	time.type = vpiSimTime;
+	time.type = vpiSuppressTime;
 	time.high = 0;
 	time.low = 0;
 	s_vpi_value value;
-	value.format = vpiIntVal;
+	value.format = format;
 	s_cb_data cb;
 	cb.reason = cbValueChange;
 	cb.cb_rtn = func;
@@ -183,7 +186,7 @@ static vpiHandle set_callback_signal(void *func, vpiHandle signal)
 	cb.time = &time;
 	cb.value = &value;
 	cb.index = 0;
-	cb.user_data = 0;
+	cb.user_data = (PLI_BYTE8 *) data;
 	return vpi_register_cb(&cb);
 }
 
@@ -200,6 +203,31 @@ static vpiHandle set_callback_event(void *func, int event)
 	return vpi_register_cb(&cb);
 }
 
+// Keep a level up to date with a one bit signal
+static PLI_INT32 watch_level(p_cb_data cb)
+{
+	*(uint32_t *) cb->user_data = cb->value->value.integer;
+	return 0;
+}
+
+// Mark the group a signal belongs to as changed
+static PLI_INT32 watch_dirty(p_cb_data cb)
+{
+	*(int *)cb->user_data = 1;
+	return 0;
+}
+
+static void watch_signal_level(vpiHandle signal, uint32_t * level)
+{
+	get_signal32(signal, level);
+	set_callback_signal(watch_level, signal, vpiIntVal, level);
+}
+
+static void watch_signal_dirty(vpiHandle signal, int *dirty)
+{
+	set_callback_signal(watch_dirty, signal, vpiSuppressVal, dirty);
+}
+
 // Helper functions
 
 static void error_message(const char *str)
@@ -267,6 +295,9 @@ PLI_INT32 aux2()
 	uint32_t done, running, llcmd_ack, yield, tbreq, paren, lat;
 	int change = 0;
 
+	if (!aux2_dirty)
+		return 0;
+
 	get_signal32(jdone, &done);
 	get_signal64(jerror, &error);
 	get_signal32(jrunning, &running);
@@ -286,9 +317,12 @@ PLI_INT32 aux2()
 	change += test_change(event.parity_enable, paren, "paren");
 	change += test_change(event.buffer_read_latency, lat, "brlat");
 
-	if (change)
-		psl_afu_aux2_change(&event, running, done, llcmd_ack, error,
-				    yield, tbreq, paren, lat);
+	// Try again next edge if the last change has not been sent yet
+	if (change && (psl_afu_aux2_change(&event, running, done, llcmd_ack,
+					   error, yield, tbreq, paren,
+					   lat) != PSL_SUCCESS))
+		return 0;
+	aux2_dirty = 0;
 
 	return 0;
 }
@@ -296,11 +330,8 @@ PLI_INT32 aux2()
 void mmio()
 {
 	uint64_t data, datapar;
-	uint32_t ack;
-
-	get_signal32(mmack, &ack);
 
-	if (!ack)
+	if (!mmack_level)
 		return;
 
 	get_signal64(mmrdata, &data);
@@ -316,10 +347,9 @@ void mmio()
 static void command()
 {
 	uint64_t addr, addrpar;
-	uint32_t valid, tag, tagpar, com, compar, abt, size, handle;
+	uint32_t tag, tagpar, com, compar, abt, size, handle;
 
-	get_signal32(cvalid, &valid);
-	if (!valid)
+	if (!cvalid_level)
 		return;
 
 	get_signal32(ctag, &tag);
@@ -345,13 +375,11 @@ static void command()
 
 void buffer_read()
 {
-	uint32_t tag, valid, parity;
+	uint32_t tag, parity;
 	uint16_t parity16;
 	uint8_t data[CACHELINE_BYTES];
 
-	get_signal32(brvalid_out, &valid);
-
-	if (!valid)
+	if (!brvalid_level)
 		return;
 
 	get_signal32(brtag_out, &tag);
@@ -376,12 +404,9 @@ void buffer_read()
 
 // Clean up on clock edges
 
-PLI_INT32 clock_edge()
+PLI_INT32 clock_edge(p_cb_data cb)
 {
-	uint32_t clock;
-	get_signal32(pclock, &clock);
-
-	if (!clock) {
+	if (!cb->value->value.integer) {
 		aux2();
 		mmio();
 		buffer_read();
@@ -433,7 +458,9 @@ PLI_INT32 register_clock()
 	argsiter = vpi_iterate(vpiArgument, systfref);
 
 	pclock = vpi_scan(argsiter);
-	set_callback_signal(clock_edge, pclock);
+	// Optional register the clock generator waits on for skipped cycles
+	pskip = vpi_scan(argsiter);
+	set_callback_signal(clock_edge, pclock, vpiIntVal, NULL);
 
 	return 0;
 }
@@ -459,6 +486,15 @@ PLI_INT32 register_control()
 	parity_enabled = vpi_scan(argsiter);
 	cl_jval = 0;
 
+	// jerror is only reported along with jdone
+	watch_signal_dirty(jrunning, &aux2_dirty);
+	watch_signal_dirty(jdone, &aux2_dirty);
+	watch_signal_dirty(jcack, &aux2_dirty);
+	watch_signal_dirty(latency, &aux2_dirty);
+	watch_signal_dirty(jyield, &aux2_dirty);
+	watch_signal_dirty(timebase_req, &aux2_dirty);
+	watch_signal_dirty(parity_enabled, &aux2_dirty);
+
 	set_signal32(jval, 0);
 
 	return 0;
@@ -483,6 +519,8 @@ PLI_INT32 register_mmio()
 	mmrdatapar = vpi_scan(argsiter);
 	cl_mmio = 0;
 
+	watch_signal_level(mmack, &mmack_level);
+
 	set_signal32(mmval, 0);
 
 	return 0;
@@ -506,6 +544,7 @@ PLI_INT32 register_command()
 	cch = vpi_scan(argsiter);
 	csize = vpi_scan(argsiter);
 
+	watch_signal_level(cvalid, &cvalid_level);
 	set_signal32(croom, event.room);
 
 	return 0;
@@ -527,6 +566,10 @@ PLI_INT32 register_rd_buffer()
 	brlat = vpi_scan(argsiter);
 	cl_br = 0;
 
+	if (vpi_get(vpiSize, brdata) != CACHELINE_BYTES * 8)
+		error_message("Buffer read data must be 1024 bits");
+	watch_signal_level(brvalid_out, &brvalid_level);
+
 	set_signal32(brval, 0);
 
 	return 0;
@@ -545,6 +588,9 @@ PLI_INT32 register_wr_buffer()
 	bwpar = vpi_scan(argsiter);
 	cl_bw = 0;
 
+	if (vpi_get(vpiSize, bwdata) != CACHELINE_BYTES * 8)
+		error_message("Buffer write data must be 1024 bits");
+
 	set_signal32(bwval, 0);
 
 	return 0;
@@ -683,13 +729,24 @@ static void psl()
 	fd_set watchset;
 	FD_ZERO(&watchset);
 	FD_SET(event.sockfd, &watchset);
-	select(event.sockfd + 1, &watchset, NULL, NULL, NULL);
+	// Granted cycles run without waiting for PSL
+	if (event.clock_grant == 0)
+		select(event.sockfd + 1, &watchset, NULL, NULL, NULL);
 	int rc = psl_get_psl_events(&event);
 	// No clock edge
 	while (!rc) {
+		// PSL stopped clocks, flush output before waiting on host
+		if (event.clock_sleep && !sleeping) {
+#ifdef DEBUG
+			info_message("PSL stopped clocks\n");
+#endif				/* #ifdef DEBUG */
+			vpi_flush();
+			sleeping = 1;
+		}
 		select(event.sockfd + 1, &watchset, NULL, NULL, NULL);
 		rc = psl_get_psl_events(&event);
 	}
+	sleeping = 0;
 	// Error case
 	if (rc < 0) {
 		info_message("Socket closed: Ending Simulation.");
@@ -700,6 +757,16 @@ static void psl()
 		vpi_control(vpiStop, 1);
 #endif
 	}
+	// Jump simulation time over cycles PSL skipped while clocks stopped
+	uint64_t skip;
+	psl_afu_clock_skip(&event, &skip);
+	if (skip && pskip) {
+#ifdef DEBUG
+		info_message("Skipping %lld cycles\n", (long long)skip);
+#endif				/* #ifdef DEBUG */
+		set_signal64(pskip, skip);
+	}
+
 	// Job
 	if (event.job_valid)
 		set_job();
@@ -740,12 +807,22 @@ PLI_INT32 afu_close()
 PLI_INT32 afu_init()
 {
 	int port = 32768;
-	while (psl_serv_afu_event(&event, port) != PSL_SUCCESS) {
-		if (port == 65535) {
-			error_message("Unable to find open port!");
+	char *path = getenv("PSL_UNIX_SOCKET");
+
+	// Listen on a unix domain socket instead when PSL runs on this host
+	if ((path != NULL) && (*path != '\0')) {
+		if (psl_serv_afu_event_unix(&event, path) != PSL_SUCCESS)
+			error_message("Unable to listen on PSL_UNIX_SOCKET!");
+	} else {
+		while (psl_serv_afu_event(&event, port) != PSL_SUCCESS) {
+			if (port == 65535) {
+				error_message("Unable to find open port!");
+			}
+			++port;
 		}
-		++port;
 	}
+	// Let PSL clock the AFU several cycles per frame when it can
+	psl_afu_clock_batch(&event, PSL_CLOCK_BATCH_MAX);
 	set_callback_event(afu_close, cbEndOfSimulation);
 	return 0;
 }
@@ -0,0 +1,487 @@
+/*
+ * Copyright 2014,2015 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: afu_driver_dpi.c
+ *
+ *  This file is a DPI-C version of afu_driver.c for simulators where VPI
+ *  calls are slow.  top.v compiled as SystemVerilog with PSL_DPI defined
+ *  calls afu_dpi_negedge() and afu_dpi_posedge() just before each clock
+ *  edge, passing the AFU outputs as packed arguments.  Inputs to the AFU
+ *  are written only when PSL changes them, one call per signal group to a
+ *  function top.v exports, rather than one VPI call per signal.
+ */
+
+#include <arpa/inet.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "psl_interface.h"
+#include "svdpi.h"
+
+#define CLOCK_EDGE_DELAY 2
+#define CACHELINE_BYTES 128
+#define CACHELINE_WORDS (CACHELINE_BYTES / 4)
+
+// Valid signals dropped by afu_dpi_clear()
+#define DPI_JOB 0
+#define DPI_MMIO 1
+#define DPI_BUFFER_READ 2
+#define DPI_BUFFER_WRITE 3
+#define DPI_RESPONSE 4
+
+// Return codes for afu_dpi_posedge()
+#define DPI_RUN 0
+#define DPI_STOP 1
+#define DPI_FINISH 2
+
+struct resp_event {
+	uint32_t tag;
+	uint32_t tagpar;
+	uint32_t code;
+	int32_t credits;
+	struct resp_event *__next;
+};
+
+// Functions exported by top.v
+
+extern void afu_dpi_job(const svBitVecVal * com, svBit compar,
+			const svBitVecVal * ea, svBit eapar);
+extern void afu_dpi_mmio(svBit cfg, svBit rnw, svBit dw,
+			 const svBitVecVal * ad, svBit adpar,
+			 const svBitVecVal * data, svBit datapar);
+extern void afu_dpi_room(const svBitVecVal * room);
+extern void afu_dpi_buffer_read(const svBitVecVal * tag, svBit tagpar);
+extern void afu_dpi_buffer_write(const svBitVecVal * tag, svBit tagpar,
+				 const svBitVecVal * data,
+				 const svBitVecVal * par);
+extern void afu_dpi_response(const svBitVecVal * tag, svBit tagpar,
+			     const svBitVecVal * code,
+			     const svBitVecVal * credits);
+extern void afu_dpi_clear(int group);
+extern void afu_dpi_skip(const svBitVecVal * cycles);
+
+// Global variables
+
+static unsigned int bw_delay;
+static struct AFU_EVENT event;
+static struct resp_event *resp_list;
+static int cl_jval, cl_mmio, cl_br, cl_bw, cl_rval;
+static int sleeping;
+static uint64_t cycle;
+
+// Packing helpers, word 0 of a packed argument holds its rightmost bits
+
+static void pack64(svBitVecVal * vec, uint64_t data)
+{
+	vec[0] = (svBitVecVal) (data & 0xffffffff);
+	vec[1] = (svBitVecVal) (data >> 32);
+}
+
+static uint64_t unpack64(const svBitVecVal * vec)
+{
+	return ((uint64_t) vec[1] << 32) | (uint64_t) vec[0];
+}
+
+// data[0] is the most significant byte
+static void pack_long(svBitVecVal * vec, uint8_t * data)
+{
+	uint32_t datum;
+	int i;
+
+	for (i = 0; i < CACHELINE_WORDS; i++) {
+		memcpy(&datum, data + i * 4, sizeof(datum));
+		vec[CACHELINE_WORDS - (i + 1)] = ntohl(datum);
+	}
+}
+
+static void unpack_long(const svBitVecVal * vec, uint8_t * data)
+{
+	uint32_t datum;
+	int i;
+
+	for (i = 0; i < CACHELINE_WORDS; i++) {
+		datum = htonl(vec[CACHELINE_WORDS - (i + 1)]);
+		memcpy(data + i * 4, &datum, sizeof(datum));
+	}
+}
+
+// Helper functions, DPI has no simulation time so cycles are printed
+
+static int info_message(char *format, ...)
+{
+	va_list args;
+	int ret;
+
+	printf("%08lld: ", (long long)cycle);
+	va_start(args, format);
+	ret = vprintf(format, args);
+	va_end(args);
+	return ret;
+}
+
+// PSL functions
+
+static void add_response()
+{
+	struct resp_event *new_resp;
+	new_resp = (struct resp_event *)malloc(sizeof(struct resp_event));
+	new_resp->tag = event.response_tag;
+	new_resp->tagpar = event.response_tag_parity;
+	new_resp->code = event.response_code;
+	new_resp->credits = event.credits;
+	new_resp->__next = NULL;
+
+	event.response_valid = 0;
+
+	if (resp_list == NULL) {
+		resp_list = new_resp;
+		return;
+	}
+
+	struct resp_event *resp_ptr = resp_list;
+	while (resp_ptr->__next != NULL)
+		resp_ptr = resp_ptr->__next;
+
+	resp_ptr->__next = new_resp;
+}
+
+static int test_change(uint32_t previous, uint32_t current, const char *sig)
+{
+
+	if (previous != current) {
+#ifdef DEBUG
+		if (current)
+			info_message("%s=%d\n", sig, current);
+#endif				/* #ifdef DEBUG */
+		return 1;
+	}
+
+	return 0;
+}
+
+static void aux2(uint32_t running, uint32_t done, uint32_t llcmd_ack,
+		 uint64_t error, uint32_t lat, uint32_t yield, uint32_t tbreq,
+		 uint32_t paren)
+{
+	int change;
+
+	change = test_change(event.job_done, done, "jdone");
+	if (change && error)
+		info_message("jerror=0x%016llx\n", (long long)error);
+	change += test_change(event.job_running, running, "jrunning");
+	change += test_change(event.job_cack_llcmd, llcmd_ack, "jcack");
+	change += test_change(event.job_yield, yield, "jyield");
+	change += test_change(event.timebase_request, tbreq, "jtbreq");
+	change += test_change(event.parity_enable, paren, "paren");
+	change += test_change(event.buffer_read_latency, lat, "brlat");
+
+	if (change)
+		psl_afu_aux2_change(&event, running, done, llcmd_ack, error,
+				    yield, tbreq, paren, lat);
+}
+
+// AFU abstraction functions
+
+static void set_job()
+{
+	svBitVecVal com, ea[2];
+
+	com = event.job_code;
+	pack64(ea, event.job_address);
+	afu_dpi_job(&com, event.job_code_parity, ea,
+		    event.job_address_parity);
+
+#ifdef DEBUG
+	info_message("Job 0x%03x EA=0x%016llx\n", event.job_code,
+		     event.job_address);
+#endif				/* #ifdef DEBUG */
+
+	cl_jval = CLOCK_EDGE_DELAY;
+
+	event.job_valid = 0;
+}
+
+static void set_mmio()
+{
+	svBitVecVal ad, data[2];
+
+	ad = event.mmio_address;
+	pack64(data, event.mmio_wdata);
+	afu_dpi_mmio(event.mmio_afudescaccess, event.mmio_read,
+		     event.mmio_double, &ad, event.mmio_address_parity, data,
+		     event.mmio_wdata_parity);
+
+#ifdef DEBUG
+	info_message("MMIO rnw=%d dw=%d addr=0x%08x data=0x%016llx\n",
+		     event.mmio_read, event.mmio_double, event.mmio_address,
+		     event.mmio_wdata);
+#endif				/* #ifdef DEBUG */
+
+	cl_mmio = CLOCK_EDGE_DELAY;
+
+	event.mmio_valid = 0;
+}
+
+static void set_buffer_read()
+{
+	svBitVecVal tag;
+
+	tag = event.buffer_read_tag;
+	afu_dpi_buffer_read(&tag, event.buffer_read_tag_parity);
+
+#ifdef DEBUG
+	info_message("Buffer Read tag=0x%02x\n", event.buffer_read_tag);
+#endif				/* #ifdef DEBUG */
+
+	cl_br = CLOCK_EDGE_DELAY;
+
+	event.buffer_read = 0;
+}
+
+static void set_buffer_write()
+{
+	svBitVecVal tag, data[CACHELINE_WORDS], parity;
+
+	bw_delay += 2;
+	parity = (uint32_t) event.buffer_wparity[0];
+	parity <<= 8;
+	parity += (uint32_t) event.buffer_wparity[1];
+	tag = event.buffer_write_tag;
+	pack_long(data, event.buffer_wdata);
+	afu_dpi_buffer_write(&tag, event.buffer_write_tag_parity, data,
+			     &parity);
+
+#ifdef DEBUG
+	info_message("Buffer Write tag=0x%02x\n", event.buffer_write_tag);
+#endif				/* #ifdef DEBUG */
+
+	cl_bw = CLOCK_EDGE_DELAY;
+
+	event.buffer_write = 0;
+}
+
+static void set_response()
+{
+	svBitVecVal tag, code, credits;
+
+	tag = resp_list->tag;
+	code = resp_list->code;
+	credits = resp_list->credits & 0x1ff;
+	afu_dpi_response(&tag, resp_list->tagpar, &code, &credits);
+
+#ifdef DEBUG
+	info_message("Response tag=0x%02x code=0x%02x credits=%d\n",
+		     resp_list->tag, resp_list->code, resp_list->credits);
+#endif				/* #ifdef DEBUG */
+
+	struct resp_event *tmp;
+	tmp = resp_list;
+	resp_list = resp_list->__next;
+	free(tmp);
+
+	cl_rval = CLOCK_EDGE_DELAY;
+}
+
+// AFU functions
+
+static int psl()
+{
+	// Wait for clock edge from PSL
+	fd_set watchset;
+	FD_ZERO(&watchset);
+	FD_SET(event.sockfd, &watchset);
+	// Granted cycles run without waiting for PSL
+	if (event.clock_grant == 0)
+		select(event.sockfd + 1, &watchset, NULL, NULL, NULL);
+	int rc = psl_get_psl_events(&event);
+	// No clock edge
+	while (!rc) {
+		// PSL stopped clocks, flush output before waiting on host
+		if (event.clock_sleep && !sleeping) {
+			fflush(stdout);
+			sleeping = 1;
+		}
+		select(event.sockfd + 1, &watchset, NULL, NULL, NULL);
+		rc = psl_get_psl_events(&event);
+	}
+	sleeping = 0;
+	// Error case
+	if (rc < 0) {
+		info_message("Socket closed: Ending Simulation.");
+		psl_close_afu_event(&event);
+#ifdef FINISH
+		return DPI_FINISH;
+#else
+		return DPI_STOP;
+#endif
+	}
+	// Jump simulation time over cycles PSL skipped while clocks stopped
+	uint64_t skip;
+	svBitVecVal cycles[2];
+	psl_afu_clock_skip(&event, &skip);
+	if (skip) {
+		pack64(cycles, skip);
+		afu_dpi_skip(cycles);
+	}
+
+	// Job
+	if (event.job_valid)
+		set_job();
+
+	// MMIO
+	if (event.mmio_valid)
+		set_mmio();
+
+	// Buffer read
+	if (event.buffer_read)
+		set_buffer_read();
+
+	// Buffer write
+	if (event.buffer_write)
+		set_buffer_write();
+	if (bw_delay > 0)
+		--bw_delay;
+	if (resp_list && !(bw_delay % 2))
+		set_response();
+
+	// Response
+	if (event.response_valid)
+		add_response();
+
+	// Croom
+	if (event.aux1_change) {
+		svBitVecVal room = event.room;
+		afu_dpi_room(&room);
+		event.aux1_change = 0;
+	}
+
+	return DPI_RUN;
+}
+
+// Drop a valid signal CLOCK_EDGE_DELAY edges after it was raised
+static void clear_valid(int *count, int group)
+{
+	if (!*count)
+		return;
+	--*count;
+	if (!*count)
+		afu_dpi_clear(group);
+}
+
+// Functions imported by top.v
+
+void afu_dpi_init()
+{
+	int port = 32768;
+	char *path = getenv("PSL_UNIX_SOCKET");
+
+	// Listen on a unix domain socket instead when PSL runs on this host
+	if ((path != NULL) && (*path != '\0')) {
+		if (psl_serv_afu_event_unix(&event, path) != PSL_SUCCESS)
+			fprintf(stderr, "ERROR: Unable to listen on "
+				"PSL_UNIX_SOCKET!\n");
+	} else {
+		while (psl_serv_afu_event(&event, port) != PSL_SUCCESS) {
+			if (port == 65535) {
+				fprintf(stderr, "ERROR: Unable to find open "
+					"port!\n");
+			}
+			++port;
+		}
+	}
+	// Let PSL clock the AFU several cycles per frame when it can
+	psl_afu_clock_batch(&event, PSL_CLOCK_BATCH_MAX);
+}
+
+void afu_dpi_close()
+{
+	psl_close_afu_event(&event);
+}
+
+// Called before each falling edge with the AFU outputs PSL samples there
+void
+afu_dpi_negedge(svBit jrunning, svBit jdone, svBit jcack,
+		const svBitVecVal * jerror, const svBitVecVal * brlat,
+		svBit jyield, svBit tbreq, svBit paren, svBit mmack,
+		const svBitVecVal * mmrdata, svBit mmrdatapar, svBit brvalid,
+		const svBitVecVal * brtag, const svBitVecVal * brdata,
+		const svBitVecVal * brpar)
+{
+	uint8_t data[CACHELINE_BYTES];
+	uint16_t parity16;
+
+	aux2(jrunning, jdone, jcack, unpack64(jerror), *brlat & 0xf, jyield,
+	     tbreq, paren);
+
+	if (mmack) {
+		psl_afu_mmio_ack(&event, unpack64(mmrdata), mmrdatapar);
+#ifdef DEBUG
+		info_message("MMIO Ack data=0x%016llx\n",
+			     (long long)unpack64(mmrdata));
+#endif				/* #ifdef DEBUG */
+	}
+
+	if (brvalid) {
+		unpack_long(brdata, data);
+		parity16 = htons((uint16_t) * brpar);
+		psl_afu_read_buffer_data(&event, CACHELINE_BYTES, data,
+					 (uint8_t *) & parity16);
+#ifdef DEBUG
+		info_message("Buffer read data tag=0x%02x\n", *brtag & 0xff);
+#endif				/* #ifdef DEBUG */
+	}
+}
+
+// Called before each rising edge with the AFU command PSL samples there,
+// returns DPI_STOP or DPI_FINISH once PSL has gone
+int
+afu_dpi_posedge(svBit cvalid, const svBitVecVal * ctag, svBit ctagpar,
+		const svBitVecVal * com, svBit compar,
+		const svBitVecVal * cabt, const svBitVecVal * cea,
+		svBit ceapar, const svBitVecVal * cch,
+		const svBitVecVal * csize)
+{
+	int rc;
+
+	++cycle;
+	rc = psl();
+	if (rc != DPI_RUN)
+		return rc;
+
+	if (cvalid) {
+		psl_afu_command(&event, *ctag & 0xff, ctagpar, *com & 0x1fff,
+				compar, unpack64(cea), ceapar, *csize & 0xfff,
+				*cabt & 0x7, *cch & 0xffff);
+#ifdef DEBUG
+		info_message("Command tag=0x%02x com=%03x ea=0x%016llx "
+			     "size=%d abt=%x\n", *ctag & 0xff, *com & 0x1fff,
+			     (long long)unpack64(cea), *csize & 0xfff,
+			     *cabt & 0x7);
+#endif				/* #ifdef DEBUG */
+	}
+
+	clear_valid(&cl_jval, DPI_JOB);
+	clear_valid(&cl_mmio, DPI_MMIO);
+	clear_valid(&cl_br, DPI_BUFFER_READ);
+	clear_valid(&cl_bw, DPI_BUFFER_WRITE);
+	clear_valid(&cl_rval, DPI_RESPONSE);
+
+	return DPI_RUN;
+}
@@ -49,6 +49,7 @@ module top (
   reg    [0:63]   ha_jea_top;
   reg             ha_jeapar_top;
   reg             ha_pclock;
+  reg    [0:63]   ha_skip;
 
   // Output
   reg             ah_cvalid_top;
@@ -187,6 +188,102 @@ module top (
 
   integer         i;
 
+`ifdef PSL_DPI
+  int             dpi_rc;
+
+  // DPI-C driver interface, see afu_driver/src/afu_driver_dpi.c
+
+  import "DPI-C" context function void afu_dpi_init();
+  import "DPI-C" context function void afu_dpi_close();
+  import "DPI-C" context function void afu_dpi_negedge(
+    input bit jrunning, input bit jdone, input bit jcack,
+    input bit [0:63] jerror, input bit [0:3] brlat, input bit jyield,
+    input bit tbreq, input bit paren, input bit mmack,
+    input bit [0:63] mmdata, input bit mmdatapar, input bit brvalid,
+    input bit [0:7] brtag, input bit [0:1023] brdata, input bit [0:15] brpar);
+  import "DPI-C" context function int afu_dpi_posedge(
+    input bit cvalid, input bit [0:7] ctag, input bit ctagpar,
+    input bit [0:12] com, input bit compar, input bit [0:2] cabt,
+    input bit [0:63] cea, input bit ceapar, input bit [0:15] cch,
+    input bit [0:11] csize);
+
+  export "DPI-C" function afu_dpi_job;
+  export "DPI-C" function afu_dpi_mmio;
+  export "DPI-C" function afu_dpi_room;
+  export "DPI-C" function afu_dpi_buffer_read;
+  export "DPI-C" function afu_dpi_buffer_write;
+  export "DPI-C" function afu_dpi_response;
+  export "DPI-C" function afu_dpi_clear;
+  export "DPI-C" function afu_dpi_skip;
+
+  function void afu_dpi_job(input bit [0:7] com, input bit compar,
+                            input bit [0:63] ea, input bit eapar);
+    ha_jcom_top = com;
+    ha_jcompar_top = compar;
+    ha_jea_top = ea;
+    ha_jeapar_top = eapar;
+    ha_jval_top = 1;
+  endfunction
+
+  function void afu_dpi_mmio(input bit cfg, input bit rnw, input bit dw,
+                             input bit [0:23] ad, input bit adpar,
+                             input bit [0:63] data, input bit datapar);
+    ha_mmcfg_top = cfg;
+    ha_mmrnw_top = rnw;
+    ha_mmdw_top = dw;
+    ha_mmad_top = ad;
+    ha_mmadpar_top = adpar;
+    ha_mmdata_top = data;
+    ha_mmdatapar_top = datapar;
+    ha_mmval_top = 1;
+  endfunction
+
+  function void afu_dpi_room(input bit [0:7] room);
+    ha_croom_top = room;
+  endfunction
+
+  function void afu_dpi_buffer_read(input bit [0:7] tag, input bit tagpar);
+    ha_brtag_top = tag;
+    ha_brtagpar_top = tagpar;
+    ha_brvalid_top = 1;
+  endfunction
+
+  function void afu_dpi_buffer_write(input bit [0:7] tag, input bit tagpar,
+                                     input bit [0:1023] data,
+                                     input bit [0:15] par);
+    ha_bwtag_top = tag;
+    ha_bwtagpar_top = tagpar;
+    ha_bwdata_top = data;
+    ha_bwpar_top = par;
+    ha_bwvalid_top = 1;
+  endfunction
+
+  function void afu_dpi_response(input bit [0:7] tag, input bit tagpar,
+                                 input bit [0:7] code,
+                                 input bit [0:8] credits);
+    ha_rtag_top = tag;
+    ha_rtagpar_top = tagpar;
+    ha_response_top = code;
+    ha_rcredits_top = credits;
+    ha_rvalid_top = 1;
+  endfunction
+
+  // Drop a valid that was held for one cycle, groups as in afu_driver_dpi.c
+  function void afu_dpi_clear(input int group);
+    case (group)
+      0: ha_jval_top = 0;
+      1: ha_mmval_top = 0;
+      2: ha_brvalid_top = 0;
+      3: ha_bwvalid_top = 0;
+      4: ha_rvalid_top = 0;
+    endcase
+  endfunction
+
+  function void afu_dpi_skip(input bit [0:63] cycles);
+    ha_skip = cycles;
+  endfunction
+`endif
+
   // C code interface registration
 
   initial begin
@@ -227,8 +324,12 @@ module top (
     ha_jea_top <= 0;
     ha_jeapar_top <= 0;
     ha_pclock <= 0;
+    ha_skip <= 0;
+`ifdef PSL_DPI
+    afu_dpi_init();
+`else
     $afu_init;
-    $register_clock(ha_pclock);
+    $register_clock(ha_pclock, ha_skip);
     $register_control(ha_jval_top, ha_jcom_top, ha_jcompar_top, ha_jea_top,
                       ha_jeapar_top, ah_jrunning_top, ah_jdone_top,
                       ah_jcack_top, ah_jerror_top, ah_brlat_top, ah_jyield,
@@ -246,13 +347,50 @@ module top (
                         ha_bwdata_top, ha_bwpar_top);
     $register_response(ha_rvalid_top, ha_rtag_top, ha_rtagpar_top,
                        ha_response_top, ha_rcredits_top);
+`endif
   end
 
+`ifdef PSL_DPI
+  final afu_dpi_close();
+`endif
+
   // Clock generation
 
+`ifdef PSL_DPI
+  // The DPI driver samples AFU outputs just before each edge
+  always begin
+    #2;
+    if (ha_pclock)
+      afu_dpi_negedge(ah_jrunning_top, ah_jdone_top, ah_jcack_top,
+                      ah_jerror_top, ah_brlat_top, ah_jyield, ah_tbreq_top,
+                      ah_paren_top, ah_mmack_top, ah_mmdata_top,
+                      ah_mmdatapar_top, ah_brvalid_top, ah_brtag_top,
+                      ah_brdata_top, ah_brpar_top);
+    else begin
+      dpi_rc = afu_dpi_posedge(ah_cvalid_top, ah_ctag_top, ah_ctagpar_top,
+                               ah_com_top, ah_compar_top, ah_cabt_top,
+                               ah_cea_top, ah_ceapar_top, ah_cch_top,
+                               ah_csize_top);
+      if (dpi_rc == 1)
+        $stop;
+      else if (dpi_rc == 2)
+        $finish;
+    end
+    ha_pclock = !ha_pclock;
+    // Advance time over cycles PSL skipped while clocks were stopped
+    if (ha_skip != 0) begin
+      #(4 * ha_skip) ha_skip = 0;
+    end
+  end
+`else
   always begin
     #2 ha_pclock = !ha_pclock;
+    // Advance time over cycles PSL skipped while clocks were stopped
+    if (ha_skip != 0) begin
+      #(4 * ha_skip) ha_skip = 0;
+    end
   end
+`endif
 
   // Currently unused inputs
 
@@ -230,6 +230,12 @@ void set_machine_config_buffer_read_parity(MachineConfig * machine, uint8_t inje
 	machine->config[1] |= ((uint64_t)inject << 44);
 }
 
+// Tag duplicate inject field is bit[0] of double-word 1
+void set_machine_config_command_tag_duplicate(MachineConfig * machine, uint8_t inject) {
+	machine->config[1] &= ~0x8000000000000000LL;
+	machine->config[1] |= ((uint64_t)inject << 63);
+}
+
 // Base address of the memory space the AFU machine operate in
 void set_machine_memory_base_address(MachineConfig * machine, uint64_t addr) {
 	machine->config[2] = addr;
@@ -304,6 +310,11 @@ void get_machine_config_buffer_read_parity(MachineConfig *machine, uint8_t* inje
 	*inject= (uint16_t)((machine->config[1] & 0x0000100000000000LL) >> 44);
 }
 
+// Tag duplicate inject field is bit[0] of double-word 1
+void get_machine_config_command_tag_duplicate(MachineConfig *machine, uint8_t* inject) {
+	*inject = (uint16_t)((machine->config[1] & 0x8000000000000000LL) >> 63);
+}
+
 // Idling field is bit[23] of double-word 1
 void get_machine_config_machine_idling(MachineConfig *machine, uint8_t* idling) {
 	*idling = (uint16_t)((machine->config[1] & 0x0000010000000000LL) >> 40);
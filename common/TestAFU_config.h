@@ -96,6 +96,9 @@ void set_machine_config_command_tag_parity(MachineConfig * machine, uint8_t inje
 // Buffer read parity inject field is bit[18] of double-word 1
 void set_machine_config_buffer_read_parity(MachineConfig * machine, uint8_t inject);
 
+// Tag duplicate inject field is bit[0] of double-word 1
+void set_machine_config_command_tag_duplicate(MachineConfig * machine, uint8_t inject);
+
 // Base address of the memory space the AFU machine operate in
 void set_machine_memory_base_address(MachineConfig * machine, uint64_t addr);
 
@@ -138,6 +141,9 @@ void get_machine_config_command_tag_parity(MachineConfig *machine, uint8_t* inje
 // Buffer read parity inject field is bit[19] of double-word 1
 void get_machine_config_buffer_read_parity(MachineConfig *machine, uint8_t* inject);
 
+// Tag duplicate inject field is bit[0] of double-word 1
+void get_machine_config_command_tag_duplicate(MachineConfig *machine, uint8_t* inject);
+
 // Idling field is bit[23] of double-word 1
 void get_machine_config_machine_idling(MachineConfig *machine, uint8_t* idling);
 
@@ -1,12 +1,76 @@
+#include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "debug.h"
 #include "psl_interface_t.h"
 #include "utils.h"
 
+// Records are staged in a ring owned by the writing thread and drained to the
+// log file by a background thread once debug_log_start() is called.  Each
+// staged record is stamped with a sequence number taken from one counter, and
+// the writer merges the rings by stamp so the file keeps the order records
+// were logged in across threads.
+
+#define DBG_RING_BYTES (64 * 1024)	// Power of 2
+#define DBG_RECORD_MAX 16
+#define DBG_MMAP_WINDOW (4 * 1024 * 1024)
+#define DBG_WRITER_NS (10 * 1000 * 1000)
+#define DBG_SEQ_BYTES sizeof(uint64_t)	// Stamp ahead of each record
+#define DBG_MERGE_BYTES (16 * 1024)
+#define DBG_AFUS 256		// AFU ids fit in a byte
+
+struct debug_ring {
+	uint8_t *data;
+	uint32_t head;		// Staged bytes, owning thread only
+	uint32_t tail;		// Drained bytes, writer thread only
+	uint32_t staging;	// Owning thread holds a stamp not yet staged
+	uint32_t closed;	// Owning thread has exited
+	uint32_t end;		// Staged bytes seen by the writer
+	uint64_t peek;		// Stamp of the next record the writer takes
+	struct debug_ring *_next;
+};
+
+struct debug_log {
+	FILE *fp;
+	int fd;
+	int use_mmap;
+	int stop;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t flushed;
+	pthread_key_t key;
+	struct debug_ring *rings;
+	uint8_t *map;
+	uint64_t map_off;
+	uint64_t file_len;
+	uint64_t pos;
+	uint64_t seq;
+	uint64_t flush_req;
+	uint64_t flush_done;
+	uint64_t stalls;
+	uint64_t t0;
+	struct debug_index index;
+	uint8_t aux2;
+};
+
+static struct debug_log *_log;
+static uint32_t _debug_mask = DBG_CAT_ALL;
+static uint32_t _debug_enabled = 1;
+
+// Cycle count of each AFU's PSL by AFU id, see debug_set_cycle()
+static uint64_t _debug_cycle[DBG_AFUS];
+static uint64_t _debug_cycle_logged[DBG_AFUS];
+static uint8_t _debug_cycle_set[DBG_AFUS];
+
 static DBG_HEADER adjust_header(DBG_HEADER header)
 {
 	switch (sizeof(header)) {
@@ -25,197 +89,912 @@ static DBG_HEADER adjust_header(DBG_HEADER header)
 	return header;
 }
 
+// Category a record header is filtered by, DBG_CAT_NONE is always logged
+static uint32_t _debug_category(DBG_HEADER header)
+{
+	switch (header) {
+	case DBG_HEADER_VERSION:
+		return DBG_CAT_NONE;
+	case DBG_HEADER_PARM:
+		return DBG_CAT_PARM;
+	case DBG_HEADER_SOCKET_PUT:
+	case DBG_HEADER_SOCKET_GET:
+		return DBG_CAT_SOCKET;
+	case DBG_HEADER_AFU_CONNECT:
+	case DBG_HEADER_AFU_DROP:
+		return DBG_CAT_AFU;
+	case DBG_HEADER_CONTEXT_ADD:
+	case DBG_HEADER_CONTEXT_REMOVE:
+		return DBG_CAT_CONTEXT;
+	case DBG_HEADER_JOB_ADD:
+	case DBG_HEADER_JOB_SEND:
+	case DBG_HEADER_JOB_AUX2:
+		return DBG_CAT_JOB;
+	case DBG_HEADER_MMIO_MAP:
+	case DBG_HEADER_MMIO_ADD:
+	case DBG_HEADER_MMIO_SEND:
+	case DBG_HEADER_MMIO_ACK:
+	case DBG_HEADER_MMIO_RETURN:
+		return DBG_CAT_MMIO;
+	default:
+		return DBG_CAT_CMD;
+	}
+}
+
+uint32_t debug_record_size(DBG_HEADER header)
+{
+	switch (header) {
+	case DBG_HEADER_AFU_CONNECT:
+	case DBG_HEADER_AFU_DROP:
+	case DBG_HEADER_MMIO_ACK:
+		return sizeof(DBG_HEADER) + 1;
+	case DBG_HEADER_VERSION:
+	case DBG_HEADER_JOB_AUX2:
+	case DBG_HEADER_CMD_BUFFER_WRITE:
+	case DBG_HEADER_CMD_BUFFER_READ:
+	case DBG_HEADER_CMD_RESPONSE:
+		return sizeof(DBG_HEADER) + 2;
+	case DBG_HEADER_CONTEXT_ADD:
+	case DBG_HEADER_CONTEXT_REMOVE:
+	case DBG_HEADER_MMIO_MAP:
+	case DBG_HEADER_MMIO_RETURN:
+		return sizeof(DBG_HEADER) + 3;
+	case DBG_HEADER_SOCKET_PUT:
+	case DBG_HEADER_SOCKET_GET:
+	case DBG_HEADER_CMD_CLIENT_REQ:
+	case DBG_HEADER_CMD_CLIENT_ACK:
+		return sizeof(DBG_HEADER) + 4;
+	case DBG_HEADER_JOB_ADD:
+	case DBG_HEADER_JOB_SEND:
+		return sizeof(DBG_HEADER) + 5;
+	case DBG_HEADER_CMD_ADD:
+	case DBG_HEADER_CMD_UPDATE:
+		return sizeof(DBG_HEADER) + 6;
+	case DBG_HEADER_PARM:
+		return sizeof(DBG_HEADER) + 8;
+	case DBG_HEADER_MMIO_ADD:
+	case DBG_HEADER_MMIO_SEND:
+	case DBG_HEADER_CYCLE:
+		return sizeof(DBG_HEADER) + 9;
+	case DBG_HEADER_INDEX:
+		return DBG_INDEX_SIZE;
+	case DBG_HEADER_INDEX_END:
+		return DBG_INDEX_END_SIZE;
+	default:
+		return 0;
+	}
+}
+
+static uint16_t _get16(uint8_t * buffer)
+{
+	uint16_t value;
+
+	memcpy(&value, buffer, sizeof(value));
+	return ntohs(value);
+}
+
+static uint32_t _get32(uint8_t * buffer)
+{
+	uint32_t value;
+
+	memcpy(&value, buffer, sizeof(value));
+	return ntohl(value);
+}
+
+static uint64_t _get64(uint8_t * buffer)
+{
+	uint64_t value;
+
+	memcpy(&value, buffer, sizeof(value));
+	return ntohll(value);
+}
+
+static void _put16(uint8_t * buffer, uint16_t value)
+{
+	value = htons(value);
+	memcpy(buffer, &value, sizeof(value));
+}
+
+static void _put32(uint8_t * buffer, uint32_t value)
+{
+	value = htonl(value);
+	memcpy(buffer, &value, sizeof(value));
+}
+
+static void _put64(uint8_t * buffer, uint64_t value)
+{
+	value = htonll(value);
+	memcpy(buffer, &value, sizeof(value));
+}
+
+void debug_record_fields(uint8_t * record, struct debug_fields *fields)
+{
+	uint8_t *body = record + sizeof(DBG_HEADER);
+
+	fields->afu = body[0];
+	fields->context = -1;
+	fields->tag = -1;
+	fields->command = -1;
+	fields->aux2 = -1;
+	switch (record[0]) {
+	case DBG_HEADER_VERSION:
+	case DBG_HEADER_PARM:
+	case DBG_HEADER_INDEX:
+	case DBG_HEADER_INDEX_END:
+		fields->afu = -1;
+		break;
+	case DBG_HEADER_SOCKET_PUT:
+	case DBG_HEADER_SOCKET_GET:
+		if (fields->afu == 0xFF)
+			fields->afu = -1;
+		if (_get16(body + 2) != 0xFFFF)
+			fields->context = _get16(body + 2);
+		break;
+	case DBG_HEADER_CONTEXT_ADD:
+	case DBG_HEADER_CONTEXT_REMOVE:
+	case DBG_HEADER_MMIO_MAP:
+	case DBG_HEADER_MMIO_RETURN:
+		fields->context = _get16(body + 1);
+		break;
+	case DBG_HEADER_MMIO_ADD:
+	case DBG_HEADER_MMIO_SEND:
+		if (_get16(body + 3) != 0xFFFF)
+			fields->context = _get16(body + 3);
+		break;
+	case DBG_HEADER_JOB_AUX2:
+		fields->aux2 = body[1];
+		break;
+	case DBG_HEADER_CMD_ADD:
+		fields->command = _get16(body + 4);
+		// Fall through
+	case DBG_HEADER_CMD_UPDATE:
+	case DBG_HEADER_CMD_CLIENT_REQ:
+	case DBG_HEADER_CMD_CLIENT_ACK:
+		fields->context = _get16(body + 2);
+		// Fall through
+	case DBG_HEADER_CMD_BUFFER_WRITE:
+	case DBG_HEADER_CMD_BUFFER_READ:
+	case DBG_HEADER_CMD_RESPONSE:
+		fields->tag = body[1];
+		break;
+	default:
+		break;
+	}
+}
+
+void debug_index_reset(struct debug_index *index, uint64_t start, uint8_t aux2)
+{
+	memset(index, 0, sizeof(*index));
+	index->prev = DBG_INDEX_NONE;
+	index->start = start;
+	index->context_min = 0xFFFF;
+	index->aux2 = aux2;
+}
+
+void debug_index_add(struct debug_index *index, struct debug_fields *fields)
+{
+	index->records++;
+	if (fields->afu >= 0)
+		index->afu[fields->afu / 8] |= 1 << (fields->afu % 8);
+	if (fields->tag >= 0)
+		index->tag[fields->tag / 8] |= 1 << (fields->tag % 8);
+	if (fields->context >= 0) {
+		if (fields->context < index->context_min)
+			index->context_min = fields->context;
+		if (fields->context > index->context_max)
+			index->context_max = fields->context;
+	}
+}
+
+void debug_index_encode(struct debug_index *index, uint8_t * buffer)
+{
+	buffer[0] = DBG_HEADER_INDEX;
+	_put64(buffer + 1, index->prev);
+	_put64(buffer + 9, index->start);
+	_put64(buffer + 17, index->time);
+	_put32(buffer + 25, index->records);
+	_put16(buffer + 29, index->context_min);
+	_put16(buffer + 31, index->context_max);
+	buffer[33] = index->aux2;
+	memcpy(buffer + 34, index->afu, sizeof(index->afu));
+	memcpy(buffer + 66, index->tag, sizeof(index->tag));
+}
+
+// Returns -1 if buffer doesn't hold an index block
+int debug_index_decode(uint8_t * buffer, struct debug_index *index)
+{
+	if (buffer[0] != DBG_HEADER_INDEX)
+		return -1;
+	index->prev = _get64(buffer + 1);
+	index->start = _get64(buffer + 9);
+	index->time = _get64(buffer + 17);
+	index->records = _get32(buffer + 25);
+	index->context_min = _get16(buffer + 29);
+	index->context_max = _get16(buffer + 31);
+	index->aux2 = buffer[33];
+	memcpy(index->afu, buffer + 34, sizeof(index->afu));
+	memcpy(index->tag, buffer + 66, sizeof(index->tag));
+	return 0;
+}
+
+// Thread exit: hand ring to writer to drain and free
+static void _debug_ring_close(void *ptr)
+{
+	struct debug_ring *ring = (struct debug_ring *)ptr;
+
+	__atomic_store_n(&ring->closed, 1, __ATOMIC_RELEASE);
+}
+
+// Find or create the calling thread's ring
+static struct debug_ring *_debug_ring(struct debug_log *log)
+{
+	struct debug_ring *ring;
+
+	ring = (struct debug_ring *)pthread_getspecific(log->key);
+	if (ring != NULL)
+		return ring;
+	ring = (struct debug_ring *)calloc(1, sizeof(struct debug_ring));
+	if (ring == NULL)
+		return NULL;
+	if ((ring->data = (uint8_t *) malloc(DBG_RING_BYTES)) == NULL) {
+		free(ring);
+		return NULL;
+	}
+	pthread_mutex_lock(&(log->lock));
+	ring->_next = log->rings;
+	log->rings = ring;
+	pthread_mutex_unlock(&(log->lock));
+	pthread_setspecific(log->key, ring);
+	return ring;
+}
+
+// Copy len bytes from position pos in a ring
+static void _debug_ring_copy(struct debug_ring *ring, uint32_t pos,
+			     uint8_t * buffer, uint32_t len)
+{
+	uint32_t offset, first;
+
+	offset = pos & (DBG_RING_BYTES - 1);
+	first = DBG_RING_BYTES - offset;
+	if (first > len)
+		first = len;
+	memcpy(buffer, ring->data + offset, first);
+	memcpy(buffer + first, ring->data, len - first);
+}
+
+// Copy len bytes into a ring at position pos
+static void _debug_ring_put(struct debug_ring *ring, uint32_t pos,
+			    uint8_t * buffer, uint32_t len)
+{
+	uint32_t offset, first;
+
+	offset = pos & (DBG_RING_BYTES - 1);
+	first = DBG_RING_BYTES - offset;
+	if (first > len)
+		first = len;
+	memcpy(ring->data + offset, buffer, first);
+	memcpy(ring->data, buffer + first, len - first);
+}
+
+// Stage one record, or write it directly when fp has no background writer
+static void _debug_stage(FILE * fp, uint8_t * record, uint32_t size)
+{
+	struct debug_log *log;
+	struct debug_ring *ring;
+	uint8_t entry[DBG_SEQ_BYTES + DBG_RECORD_MAX];
+	uint64_t seq;
+	uint32_t head, used, need;
+
+	log = __atomic_load_n(&_log, __ATOMIC_ACQUIRE);
+	if ((log == NULL) || (log->fp != fp) ||
+	    ((ring = _debug_ring(log)) == NULL)) {
+		if (fp != NULL)
+			fwrite(record, size, 1, fp);
+		return;
+	}
+
+	// Wait for the writer if this thread has filled its ring
+	head = ring->head;
+	need = DBG_SEQ_BYTES + size;
+	used = head - __atomic_load_n(&(ring->tail), __ATOMIC_ACQUIRE);
+	while (used + need > DBG_RING_BYTES) {
+		__atomic_add_fetch(&(log->stalls), 1, __ATOMIC_RELAXED);
+		pthread_cond_signal(&(log->wake));
+		sched_yield();
+		used = head - __atomic_load_n(&(ring->tail), __ATOMIC_ACQUIRE);
+	}
+
+	// Raise staging before taking the stamp.  A writer that sees a later
+	// count through the stamp's release also sees staging until this
+	// record is staged.
+	__atomic_store_n(&(ring->staging), 1, __ATOMIC_RELAXED);
+	seq = __atomic_fetch_add(&(log->seq), 1, __ATOMIC_ACQ_REL);
+	memcpy(entry, &seq, DBG_SEQ_BYTES);
+	memcpy(entry + DBG_SEQ_BYTES, record, size);
+	_debug_ring_put(ring, head, entry, need);
+	__atomic_store_n(&(ring->head), head + need, __ATOMIC_RELEASE);
+	__atomic_store_n(&(ring->staging), 0, __ATOMIC_RELEASE);
+
+	// Nudge the writer as the ring crosses half full
+	if ((used < DBG_RING_BYTES / 2) && (used + need >= DBG_RING_BYTES / 2))
+		pthread_cond_signal(&(log->wake));
+}
+
+// Filter a record and stage it, behind a CYCLE record if the count moved
+static void _debug_put(FILE * fp, uint8_t * record, uint32_t size)
+{
+	struct debug_fields fields;
+	uint8_t cycle[DBG_RECORD_MAX];
+	DBG_HEADER header;
+	uint64_t cycles;
+	uint32_t category;
+
+	memcpy(&header, record, sizeof(DBG_HEADER));
+	category = _debug_category(adjust_header(header));
+	if ((category != DBG_CAT_NONE) &&
+	    (!__atomic_load_n(&_debug_enabled, __ATOMIC_RELAXED) ||
+	     !(__atomic_load_n(&_debug_mask, __ATOMIC_RELAXED) & category)))
+		return;
+
+	// Whichever thread logs it, a record is timed by its own AFU's PSL
+	debug_record_fields(record, &fields);
+	if ((fields.afu >= 0) &&
+	    __atomic_load_n(&(_debug_cycle_set[fields.afu]), __ATOMIC_ACQUIRE)) {
+		cycles = __atomic_load_n(&(_debug_cycle[fields.afu]),
+					 __ATOMIC_RELAXED);
+		if (__atomic_exchange_n(&(_debug_cycle_logged[fields.afu]),
+					cycles, __ATOMIC_RELAXED) != cycles) {
+			header = adjust_header(DBG_HEADER_CYCLE);
+			memcpy(cycle, &header, sizeof(DBG_HEADER));
+			cycle[sizeof(DBG_HEADER)] = fields.afu;
+			_put64(cycle + sizeof(DBG_HEADER) + 1, cycles);
+			_debug_stage(fp, cycle,
+				     debug_record_size(DBG_HEADER_CYCLE));
+		}
+	}
+	_debug_stage(fp, record, size);
+}
+
+// Copy bytes into the mmap window, returns -1 if the file can't be mapped
+static int _debug_emit_map(struct debug_log *log, uint8_t * data, uint32_t len)
+{
+	uint64_t end;
+	uint32_t piece;
+
+	while (len > 0) {
+		end = log->map_off + DBG_MMAP_WINDOW;
+		if ((log->map == NULL) || (log->pos >= end)) {
+			if (log->map != NULL)
+				munmap(log->map, DBG_MMAP_WINDOW);
+			log->map_off = log->pos;
+			end = log->map_off + DBG_MMAP_WINDOW;
+			if (ftruncate(log->fd, end) < 0)
+				goto map_fail;
+			log->file_len = end;
+			log->map = (uint8_t *) mmap(NULL, DBG_MMAP_WINDOW,
+						    PROT_READ | PROT_WRITE,
+						    MAP_SHARED, log->fd,
+						    log->map_off);
+			if (log->map == MAP_FAILED)
+				goto map_fail;
+		}
+		// debug_log_flush() trims the file back to the data written
+		if (log->file_len < end) {
+			if (ftruncate(log->fd, end) < 0)
+				goto map_fail;
+			log->file_len = end;
+		}
+		piece = end - log->pos;
+		if (piece > len)
+			piece = len;
+		memcpy(log->map + (log->pos - log->map_off), data, piece);
+		log->pos += piece;
+		data += piece;
+		len -= piece;
+	}
+	return 0;
+
+ map_fail:
+	log->map = NULL;
+	return -1;
+}
+
+static void _debug_emit(struct debug_log *log, uint8_t * data, uint32_t len)
+{
+	if (log->use_mmap) {
+		if (_debug_emit_map(log, data, len) == 0)
+			return;
+		warn_msg("Unable to mmap debug log, falling back to stdio");
+		log->use_mmap = 0;
+		fseek(log->fp, log->pos, SEEK_SET);
+	}
+	fwrite(data, len, 1, log->fp);
+	log->pos += len;
+}
+
+static uint64_t _debug_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Write an index block for the records since the last one
+static void _debug_index(struct debug_log *log)
+{
+	uint8_t buffer[DBG_INDEX_SIZE];
+	uint64_t prev;
+
+	prev = log->pos;
+	log->index.time = _debug_ns() - log->t0;
+	debug_index_encode(&(log->index), buffer);
+	_debug_emit(log, buffer, sizeof(buffer));
+	debug_index_reset(&(log->index), log->pos, log->aux2);
+	log->index.prev = prev;
+}
+
+// Index the last chunk and point to its block from the end of the file
+static void _debug_index_end(struct debug_log *log)
+{
+	uint8_t buffer[DBG_INDEX_END_SIZE];
+
+	if (log->index.records)
+		_debug_index(log);
+	if (log->index.prev == DBG_INDEX_NONE)
+		return;
+	buffer[0] = DBG_HEADER_INDEX_END;
+	_put64(buffer + 1, log->index.prev);
+	_debug_emit(log, buffer, sizeof(buffer));
+}
+
+// Point to the stamped record at pos in a ring, copied out if it wraps
+static uint8_t *_debug_entry(struct debug_ring *ring, uint32_t pos,
+			     uint8_t * entry)
+{
+	uint32_t offset = pos & (DBG_RING_BYTES - 1);
+
+	if (offset + DBG_SEQ_BYTES + DBG_RECORD_MAX <= DBG_RING_BYTES)
+		return ring->data + offset;
+	_debug_ring_copy(ring, pos, entry, DBG_SEQ_BYTES + DBG_RECORD_MAX);
+	return entry;
+}
+
+// Stamp of the next record in a ring the writer may take, ~0 if none
+static uint64_t _debug_peek(struct debug_ring *ring, uint64_t limit)
+{
+	uint8_t entry[DBG_SEQ_BYTES + DBG_RECORD_MAX];
+	uint64_t seq;
+
+	if (ring->tail == ring->end)
+		return ~0ull;
+	memcpy(&seq, _debug_entry(ring, ring->tail, entry), DBG_SEQ_BYTES);
+	return (seq < limit) ? seq : ~0ull;
+}
+
+// Write out merged records and follow them with an index block when due
+static void _debug_merge_out(struct debug_log *log, uint8_t * out,
+			     uint32_t * used)
+{
+	_debug_emit(log, out, *used);
+	*used = 0;
+	if (log->pos - log->index.start >= DBG_INDEX_CHUNK)
+		_debug_index(log);
+}
+
+// Move every record stamped below limit from the rings to the log file,
+// lowest stamp first
+static void _debug_merge(struct debug_log *log, struct debug_ring *rings,
+			 uint64_t limit)
+{
+	struct debug_fields fields;
+	struct debug_ring *ring, *next;
+	uint8_t entry[DBG_SEQ_BYTES + DBG_RECORD_MAX];
+	uint8_t out[DBG_MERGE_BYTES];
+	uint8_t *data, *record;
+	uint64_t seq, until;
+	uint32_t tail, len, used;
+
+	for (ring = rings; ring != NULL; ring = ring->_next) {
+		ring->end = __atomic_load_n(&(ring->head), __ATOMIC_ACQUIRE);
+		ring->peek = _debug_peek(ring, limit);
+	}
+
+	used = 0;
+	while (1) {
+		// Find the ring holding the oldest record, it can be taken from
+		// until its stamps pass the oldest record of any other ring
+		next = NULL;
+		until = limit;
+		for (ring = rings; ring != NULL; ring = ring->_next) {
+			if ((next == NULL) || (ring->peek < next->peek)) {
+				if ((next != NULL) && (next->peek < until))
+					until = next->peek;
+				next = ring;
+			} else if (ring->peek < until)
+				until = ring->peek;
+		}
+		if ((next == NULL) || (next->peek == ~0ull))
+			break;
+
+		for (tail = next->tail; tail != next->end; tail += len) {
+			data = _debug_entry(next, tail, entry);
+			memcpy(&seq, data, DBG_SEQ_BYTES);
+			if (seq >= until)
+				break;
+			record = data + DBG_SEQ_BYTES;
+			if ((len = debug_record_size(record[0])) == 0) {
+				warn_msg("Dropping unknown debug record 0x%02x",
+					 record[0]);
+				tail = next->end;
+				break;
+			}
+
+			// Flushing may close the chunk, so only then summarize
+			// the record for the index block of the chunk it is in
+			if (used + len > sizeof(out))
+				_debug_merge_out(log, out, &used);
+			debug_record_fields(record, &fields);
+			debug_index_add(&(log->index), &fields);
+			if (fields.aux2 >= 0)
+				log->aux2 = fields.aux2;
+			memcpy(out + used, record, len);
+			used += len;
+			len += DBG_SEQ_BYTES;
+		}
+		__atomic_store_n(&(next->tail), tail, __ATOMIC_RELEASE);
+		next->peek = _debug_peek(next, limit);
+	}
+	if (used)
+		_debug_merge_out(log, out, &used);
+}
+
+// Make everything written so far visible in the file
+static void _debug_sync(struct debug_log *log)
+{
+	if (log->use_mmap) {
+		if ((log->file_len > log->pos) &&
+		    (ftruncate(log->fd, log->pos) == 0))
+			log->file_len = log->pos;
+		return;
+	}
+	fflush(log->fp);
+}
+
+static void *_debug_writer(void *ptr)
+{
+	struct debug_log *log = (struct debug_log *)ptr;
+	struct debug_ring *rings, *ring, **ring_ptr;
+	struct timespec ts;
+	uint64_t req, limit;
+	int stop;
+
+	pthread_mutex_lock(&(log->lock));
+	while (1) {
+		req = log->flush_req;
+		stop = log->stop;
+		rings = log->rings;
+		// Rings pushed after this only hold stamps from limit up
+		limit = __atomic_load_n(&(log->seq), __ATOMIC_ACQUIRE);
+		pthread_mutex_unlock(&(log->lock));
+
+		// Every stamp below limit is staged once its ring is out of
+		// _debug_stage(), later stamps wait for the next pass
+		for (ring = rings; ring != NULL; ring = ring->_next) {
+			while (__atomic_load_n(&(ring->staging),
+					       __ATOMIC_ACQUIRE))
+				sched_yield();
+		}
+		_debug_merge(log, rings, limit);
+		if (stop)
+			_debug_index_end(log);
+		if ((req != log->flush_done) || stop)
+			_debug_sync(log);
+
+		pthread_mutex_lock(&(log->lock));
+		// Free rings of exited threads once drained
+		ring_ptr = &(log->rings);
+		while (*ring_ptr != NULL) {
+			ring = *ring_ptr;
+			if (__atomic_load_n(&(ring->closed), __ATOMIC_ACQUIRE)
+			    && (ring->tail == ring->head)) {
+				*ring_ptr = ring->_next;
+				free(ring->data);
+				free(ring);
+				continue;
+			}
+			ring_ptr = &(ring->_next);
+		}
+		if (req != log->flush_done) {
+			log->flush_done = req;
+			pthread_cond_broadcast(&(log->flushed));
+		}
+		if (stop)
+			break;
+		if (log->flush_req == req) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += DBG_WRITER_NS;
+			if (ts.tv_nsec >= 1000000000) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&(log->wake), &(log->lock), &ts);
+		}
+	}
+	pthread_mutex_unlock(&(log->lock));
+	return NULL;
+}
+
+int debug_log_start(FILE * fp, uint32_t mask, int use_mmap)
+{
+	struct debug_log *log;
+
+	if ((fp == NULL) || (_log != NULL))
+		return -1;
+	if ((log = (struct debug_log *)calloc(1, sizeof(*log))) == NULL)
+		return -1;
+	fflush(fp);
+	log->fp = fp;
+	log->fd = fileno(fp);
+	log->pos = ftell(fp);
+	log->use_mmap = use_mmap;
+	log->t0 = _debug_ns();
+	debug_index_reset(&(log->index), log->pos, 0);
+	if (use_mmap && ((fcntl(log->fd, F_GETFL) & O_ACCMODE) != O_RDWR)) {
+		warn_msg("Debug log not opened \"w+\", can't mmap it");
+		log->use_mmap = 0;
+	}
+	if (pthread_key_create(&(log->key), _debug_ring_close))
+		goto start_fail;
+	pthread_mutex_init(&(log->lock), NULL);
+	pthread_cond_init(&(log->wake), NULL);
+	pthread_cond_init(&(log->flushed), NULL);
+	if (pthread_create(&(log->thread), NULL, _debug_writer, log)) {
+		perror("pthread_create");
+		pthread_key_delete(log->key);
+		goto start_fail;
+	}
+	debug_log_set_mask(mask);
+	__atomic_store_n(&_log, log, __ATOMIC_RELEASE);
+	return 0;
+
+ start_fail:
+	free(log);
+	return -1;
+}
+
+void debug_log_flush(void)
+{
+	struct debug_log *log = __atomic_load_n(&_log, __ATOMIC_ACQUIRE);
+	uint64_t req;
+
+	if (log == NULL)
+		return;
+	pthread_mutex_lock(&(log->lock));
+	req = ++log->flush_req;
+	pthread_cond_signal(&(log->wake));
+	while (log->flush_done < req)
+		pthread_cond_wait(&(log->flushed), &(log->lock));
+	pthread_mutex_unlock(&(log->lock));
+}
+
+void debug_log_stop(void)
+{
+	struct debug_log *log = __atomic_load_n(&_log, __ATOMIC_ACQUIRE);
+	struct debug_ring *ring;
+
+	if (log == NULL)
+		return;
+	pthread_mutex_lock(&(log->lock));
+	log->stop = 1;
+	pthread_cond_signal(&(log->wake));
+	pthread_mutex_unlock(&(log->lock));
+	pthread_join(log->thread, NULL);
+	__atomic_store_n(&_log, NULL, __ATOMIC_RELEASE);
+
+	// Rings of threads still running are left to them, they may be exiting
+	pthread_key_delete(log->key);
+	while ((ring = log->rings) != NULL) {
+		log->rings = ring->_next;
+		if (__atomic_load_n(&(ring->closed), __ATOMIC_ACQUIRE)) {
+			free(ring->data);
+			free(ring);
+		}
+	}
+	if (log->map != NULL)
+		munmap(log->map, DBG_MMAP_WINDOW);
+	if (log->file_len > log->pos) {
+		if (ftruncate(log->fd, log->pos) < 0)
+			perror("ftruncate");
+	}
+	fseek(log->fp, log->pos, SEEK_SET);
+	if (log->stalls)
+		info_msg("Debug log writer fell behind %" PRIu64 " times",
+			 log->stalls);
+	pthread_cond_destroy(&(log->flushed));
+	pthread_cond_destroy(&(log->wake));
+	pthread_mutex_destroy(&(log->lock));
+	free(log);
+}
+
+void debug_log_enable(int enable)
+{
+	__atomic_store_n(&_debug_enabled, enable ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+int debug_log_enabled(void)
+{
+	return __atomic_load_n(&_debug_enabled, __ATOMIC_RELAXED);
+}
+
+void debug_log_set_mask(uint32_t mask)
+{
+	__atomic_store_n(&_debug_mask, mask, __ATOMIC_RELAXED);
+}
+
+void debug_set_cycle(uint8_t id, uint64_t cycles)
+{
+	__atomic_store_n(&(_debug_cycle[id]), cycles, __ATOMIC_RELAXED);
+	if (!__atomic_load_n(&(_debug_cycle_set[id]), __ATOMIC_RELAXED)) {
+		_debug_cycle_logged[id] = ~cycles;
+		__atomic_store_n(&(_debug_cycle_set[id]), 1, __ATOMIC_RELEASE);
+	}
+}
+
 static void _debug_send_id(FILE * fp, DBG_HEADER header, uint8_t id)
 {
-	char *buffer;
-	size_t size;
-	int offset;
+	uint8_t buffer[DBG_RECORD_MAX];
+	uint32_t offset;
 
 	offset = 0;
 	header = adjust_header(header);
-	size = sizeof(DBG_HEADER) + sizeof(id);
-	if ((buffer = (char *)malloc(size)) != NULL) {
-		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
-		offset += sizeof(DBG_HEADER);
-		buffer[offset] = id;
-		fwrite(buffer, size, 1, fp);
-		free(buffer);
-	}
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	offset += sizeof(DBG_HEADER);
+	buffer[offset] = id;
+	offset += sizeof(id);
+	_debug_put(fp, buffer, offset);
 }
 
 static void _debug_send_id_8(FILE * fp, DBG_HEADER header, uint8_t id,
 			     uint8_t value)
 {
-	char *buffer;
-	size_t size;
-	int offset;
+	uint8_t buffer[DBG_RECORD_MAX];
+	uint32_t offset;
 
 	offset = 0;
 	header = adjust_header(header);
-	size = sizeof(DBG_HEADER) + sizeof(id) + sizeof(value);
-	if ((buffer = (char *)malloc(size)) != NULL) {
-		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
-		offset += sizeof(header);
-		buffer[offset] = id;
-		offset += sizeof(id);
-		buffer[offset] = value;
-		fwrite(buffer, size, 1, fp);
-		free(buffer);
-	}
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	offset += sizeof(header);
+	buffer[offset] = id;
+	offset += sizeof(id);
+	buffer[offset] = value;
+	offset += sizeof(value);
+	_debug_put(fp, buffer, offset);
 }
 
 static void _debug_send_id_16(FILE * fp, DBG_HEADER header, uint8_t id,
 			      uint16_t value)
 {
-	char *buffer;
-	size_t size;
-	int offset;
+	uint8_t buffer[DBG_RECORD_MAX];
+	uint32_t offset;
 
 	offset = 0;
 	header = adjust_header(header);
-	size = sizeof(DBG_HEADER) + sizeof(id) + sizeof(value);
-	if ((buffer = (char *)malloc(size)) != NULL) {
-		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
-		offset += sizeof(header);
-		buffer[offset] = id;
-		offset += sizeof(id);
-		value = htons(value);
-		memcpy(buffer + offset, (char *)&value, sizeof(value));
-		fwrite(buffer, size, 1, fp);
-		free(buffer);
-	}
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	offset += sizeof(header);
+	buffer[offset] = id;
+	offset += sizeof(id);
+	value = htons(value);
+	memcpy(buffer + offset, (char *)&value, sizeof(value));
+	offset += sizeof(value);
+	_debug_put(fp, buffer, offset);
 }
 
 static void _debug_send_id_32(FILE * fp, DBG_HEADER header, uint8_t id,
 			      uint32_t value)
 {
-	char *buffer;
-	size_t size;
-	int offset;
+	uint8_t buffer[DBG_RECORD_MAX];
+	uint32_t offset;
 
 	offset = 0;
 	header = adjust_header(header);
-	size = sizeof(DBG_HEADER) + sizeof(id) + sizeof(value);
-	if ((buffer = (char *)malloc(size)) != NULL) {
-		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
-		offset += sizeof(header);
-		buffer[offset] = id;
-		offset += sizeof(id);
-		value = htonl(value);
-		memcpy(buffer + offset, (char *)&value, sizeof(value));
-		fwrite(buffer, size, 1, fp);
-		free(buffer);
-	}
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	offset += sizeof(header);
+	buffer[offset] = id;
+	offset += sizeof(id);
+	value = htonl(value);
+	memcpy(buffer + offset, (char *)&value, sizeof(value));
+	offset += sizeof(value);
+	_debug_put(fp, buffer, offset);
 }
 
 static void _debug_send_32_32(FILE * fp, DBG_HEADER header, uint32_t value0,
 			      uint32_t value1)
 {
-	char *buffer;
-	size_t size;
-	int offset;
+	uint8_t buffer[DBG_RECORD_MAX];
+	uint32_t offset;
 
 	offset = 0;
 	header = adjust_header(header);
-	size = sizeof(DBG_HEADER) + sizeof(value0) + sizeof(value1);
-	if ((buffer = (char *)malloc(size)) != NULL) {
-		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
-		offset += sizeof(header);
-		value0 = htonl(value0);
-		memcpy(buffer + offset, (char *)&value0, sizeof(value0));
-		offset += sizeof(value0);
-		value0 = htonl(value1);
-		memcpy(buffer + offset, (char *)&value1, sizeof(value1));
-		fwrite(buffer, size, 1, fp);
-		free(buffer);
-	}
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	offset += sizeof(header);
+	value0 = htonl(value0);
+	memcpy(buffer + offset, (char *)&value0, sizeof(value0));
+	offset += sizeof(value0);
+	value1 = htonl(value1);
+	memcpy(buffer + offset, (char *)&value1, sizeof(value1));
+	offset += sizeof(value1);
+	_debug_put(fp, buffer, offset);
 }
 
 static void _debug_send_id_8_16(FILE * fp, DBG_HEADER header, uint8_t id,
 				uint8_t value0, uint16_t value1)
 {
-	char *buffer;
-	size_t size;
-	int offset;
+	uint8_t buffer[DBG_RECORD_MAX];
+	uint32_t offset;
 
 	offset = 0;
 	header = adjust_header(header);
-	size =
-	    sizeof(DBG_HEADER) + sizeof(id) + sizeof(value0) + sizeof(value1);
-	if ((buffer = (char *)malloc(size)) != NULL) {
-		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
-		offset += sizeof(header);
-		buffer[offset] = id;
-		offset += sizeof(id);
-		buffer[offset] = value0;
-		offset += sizeof(value0);
-		value1 = htons(value1);
-		memcpy(buffer + offset, (char *)&value1, sizeof(value1));
-		fwrite(buffer, size, 1, fp);
-		free(buffer);
-	}
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	offset += sizeof(header);
+	buffer[offset] = id;
+	offset += sizeof(id);
+	buffer[offset] = value0;
+	offset += sizeof(value0);
+	value1 = htons(value1);
+	memcpy(buffer + offset, (char *)&value1, sizeof(value1));
+	offset += sizeof(value1);
+	_debug_put(fp, buffer, offset);
 }
 
 static void _debug_send_id_8_16_16(FILE * fp, DBG_HEADER header, uint8_t id,
 				   uint8_t value0, uint16_t value1,
 				   uint16_t value2)
 {
-	char *buffer;
-	size_t size;
-	int offset;
+	uint8_t buffer[DBG_RECORD_MAX];
+	uint32_t offset;
 
 	offset = 0;
 	header = adjust_header(header);
-	size =
-	    sizeof(DBG_HEADER) + sizeof(id) + sizeof(value0) + sizeof(value1) +
-	    sizeof(value2);
-	if ((buffer = (char *)malloc(size)) != NULL) {
-		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
-		offset += sizeof(header);
-		buffer[offset] = id;
-		offset += sizeof(id);
-		buffer[offset] = value0;
-		offset += sizeof(value0);
-		value1 = htons(value1);
-		memcpy(buffer + offset, (char *)&value1, sizeof(value1));
-		offset += sizeof(value1);
-		value2 = htons(value2);
-		memcpy(buffer + offset, (char *)&value2, sizeof(value2));
-		fwrite(buffer, size, 1, fp);
-		free(buffer);
-	}
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	offset += sizeof(header);
+	buffer[offset] = id;
+	offset += sizeof(id);
+	buffer[offset] = value0;
+	offset += sizeof(value0);
+	value1 = htons(value1);
+	memcpy(buffer + offset, (char *)&value1, sizeof(value1));
+	offset += sizeof(value1);
+	value2 = htons(value2);
+	memcpy(buffer + offset, (char *)&value2, sizeof(value2));
+	offset += sizeof(value2);
+	_debug_put(fp, buffer, offset);
 }
 
 static void _debug_send_id_8_8_16_32(FILE * fp, DBG_HEADER header, uint8_t id,
 				     uint8_t value0, uint8_t value1,
 				     uint16_t value2, uint32_t value3)
 {
-	char *buffer;
-	size_t size;
-	int offset;
+	uint8_t buffer[DBG_RECORD_MAX];
+	uint32_t offset;
 
 	offset = 0;
 	header = adjust_header(header);
-	size =
-	    sizeof(DBG_HEADER) + sizeof(id) + sizeof(value0) + sizeof(value1) +
-	    sizeof(value2) + sizeof(value3);
-	if ((buffer = (char *)malloc(size)) != NULL) {
-		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
-		offset += sizeof(header);
-		buffer[offset] = id;
-		offset += sizeof(id);
-		buffer[offset] = value0;
-		offset += sizeof(value0);
-		buffer[offset] = value1;
-		offset += sizeof(value1);
-		value2 = htons(value2);
-		memcpy(buffer + offset, (char *)&value2, sizeof(value2));
-		offset += sizeof(value2);
-		value3 = htonl(value3);
-		memcpy(buffer + offset, (char *)&value3, sizeof(value3));
-		fwrite(buffer, size, 1, fp);
-		free(buffer);
-	}
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	offset += sizeof(header);
+	buffer[offset] = id;
+	offset += sizeof(id);
+	buffer[offset] = value0;
+	offset += sizeof(value0);
+	buffer[offset] = value1;
+	offset += sizeof(value1);
+	value2 = htons(value2);
+	memcpy(buffer + offset, (char *)&value2, sizeof(value2));
+	offset += sizeof(value2);
+	value3 = htonl(value3);
+	memcpy(buffer + offset, (char *)&value3, sizeof(value3));
+	offset += sizeof(value3);
+	_debug_put(fp, buffer, offset);
 }
 
 size_t debug_get_64(FILE * fp, uint64_t * value)
@@ -274,23 +1053,19 @@ DBG_HEADER debug_get_header(FILE * fp)
 
 void debug_send_version(FILE * fp, uint8_t major, uint8_t minor)
 {
-	char *buffer;
-	size_t size;
-	int offset;
+	uint8_t buffer[DBG_RECORD_MAX];
+	uint32_t offset;
 	DBG_HEADER header;
 
 	offset = 0;
 	header = adjust_header(DBG_HEADER_VERSION);
-	size = sizeof(DBG_HEADER) + sizeof(major) + sizeof(minor);
-	if ((buffer = (char *)malloc(size)) != NULL) {
-		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
-		offset += sizeof(header);
-		buffer[offset] = major;
-		offset += sizeof(major);
-		buffer[offset] = minor;
-		fwrite(buffer, size, 1, fp);
-		free(buffer);
-	}
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	offset += sizeof(header);
+	buffer[offset] = major;
+	offset += sizeof(major);
+	buffer[offset] = minor;
+	offset += sizeof(minor);
+	_debug_put(fp, buffer, offset);
 }
 
 void debug_afu_connect(FILE * fp, uint8_t id)
@@ -45,6 +45,9 @@ typedef uint8_t DBG_HEADER;
 #define DBG_HEADER_CMD_BUFFER_WRITE 	0x14
 #define DBG_HEADER_CMD_BUFFER_READ 	0x15
 #define DBG_HEADER_CMD_RESPONSE    	0x16
+#define DBG_HEADER_INDEX		0x17
+#define DBG_HEADER_INDEX_END		0x18
+#define DBG_HEADER_CYCLE		0x19
 
 #define DBG_AUX2_DONE			0x80
 #define DBG_AUX2_RUNNING		0x40
@@ -60,6 +63,84 @@ typedef uint8_t DBG_HEADER;
 #define DBG_PARM_PAGED_PERCENT		0x4
 #define DBG_PARM_REORDER_PERCENT	0x5
 #define DBG_PARM_BUFFER_PERCENT		0x6
+#define DBG_PARM_ERAT_SETS		0x7
+#define DBG_PARM_ERAT_WAYS		0x8
+#define DBG_PARM_ERAT_PAGE_SIZE		0x9
+#define DBG_PARM_ERAT_POLICY		0xa
+#define DBG_PARM_TIMING			0xb
+#define DBG_PARM_TIMING_HIT_PERCENT	0xc
+#define DBG_PARM_TIMING_HIT_LATENCY	0xd	// max << 16 | min
+#define DBG_PARM_TIMING_MISS_LATENCY	0xe
+#define DBG_PARM_TIMING_XLATE_LATENCY	0xf
+#define DBG_PARM_TIMING_LINK_BYTES	0x10
+#define DBG_PARM_TIMING_MAX_READS	0x11
+
+// The background writer follows each chunk of about DBG_INDEX_CHUNK bytes of
+// records with an index block summarizing it.  Each block points back to the
+// one before, and an INDEX_END record at the end of the file points to the
+// last, so a reader can find every chunk without decoding the records.
+#define DBG_INDEX_CHUNK			(256 * 1024)
+#define DBG_INDEX_NONE			((uint64_t) -1)
+#define DBG_INDEX_SIZE			98
+#define DBG_INDEX_END_SIZE		9
+
+struct debug_index {
+	uint64_t prev;		// Previous block offset or DBG_INDEX_NONE
+	uint64_t start;		// Offset of first record in chunk
+	uint64_t time;		// ns since log start at block write
+	uint32_t records;
+	uint16_t context_min;	// Contexts in chunk, none if min > max
+	uint16_t context_max;
+	uint8_t aux2;		// Last JOB_AUX2 value before chunk
+	uint8_t afu[32];	// Bitmap of AFU ids in chunk
+	uint8_t tag[32];	// Bitmap of command tags in chunk
+};
+
+// Fields of one record, -1 for those it doesn't carry
+struct debug_fields {
+	int afu;
+	int context;
+	int tag;
+	int command;
+	int aux2;
+};
+
+// Categories for debug_log_set_mask(), version records are always logged
+#define DBG_CAT_NONE			0x00
+#define DBG_CAT_PARM			0x01
+#define DBG_CAT_SOCKET			0x02
+#define DBG_CAT_AFU			0x04
+#define DBG_CAT_CONTEXT			0x08
+#define DBG_CAT_JOB			0x10
+#define DBG_CAT_MMIO			0x20
+#define DBG_CAT_CMD			0x40
+#define DBG_CAT_ALL			0x7F
+
+// Stage records written to fp in per-thread buffers drained by a background
+// thread, optionally through mmap (fp opened "w+").  Stop once all writing
+// threads are done.
+int debug_log_start(FILE * fp, uint32_t mask, int use_mmap);
+void debug_log_flush(void);
+void debug_log_stop(void);
+
+// Runtime switches, safe to call from a signal handler
+void debug_log_enable(int enable);
+int debug_log_enabled(void);
+void debug_log_set_mask(uint32_t mask);
+
+// Tag records for AFU id with its PSL cycle count, whichever thread logs them.
+// A CYCLE record goes ahead of the first record for the AFU logged after its
+// count changes.
+void debug_set_cycle(uint8_t id, uint64_t cycles);
+
+// Bytes in a record with this header, 0 if unknown
+uint32_t debug_record_size(DBG_HEADER header);
+void debug_record_fields(uint8_t * record, struct debug_fields *fields);
+
+void debug_index_reset(struct debug_index *index, uint64_t start, uint8_t aux2);
+void debug_index_add(struct debug_index *index, struct debug_fields *fields);
+void debug_index_encode(struct debug_index *index, uint8_t * buffer);
+int debug_index_decode(uint8_t * buffer, struct debug_index *index);
 
 size_t debug_get_64(FILE * fp, uint64_t * value);
 size_t debug_get_32(FILE * fp, uint32_t * value);
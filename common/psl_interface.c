@@ -19,29 +19,157 @@
 #include <arpa/inet.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
+#include <endian.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
+/* Shared memory ring transport.  When both sides of the connection are on the
+ * same host the frames normally sent over the socket are instead exchanged
+ * through a pair of single producer, single consumer rings in a POSIX shared
+ * memory segment.  The socket stays open and carries a 1 byte "doorbell" only
+ * when the consumer may be blocked in select() on it, so callers that wait on
+ * event->sockfd keep working unchanged. */
+
+#define PSL_SHM_MAGIC 0x50534c5348524e47ULL	/* "PSLSHRNG" */
+#define PSL_SHM_NAME_SIZE 64
+#define PSL_SHM_SLOTS 16
+#define PSL_SHM_SPIN 4096
+#define PSL_SHM_TO_AFU 0
+#define PSL_SHM_TO_PSL 1
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHM_RELAX() __builtin_ia32_pause()
+#else
+#define SHM_RELAX() __asm__ __volatile__("" ::: "memory")
+#endif
+
+struct psl_shm_slot {
+	uint32_t len;
+	unsigned char data[PSL_BUFFER_SIZE];
+};
+
+struct psl_shm_ring {
+	uint32_t head;		// Written by producer only
+	unsigned char pad0[60];
+	uint32_t tail;		// Written by consumer only
+	uint32_t sleeping;	// Consumer may be blocked on the socket
+	unsigned char pad1[56];
+	struct psl_shm_slot slot[PSL_SHM_SLOTS];
+};
+
+struct psl_shm {
+	uint64_t magic;
+	uint64_t cookie;
+	struct psl_shm_ring ring[2];
+};
+
+/* Frame codec.  The first byte of every frame holds flags and each flagged
+ * section follows it in order from the most significant flag down.  Sections
+ * have fixed sizes, indexed below by flag bit number.  Multi-byte fields are
+ * big endian. */
+
+#define PSL_FRAME_GRANT 0x80	/* PSL to AFU: clock grant */
+#define PSL_FRAME_CLOCK 0x40
+#define PSL_FRAME_AUX1 0x20
+#define PSL_FRAME_JOB 0x10
+#define PSL_FRAME_MMIO 0x08
+#define PSL_FRAME_RESPONSE 0x04
+#define PSL_FRAME_BUFFER_READ 0x02
+#define PSL_FRAME_BUFFER_WRITE 0x01
+
+#define AFU_FRAME_TRANSACT 0x80	/* AFU to PSL: AFU takes transactions */
+#define AFU_FRAME_COMMAND_DATA 0x40	/* Write data for the command */
+#define AFU_FRAME_BATCH 0x20	/* AFU to PSL: clock batch and cycles run */
+#define AFU_FRAME_CLOCK 0x10
+#define AFU_FRAME_AUX2 0x08
+#define AFU_FRAME_MMIO_ACK 0x04
+#define AFU_FRAME_BUFFER_RDATA 0x02
+#define AFU_FRAME_COMMAND 0x01
+
+static const uint8_t _psl_frame_bytes[8] = { 133, 3, 6, 12, 10, 1, 0, 2 };
+static const uint8_t _afu_frame_bytes[8] = { 15, 130, 9, 10, 0, 4, 130, 0 };
+
+/* A PSL frame without PSL_FRAME_CLOCK carries no cycle and needs no answer.
+ * Empty, it tells the AFU clocks have stopped until PSL has work.  With
+ * PSL_FRAME_SKIP it gives the cycles PSL skipped before clocking again. */
+
+#define PSL_FRAME_SKIP 0x80	/* Without PSL_FRAME_CLOCK: cycles skipped */
+
+static const uint8_t _psl_control_bytes[8] = { 0, 0, 0, 0, 0, 0, 0, 4 };
+
+// Total frame length for the sections flagged in the first byte
+static uint32_t _frame_len(const uint8_t * bytes, uint8_t flags)
+{
+	uint32_t len = 1;
+
+	while (flags) {
+		len += bytes[__builtin_ctz(flags)];
+		flags &= flags - 1;
+	}
+	return len;
+}
+
+static inline void _put16(unsigned char *buf, uint16_t value)
+{
+	value = htobe16(value);
+	memcpy(buf, &value, sizeof(value));
+}
+
+static inline uint16_t _get16(const unsigned char *buf)
+{
+	uint16_t value;
+
+	memcpy(&value, buf, sizeof(value));
+	return be16toh(value);
+}
+
+static inline void _put32(unsigned char *buf, uint32_t value)
+{
+	value = htobe32(value);
+	memcpy(buf, &value, sizeof(value));
+}
+
+static inline uint32_t _get32(const unsigned char *buf)
+{
+	uint32_t value;
+
+	memcpy(&value, buf, sizeof(value));
+	return be32toh(value);
+}
+
+static inline void _put64(unsigned char *buf, uint64_t value)
+{
+	value = htobe64(value);
+	memcpy(buf, &value, sizeof(value));
+}
+
+static inline uint64_t _get64(const unsigned char *buf)
+{
+	uint64_t value;
+
+	memcpy(&value, buf, sizeof(value));
+	return be64toh(value);
+}
+
 /* For PSL out-bound haX parity buses, generate Odd parity bit for a specified
  * data size set */
 
 static uint32_t genoddParitybitperbytes(uint64_t data)
 {
 	//For odd parity: If sum of data bits is even, parity is 1
-	uint32_t oddparity;
-	oddparity = 1;		//since odd, start off setting
-
-	// Count off least significant asserted bit
-	while (data) {
-		oddparity = 1 - oddparity;	// 0->1 or 1->0
-		data &= data - 1;	// Remove lsb that is set to 1
-	}
-
-	return oddparity;
+	return 1 ^ __builtin_parityll(data);
 }
 
 static void set_protocol_level(struct AFU_EVENT *event, uint32_t primary,
@@ -62,6 +190,304 @@ static void set_protocol_level(struct AFU_EVENT *event, uint32_t primary,
 	event->proto_tertiary = tertiary;
 }
 
+static int _send_all(struct AFU_EVENT *event, unsigned char *buf, int bl)
+{
+	fd_set watchset;
+	int bc, bp;
+
+	bp = 0;
+	while (bp < bl) {
+		bc = send(event->sockfd, buf + bp, bl - bp, 0);
+		if ((bc < 0) && (errno == EWOULDBLOCK)) {
+			FD_ZERO(&watchset);
+			FD_SET(event->sockfd, &watchset);
+			select(event->sockfd + 1, NULL, &watchset, NULL, NULL);
+			continue;
+		}
+		if (bc < 0)
+			return PSL_TRANSMISSION_ERROR;
+		bp += bc;
+	}
+	return PSL_SUCCESS;
+}
+
+static int _recv_all(struct AFU_EVENT *event, unsigned char *buf, int bl)
+{
+	fd_set watchset;
+	int bc, bp;
+
+	bp = 0;
+	while (bp < bl) {
+		FD_ZERO(&watchset);
+		FD_SET(event->sockfd, &watchset);
+		select(event->sockfd + 1, &watchset, NULL, NULL, NULL);
+		bc = recv(event->sockfd, buf + bp, bl - bp, 0);
+		if ((bc < 0) && (errno == EWOULDBLOCK))
+			continue;
+		if (bc <= 0)
+			return PSL_BAD_SOCKET;
+		bp += bc;
+	}
+	return PSL_SUCCESS;
+}
+
+// Shared memory transport can be disabled with PSL_SHM=0 in the environment
+static int _shm_enabled(void)
+{
+	char *env = getenv("PSL_SHM");
+
+	return ((env == NULL) || strcmp(env, "0"));
+}
+
+static int _shm_empty(struct psl_shm_ring *ring)
+{
+	return (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) ==
+		__atomic_load_n(&ring->tail, __ATOMIC_RELAXED));
+}
+
+// PSL side: create segment and fill in name and cookie to offer to AFU side
+static int _shm_create(struct AFU_EVENT *event, char *name, uint64_t * cookie)
+{
+	struct timespec ts;
+	struct psl_shm *shm;
+	int fd;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	*cookie = ((uint64_t) getpid() << 32) ^ (uint64_t) ts.tv_nsec ^
+	    (uint64_t) ts.tv_sec ^ (uint64_t) (uintptr_t) event;
+	snprintf(name, PSL_SHM_NAME_SIZE, "/psl_shm.%d.%016llx", getpid(),
+		 (unsigned long long)*cookie);
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0)
+		return -1;
+	if (ftruncate(fd, sizeof(struct psl_shm)) < 0) {
+		close(fd);
+		shm_unlink(name);
+		return -1;
+	}
+	shm = (struct psl_shm *)mmap(NULL, sizeof(struct psl_shm),
+				     PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED) {
+		shm_unlink(name);
+		return -1;
+	}
+	memset(shm, 0, sizeof(struct psl_shm));
+	shm->cookie = *cookie;
+	// AFU side callers select() on the socket before every poll
+	shm->ring[PSL_SHM_TO_AFU].sleeping = 1;
+	__atomic_store_n(&shm->magic, PSL_SHM_MAGIC, __ATOMIC_RELEASE);
+	event->shm = shm;
+	event->shm_tx = PSL_SHM_TO_AFU;
+	event->shm_rx = PSL_SHM_TO_PSL;
+	return 0;
+}
+
+// AFU side: map segment offered by PSL side, fails if not on the same host
+static int _shm_attach(struct AFU_EVENT *event, char *name, uint64_t cookie)
+{
+	struct psl_shm *shm;
+	struct stat sb;
+	int fd;
+
+	fd = shm_open(name, O_RDWR, 0600);
+	if (fd < 0)
+		return -1;
+	if ((fstat(fd, &sb) < 0) || (sb.st_size != sizeof(struct psl_shm))) {
+		close(fd);
+		return -1;
+	}
+	shm = (struct psl_shm *)mmap(NULL, sizeof(struct psl_shm),
+				     PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED)
+		return -1;
+	if ((__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != PSL_SHM_MAGIC) ||
+	    (shm->cookie != cookie)) {
+		munmap(shm, sizeof(struct psl_shm));
+		return -1;
+	}
+	event->shm = shm;
+	event->shm_tx = PSL_SHM_TO_PSL;
+	event->shm_rx = PSL_SHM_TO_AFU;
+	return 0;
+}
+
+static void _shm_detach(struct AFU_EVENT *event)
+{
+	if (event->shm == NULL)
+		return;
+	munmap(event->shm, sizeof(struct psl_shm));
+	event->shm = NULL;
+}
+
+// Offer (PSL side) or accept (AFU side) the shared memory transport.  A failure
+// to set up the segment on either side is not an error, the socket is used.
+static int _shm_negotiate(struct AFU_EVENT *event, int offer)
+{
+	unsigned char buf[PSL_SHM_NAME_SIZE + 8];
+	char name[PSL_SHM_NAME_SIZE];
+	uint64_t cookie;
+	uint8_t ack;
+	int i, rc;
+
+	memset(buf, 0, sizeof(buf));
+	if (offer) {
+		memset(name, 0, sizeof(name));
+		cookie = 0;
+		if (_shm_enabled() && (_shm_create(event, name, &cookie) < 0))
+			name[0] = '\0';
+		memcpy(buf, name, sizeof(name));
+		for (i = 0; i < 8; i++)
+			buf[PSL_SHM_NAME_SIZE + i] = (cookie >> ((7 - i) * 8)) & 0xFF;
+		rc = _send_all(event, buf, sizeof(buf));
+		if (rc == PSL_SUCCESS)
+			rc = _recv_all(event, &ack, 1);
+		if (name[0] != '\0')
+			shm_unlink(name);
+		if ((rc != PSL_SUCCESS) || !ack)
+			_shm_detach(event);
+		return rc;
+	}
+
+	if ((rc = _recv_all(event, buf, sizeof(buf))) != PSL_SUCCESS)
+		return rc;
+	memcpy(name, buf, sizeof(name));
+	name[PSL_SHM_NAME_SIZE - 1] = '\0';
+	cookie = 0;
+	for (i = 0; i < 8; i++)
+		cookie = (cookie << 8) | buf[PSL_SHM_NAME_SIZE + i];
+	ack = 0;
+	if ((name[0] != '\0') && _shm_enabled() &&
+	    (_shm_attach(event, name, cookie) == 0))
+		ack = 1;
+	return _send_all(event, &ack, 1);
+}
+
+// Push frame into transmit ring and ring doorbell if consumer is blocked
+static int _shm_send(struct AFU_EVENT *event, int bl)
+{
+	struct psl_shm_ring *ring = &(event->shm->ring[event->shm_tx]);
+	struct psl_shm_slot *slot;
+	uint32_t head;
+	uint8_t byte;
+
+	head = ring->head;
+	while (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >=
+	       PSL_SHM_SLOTS) {
+		if (recv(event->sockfd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0)
+			return PSL_TRANSMISSION_ERROR;
+		sched_yield();
+	}
+	slot = &(ring->slot[head % PSL_SHM_SLOTS]);
+	memcpy(slot->data, event->tbuf, bl);
+	slot->len = bl;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&ring->sleeping, __ATOMIC_RELAXED))
+		return PSL_SUCCESS;
+	byte = 0;
+	return _send_all(event, &byte, 1);
+}
+
+// Drain all pending doorbell bytes, returns 0 if socket closed
+static int _shm_drain(struct AFU_EVENT *event)
+{
+	unsigned char buf[64];
+	int bc;
+
+	while ((bc = recv(event->sockfd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) ;
+	return bc;
+}
+
+// Wait for frame in receive ring, spinning briefly before blocking on socket
+static int _shm_wait(struct AFU_EVENT *event)
+{
+	struct psl_shm_ring *ring = &(event->shm->ring[event->shm_rx]);
+	fd_set watchset;
+	int i;
+
+	for (i = 0; i < PSL_SHM_SPIN; i++) {
+		if (!_shm_empty(ring))
+			return 1;
+		SHM_RELAX();
+	}
+	while (1) {
+		__atomic_store_n(&ring->sleeping, 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (!_shm_empty(ring))
+			break;
+		FD_ZERO(&watchset);
+		FD_SET(event->sockfd, &watchset);
+		select(event->sockfd + 1, &watchset, NULL, NULL, NULL);
+		if (_shm_drain(event) == 0) {
+			__atomic_store_n(&ring->sleeping, 0, __ATOMIC_RELAXED);
+			return -1;
+		}
+		if (!_shm_empty(ring))
+			break;
+	}
+	__atomic_store_n(&ring->sleeping, 0, __ATOMIC_RELAXED);
+	return 1;
+}
+
+// Copy bytes of current frame in receive ring using recv() semantics
+static int _shm_recv(struct AFU_EVENT *event, unsigned char *buf, uint32_t len)
+{
+	struct psl_shm_ring *ring = &(event->shm->ring[event->shm_rx]);
+	struct psl_shm_slot *slot;
+	uint8_t byte;
+	int bc;
+
+	if (_shm_empty(ring)) {
+		// Consume owed doorbells or detect closed socket, then retry
+		while (event->shm_owed) {
+			bc = recv(event->sockfd, &byte, 1, MSG_DONTWAIT);
+			if (bc == 0)
+				return 0;
+			if (bc < 0)
+				break;
+			event->shm_owed--;
+		}
+		if (!event->shm_owed &&
+		    (recv(event->sockfd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0))
+			return 0;
+		if (_shm_empty(ring)) {
+			errno = EWOULDBLOCK;
+			return -1;
+		}
+	}
+	slot = &(ring->slot[ring->tail % PSL_SHM_SLOTS]);
+	if (len > slot->len - event->shm_roff)
+		len = slot->len - event->shm_roff;
+	memcpy(buf, slot->data + event->shm_roff, len);
+	event->shm_roff += len;
+	if (event->shm_roff < slot->len)
+		return len;
+
+	// Frame complete, release slot and take its doorbell if one was sent
+	event->shm_roff = 0;
+	__atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+	if (__atomic_load_n(&ring->sleeping, __ATOMIC_RELAXED) &&
+	    (recv(event->sockfd, &byte, 1, MSG_DONTWAIT) != 1))
+		event->shm_owed++;
+	return len;
+}
+
+static int _event_send(struct AFU_EVENT *event, int bl)
+{
+	if (event->shm != NULL)
+		return _shm_send(event, bl);
+	return _send_all(event, event->tbuf, bl);
+}
+
+static int _event_recv(struct AFU_EVENT *event, unsigned char *buf, uint32_t len)
+{
+	if (event->shm != NULL)
+		return _shm_recv(event, buf, len);
+	return recv(event->sockfd, buf, len, 0);
+}
+
 static int establish_protocol(struct AFU_EVENT *event)
 {
 	int bc, bl, bp, i;
@@ -170,6 +596,60 @@ static int establish_protocol(struct AFU_EVENT *event)
 	return PSL_SUCCESS;
 }
 
+// Check if the agreed protocol level includes an optional feature
+static int _proto_supports(struct AFU_EVENT *event, uint32_t tertiary)
+{
+	return ((event->proto_primary == PROTOCOL_PRIMARY) &&
+		(event->proto_secondary == PROTOCOL_SECONDARY) &&
+		(event->proto_tertiary >= tertiary));
+}
+
+// Set up optional features once both sides agree on protocol level
+static int establish_transport(struct AFU_EVENT *event, int offer_shm)
+{
+	int rc;
+
+	if (!_proto_supports(event, PROTOCOL_TERTIARY_SHM))
+		return PSL_SUCCESS;
+	rc = _shm_negotiate(event, offer_shm);
+	if ((rc == PSL_SUCCESS) && (event->shm != NULL))
+		printf("PSL_SOCKET: Using shared memory transport\n");
+	return rc;
+}
+
+/* Frames, doorbells and PSLSE messages are small and never wait for a reply
+ * to be sent with them, so turn off Nagle on TCP links and give both
+ * directions enough buffer for a burst of full frames */
+
+void psl_tune_socket(int fd)
+{
+	struct sockaddr_storage addr;
+	socklen_t len = sizeof(addr);
+	int flag = 1;
+	int size = PSL_SOCKET_BUFFER;
+
+	if (getsockname(fd, (struct sockaddr *)&addr, &len) < 0)
+		return;
+	if ((addr.ss_family != AF_INET) && (addr.ss_family != AF_INET6))
+		return;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+	setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+}
+
+// Fill in a unix domain socket address, fails if path is too long
+static int _unix_addr(struct sockaddr_un *addr, const char *path)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		fprintf(stderr, "PSL_SOCKET: Socket path too long: %s\n", path);
+		return -1;
+	}
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
 /* Call this at startup to reset all the event indicators */
 
 void psl_event_reset(struct AFU_EVENT *event)
@@ -184,7 +664,8 @@ void psl_event_reset(struct AFU_EVENT *event)
  * open a socket conection to an AFU server.  This function initializes the
  * PSL side of the interface which is the client in the socket connection
  * server_host should be the name of the server hosting the simulation of
- * the AFU and port is the active port on that server. */
+ * the AFU and port is the active port on that server.  A server_host of
+ * "unix:<path>" connects to the unix domain socket at path instead. */
 
 int psl_init_afu_event(struct AFU_EVENT *event, char *server_host, int port)
 {
@@ -192,31 +673,46 @@ int psl_init_afu_event(struct AFU_EVENT *event, char *server_host, int port)
 	event->room = 64;
 	event->rbp = 0;
 	struct hostent *he;
-	if ((he = gethostbyname(server_host)) == NULL) {
-		herror("gethostbyname");
-		return PSL_BAD_SOCKET;
-	}
 	struct sockaddr_in ssadr;
-	memset(&ssadr, 0, sizeof(ssadr));
-	memcpy(&ssadr.sin_addr, he->h_addr_list[0], he->h_length);
-	ssadr.sin_family = AF_INET;
-	ssadr.sin_port = htons(port);
-	event->sockfd = socket(PF_INET, SOCK_STREAM, 0);
-	if (event->sockfd == 0) {
+	struct sockaddr_un sunadr;
+	struct sockaddr *adr;
+	socklen_t adrlen;
+	if (strncmp(server_host, PSL_UNIX_PREFIX, strlen(PSL_UNIX_PREFIX)) ==
+	    0) {
+		if (_unix_addr(&sunadr, server_host + strlen(PSL_UNIX_PREFIX)))
+			return PSL_BAD_SOCKET;
+		adr = (struct sockaddr *)&sunadr;
+		adrlen = sizeof(sunadr);
+	} else {
+		if ((he = gethostbyname(server_host)) == NULL) {
+			herror("gethostbyname");
+			return PSL_BAD_SOCKET;
+		}
+		memset(&ssadr, 0, sizeof(ssadr));
+		memcpy(&ssadr.sin_addr, he->h_addr_list[0], he->h_length);
+		ssadr.sin_family = AF_INET;
+		ssadr.sin_port = htons(port);
+		adr = (struct sockaddr *)&ssadr;
+		adrlen = sizeof(ssadr);
+	}
+	event->sockfd = socket(adr->sa_family, SOCK_STREAM, 0);
+	if (event->sockfd < 0) {
 		perror("socket");
 		return PSL_BAD_SOCKET;
 	}
-	if (connect(event->sockfd, (struct sockaddr *)&ssadr, sizeof(ssadr)) <
-	    0) {
+	if (connect(event->sockfd, adr, adrlen) < 0) {
 		perror("connect");
 		return PSL_BAD_SOCKET;
 	}
+	psl_tune_socket(event->sockfd);
 	fcntl(event->sockfd, F_SETFL, O_NONBLOCK);
 
 	int rc = establish_protocol(event);
 	printf("PSL_SOCKET: Using PSL protocol level : %d.%d.%d\n",
 	       event->proto_primary, event->proto_secondary,
 	       event->proto_tertiary);
+	if (rc == PSL_SUCCESS)
+		rc = establish_transport(event, 1);
 
 	return rc;
 }
@@ -239,22 +735,64 @@ int psl_close_afu_event(struct AFU_EVENT *event)
 	if (close(event->sockfd))
 		return PSL_CLOSE_ERROR;
 	event->sockfd = -1;
+	_shm_detach(event);
 
 	return PSL_SUCCESS;
 }
 
+/* AFU side: wait for PSL to connect to the listening socket in sockfd, then
+ * replace it with the connection and agree on protocol */
+
+static int _serv_accept(struct AFU_EVENT *event)
+{
+	struct sockaddr_storage csadr;
+	socklen_t csalen = sizeof(csadr);
+	char clientname[1024];
+	int cs = -1;
+
+	if (listen(event->sockfd, 10) == -1) {
+		perror("listen");
+		psl_close_afu_event(event);
+		return PSL_BAD_SOCKET;
+	}
+	while (cs < 0) {
+		cs = accept(event->sockfd, (struct sockaddr *)&csadr, &csalen);
+		if ((cs < 0) && (errno != EINTR)) {
+			perror("accept");
+			psl_close_afu_event(event);
+			return PSL_BAD_SOCKET;
+		}
+	}
+	close(event->sockfd);
+	event->sockfd = cs;
+	psl_tune_socket(event->sockfd);
+	fcntl(event->sockfd, F_SETFL, O_NONBLOCK);
+	clientname[1023] = '\0';
+	if ((csadr.ss_family == AF_UNIX) ||
+	    getnameinfo((struct sockaddr *)&csadr, csalen, clientname, 1024,
+			NULL, 0, 0))
+		strcpy(clientname, "local");
+	printf("PSL client connection from %s\n", clientname);
+
+	int rc = establish_protocol(event);
+	printf("Using PSL protocol level : %d.%d.%d\n", event->proto_primary,
+	       event->proto_secondary, event->proto_tertiary);
+	if (rc == PSL_SUCCESS)
+		rc = establish_transport(event, 0);
+
+	return rc;
+}
+
 /* Call this once after creation to initialize the AFU_EVENT structure. */
 /* This function initializes the AFU side of the interface which is the
  * server in the socket connection. */
 
 int psl_serv_afu_event(struct AFU_EVENT *event, int port)
 {
-	int cs = -1;
 	psl_event_reset(event);
 	event->room = 64;
 	event->rbp = 0;
-	struct sockaddr_in ssadr, csadr;
-	unsigned int csalen = sizeof(csadr);
+	struct sockaddr_in ssadr;
 	memset(&ssadr, 0, sizeof(ssadr));
 	ssadr.sin_family = AF_UNSPEC;
 	ssadr.sin_addr.s_addr = INADDR_ANY;
@@ -275,32 +813,41 @@ int psl_serv_afu_event(struct AFU_EVENT *event, int port)
 	printf("AFU Server is waiting for connection on %s:%d\n", hostname,
 	       port);
 	fflush(stdout);
-	if (listen(event->sockfd, 10) == -1) {
-		perror("listen");
-		psl_close_afu_event(event);
+	return _serv_accept(event);
+}
+
+/* Same as psl_serv_afu_event() but listens on the unix domain socket at path,
+ * which PSL reaches with "unix:<path>" in place of host:port.  Any stale
+ * socket file at path is removed first. */
+
+int psl_serv_afu_event_unix(struct AFU_EVENT *event, char *path)
+{
+	struct sockaddr_un sunadr;
+	int rc;
+
+	psl_event_reset(event);
+	event->room = 64;
+	event->rbp = 0;
+	if (_unix_addr(&sunadr, path))
+		return PSL_BAD_SOCKET;
+	event->sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (event->sockfd < 0) {
+		perror("socket");
 		return PSL_BAD_SOCKET;
 	}
-	while (cs < 0) {
-		cs = accept(event->sockfd, (struct sockaddr *)&csadr, &csalen);
-		if ((cs < 0) && (errno != EINTR)) {
-			perror("accept");
-			psl_close_afu_event(event);
-			return PSL_BAD_SOCKET;
-		}
+	unlink(path);
+	if (bind(event->sockfd, (struct sockaddr *)&sunadr, sizeof(sunadr)) ==
+	    -1) {
+		perror("bind");
+		psl_close_afu_event(event);
+		return PSL_BAD_SOCKET;
 	}
-	close(event->sockfd);
-	event->sockfd = cs;
-	fcntl(event->sockfd, F_SETFL, O_NONBLOCK);
-	char clientname[1024];
-	clientname[1023] = '\0';
-	getnameinfo((struct sockaddr *)&csadr, sizeof(csadr), clientname, 1024,
-		    NULL, 0, 0);
-	printf("PSL client connection from %s\n", clientname);
-
-	int rc = establish_protocol(event);
-	printf("Using PSL protocol level : %d.%d.%d\n", event->proto_primary,
-	       event->proto_secondary, event->proto_tertiary);
-
+	printf("AFU Server is waiting for connection on %s%s\n",
+	       PSL_UNIX_PREFIX, path);
+	fflush(stdout);
+	rc = _serv_accept(event);
+	// Nothing else connects once PSL has
+	unlink(path);
 	return rc;
 }
 
@@ -317,6 +864,49 @@ int psl_aux1_change(struct AFU_EVENT *event, uint32_t room)
 	}
 }
 
+/* Call this to let the AFU run up to cycles clocks on the next
+ * psl_signal_afu_model() call.  The grant is capped by what the AFU accepts,
+ * clock_cycles holds the cycles it actually ran once it answers */
+
+int psl_clock_grant(struct AFU_EVENT *event, uint32_t cycles)
+{
+	event->clock_grant = cycles;
+	return PSL_SUCCESS;
+}
+
+/* Send a clock control frame, the AFU does not answer it */
+
+static int _psl_control_send(struct AFU_EVENT *event, uint8_t flags,
+			     uint32_t cycles)
+{
+	int bp = 1;
+
+	if (!_proto_supports(event, PROTOCOL_TERTIARY_SLEEP))
+		return PSL_NOT_SUPPORTED;
+	event->tbuf[0] = flags;
+	if (flags & PSL_FRAME_SKIP) {
+		_put32(event->tbuf + bp, cycles);
+		bp += 4;
+	}
+	return _event_send(event, bp);
+}
+
+/* Call this after the AFU answers the last clock before clocks stop, so the
+ * AFU knows it is waiting on host software rather than on PSL */
+
+int psl_clock_stop(struct AFU_EVENT *event)
+{
+	return _psl_control_send(event, 0, 0);
+}
+
+/* Call this before the first clock after psl_clock_stop() to let the AFU
+ * advance its time by the cycles that passed while clocks were stopped */
+
+int psl_clock_skip(struct AFU_EVENT *event, uint32_t cycles)
+{
+	return _psl_control_send(event, PSL_FRAME_SKIP, cycles);
+}
+
 /* Call this to create an accelerator control command */
 
 int
@@ -547,198 +1137,374 @@ psl_get_command(struct AFU_EVENT *event,
 	}
 }
 
+/* Call after psl_get_command() to get write data the AFU sent with the
+ * command.  Without it PSL has to get the data with a buffer read */
+
+int
+psl_get_command_data(struct AFU_EVENT *event,
+		     uint8_t * write_data, uint8_t * write_parity)
+{
+	if (!event->command_data_valid)
+		return PSL_BUFFER_READ_DATA_NOT_VALID;
+	event->command_data_valid = 0;
+	memcpy(write_data, event->command_wdata, sizeof(event->command_wdata));
+	memcpy(write_parity, event->command_wparity,
+	       sizeof(event->command_wparity));
+	return PSL_SUCCESS;
+}
+
 /* Call this to send an event to the AFU model after calling one or more of:
  * psl_aux1_change, psl_job_control, psl_mmio_read, psl_mmio_write,
  * psl_response, psl_buffer_read, psl_buffer_write */
 
-int psl_signal_afu_model(struct AFU_EVENT *event)
+/* Build the PSL to AFU frame in tbuf and clear the sent events, returns the
+ * frame length */
+
+static int _psl_frame_encode(struct AFU_EVENT *event)
 {
-	int i, bc, bl;
+	unsigned char *buf = event->tbuf;
+	uint32_t grant;
 	int bp = 1;
-	if (event->clock != 0)
-		return PSL_TRANSMISSION_ERROR;
-	event->clock = 1;
-	event->tbuf[0] = 0x40;
+
+	buf[0] = PSL_FRAME_CLOCK;
+	grant = event->clock_grant;
+	if (grant > event->clock_batch)
+		grant = event->clock_batch;
+	if ((grant > 1) && _proto_supports(event, PROTOCOL_TERTIARY_BATCH)) {
+		buf[0] |= PSL_FRAME_GRANT;
+		_put16(buf + bp, grant);
+		bp += 2;
+	}
+	event->clock_grant = 0;
 	if (event->aux1_change != 0) {
-		event->tbuf[0] = event->tbuf[0] | 0x20;
-		event->tbuf[bp++] = event->room;
+		buf[0] |= PSL_FRAME_AUX1;
+		buf[bp++] = event->room;
 		event->aux1_change = 0;
 	}
 	if (event->job_valid != 0) {
-		event->tbuf[0] = event->tbuf[0] | 0x10;
-		event->tbuf[bp++] = event->job_code;
-		for (i = 0; i < 8; i++) {
-			event->tbuf[bp++] =
-			    ((event->job_address) >> ((7 - i) * 8)) & 0xFF;
-		}
-		event->tbuf[bp++] = (((event->job_address_parity) << 1) & 0x2) |
+		buf[0] |= PSL_FRAME_JOB;
+		buf[bp++] = event->job_code;
+		_put64(buf + bp, event->job_address);
+		bp += 8;
+		buf[bp++] = (((event->job_address_parity) << 1) & 0x2) |
 		    ((event->job_code_parity) & 0x1);
 		event->job_valid = 0;
 	}
 	if (event->mmio_valid != 0) {
-		event->tbuf[0] = event->tbuf[0] | 0x08;
-		if (event->mmio_read != 0) {
-			event->tbuf[bp] = 0x01;
-		} else {
-			event->tbuf[bp] = 0x00;
-		}
-		if (event->mmio_double != 0) {
-			event->tbuf[bp] = event->tbuf[bp] | 0x02;
-		}
-		if (event->mmio_afudescaccess != 0) {
-			event->tbuf[bp] = event->tbuf[bp] | 0x04;
-		}
-		if (event->mmio_address_parity != 0) {
-			event->tbuf[bp] = event->tbuf[bp] | 0x08;
-		}
-		if (event->mmio_wdata_parity != 0) {
-			event->tbuf[bp] = event->tbuf[bp] | 0x10;
-		}
-		bp++;
-		for (i = 0; i < 3; i++) {
-			event->tbuf[bp++] =
-			    ((event->mmio_address) >> ((2 - i) * 8)) & 0xFF;
-		}
-		for (i = 0; i < 8; i++) {
-			event->tbuf[bp++] =
-			    ((event->mmio_wdata) >> ((7 - i) * 8)) & 0xFF;
-		}
+		buf[0] |= PSL_FRAME_MMIO;
+		buf[bp++] = (event->mmio_read != 0) |
+		    ((event->mmio_double != 0) << 1) |
+		    ((event->mmio_afudescaccess != 0) << 2) |
+		    ((event->mmio_address_parity != 0) << 3) |
+		    ((event->mmio_wdata_parity != 0) << 4);
+		buf[bp++] = (event->mmio_address >> 16) & 0xFF;
+		_put16(buf + bp, event->mmio_address & 0xFFFF);
+		bp += 2;
+		_put64(buf + bp, event->mmio_wdata);
+		bp += 8;
 		event->mmio_valid = 0;
 	}
 	if (event->response_valid != 0) {
-		event->tbuf[0] = event->tbuf[0] | 0x04;
-		event->tbuf[bp++] = event->response_tag;
-		event->tbuf[bp++] = event->response_tag_parity;
-		event->tbuf[bp++] = event->response_code;
-		event->tbuf[bp++] = ((event->cache_position) >> 5) & 0xFF;
-		event->tbuf[bp++] = ((event->cache_position) << 3) |
+		buf[0] |= PSL_FRAME_RESPONSE;
+		buf[bp++] = event->response_tag;
+		buf[bp++] = event->response_tag_parity;
+		buf[bp++] = event->response_code;
+		buf[bp++] = ((event->cache_position) >> 5) & 0xFF;
+		buf[bp++] = ((event->cache_position) << 3) |
 		    (((event->cache_state) << 1) & 0x6) |
 		    (((event->credits) >> 8) & 1);
-		event->tbuf[bp++] = event->credits & 0xFF;
+		buf[bp++] = event->credits & 0xFF;
 		event->response_valid = 0;
 	}
 	if (event->buffer_read != 0) {
-		event->tbuf[0] = event->tbuf[0] | 0x02;
-		event->tbuf[bp++] = event->buffer_read_tag;
-		event->tbuf[bp++] = event->buffer_read_tag_parity;
-		if (event->buffer_read_length > 64) {
-			event->tbuf[bp++] =
-			    0x80 | (event->buffer_read_address & 0x3F);
-		} else {
-			event->tbuf[bp++] =
-			    0x00 | (event->buffer_read_address & 0x3F);
-		}
+		buf[0] |= PSL_FRAME_BUFFER_READ;
+		buf[bp++] = event->buffer_read_tag;
+		buf[bp++] = event->buffer_read_tag_parity;
+		buf[bp++] = ((event->buffer_read_length > 64) ? 0x80 : 0x00) |
+		    (event->buffer_read_address & 0x3F);
 		event->buffer_read = 0;
 	}
 	if (event->buffer_write != 0) {
-		event->tbuf[0] = event->tbuf[0] | 0x01;
-		event->tbuf[bp++] = event->buffer_write_tag;
-		event->tbuf[bp++] = event->buffer_write_tag_parity;
-		if (event->buffer_write_length > 64) {
-			event->tbuf[bp++] =
-			    0x80 | (event->buffer_write_address & 0x3F);
-		} else {
-			event->tbuf[bp++] =
-			    0x00 | (event->buffer_write_address & 0x3F);
-		}
-		for (i = 0; i < 128; i++) {
-			event->tbuf[bp++] = event->buffer_wdata[i];
-		}
-		for (i = 0; i < 2; i++) {
-			event->tbuf[bp++] = event->buffer_wparity[i];
-		}
+		buf[0] |= PSL_FRAME_BUFFER_WRITE;
+		buf[bp++] = event->buffer_write_tag;
+		buf[bp++] = event->buffer_write_tag_parity;
+		buf[bp++] = ((event->buffer_write_length > 64) ? 0x80 : 0x00) |
+		    (event->buffer_write_address & 0x3F);
+		memcpy(buf + bp, event->buffer_wdata,
+		       sizeof(event->buffer_wdata));
+		bp += sizeof(event->buffer_wdata);
+		memcpy(buf + bp, event->buffer_wparity,
+		       sizeof(event->buffer_wparity));
+		bp += sizeof(event->buffer_wparity);
 		event->buffer_write = 0;
 	}
-	bl = bp;
-	bp = 0;
-	while (bp < bl) {
-		bc = send(event->sockfd, event->tbuf + bp, bl - bp, 0);
-		if (bc < 0)
-			return PSL_TRANSMISSION_ERROR;
-		bp += bc;
+	return bp;
+}
+
+/* Unpack a complete PSL to AFU frame from rbuf.  A clock grant is left in
+ * clock_grant for the caller to start */
+
+static void _psl_frame_decode(struct AFU_EVENT *event)
+{
+	unsigned char *buf = event->rbuf;
+	uint32_t rbc = 1;
+
+	if (buf[0] & PSL_FRAME_GRANT) {
+		event->clock_grant = _get16(buf + rbc);
+		rbc += 2;
+		if (event->clock_grant == 0)
+			event->clock_grant = 1;
+		event->clock_cycles = 0;
+	}
+	event->aux1_change = ((buf[0] & PSL_FRAME_AUX1) != 0);
+	if (event->aux1_change)
+		event->room = buf[rbc++];
+	event->job_valid = ((buf[0] & PSL_FRAME_JOB) != 0);
+	if (event->job_valid) {
+		event->job_code = buf[rbc++];
+		event->job_address = _get64(buf + rbc);
+		rbc += 8;
+		event->job_address_parity = (buf[rbc] >> 1) & 0x01;
+		event->job_code_parity = buf[rbc++] & 0x01;
+	}
+	event->mmio_valid = ((buf[0] & PSL_FRAME_MMIO) != 0);
+	if (event->mmio_valid) {
+		event->mmio_wdata_parity = (buf[rbc] >> 4) & 1;
+		event->mmio_address_parity = (buf[rbc] >> 3) & 1;
+		event->mmio_afudescaccess = (buf[rbc] >> 2) & 1;
+		event->mmio_double = (buf[rbc] >> 1) & 1;
+		event->mmio_read = buf[rbc++] & 1;
+		event->mmio_address = (buf[rbc] << 16) | _get16(buf + rbc + 1);
+		rbc += 3;
+		event->mmio_wdata = _get64(buf + rbc);
+		rbc += 8;
+	}
+	event->response_valid = ((buf[0] & PSL_FRAME_RESPONSE) != 0);
+	if (event->response_valid) {
+		event->response_tag = buf[rbc++];
+		event->response_tag_parity = buf[rbc++];
+		event->response_code = buf[rbc++];
+		event->cache_position = buf[rbc++] << 5;
+		event->cache_position |= (buf[rbc] >> 3) & 0x1F;
+		event->cache_state = (buf[rbc] >> 2) & 0x3;
+		event->credits = (buf[rbc++] << 8) & 0x100;
+		event->credits |= buf[rbc++];
+	}
+	event->buffer_read = ((buf[0] & PSL_FRAME_BUFFER_READ) != 0);
+	if (event->buffer_read) {
+		event->buffer_read_tag = buf[rbc++];
+		event->buffer_read_tag_parity = buf[rbc++];
+		event->buffer_read_length = (buf[rbc] & 0x80) ? 128 : 64;
+		event->buffer_read_address = buf[rbc++] & 0x3F;
+	}
+	event->buffer_write = ((buf[0] & PSL_FRAME_BUFFER_WRITE) != 0);
+	if (event->buffer_write) {
+		event->buffer_write_tag = buf[rbc++];
+		event->buffer_write_tag_parity = buf[rbc++];
+		event->buffer_write_length = (buf[rbc] & 0x80) ? 128 : 64;
+		event->buffer_write_address = buf[rbc++] & 0x3F;
+		memcpy(event->buffer_wdata, buf + rbc,
+		       sizeof(event->buffer_wdata));
+		rbc += sizeof(event->buffer_wdata);
+		memcpy(event->buffer_wparity, buf + rbc,
+		       sizeof(event->buffer_wparity));
 	}
-	return PSL_SUCCESS;
 }
 
-/* Call this to send an event to the PSL model */
-/* UPDATE: Now static as it's called in psl_get_psl_events() */
+/* Unpack a clock control frame from rbuf.  Skipped cycles add up until the
+ * AFU takes them with psl_afu_clock_skip() */
 
-static int psl_signal_psl_model(struct AFU_EVENT *event)
+static void _psl_control_decode(struct AFU_EVENT *event)
+{
+	if (event->rbuf[0] & PSL_FRAME_SKIP) {
+		event->clock_skip += _get32(event->rbuf + 1);
+		event->clock_sleep = 0;
+	} else {
+		event->clock_sleep = 1;
+	}
+}
+
+/* Build the AFU to PSL frame in tbuf and clear the sent events, returns the
+ * frame length */
+
+static int _afu_frame_encode(struct AFU_EVENT *event)
 {
-	int i, bc, bl;
+	unsigned char *buf = event->tbuf;
 	int bp = 1;
-	if (event->clock != 1)
-		return PSL_SUCCESS;
-	event->clock = 0;
-	event->tbuf[0] = 0x10;
-	if (event->aux2_change) {
-		event->tbuf[0] = event->tbuf[0] | 0x08;
-		event->tbuf[bp++] =
-		    (((event->buffer_read_latency) << 4) & 0xF0) |
-		    (((event->job_running)
-		      << 1) & 0x2) | (event->job_done & 1);
-		for (i = 0; i < 8; i++) {
-			event->tbuf[bp++] =
-			    ((event->job_error) >> ((7 - i) * 8)) & 0xFF;
+
+	buf[0] = AFU_FRAME_CLOCK;
+	if (event->transactions &&
+	    _proto_supports(event, PROTOCOL_TERTIARY_TRANSACTION)) {
+		buf[0] |= AFU_FRAME_TRANSACT;
+		if (event->command_valid && event->command_data_valid) {
+			buf[0] |= AFU_FRAME_COMMAND_DATA;
+			memcpy(buf + bp, event->command_wdata,
+			       sizeof(event->command_wdata));
+			bp += sizeof(event->command_wdata);
+			memcpy(buf + bp, event->command_wparity,
+			       sizeof(event->command_wparity));
+			bp += sizeof(event->command_wparity);
 		}
-		event->tbuf[bp++] = (((event->job_cack_llcmd) << 3) & 0x08) |
+	}
+	event->command_data_valid = 0;
+	if (event->clock_batch &&
+	    _proto_supports(event, PROTOCOL_TERTIARY_BATCH)) {
+		buf[0] |= AFU_FRAME_BATCH;
+		_put16(buf + bp, event->clock_batch);
+		_put16(buf + bp + 2, event->clock_cycles);
+		bp += 4;
+	}
+	event->clock_cycles = 0;
+	if (event->aux2_change) {
+		buf[0] |= AFU_FRAME_AUX2;
+		buf[bp++] = (((event->buffer_read_latency) << 4) & 0xF0) |
+		    (((event->job_running) << 1) & 0x2) |
+		    (event->job_done & 1);
+		_put64(buf + bp, event->job_error);
+		bp += 8;
+		buf[bp++] = (((event->job_cack_llcmd) << 3) & 0x08) |
 		    (((event->job_yield) << 2) & 0x04) |
 		    (((event->timebase_request) << 1) & 0x03) |
 		    ((event->parity_enable) & 0x01);
 		event->aux2_change = 0;
 	}
 	if (event->mmio_ack) {
-		event->tbuf[0] = event->tbuf[0] | 0x04;
-		for (i = 0; i < 8; i++) {
-			event->tbuf[bp++] =
-			    ((event->mmio_rdata) >> ((7 - i) * 8)) & 0xFF;
-		}
-		event->tbuf[bp++] = event->mmio_rdata_parity;
+		buf[0] |= AFU_FRAME_MMIO_ACK;
+		_put64(buf + bp, event->mmio_rdata);
+		bp += 8;
+		buf[bp++] = event->mmio_rdata_parity;
 		event->mmio_ack = 0;
 	}
 	if (event->buffer_rdata_valid) {
-		event->tbuf[0] = event->tbuf[0] | 0x02;
-		for (i = 0; i < 128; i++) {
-			event->tbuf[bp++] = event->buffer_rdata[i];
-		}
-		for (i = 0; i < 2; i++) {
-			event->tbuf[bp++] = event->buffer_rparity[i];
-		}
+		buf[0] |= AFU_FRAME_BUFFER_RDATA;
+		memcpy(buf + bp, event->buffer_rdata,
+		       sizeof(event->buffer_rdata));
+		bp += sizeof(event->buffer_rdata);
+		memcpy(buf + bp, event->buffer_rparity,
+		       sizeof(event->buffer_rparity));
+		bp += sizeof(event->buffer_rparity);
 		event->buffer_rdata_valid = 0;
 	}
 	if (event->command_valid) {
-		event->tbuf[0] = event->tbuf[0] | 0x01;
-		event->tbuf[bp++] = event->command_tag;
-		event->tbuf[bp++] = (((event->command_abort) << 5) & 0xE0) |
+		buf[0] |= AFU_FRAME_COMMAND;
+		buf[bp++] = event->command_tag;
+		buf[bp++] = (((event->command_abort) << 5) & 0xE0) |
 		    (((event->command_code) >> 8) & 0x1F);
-		event->tbuf[bp++] = event->command_code & 0xFF;
-		event->tbuf[bp++] =
-		    (((event->command_tag_parity) << 6) & 0x40) |
-		    (((event->command_code_parity)
-		      << 5) & 0x20) | (((event->command_address_parity) << 4) &
-				       0x10) | (((event->command_size)
-						 >> 8) & 0x0F);
-		event->tbuf[bp++] = event->command_size & 0xFF;
-		for (i = 0; i < 8; i++) {
-			event->tbuf[bp++] =
-			    ((event->command_address) >> ((7 - i) * 8)) & 0xFF;
-		}
-		for (i = 0; i < 2; i++) {
-			event->tbuf[bp++] =
-			    ((event->command_handle) >> ((1 - i) * 8)) & 0xFF;
-		}
+		buf[bp++] = event->command_code & 0xFF;
+		buf[bp++] = (((event->command_tag_parity) << 6) & 0x40) |
+		    (((event->command_code_parity) << 5) & 0x20) |
+		    (((event->command_address_parity) << 4) & 0x10) |
+		    (((event->command_size) >> 8) & 0x0F);
+		buf[bp++] = event->command_size & 0xFF;
+		_put64(buf + bp, event->command_address);
+		bp += 8;
+		_put16(buf + bp, event->command_handle);
+		bp += 2;
 		event->command_valid = 0;
 	}
+	return bp;
+}
 
-	bl = bp;
-	bp = 0;
-	while (bp < bl) {
-		bc = send(event->sockfd, event->tbuf + bp, bl - bp, 0);
-		if (bc < 0)
-			return PSL_TRANSMISSION_ERROR;
-		bp += bc;
+/* Unpack a complete AFU to PSL frame from rbuf */
+
+static void _afu_frame_decode(struct AFU_EVENT *event)
+{
+	unsigned char *buf = event->rbuf;
+	uint32_t rbc = 1;
+
+	event->transactions = ((buf[0] & AFU_FRAME_TRANSACT) != 0);
+	event->command_data_valid = ((buf[0] & AFU_FRAME_COMMAND_DATA) != 0);
+	if (event->command_data_valid) {
+		memcpy(event->command_wdata, buf + rbc,
+		       sizeof(event->command_wdata));
+		rbc += sizeof(event->command_wdata);
+		memcpy(event->command_wparity, buf + rbc,
+		       sizeof(event->command_wparity));
+		rbc += sizeof(event->command_wparity);
 	}
-	return PSL_SUCCESS;
+	if (buf[0] & AFU_FRAME_BATCH) {
+		event->clock_batch = _get16(buf + rbc);
+		event->clock_cycles = _get16(buf + rbc + 2);
+		rbc += 4;
+	} else {
+		event->clock_cycles = 1;
+	}
+	event->aux2_change = ((buf[0] & AFU_FRAME_AUX2) != 0);
+	if (event->aux2_change) {
+		event->buffer_read_latency = buf[rbc] >> 4;
+		event->job_running = (buf[rbc] >> 1) & 0x01;
+		event->job_done = buf[rbc++] & 0x01;
+		event->job_error = _get64(buf + rbc);
+		rbc += 8;
+		event->job_cack_llcmd = (buf[rbc] >> 3) & 0x01;
+		event->job_yield = (buf[rbc] >> 2) & 0x01;
+		event->timebase_request = (buf[rbc] >> 1) & 0x01;
+		event->parity_enable = buf[rbc++] & 0x01;
+	}
+	event->mmio_ack = ((buf[0] & AFU_FRAME_MMIO_ACK) != 0);
+	if (event->mmio_ack) {
+		event->mmio_rdata = _get64(buf + rbc);
+		rbc += 8;
+		event->mmio_rdata_parity = buf[rbc++];
+	}
+	event->buffer_rdata_valid = ((buf[0] & AFU_FRAME_BUFFER_RDATA) != 0);
+	if (event->buffer_rdata_valid) {
+		memcpy(event->buffer_rdata, buf + rbc,
+		       sizeof(event->buffer_rdata));
+		rbc += sizeof(event->buffer_rdata);
+		memcpy(event->buffer_rparity, buf + rbc,
+		       sizeof(event->buffer_rparity));
+		rbc += sizeof(event->buffer_rparity);
+	}
+	event->command_valid = ((buf[0] & AFU_FRAME_COMMAND) != 0);
+	if (event->command_valid) {
+		event->command_tag = buf[rbc++];
+		event->command_abort = (buf[rbc] >> 5) & 0x7;
+		event->command_code = (buf[rbc++] & 0x1F) << 8;
+		event->command_code |= buf[rbc++];
+		event->command_tag_parity = (buf[rbc] >> 6) & 0x01;
+		event->command_code_parity = (buf[rbc] >> 5) & 0x01;
+		event->command_address_parity = (buf[rbc] >> 4) & 0x01;
+		event->command_size = (buf[rbc++] & 0x0F) << 8;
+		event->command_size |= buf[rbc++];
+		event->command_address = _get64(buf + rbc);
+		rbc += 8;
+		event->command_handle = _get16(buf + rbc);
+	}
+}
+
+int psl_signal_afu_model(struct AFU_EVENT *event)
+{
+	if (event->clock != 0)
+		return PSL_TRANSMISSION_ERROR;
+	event->clock = 1;
+	return _event_send(event, _psl_frame_encode(event));
+}
+
+/* Call this to send an event to the PSL model */
+/* UPDATE: Now static as it's called in psl_get_psl_events() */
+
+static int psl_signal_psl_model(struct AFU_EVENT *event)
+{
+	if (event->clock != 1)
+		return PSL_SUCCESS;
+	event->clock = 0;
+	return _event_send(event, _afu_frame_encode(event));
+}
+
+/* AFU side: run one cycle of the current clock grant.  PSL is answered once
+ * the grant is used up or as soon as the AFU has something to report */
+
+static int _afu_clock_tick(struct AFU_EVENT *event)
+{
+	event->clock_cycles++;
+	event->clock_grant--;
+	if (event->clock_grant && !event->aux2_change && !event->mmio_ack &&
+	    !event->buffer_rdata_valid && !event->command_valid)
+		return PSL_SUCCESS;
+	event->clock_grant = 0;
+	event->clock = 1;
+	return psl_signal_psl_model(event);
 }
 
 /* This function checks the socket connection for data from the external AFU
@@ -761,12 +1527,17 @@ int psl_get_afu_events(struct AFU_EVENT *event)
 	int bc = 0;
 	uint32_t rbc = 1;
 	fd_set watchset;	/* fds to read from */
-	/* initialize watchset */
-	FD_ZERO(&watchset);
-	FD_SET(event->sockfd, &watchset);
-	select(event->sockfd + 1, &watchset, NULL, NULL, NULL);
+	if (event->shm != NULL) {
+		if (_shm_wait(event) < 0)
+			return -1;
+	} else {
+		/* initialize watchset */
+		FD_ZERO(&watchset);
+		FD_SET(event->sockfd, &watchset);
+		select(event->sockfd + 1, &watchset, NULL, NULL, NULL);
+	}
 	if (event->rbp == 0) {
-		if ((bc = recv(event->sockfd, event->rbuf, 1, 0)) == -1) {
+		if ((bc = _event_recv(event, event->rbuf, 1)) == -1) {
 			if (errno == EWOULDBLOCK) {
 				return 0;
 			} else {
@@ -778,102 +1549,35 @@ int psl_get_afu_events(struct AFU_EVENT *event)
 	if (bc == 0)
 		return -1;
 	if (event->rbp != 0) {
-		if ((event->rbuf[0] & 0x10) != 0) {
+		if ((event->rbuf[0] & AFU_FRAME_CLOCK) != 0) {
 			event->clock = 0;
-			if (event->rbuf[0] == 0x10) {
+			if (event->rbuf[0] == AFU_FRAME_CLOCK) {
+				event->clock_cycles = 1;
 				event->rbp = 0;
 				return 1;
 			}
 		}
-		if ((event->rbuf[0] & 0x08) != 0)
-			rbc += 10;
-		if ((event->rbuf[0] & 0x04) != 0)
-			rbc += 9;
-		if ((event->rbuf[0] & 0x02) != 0)
-			rbc += 130;
-		if ((event->rbuf[0] & 0x01) != 0)
-			rbc += 15;
-	}
-	if ((bc =
-	     recv(event->sockfd, event->rbuf + event->rbp, rbc - event->rbp,
-		  0)) == -1) {
-		if (errno == EWOULDBLOCK) {
-			return 0;
-		} else {
-			return -1;
-		}
+		rbc = _frame_len(_afu_frame_bytes, event->rbuf[0]);
 	}
-	if (bc == 0)
-		return -1;
-	event->rbp += bc;
-	if (event->rbp < rbc)
-		return 0;
-
-	rbc = 1;
-	if ((event->rbuf[0] & 0x08) != 0) {
-		event->aux2_change = 1;
-		event->buffer_read_latency = (event->rbuf[rbc]) >> 4;
-		event->job_running = ((event->rbuf[rbc]) >> 1) & 0x01;
-		event->job_done = (event->rbuf[rbc++]) & 0x01;
-		event->job_error = 0;
-		for (bc = 0; bc < 8; bc++) {
-			event->job_error =
-			    ((event->job_error) << 8) | event->rbuf[rbc++];
-		}
-		event->job_cack_llcmd = ((event->rbuf[rbc]) >> 3) & 0x01;
-		event->job_yield = ((event->rbuf[rbc]) >> 2) & 0x01;
-		event->timebase_request = ((event->rbuf[rbc]) >> 1) & 0x01;
-		event->parity_enable = (event->rbuf[rbc++]) & 0x01;
-	} else {
-		event->aux2_change = 0;
-	}
-	if ((event->rbuf[0] & 0x04) != 0) {
-		event->mmio_ack = 1;
-		event->mmio_rdata = 0;
-		for (bc = 0; bc < 8; bc++) {
-			event->mmio_rdata =
-			    ((event->mmio_rdata) << 8) | event->rbuf[rbc++];
-		}
-		event->mmio_rdata_parity = event->rbuf[rbc++];
-	} else {
-		event->mmio_ack = 0;
-	}
-	if ((event->rbuf[0] & 0x02) != 0) {
-		event->buffer_rdata_valid = 1;
-		for (bc = 0; bc < 128; bc++) {
-			event->buffer_rdata[bc] = event->rbuf[rbc++];
-		}
-		for (bc = 0; bc < 2; bc++) {
-			event->buffer_rparity[bc] = event->rbuf[rbc++];
-		}
-	} else {
-		event->buffer_rdata_valid = 0;
-	}
-	if ((event->rbuf[0] & 0x01) != 0) {
-		event->command_valid = 1;
-		event->command_tag = event->rbuf[rbc++];
-		event->command_abort = (event->rbuf[rbc] >> 5) & 0x7;
-		event->command_code = (event->rbuf[rbc++] & 0x1F) << 8;
-		event->command_code = event->command_code | event->rbuf[rbc++];
-		event->command_tag_parity = (event->rbuf[rbc] >> 6) & 0x01;
-		event->command_code_parity = (event->rbuf[rbc] >> 5) & 0x01;
-		event->command_address_parity = (event->rbuf[rbc] >> 4) & 0x01;
-		event->command_size = (event->rbuf[rbc++] & 0x0F) << 8;
-		event->command_size = event->command_size | event->rbuf[rbc++];
-		event->command_address = 0;
-		for (bc = 0; bc < 8; bc++) {
-			event->command_address =
-			    ((event->command_address) << 8) |
-			    event->rbuf[rbc++];
-		}
-		event->command_handle = 0;
-		for (bc = 0; bc < 2; bc++) {
-			event->command_handle =
-			    ((event->command_handle) << 8) | event->rbuf[rbc++];
+	// Flags alone may make up the whole frame
+	if (event->rbp < rbc) {
+		if ((bc =
+		     _event_recv(event, event->rbuf + event->rbp,
+				 rbc - event->rbp)) == -1) {
+			if (errno == EWOULDBLOCK) {
+				return 0;
+			} else {
+				return -1;
+			}
 		}
-	} else {
-		event->command_valid = 0;
+		if (bc == 0)
+			return -1;
+		event->rbp += bc;
+		if (event->rbp < rbc)
+			return 0;
 	}
+
+	_afu_frame_decode(event);
 	event->rbp = 0;
 	return 1;
 }
@@ -887,8 +1591,20 @@ int psl_get_psl_events(struct AFU_EVENT *event)
 {
 	int bc;
 	uint32_t rbc = 1;
+	if (event->clock_grant != 0) {
+		// Granted cycle, nothing new from PSL until the grant is answered
+		event->aux1_change = 0;
+		event->job_valid = 0;
+		event->mmio_valid = 0;
+		event->response_valid = 0;
+		event->buffer_read = 0;
+		event->buffer_write = 0;
+		if (_afu_clock_tick(event) != PSL_SUCCESS)
+			return -1;
+		return 1;
+	}
 	if (event->rbp == 0) {
-		if ((bc = recv(event->sockfd, event->rbuf, 1, 0)) == -1) {
+		if ((bc = _event_recv(event, event->rbuf, 1)) == -1) {
 			if (errno == EWOULDBLOCK) {
 				return 0;
 			} else {
@@ -900,29 +1616,26 @@ int psl_get_psl_events(struct AFU_EVENT *event)
 		event->rbp += bc;
 	}
 	if (event->rbp != 0) {
-		if ((event->rbuf[0] & 0x40) != 0) {
+		if ((event->rbuf[0] & (PSL_FRAME_GRANT | PSL_FRAME_CLOCK)) ==
+		    PSL_FRAME_CLOCK) {
 			event->clock = 1;
+			event->clock_cycles = 1;
+			event->clock_sleep = 0;
 			psl_signal_psl_model(event);
-			if (event->rbuf[0] == 0x40) {
+			if (event->rbuf[0] == PSL_FRAME_CLOCK) {
 				event->rbp = 0;
 				return 1;
 			}
 		}
-		if ((event->rbuf[0] & 0x20) != 0)
-			rbc += 1;
-		if ((event->rbuf[0] & 0x10) != 0)
-			rbc += 10;
-		if ((event->rbuf[0] & 0x08) != 0)
-			rbc += 12;
-		if ((event->rbuf[0] & 0x04) != 0)
-			rbc += 6;
-		if ((event->rbuf[0] & 0x02) != 0)
-			rbc += 3;
-		if ((event->rbuf[0] & 0x01) != 0)
-			rbc += 133;
+		if (event->rbuf[0] & PSL_FRAME_CLOCK)
+			rbc = _frame_len(_psl_frame_bytes, event->rbuf[0]);
+		else
+			rbc = _frame_len(_psl_control_bytes, event->rbuf[0]);
+	}
+	if (event->rbp < rbc) {
 		if ((bc =
-		     recv(event->sockfd, event->rbuf + event->rbp,
-			  rbc - event->rbp, 0)) == -1) {
+		     _event_recv(event, event->rbuf + event->rbp,
+				 rbc - event->rbp)) == -1) {
 			if (errno == EWOULDBLOCK) {
 				return 0;
 			} else {
@@ -935,93 +1648,17 @@ int psl_get_psl_events(struct AFU_EVENT *event)
 	}
 	if (event->rbp < rbc)
 		return 0;
-	rbc = 1;
-	if (event->rbuf[0] & 0x20) {
-		event->aux1_change = 1;
-		event->room = event->rbuf[rbc++];
-	} else {
-		event->aux1_change = 0;
-	}
-	if (event->rbuf[0] & 0x10) {
-		event->job_valid = 1;
-		event->job_code = event->rbuf[rbc++];
-		event->job_address = 0;
-		for (bc = 0; bc < 8; bc++) {
-			event->job_address =
-			    ((event->job_address) << 8) | event->rbuf[rbc++];
-		}
-		event->job_address_parity = (event->rbuf[rbc] >> 1) & 0x01;
-		event->job_code_parity = event->rbuf[rbc++] & 0x01;
-	} else {
-		event->job_valid = 0;
-	}
-	if (event->rbuf[0] & 0x08) {
-		event->mmio_valid = 1;
-		event->mmio_wdata_parity = ((event->rbuf[rbc]) >> 4) & 1;
-		event->mmio_address_parity = ((event->rbuf[rbc]) >> 3) & 1;
-		event->mmio_afudescaccess = ((event->rbuf[rbc]) >> 2) & 1;
-		event->mmio_double = ((event->rbuf[rbc]) >> 1) & 1;
-		event->mmio_read = (event->rbuf[rbc++]) & 1;
-		event->mmio_address = 0;
-		for (bc = 0; bc < 3; bc++) {
-			event->mmio_address =
-			    ((event->mmio_address) << 8) | event->rbuf[rbc++];
-		}
-		event->mmio_wdata = 0;
-		for (bc = 0; bc < 8; bc++) {
-			event->mmio_wdata =
-			    ((event->mmio_wdata) << 8) | event->rbuf[rbc++];
-		}
-	} else {
-		event->mmio_valid = 0;
-	}
-	if (event->rbuf[0] & 0x04) {
-		event->response_valid = 1;
-		event->response_tag = event->rbuf[rbc++];
-		event->response_tag_parity = event->rbuf[rbc++];
-		event->response_code = event->rbuf[rbc++];
-		event->cache_position = event->rbuf[rbc++] << 5;
-		event->cache_position =
-		    event->cache_position | (((event->rbuf[rbc]) >> 3) & 0x1F);
-		event->cache_state = ((event->rbuf[rbc]) >> 2) & 0x3;
-		event->credits = (event->rbuf[rbc++] << 8) & 0x100;
-		event->credits = event->credits | event->rbuf[rbc++];
-	} else {
-		event->response_valid = 0;
-	}
-	if (event->rbuf[0] & 0x02) {
-		event->buffer_read = 1;
-		event->buffer_read_tag = event->rbuf[rbc++];
-		event->buffer_read_tag_parity = event->rbuf[rbc++];
-		if ((event->rbuf[rbc]) >> 7) {
-			event->buffer_read_length = 128;
-		} else {
-			event->buffer_read_length = 64;
-		}
-		event->buffer_read_address = (event->rbuf[rbc++]) & 0x3F;
-	} else {
-		event->buffer_read = 0;
-	}
-	if (event->rbuf[0] & 0x01) {
-		event->buffer_write = 1;
-		event->buffer_write_tag = event->rbuf[rbc++];
-		event->buffer_write_tag_parity = event->rbuf[rbc++];
-		if ((event->rbuf[rbc]) >> 7) {
-			event->buffer_write_length = 128;
-		} else {
-			event->buffer_write_length = 64;
-		}
-		event->buffer_write_address = (event->rbuf[rbc++]) & 0x3F;
-		for (bc = 0; bc < 128; bc++) {
-			event->buffer_wdata[bc] = event->rbuf[rbc++];
-		}
-		for (bc = 0; bc < 2; bc++) {
-			event->buffer_wparity[bc] = event->rbuf[rbc++];
-		}
-	} else {
-		event->buffer_write = 0;
+	// Clock control frames carry no cycle, look for the next frame
+	if (!(event->rbuf[0] & PSL_FRAME_CLOCK)) {
+		_psl_control_decode(event);
+		event->rbp = 0;
+		return psl_get_psl_events(event);
 	}
+	event->clock_sleep = 0;
+	_psl_frame_decode(event);
 	event->rbp = 0;
+	if (event->clock_grant && (_afu_clock_tick(event) != PSL_SUCCESS))
+		return -1;
 	return 1;
 }
 
@@ -1090,6 +1727,62 @@ psl_afu_read_buffer_data(struct AFU_EVENT *event,
 	}
 }
 
+/* Call this on the AFU side to accept clock grants of up to max_cycles per
+ * clock frame from PSL.  During a grant psl_get_psl_events() returns the next
+ * cycle without reading the socket, so callers that block on the socket
+ * should only do so while clock_grant is 0 */
+
+int psl_afu_clock_batch(struct AFU_EVENT *event, uint32_t max_cycles)
+{
+	if (max_cycles > PSL_CLOCK_BATCH_MAX)
+		max_cycles = PSL_CLOCK_BATCH_MAX;
+	event->clock_batch = max_cycles;
+	return PSL_SUCCESS;
+}
+
+/* Call this on the AFU side after psl_get_psl_events() returns 1 to take the
+ * cycles PSL skipped while clocks were stopped.  They passed before the cycle
+ * just returned. */
+
+int psl_afu_clock_skip(struct AFU_EVENT *event, uint64_t * cycles)
+{
+	*cycles = event->clock_skip;
+	event->clock_skip = 0;
+	return PSL_SUCCESS;
+}
+
+/* Call this on the AFU side once connected to tell PSL the AFU takes whole
+ * transactions.  PSL then skips random delays, may send read data and the
+ * response for a command in the same frame and takes write data sent with
+ * psl_afu_command_data() in place of buffer reads */
+
+int psl_afu_transactions(struct AFU_EVENT *event)
+{
+	if (!_proto_supports(event, PROTOCOL_TERTIARY_TRANSACTION))
+		return PSL_NOT_SUPPORTED;
+	event->transactions = 1;
+	return PSL_SUCCESS;
+}
+
+/* Call this on the AFU side after psl_afu_command() to send the write data
+ * with the command.  Only possible after psl_afu_transactions(), otherwise
+ * the data is sent when PSL asks for it with a buffer read */
+
+int
+psl_afu_command_data(struct AFU_EVENT *event,
+		     uint8_t * write_data, uint8_t * write_parity)
+{
+	if (!event->command_valid)
+		return PSL_COMMAND_NOT_VALID;
+	if (!event->transactions)
+		return PSL_NOT_SUPPORTED;
+	event->command_data_valid = 1;
+	memcpy(event->command_wdata, write_data, sizeof(event->command_wdata));
+	memcpy(event->command_wparity, write_parity,
+	       sizeof(event->command_wparity));
+	return PSL_SUCCESS;
+}
+
 /* Call this on the AFU side to change the auxilliary signals
  * (running, done, job error, buffer read latency) */
 
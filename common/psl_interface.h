@@ -27,7 +27,8 @@ void psl_event_reset(struct AFU_EVENT *event);
  * a socket conection to an AFU server.  This function initializes the PSL side
  * of the interface which is the client in the socket connection server_host
  * should be the name of the server hosting the simulation of the AFU and port
- * is the active port on that server */
+ * is the active port on that server.  A server_host of "unix:<path>" connects
+ * to the unix domain socket at path and ignores port */
 
 int psl_init_afu_event(struct AFU_EVENT *event, char *server_host, int port);
 
@@ -41,10 +42,32 @@ int psl_close_afu_event(struct AFU_EVENT *event);
 
 int psl_serv_afu_event(struct AFU_EVENT *event, int port);
 
+/* Same as psl_serv_afu_event() but listens on a unix domain socket at path */
+
+int psl_serv_afu_event_unix(struct AFU_EVENT *event, char *path);
+
+/* Turn off Nagle and size buffers on a TCP socket, no-op for unix sockets.
+ * PSLSE and libcxl also call this on their own sockets */
+
+void psl_tune_socket(int fd);
+
 /* Call this to change auxilliary signals (room) */
 
 int psl_aux1_change(struct AFU_EVENT *event, uint32_t room);
 
+/* Call this to let the AFU run up to cycles clocks on the next
+ * psl_signal_afu_model() call.  The AFU answers early when it has anything to
+ * report and clock_cycles holds the cycles it actually ran */
+
+int psl_clock_grant(struct AFU_EVENT *event, uint32_t cycles);
+
+/* Call this once clocks stop to tell the AFU it is waiting on host software,
+ * then psl_clock_skip() before clocking again with the cycles that passed */
+
+int psl_clock_stop(struct AFU_EVENT *event);
+
+int psl_clock_skip(struct AFU_EVENT *event, uint32_t cycles);
+
 /* Call this to create an accelerator control command */
 
 int psl_job_control(struct AFU_EVENT *event,
@@ -116,6 +139,12 @@ int psl_get_command(struct AFU_EVENT *event,
 		    uint64_t * address_parity,
 		    uint32_t * size, uint32_t * abort, uint32_t * handle);
 
+/* Call after psl_get_command() to get write data the AFU sent with the
+ * command, if any */
+
+int psl_get_command_data(struct AFU_EVENT *event,
+			 uint8_t * write_data, uint8_t * write_parity);
+
 /* Call this periodically to send events and clocking synchronization to AFU */
 
 int psl_signal_afu_model(struct AFU_EVENT *event);
@@ -168,6 +197,31 @@ int psl_afu_read_buffer_data(struct AFU_EVENT *event,
 			     uint32_t length,
 			     uint8_t * read_data, uint8_t * read_parity);
 
+/* Call this on the AFU side to accept clock grants of up to max_cycles per
+ * clock frame.  During a grant psl_get_psl_events() returns the next cycle
+ * without reading the socket, so only block on the socket while clock_grant
+ * is 0 */
+
+int psl_afu_clock_batch(struct AFU_EVENT *event, uint32_t max_cycles);
+
+/* Call this on the AFU side after psl_get_psl_events() returns 1 to take the
+ * cycles PSL skipped while clocks were stopped, if any.  Simulators can
+ * advance time over them in one step. */
+
+int psl_afu_clock_skip(struct AFU_EVENT *event, uint64_t * cycles);
+
+/* Call this on the AFU side to take whole transactions from PSL: read data
+ * may come with the response for a command and write data may be sent with
+ * the command using psl_afu_command_data() */
+
+int psl_afu_transactions(struct AFU_EVENT *event);
+
+/* Call this on the AFU side after psl_afu_command() to send 128B of write
+ * data with the command in place of answering a buffer read */
+
+int psl_afu_command_data(struct AFU_EVENT *event,
+			 uint8_t * write_data, uint8_t * write_parity);
+
 /* Call this on the AFU side to change the auxilliary signals
  * (running, done, job error, buffer read latency) */
 
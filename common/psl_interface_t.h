@@ -26,10 +26,35 @@
 #include <stdio.h>
 #include <unistd.h>
 
-#define PSL_BUFFER_SIZE 200
+#define PSL_BUFFER_SIZE 320
 #define PROTOCOL_PRIMARY 0
 #define PROTOCOL_SECONDARY 9908
-#define PROTOCOL_TERTIARY 1
+#define PROTOCOL_TERTIARY 5
+
+/* Lowest protocol tertiary level supporting each optional feature */
+
+#define PROTOCOL_TERTIARY_SHM 2	/* Shared memory ring transport */
+#define PROTOCOL_TERTIARY_BATCH 3	/* Multi-cycle clock grants */
+#define PROTOCOL_TERTIARY_TRANSACTION 4	/* Write data sent with commands */
+#define PROTOCOL_TERTIARY_SLEEP 5	/* Clock stop and skip notices */
+
+/* Host name and prefix of a unix domain socket path given in place of a
+ * host name, as in "unix:<path>" */
+
+#define PSL_UNIX_HOST "unix"
+#define PSL_UNIX_PREFIX PSL_UNIX_HOST ":"
+
+/* Send and receive buffer size for TCP links */
+
+#define PSL_SOCKET_BUFFER (256 * 1024)
+
+/* Largest clock grant that fits in a clock frame */
+
+#define PSL_CLOCK_BATCH_MAX 0xFFFF
+
+/* Most cycles skipped in one clock skip notice */
+
+#define PSL_CLOCK_SKIP_MAX 0xFFFFFFFF
 
 /* Return codes for interface functions */
 
@@ -54,6 +79,9 @@
 				   the socket */
 #define PSL_AUX2_NOT_VALID 256	/* There auxilliary signals
 				   have not changed */
+#define PSL_NOT_SUPPORTED 512	/* The other side of the socket
+				   is at a protocol level without
+				   the feature */
 
 /* Job Control Codes */
 
@@ -110,6 +138,10 @@
 #define PSL_COMMAND_UNLOCK       0x017B
 #define PSL_COMMAND_RESTART      0x0001
 
+/* Shared memory ring transport state, private to psl_interface.c */
+
+struct psl_shm;
+
 /* Create one of these structures to interface to an AFU model and use the functions below to manipulate it */
 
 /* *INDENT-OFF* */
@@ -122,6 +154,17 @@ struct AFU_EVENT {
   unsigned char tbuf[PSL_BUFFER_SIZE];/* transmit buffer for socket communications */
   unsigned char rbuf[PSL_BUFFER_SIZE];/* receive buffer for socket communications */
   uint32_t rbp;                       /* receive buffer position */
+  struct psl_shm *shm;                /* shared memory rings, NULL when frames go over the socket */
+  uint32_t shm_tx;                    /* ring this side produces frames into */
+  uint32_t shm_rx;                    /* ring this side consumes frames from */
+  uint32_t shm_roff;                  /* read offset into current receive ring slot */
+  uint32_t shm_owed;                  /* doorbell bytes still to be drained from socket */
+  uint32_t clock_batch;               /* most cycles the AFU accepts per clock frame, 0 for one */
+  uint32_t clock_grant;               /* PSL: cycles to grant with next clock, AFU: granted cycles left */
+  uint32_t clock_cycles;              /* cycles the AFU ran for the last clock frame */
+  uint32_t transactions;              /* AFU takes whole transactions: data with commands and responses */
+  uint32_t clock_sleep;               /* AFU: PSL stopped clocks until it has work */
+  uint64_t clock_skip;                /* AFU: cycles PSL skipped while clocks were stopped, not yet taken */
   uint64_t job_address;               /* effective address of the work element descriptor */
   uint64_t job_error;                 /* error code for completed job */
   uint32_t job_valid;                 /* AFU event contains a valid job control command */
@@ -180,6 +223,9 @@ struct AFU_EVENT {
   uint32_t command_size;              /* number of bytes for commands requiring transfer size */
   uint32_t command_abort;             /* indicates that the command may be aborted */
   uint32_t command_handle;            /* Context handle (Process Element ID) */
+  uint32_t command_data_valid;        /* write data for the command came with it, in place of a buffer read */
+  unsigned char command_wdata[128];   /* 128B write data sent with the command */
+  unsigned char command_wparity[2];   /* 128b parity for the command write data */
   uint32_t aux2_change;               /* The value of one of the auxilliary signals has changed (running, job done or error, read latency) */
 };
 /* *INDENT-ON* */
@@ -276,37 +276,94 @@ int put_bytes(int fd, int size, uint8_t * data, FILE * dbg_fp, uint8_t dbg_id,
 // Generate parity for up to 64bits of data
 uint8_t generate_parity(uint64_t data, uint8_t odd)
 {
-	uint8_t parity = odd;
-	// While at least 1 bit is set
-	while (data) {
-		// Invert parity bit
-		parity = 1 - parity;
-		// Zero out least significant bit that is set to 1
-		data &= data - 1;
-	}
-	return parity;
+	return (odd ^ __builtin_parityll(data)) & 1;
 }
 
-// Generate parity for entire cacheline of data
-void generate_cl_parity(uint8_t * data, uint8_t * parity)
+// Reverse bits so dword 0 of each group of 8 lands in the most significant bit
+static uint8_t _bit_reverse(uint8_t bits)
+{
+	bits = (bits & 0xF0) >> 4 | (bits & 0x0F) << 4;
+	bits = (bits & 0xCC) >> 2 | (bits & 0x33) << 2;
+	return (bits & 0xAA) >> 1 | (bits & 0x55) << 1;
+}
+
+// Pack per dword even parity bits (bit i for dword i) into cacheline parity
+static void _cl_parity_pack(uint16_t even, uint8_t * parity)
+{
+	parity[0] = _bit_reverse(~even & 0xFF);
+	parity[1] = _bit_reverse(~even >> 8);
+}
+
+static void _cl_parity_scalar(uint8_t * data, uint8_t * parity)
 {
-	int i;
 	uint64_t dw;
-	uint8_t p;
+	uint16_t even = 0;
+	int i;
 
-	// Walk each double word (dword) in cacheline
 	for (i = 0; i < DWORDS_PER_CACHELINE; i++) {
-		// Copy dword of data into uint64_t dw
 		memcpy(&dw, &(data[BYTES_PER_DWORD * i]), BYTES_PER_DWORD);
-		// Initialize parity entry to 0 when starting parity byte
-		if ((i % BYTES_PER_DWORD) == 0)
-			parity[i / BYTES_PER_DWORD] = 0;
-		// Shift previously calculated parity bits left
-		parity[i / BYTES_PER_DWORD] <<= 1;
-		// Generate parity bit for this dword
-		p = generate_parity(dw, ODD_PARITY);
-		parity[i / BYTES_PER_DWORD] += p;
+		even |= __builtin_parityll(dw) << i;
+	}
+	_cl_parity_pack(even, parity);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+// Fold each 64 bit lane down to its low nibble, look up the nibble parity
+// with PSHUFB and gather one bit per dword with MOVMSKPD
+__attribute__ ((target("avx2")))
+static void _cl_parity_avx2(uint8_t * data, uint8_t * parity)
+{
+	const __m256i table = _mm256_setr_epi8(0, 1, 1, 0, 1, 0, 0, 1,
+					       1, 0, 0, 1, 0, 1, 1, 0,
+					       0, 1, 1, 0, 1, 0, 0, 1,
+					       1, 0, 0, 1, 0, 1, 1, 0);
+	const __m256i nibble = _mm256_set1_epi64x(0xF);
+	__m256i v;
+	uint16_t even = 0;
+	int i;
+
+	for (i = 0; i < CACHELINE_BYTES / 32; i++) {
+		v = _mm256_loadu_si256((__m256i *) (data + 32 * i));
+		v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 32));
+		v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 16));
+		v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 8));
+		v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 4));
+		v = _mm256_shuffle_epi8(table, _mm256_and_si256(v, nibble));
+		v = _mm256_slli_epi64(v, 63);
+		even |= _mm256_movemask_pd(_mm256_castsi256_pd(v)) << (4 * i);
+	}
+	_cl_parity_pack(even, parity);
+}
+#endif
+
+static void (*_cl_parity) (uint8_t *, uint8_t *);
+
+// Pick the fastest cacheline parity the CPU supports on first use
+static void _cl_parity_select(void)
+{
+	void (*fn) (uint8_t *, uint8_t *) = _cl_parity_scalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		fn = _cl_parity_avx2;
+#endif
+	__atomic_store_n(&_cl_parity, fn, __ATOMIC_RELEASE);
+}
+
+// Generate parity for entire cacheline of data
+void generate_cl_parity(uint8_t * data, uint8_t * parity)
+{
+	void (*fn) (uint8_t *, uint8_t *);
+
+	fn = __atomic_load_n(&_cl_parity, __ATOMIC_ACQUIRE);
+	if (fn == NULL) {
+		_cl_parity_select();
+		fn = _cl_parity;
 	}
+	fn(data, parity);
 }
 
 // Gracefully shutdown and close socket connection
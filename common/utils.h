@@ -34,9 +34,10 @@
 #define DWORDS_PER_CACHELINE 16
 #define CACHELINE_BYTES 128
 #define PSL_IDLE_CYCLES 20
+#define PSL_CLOCK_BATCH 256
 
 #define PSLSE_VERSION_MAJOR	0x01
-#define PSLSE_VERSION_MINOR	0x02
+#define PSLSE_VERSION_MINOR	0x05
 
 #define PSLSE_CONNECT		0x01
 #define PSLSE_QUERY		0x02
@@ -58,6 +59,10 @@
 #define PSLSE_MMIO_FAIL		0x12
 #define PSLSE_INTERRUPT		0x13
 #define PSLSE_AFU_ERROR		0x14
+#define PSLSE_MEM_DIRECT	0x15
+#define PSLSE_MMIO_BATCH	0x16
+
+#define PSLSE_MMIO_BATCH_MAX	256
 
 // PSLSE states
 enum pslse_state {
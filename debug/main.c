@@ -1,7 +1,14 @@
+#include <getopt.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "../common/debug.h"
 #include "../common/psl_interface_t.h"
@@ -9,7 +16,51 @@
 
 #define MAX_LINE_CHARS	1024
 
-int parity, running, latency;
+#define ANY -1
+
+// Records to print, ANY for fields not filtered on
+struct filter {
+	int afu;
+	int context;
+	int tag;
+	int command;
+	uint64_t from;		// ns since PSLSE start, chunk granularity
+	uint64_t to;
+	int active;
+};
+
+// Decode state for one stream of records
+struct decoder {
+	FILE *in;
+	FILE *out;
+	FILE *null;		// Output for records the filter drops
+	struct filter *filter;
+	int parity, running, latency;
+};
+
+// A run of records between index blocks, decoded independently
+struct chunk {
+	struct debug_index index;
+	uint64_t end;
+	uint64_t time_min;
+	char *text;
+	size_t len;
+	int rc;
+	int done;
+};
+
+struct job {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct chunk **chunk;
+	struct filter *filter;
+	uint8_t *map;
+	int chunks;
+	int next;
+	int printed;
+	int window;
+	int abort;
+};
 
 static char *_afu_name(uint8_t id)
 {
@@ -23,49 +74,85 @@ static char *_afu_name(uint8_t id)
 	return name;
 }
 
-static int _report_version(FILE * fp)
+static int _report_version(struct decoder *dec)
 {
 	uint8_t major;
 	uint8_t minor;
 
-	if (debug_get_8(fp, &major) < 1)
+	if (debug_get_8(dec->in, &major) < 1)
 		return -1;
-	if (debug_get_8(fp, &minor) < 1)
+	if (debug_get_8(dec->in, &minor) < 1)
 		return -1;
 
-	printf("PSLSE_VERSION=%d.%03d\n", major, minor);
+	fprintf(dec->out, "PSLSE_VERSION=%d.%03d\n", major, minor);
 
 	return 0;
 }
 
-static int _parse_parm(FILE * fp)
+static int _parse_parm(struct decoder *dec)
 {
 	uint32_t parm;
 	uint32_t value;
 
-	if (debug_get_32(fp, &parm) < 1)
+	if (debug_get_32(dec->in, &parm) < 1)
 		return -1;
-	if (debug_get_32(fp, &value) < 1)
+	if (debug_get_32(dec->in, &value) < 1)
 		return -1;
 
 	switch (parm) {
 	case DBG_PARM_SEED:
-		printf("PARM:SEED=%d\n", value);
+		fprintf(dec->out, "PARM:SEED=%d\n", value);
 		break;
 	case DBG_PARM_TIMEOUT:
-		printf("PARM:TIMEOUT=%d\n", value);
+		fprintf(dec->out, "PARM:TIMEOUT=%d\n", value);
 		break;
 	case DBG_PARM_RESP_PERCENT:
-		printf("PARM:REPSONSE_PERCENT=%d\n", value);
+		fprintf(dec->out, "PARM:REPSONSE_PERCENT=%d\n", value);
 		break;
 	case DBG_PARM_PAGED_PERCENT:
-		printf("PARM:PAGED_PERCENT=%d\n", value);
+		fprintf(dec->out, "PARM:PAGED_PERCENT=%d\n", value);
 		break;
 	case DBG_PARM_REORDER_PERCENT:
-		printf("PARM:REORDER_PERCENT=%d\n", value);
+		fprintf(dec->out, "PARM:REORDER_PERCENT=%d\n", value);
 		break;
 	case DBG_PARM_BUFFER_PERCENT:
-		printf("PARM:BUFFER_PERCENT=%d\n", value);
+		fprintf(dec->out, "PARM:BUFFER_PERCENT=%d\n", value);
+		break;
+	case DBG_PARM_ERAT_SETS:
+		fprintf(dec->out, "PARM:ERAT_SETS=%d\n", value);
+		break;
+	case DBG_PARM_ERAT_WAYS:
+		fprintf(dec->out, "PARM:ERAT_WAYS=%d\n", value);
+		break;
+	case DBG_PARM_ERAT_PAGE_SIZE:
+		fprintf(dec->out, "PARM:ERAT_PAGE_SIZE=%d\n", value);
+		break;
+	case DBG_PARM_ERAT_POLICY:
+		fprintf(dec->out, "PARM:ERAT_POLICY=%d\n", value);
+		break;
+	case DBG_PARM_TIMING:
+		fprintf(dec->out, "PARM:TIMING=%d\n", value);
+		break;
+	case DBG_PARM_TIMING_HIT_PERCENT:
+		fprintf(dec->out, "PARM:TIMING_HIT_PERCENT=%d\n", value);
+		break;
+	case DBG_PARM_TIMING_HIT_LATENCY:
+		fprintf(dec->out, "PARM:TIMING_HIT_LATENCY=%d,%d\n",
+			value & 0xffff, value >> 16);
+		break;
+	case DBG_PARM_TIMING_MISS_LATENCY:
+		fprintf(dec->out, "PARM:TIMING_MISS_LATENCY=%d,%d\n",
+			value & 0xffff, value >> 16);
+		break;
+	case DBG_PARM_TIMING_XLATE_LATENCY:
+		fprintf(dec->out, "PARM:TIMING_XLATE_LATENCY=%d,%d\n",
+			value & 0xffff, value >> 16);
+		break;
+	case DBG_PARM_TIMING_LINK_BYTES:
+		fprintf(dec->out, "PARM:TIMING_LINK_BYTES=%d\n", value);
+		break;
+	case DBG_PARM_TIMING_MAX_READS:
+		fprintf(dec->out, "PARM:TIMING_MAX_READS=%d\n", value);
 		break;
 	default:
 		return -1;
@@ -74,21 +161,21 @@ static int _parse_parm(FILE * fp)
 	return 0;
 }
 
-static int _parse_afu(FILE * fp, DBG_HEADER header)
+static int _parse_afu(struct decoder *dec, DBG_HEADER header)
 {
 	uint8_t id;
 	char *name;
 
-	if (debug_get_8(fp, &id) < 1)
+	if (debug_get_8(dec->in, &id) < 1)
 		return -1;
 	name = _afu_name(id);
 
 	switch (header) {
 	case DBG_HEADER_AFU_CONNECT:
-		printf("%s:Connect\n", name);
+		fprintf(dec->out, "%s:Connect\n", name);
 		break;
 	case DBG_HEADER_AFU_DROP:
-		printf("%s:Disconnect\n", name);
+		fprintf(dec->out, "%s:Disconnect\n", name);
 		break;
 	default:
 		free(name);
@@ -98,24 +185,26 @@ static int _parse_afu(FILE * fp, DBG_HEADER header)
 	return 0;
 }
 
-static int _parse_context(FILE * fp, DBG_HEADER header)
+static int _parse_context(struct decoder *dec, DBG_HEADER header)
 {
 	uint16_t context;
 	uint8_t id;
 	char *name;
 
-	if (debug_get_8(fp, &id) < 1)
+	if (debug_get_8(dec->in, &id) < 1)
 		return -1;
-	if (debug_get_16(fp, &context) < 1)
+	if (debug_get_16(dec->in, &context) < 1)
 		return -1;
 	name = _afu_name(id);
 
 	switch (header) {
 	case DBG_HEADER_CONTEXT_ADD:
-		printf("%s:CLIENT: Added context %d\n", name, context);
+		fprintf(dec->out, "%s:CLIENT: Added context %d\n", name,
+			context);
 		break;
 	case DBG_HEADER_CONTEXT_REMOVE:
-		printf("%s:CLIENT: Removed context %d\n", name, context);
+		fprintf(dec->out, "%s:CLIENT: Removed context %d\n", name,
+			context);
 		break;
 	default:
 		free(name);
@@ -125,25 +214,25 @@ static int _parse_context(FILE * fp, DBG_HEADER header)
 	return 0;
 }
 
-static int _parse_job(FILE * fp, DBG_HEADER header)
+static int _parse_job(struct decoder *dec, DBG_HEADER header)
 {
 	uint32_t code;
 	uint8_t id;
 	char *name;
 
-	if (debug_get_8(fp, &id) < 1)
+	if (debug_get_8(dec->in, &id) < 1)
 		return -1;
-	if (debug_get_32(fp, &code) < 1)
+	if (debug_get_32(dec->in, &code) < 1)
 		return -1;
 	name = _afu_name(id);
 
-	printf("%s:JOB: ", name);
+	fprintf(dec->out, "%s:JOB: ", name);
 	switch (header) {
 	case DBG_HEADER_JOB_ADD:
-		printf("Added ");
+		fprintf(dec->out, "Added ");
 		break;
 	case DBG_HEADER_JOB_SEND:
-		printf("Sent ");
+		fprintf(dec->out, "Sent ");
 		break;
 	default:
 		free(name);
@@ -151,230 +240,230 @@ static int _parse_job(FILE * fp, DBG_HEADER header)
 	}
 	switch (code) {
 	case PSL_JOB_START:
-		printf("START");
+		fprintf(dec->out, "START");
 		break;
 	case PSL_JOB_RESET:
-		printf("RESET");
+		fprintf(dec->out, "RESET");
 		break;
 	default:
-		printf("Unknown:0x%08x", code);
+		fprintf(dec->out, "Unknown:0x%08x", code);
 	}
-	printf("\n");
+	fprintf(dec->out, "\n");
 	free(name);
 	return 0;
 }
 
-static int _parse_map(FILE * fp, DBG_HEADER header)
+static int _parse_map(struct decoder *dec, DBG_HEADER header)
 {
 	uint16_t context;
 	uint8_t id;
 	char *name;
 
-	if (debug_get_8(fp, &id) < 1)
+	if (debug_get_8(dec->in, &id) < 1)
 		return -1;
-	if (debug_get_16(fp, &context) < 1)
+	if (debug_get_16(dec->in, &context) < 1)
 		return -1;
 	name = _afu_name(id);
 
-	printf("%s:MMIO: Mapped context %d\n", name, context);
+	fprintf(dec->out, "%s:MMIO: Mapped context %d\n", name, context);
 	free(name);
 	return 0;
 }
 
-static int _parse_mmio(FILE * fp, DBG_HEADER header)
+static int _parse_mmio(struct decoder *dec, DBG_HEADER header)
 {
 	uint32_t addr;
 	uint16_t context;
 	uint8_t id, rnw, dw;
 	char *name;
 
-	if (debug_get_8(fp, &id) < 1)
+	if (debug_get_8(dec->in, &id) < 1)
 		return -1;
-	if (debug_get_8(fp, &rnw) < 1)
+	if (debug_get_8(dec->in, &rnw) < 1)
 		return -1;
-	if (debug_get_8(fp, &dw) < 1)
+	if (debug_get_8(dec->in, &dw) < 1)
 		return -1;
-	if (debug_get_16(fp, &context) < 1)
+	if (debug_get_16(dec->in, &context) < 1)
 		return -1;
-	if (debug_get_32(fp, &addr) < 1)
+	if (debug_get_32(dec->in, &addr) < 1)
 		return -1;
 	name = _afu_name(id);
 
-	printf("%s", name);
+	fprintf(dec->out, "%s", name);
 	if (header == DBG_HEADER_MMIO_ADD) {
 		if (((int16_t) context) != -1)
-			printf(",%d", context);
-		printf(":MMIO: Added ");
+			fprintf(dec->out, ",%d", context);
+		fprintf(dec->out, ":MMIO: Added ");
 		if (((int16_t) context) == -1)
-			printf("Descriptor ");
+			fprintf(dec->out, "Descriptor ");
 	} else {
-		printf(":MMIO: Sent ");
+		fprintf(dec->out, ":MMIO: Sent ");
 		if (((int16_t) context) == 1)
-			printf("Descriptor ");
+			fprintf(dec->out, "Descriptor ");
 	}
 	if (rnw)
-		printf("Read");
+		fprintf(dec->out, "Read");
 	else
-		printf("Write");
+		fprintf(dec->out, "Write");
 	if (dw)
-		printf("64 ");
+		fprintf(dec->out, "64 ");
 	else
-		printf("32 ");
-	printf("Address=0x%06x\n", addr);
+		fprintf(dec->out, "32 ");
+	fprintf(dec->out, "Address=0x%06x\n", addr);
 	free(name);
 
 	return 0;
 }
 
-static int _parse_mmio_ack(FILE * fp, DBG_HEADER header)
+static int _parse_mmio_ack(struct decoder *dec, DBG_HEADER header)
 {
 	uint8_t id;
 	char *name;
 
-	if (debug_get_8(fp, &id) < 1)
+	if (debug_get_8(dec->in, &id) < 1)
 		return -1;
 	name = _afu_name(id);
 
-	printf("%s:MMIO: Ack\n", name);
+	fprintf(dec->out, "%s:MMIO: Ack\n", name);
 	free(name);
 	return 0;
 }
 
-static int _parse_mmio_return(FILE * fp, DBG_HEADER header)
+static int _parse_mmio_return(struct decoder *dec, DBG_HEADER header)
 {
 	uint16_t context;
 	uint8_t id;
 	char *name;
 
-	if (debug_get_8(fp, &id) < 1)
+	if (debug_get_8(dec->in, &id) < 1)
 		return -1;
-	if (debug_get_16(fp, &context) < 1)
+	if (debug_get_16(dec->in, &context) < 1)
 		return -1;
 	name = _afu_name(id);
 
-	printf("%s,%d:MMIO: Return\n", name, context);
+	fprintf(dec->out, "%s,%d:MMIO: Return\n", name, context);
 	free(name);
 	return 0;
 }
 
-static int _parse_cmd_add(FILE * fp, DBG_HEADER header)
+static int _parse_cmd_add(struct decoder *dec, DBG_HEADER header)
 {
 	uint16_t context, command;
 	uint8_t id, tag;
 	char *name;
 
-	if (debug_get_8(fp, &id) < 1)
+	if (debug_get_8(dec->in, &id) < 1)
 		return -1;
-	if (debug_get_8(fp, &tag) < 1)
+	if (debug_get_8(dec->in, &tag) < 1)
 		return -1;
-	if (debug_get_16(fp, &context) < 1)
+	if (debug_get_16(dec->in, &context) < 1)
 		return -1;
-	if (debug_get_16(fp, &command) < 1)
+	if (debug_get_16(dec->in, &command) < 1)
 		return -1;
 	name = _afu_name(id);
 
-	printf("%s,%d:CMD: New tag=0x%02x code=0x%04x\n", name, context,
-	       tag, command);
+	fprintf(dec->out, "%s,%d:CMD: New tag=0x%02x code=0x%04x\n", name,
+		context, tag, command);
 	free(name);
 
 	return 0;
 }
 
-static int _parse_cmd_update(FILE * fp, DBG_HEADER header)
+static int _parse_cmd_update(struct decoder *dec, DBG_HEADER header)
 {
 	uint16_t context, resp;
 	uint8_t id, tag;
 	char *name;
 
-	if (debug_get_8(fp, &id) < 1)
+	if (debug_get_8(dec->in, &id) < 1)
 		return -1;
-	if (debug_get_8(fp, &tag) < 1)
+	if (debug_get_8(dec->in, &tag) < 1)
 		return -1;
-	if (debug_get_16(fp, &context) < 1)
+	if (debug_get_16(dec->in, &context) < 1)
 		return -1;
-	if (debug_get_16(fp, &resp) < 1)
+	if (debug_get_16(dec->in, &resp) < 1)
 		return -1;
 	name = _afu_name(id);
 
-	printf("%s,%d:CMD: Update tag=0x%02x resp=0x%02x\n", name, context,
-	       tag, resp);
+	fprintf(dec->out, "%s,%d:CMD: Update tag=0x%02x resp=0x%02x\n", name,
+		context, tag, resp);
 	free(name);
 
 	return 0;
 }
 
-static int _parse_cmd_client(FILE * fp, DBG_HEADER header)
+static int _parse_cmd_client(struct decoder *dec, DBG_HEADER header)
 {
 	uint16_t context;
 	uint8_t id, tag;
 	char *name;
 
-	if (debug_get_8(fp, &id) < 1)
+	if (debug_get_8(dec->in, &id) < 1)
 		return -1;
-	if (debug_get_8(fp, &tag) < 1)
+	if (debug_get_8(dec->in, &tag) < 1)
 		return -1;
-	if (debug_get_16(fp, &context) < 1)
+	if (debug_get_16(dec->in, &context) < 1)
 		return -1;
 	name = _afu_name(id);
 
-	printf("%s,%d:CMD: Client ", name, context);
+	fprintf(dec->out, "%s,%d:CMD: Client ", name, context);
 	if (header == DBG_HEADER_CMD_CLIENT_REQ)
-		printf("Request");
+		fprintf(dec->out, "Request");
 	else
-		printf("Return");
-	printf(" tag=0x%02x\n", tag);
+		fprintf(dec->out, "Return");
+	fprintf(dec->out, " tag=0x%02x\n", tag);
 	free(name);
 
 	return 0;
 }
 
-static int _parse_cmd_buffer(FILE * fp, DBG_HEADER header)
+static int _parse_cmd_buffer(struct decoder *dec, DBG_HEADER header)
 {
 	uint8_t id, tag;
 	char *name;
 
-	if (debug_get_8(fp, &id) < 1)
+	if (debug_get_8(dec->in, &id) < 1)
 		return -1;
-	if (debug_get_8(fp, &tag) < 1)
+	if (debug_get_8(dec->in, &tag) < 1)
 		return -1;
 	name = _afu_name(id);
 
-	printf("%s:CMD: Buffer ", name);
+	fprintf(dec->out, "%s:CMD: Buffer ", name);
 	if (header == DBG_HEADER_CMD_BUFFER_WRITE)
-		printf("Write");
+		fprintf(dec->out, "Write");
 	else
-		printf("Read");
-	printf(" request tag=0x%02x\n", tag);
+		fprintf(dec->out, "Read");
+	fprintf(dec->out, " request tag=0x%02x\n", tag);
 	free(name);
 
 	return 0;
 }
 
-static int _parse_cmd_response(FILE * fp, DBG_HEADER header)
+static int _parse_cmd_response(struct decoder *dec, DBG_HEADER header)
 {
 	uint8_t id, tag;
 	char *name;
 
-	if (debug_get_8(fp, &id) < 1)
+	if (debug_get_8(dec->in, &id) < 1)
 		return -1;
-	if (debug_get_8(fp, &tag) < 1)
+	if (debug_get_8(dec->in, &tag) < 1)
 		return -1;
 	name = _afu_name(id);
 
-	printf("%s:CMD: Response tag=0x%02x\n", name, tag);
+	fprintf(dec->out, "%s:CMD: Response tag=0x%02x\n", name, tag);
 	free(name);
 
 	return 0;
 }
 
-static void _aux2_banner(int *printed, char *name)
+static void _aux2_banner(struct decoder *dec, int *printed, char *name)
 {
 	if (!(*printed))
-		printf("%s:AUX2:", name);
+		fprintf(dec->out, "%s:AUX2:", name);
 	*printed = 1;
 }
 
-static int _parse_aux(FILE * fp, DBG_HEADER header)
+static int _parse_aux(struct decoder *dec, DBG_HEADER header)
 {
 	uint64_t error = 0;
 	uint8_t aux2;
@@ -382,81 +471,81 @@ static int _parse_aux(FILE * fp, DBG_HEADER header)
 	char *name;
 	int banner = 0;
 
-	if (debug_get_8(fp, &id) < 1)
+	if (debug_get_8(dec->in, &id) < 1)
 		return -1;
-	if (debug_get_8(fp, &aux2) < 1)
+	if (debug_get_8(dec->in, &aux2) < 1)
 		return -1;
 	name = _afu_name(id);
 	if ((aux2 && DBG_AUX2_DONE) == DBG_AUX2_DONE) {
-		if (debug_get_64(fp, &error) < 1)
+		if (debug_get_64(dec->in, &error) < 1)
 			return -1;
 	}
 
-	if (latency != (aux2 & DBG_AUX2_LAT_MASK)) {
-		latency = aux2 & DBG_AUX2_LAT_MASK;
-		_aux2_banner(&banner, name);
-		printf(" brlat=%d", latency);
+	if (dec->latency != (aux2 & DBG_AUX2_LAT_MASK)) {
+		dec->latency = aux2 & DBG_AUX2_LAT_MASK;
+		_aux2_banner(dec, &banner, name);
+		fprintf(dec->out, " brlat=%d", dec->latency);
 	}
 	if ((aux2 & DBG_AUX2_PAREN) == DBG_AUX2_PAREN) {
-		if (!parity) {
-			_aux2_banner(&banner, name);
-			printf(" parity=1");
+		if (!dec->parity) {
+			_aux2_banner(dec, &banner, name);
+			fprintf(dec->out, " parity=1");
 		}
-		parity = 1;
+		dec->parity = 1;
 	} else {
-		if (parity) {
-			_aux2_banner(&banner, name);
-			printf(" parity=0");
+		if (dec->parity) {
+			_aux2_banner(dec, &banner, name);
+			fprintf(dec->out, " parity=0");
 		}
-		parity = 0;
+		dec->parity = 0;
 	}
 	if ((aux2 & DBG_AUX2_TBREQ) == DBG_AUX2_TBREQ) {
-		_aux2_banner(&banner, name);
-		printf(" tbreq");
+		_aux2_banner(dec, &banner, name);
+		fprintf(dec->out, " tbreq");
 	}
 	if ((aux2 & DBG_AUX2_LLCACK) == DBG_AUX2_LLCACK) {
-		_aux2_banner(&banner, name);
-		printf(" lcack");
+		_aux2_banner(dec, &banner, name);
+		fprintf(dec->out, " lcack");
 	}
 	if ((aux2 & DBG_AUX2_RUNNING) == DBG_AUX2_RUNNING) {
-		if (!running) {
-			_aux2_banner(&banner, name);
-			printf(" jrunning=1");
+		if (!dec->running) {
+			_aux2_banner(dec, &banner, name);
+			fprintf(dec->out, " jrunning=1");
 		}
-		running = 1;
+		dec->running = 1;
 	} else {
-		if (running) {
-			_aux2_banner(&banner, name);
-			printf(" jrunning=0");
+		if (dec->running) {
+			_aux2_banner(dec, &banner, name);
+			fprintf(dec->out, " jrunning=0");
 		}
-		running = 0;
+		dec->running = 0;
 	}
 	if ((aux2 & DBG_AUX2_DONE) == DBG_AUX2_DONE) {
-		_aux2_banner(&banner, name);
-		printf(" jdone");
+		_aux2_banner(dec, &banner, name);
+		fprintf(dec->out, " jdone");
 	}
 	if (error) {
-		_aux2_banner(&banner, name);
-		printf(" jerror=%016" PRIx64, error);
+		_aux2_banner(dec, &banner, name);
+		fprintf(dec->out, " jerror=%016" PRIx64, error);
 	}
 	if (banner)
-		printf("\n");
+		fprintf(dec->out, "\n");
 	free(name);
 
 	return 0;
 }
 
-static int _parse_socket(FILE * fp, DBG_HEADER header, int silent)
+static int _parse_socket(struct decoder *dec, DBG_HEADER header, int silent)
 {
 	uint8_t id, type;
 	uint16_t context;
 	char *name;
 
-	if (debug_get_8(fp, &id) < 1)
+	if (debug_get_8(dec->in, &id) < 1)
 		return -1;
-	if (debug_get_8(fp, &type) < 1)
+	if (debug_get_8(dec->in, &type) < 1)
 		return -1;
-	if (debug_get_16(fp, &context) < 1)
+	if (debug_get_16(dec->in, &context) < 1)
 		return -1;
 
 	if (silent)
@@ -464,180 +553,617 @@ static int _parse_socket(FILE * fp, DBG_HEADER header, int silent)
 
 	if (id != (uint8_t) - 1) {
 		name = _afu_name(id);
-		printf("%s", name);
+		fprintf(dec->out, "%s", name);
 		if (context != (uint16_t) - 1)
-			printf(",%d", context);
-		printf(":");
+			fprintf(dec->out, ",%d", context);
+		fprintf(dec->out, ":");
 		free(name);
 	}
-	printf("SOCKET ");
+	fprintf(dec->out, "SOCKET ");
 	switch (header) {
 	case DBG_HEADER_SOCKET_PUT:
-		printf("OUT: ");
+		fprintf(dec->out, "OUT: ");
 		break;
 	default:
-		printf("IN: ");
+		fprintf(dec->out, "IN: ");
 		break;
 	}
 	switch (type) {
 	case 'P':
-		printf("PSLSE");
+		fprintf(dec->out, "PSLSE");
 		break;
 	case PSLSE_CONNECT:
-		printf("CONNECT");
+		fprintf(dec->out, "CONNECT");
 		break;
 	case PSLSE_QUERY:
-		printf("QUERY");
+		fprintf(dec->out, "QUERY");
 		break;
 	case PSLSE_OPEN:
-		printf("OPEN");
+		fprintf(dec->out, "OPEN");
 		break;
 	case PSLSE_ATTACH:
-		printf("ATTACH");
+		fprintf(dec->out, "ATTACH");
 		break;
 	case PSLSE_DETACH:
-		printf("DETACH");
+		fprintf(dec->out, "DETACH");
 		break;
 	case PSLSE_MEMORY_READ:
-		printf("READ");
+		fprintf(dec->out, "READ");
 		break;
 	case PSLSE_MEMORY_WRITE:
-		printf("WRITE");
+		fprintf(dec->out, "WRITE");
 		break;
 	case PSLSE_MEMORY_TOUCH:
-		printf("TOUCH");
+		fprintf(dec->out, "TOUCH");
 		break;
 	case PSLSE_MEM_SUCCESS:
-		printf("MEM ACK");
+		fprintf(dec->out, "MEM ACK");
 		break;
 	case PSLSE_MEM_FAILURE:
-		printf("MEM FAIL");
+		fprintf(dec->out, "MEM FAIL");
 		break;
 	case PSLSE_MMIO_MAP:
-		printf("MAP");
+		fprintf(dec->out, "MAP");
 		break;
 	case PSLSE_MMIO_READ64:
-		printf("READ64");
+		fprintf(dec->out, "READ64");
 		break;
 	case PSLSE_MMIO_WRITE64:
-		printf("WRITE64");
+		fprintf(dec->out, "WRITE64");
 		break;
 	case PSLSE_MMIO_READ32:
-		printf("READ32");
+		fprintf(dec->out, "READ32");
 		break;
 	case PSLSE_MMIO_WRITE32:
-		printf("WRITE32");
+		fprintf(dec->out, "WRITE32");
 		break;
 	case PSLSE_MMIO_ACK:
-		printf("MMIO ACK");
+		fprintf(dec->out, "MMIO ACK");
 		break;
 	case PSLSE_MMIO_FAIL:
-		printf("MMIO FAIL");
+		fprintf(dec->out, "MMIO FAIL");
 		break;
 	case PSLSE_INTERRUPT:
-		printf("INTERRRUPT");
+		fprintf(dec->out, "INTERRRUPT");
 		break;
 	case PSLSE_AFU_ERROR:
-		printf("AFU ERROR");
+		fprintf(dec->out, "AFU ERROR");
+		break;
+	case PSLSE_MEM_DIRECT:
+		fprintf(dec->out, "MEM DIRECT");
+		break;
+	case PSLSE_MMIO_BATCH:
+		fprintf(dec->out, "MMIO BATCH");
 		break;
 	default:
-		printf("Unknown:0x%02x", type);
+		fprintf(dec->out, "Unknown:0x%02x", type);
 	}
-	printf("\n");
+	fprintf(dec->out, "\n");
 	return 0;
 }
 
-int main(int argc, char **argv)
+// Does a record pass the filter?  Records lacking a filtered field don't.
+static int _match(struct filter *filter, struct debug_fields *fields)
 {
-	FILE *fp;
-	DBG_HEADER header;
-	int silent;
-
-	if ((fp = fopen("debug.log", "r")) == NULL) {
-		perror("fopen:debug.log");
-		return -1;
-	}
+	if ((filter->afu != ANY) && (fields->afu != filter->afu))
+		return 0;
+	if ((filter->context != ANY) && (fields->context != filter->context))
+		return 0;
+	if ((filter->tag != ANY) && (fields->tag != filter->tag))
+		return 0;
+	if ((filter->command != ANY) && (fields->command != filter->command))
+		return 0;
+	return 1;
+}
 
-	while ((header = debug_get_header(fp)) != (DBG_HEADER) - 1) {
-		silent = 0;
+// Decode records until dec->in runs out.  base points at the records when
+// they are in memory, so the filter can look at them before decoding.
+static int _decode(struct decoder *dec, uint8_t * base, uint64_t len)
+{
+	struct debug_fields fields;
+	DBG_HEADER header;
+	FILE *out;
+	long offset;
+	int rc;
+
+	rc = 0;
+	out = dec->out;
+	offset = 0;
+	while ((header = debug_get_header(dec->in)) != (DBG_HEADER) - 1) {
+		dec->out = out;
+		if (dec->filter &&
+		    (offset + debug_record_size(header) <= len)) {
+			debug_record_fields(base + offset, &fields);
+			if (!_match(dec->filter, &fields))
+				dec->out = dec->null;
+		}
 		switch (header) {
 		case DBG_HEADER_VERSION:
-			_report_version(fp);
+			_report_version(dec);
 			break;
 		case DBG_HEADER_PARM:
-			if (_parse_parm(fp) < 0)
-				return -1;
+			rc = _parse_parm(dec);
 			break;
 		case DBG_HEADER_AFU_CONNECT:
 		case DBG_HEADER_AFU_DROP:
-			if (_parse_afu(fp, header) < 0)
-				return -1;
+			rc = _parse_afu(dec, header);
 			break;
 		case DBG_HEADER_CONTEXT_ADD:
 		case DBG_HEADER_CONTEXT_REMOVE:
-			if (_parse_context(fp, header) < 0)
-				return -1;
+			rc = _parse_context(dec, header);
 			break;
 		case DBG_HEADER_JOB_ADD:
 		case DBG_HEADER_JOB_SEND:
-			if (_parse_job(fp, header) < 0)
-				return -1;
+			rc = _parse_job(dec, header);
 			break;
 		case DBG_HEADER_JOB_AUX2:
-			if (_parse_aux(fp, header) < 0)
-				return -1;
+			rc = _parse_aux(dec, header);
 			break;
 		case DBG_HEADER_MMIO_MAP:
-			if (_parse_map(fp, header) < 0)
-				return -1;
+			rc = _parse_map(dec, header);
 			break;
 		case DBG_HEADER_MMIO_ADD:
 		case DBG_HEADER_MMIO_SEND:
-			if (_parse_mmio(fp, header) < 0)
-				return -1;
+			rc = _parse_mmio(dec, header);
 			break;
 		case DBG_HEADER_MMIO_ACK:
-			if (_parse_mmio_ack(fp, header) < 0)
-				return -1;
+			rc = _parse_mmio_ack(dec, header);
 			break;
 		case DBG_HEADER_MMIO_RETURN:
-			if (_parse_mmio_return(fp, header) < 0)
-				return -1;
+			rc = _parse_mmio_return(dec, header);
 			break;
 		case DBG_HEADER_CMD_ADD:
-			if (_parse_cmd_add(fp, header) < 0)
-				return -1;
+			rc = _parse_cmd_add(dec, header);
 			break;
 		case DBG_HEADER_CMD_UPDATE:
-			if (_parse_cmd_update(fp, header) < 0)
-				return -1;
+			rc = _parse_cmd_update(dec, header);
 			break;
 		case DBG_HEADER_CMD_CLIENT_ACK:
 		case DBG_HEADER_CMD_CLIENT_REQ:
-			if (_parse_cmd_client(fp, header) < 0)
-				return -1;
+			rc = _parse_cmd_client(dec, header);
 			break;
 		case DBG_HEADER_CMD_BUFFER_WRITE:
 		case DBG_HEADER_CMD_BUFFER_READ:
-			if (_parse_cmd_buffer(fp, header) < 0)
-				return -1;
+			rc = _parse_cmd_buffer(dec, header);
 			break;
 		case DBG_HEADER_CMD_RESPONSE:
-			if (_parse_cmd_response(fp, header) < 0)
-				return -1;
+			rc = _parse_cmd_response(dec, header);
 			break;
 		case DBG_HEADER_SOCKET_GET:
 		case DBG_HEADER_SOCKET_PUT:
-			if (_parse_socket(fp, header, silent) < 0)
-				return -1;
+			rc = _parse_socket(dec, header, 0);
+			break;
+		case DBG_HEADER_INDEX:
+		case DBG_HEADER_INDEX_END:
+		case DBG_HEADER_CYCLE:
+			fseek(dec->in,
+			      debug_record_size(header) - sizeof(header),
+			      SEEK_CUR);
 			break;
 		default:
-			printf("Bad header: %d\n", header);
-			return -1;
+			fprintf(out, "Bad header: %d\n", header);
+			rc = -1;
 		}
-		header = 0;
+		if (rc < 0)
+			break;
+		offset = ftell(dec->in);
 	}
+	dec->out = out;
+	return rc;
+}
 
-	fclose(fp);
+// Add a chunk to a growing array, returns -1 if out of memory
+static int _add_chunk(struct chunk ***chunk, int *chunks,
+		      struct debug_index *index, uint64_t end)
+{
+	struct chunk **grown;
+	struct chunk *new;
+	int size;
+
+	// Double the array each time it fills
+	if ((*chunks & (*chunks - 1)) == 0) {
+		size = *chunks ? *chunks * 2 : 1;
+		grown = (struct chunk **)realloc(*chunk,
+						 size * sizeof(struct chunk *));
+		if (grown == NULL)
+			return -1;
+		*chunk = grown;
+	}
+	if ((new = (struct chunk *)calloc(1, sizeof(struct chunk))) == NULL)
+		return -1;
+	new->index = *index;
+	new->end = end;
+	(*chunk)[*chunks] = new;
+	(*chunks)++;
 	return 0;
 }
+
+// Walk index blocks back from the INDEX_END record, -1 if there isn't one
+static int _load_index(uint8_t * map, uint64_t size, struct chunk ***chunk,
+		       int *chunks)
+{
+	struct debug_index index;
+	struct chunk *swap;
+	uint64_t block;
+	int i;
+
+	if ((size < DBG_INDEX_END_SIZE) ||
+	    (map[size - DBG_INDEX_END_SIZE] != DBG_HEADER_INDEX_END))
+		return -1;
+	memcpy(&block, map + size - sizeof(block), sizeof(block));
+	block = ntohll(block);
+	while (block != DBG_INDEX_NONE) {
+		if ((block + DBG_INDEX_SIZE > size) ||
+		    (debug_index_decode(map + block, &index) < 0) ||
+		    (index.start > block) ||
+		    (_add_chunk(chunk, chunks, &index, block) < 0))
+			return -1;
+		block = index.prev;
+	}
+	for (i = 0; i < *chunks / 2; i++) {
+		swap = (*chunk)[i];
+		(*chunk)[i] = (*chunk)[*chunks - 1 - i];
+		(*chunk)[*chunks - 1 - i] = swap;
+	}
+	for (i = 1; i < *chunks; i++)
+		(*chunk)[i]->time_min = (*chunk)[i - 1]->index.time;
+	return 0;
+}
+
+// Without an index, find chunk boundaries by stepping over records
+static int _scan_index(uint8_t * map, uint64_t size, struct chunk ***chunk,
+		       int *chunks)
+{
+	struct debug_fields fields;
+	struct debug_index index;
+	uint64_t offset;
+	uint32_t len;
+	uint8_t aux2;
+
+	aux2 = 0;
+	offset = 0;
+	debug_index_reset(&index, 0, aux2);
+	while (offset < size) {
+		if (offset - index.start >= DBG_INDEX_CHUNK) {
+			if (_add_chunk(chunk, chunks, &index, offset) < 0)
+				return -1;
+			debug_index_reset(&index, offset, aux2);
+		}
+		len = debug_record_size(map[offset]);
+		if ((len == 0) || (offset + len > size)) {
+			// Leave the bad record for the decoder to report
+			offset = size;
+			break;
+		}
+		debug_record_fields(map + offset, &fields);
+		if (map[offset] != DBG_HEADER_INDEX)
+			debug_index_add(&index, &fields);
+		if (fields.aux2 >= 0)
+			aux2 = fields.aux2;
+		offset += len;
+	}
+	if (offset > index.start)
+		return _add_chunk(chunk, chunks, &index, offset);
+	return 0;
+}
+
+// Could any record in the chunk pass the filter?
+static int _chunk_match(struct chunk *chunk, struct filter *filter,
+			int indexed)
+{
+	struct debug_index *index = &(chunk->index);
+
+	if ((filter->afu != ANY) &&
+	    !(index->afu[filter->afu / 8] & (1 << (filter->afu % 8))))
+		return 0;
+	if ((filter->tag != ANY) &&
+	    !(index->tag[filter->tag / 8] & (1 << (filter->tag % 8))))
+		return 0;
+	if ((filter->context != ANY) &&
+	    ((filter->context < index->context_min) ||
+	     (filter->context > index->context_max)))
+		return 0;
+	if (indexed && ((index->time < filter->from) ||
+			(chunk->time_min > filter->to)))
+		return 0;
+	return 1;
+}
+
+static void _decode_chunk(struct job *job, struct chunk *chunk)
+{
+	struct decoder dec;
+	uint64_t len;
+
+	memset(&dec, 0, sizeof(dec));
+	len = chunk->end - chunk->index.start;
+	dec.filter = job->filter->active ? job->filter : NULL;
+	dec.latency = chunk->index.aux2 & DBG_AUX2_LAT_MASK;
+	dec.parity = (chunk->index.aux2 & DBG_AUX2_PAREN) ? 1 : 0;
+	dec.running = (chunk->index.aux2 & DBG_AUX2_RUNNING) ? 1 : 0;
+	dec.in = fmemopen(job->map + chunk->index.start, len, "r");
+	dec.out = open_memstream(&(chunk->text), &(chunk->len));
+	dec.null = fopen("/dev/null", "w");
+	if ((dec.in == NULL) || (dec.out == NULL) || (dec.null == NULL)) {
+		perror("decode");
+		chunk->rc = -1;
+	} else {
+		chunk->rc = _decode(&dec, job->map + chunk->index.start, len);
+	}
+	if (dec.in)
+		fclose(dec.in);
+	if (dec.out)
+		fclose(dec.out);
+	if (dec.null)
+		fclose(dec.null);
+}
+
+// Decode chunks in order of index, staying at most window ahead of output
+static void *_worker(void *ptr)
+{
+	struct job *job = (struct job *)ptr;
+	struct chunk *chunk;
+
+	pthread_mutex_lock(&(job->lock));
+	while (!job->abort && (job->next < job->chunks)) {
+		if (job->next >= job->printed + job->window) {
+			pthread_cond_wait(&(job->cond), &(job->lock));
+			continue;
+		}
+		chunk = job->chunk[job->next++];
+		pthread_mutex_unlock(&(job->lock));
+		_decode_chunk(job, chunk);
+		pthread_mutex_lock(&(job->lock));
+		chunk->done = 1;
+		pthread_cond_broadcast(&(job->cond));
+	}
+	pthread_mutex_unlock(&(job->lock));
+	return NULL;
+}
+
+static int _query(char *file, struct filter *filter, int threads, int list)
+{
+	struct chunk **chunk, **all;
+	struct stat st;
+	struct job job;
+	pthread_t *thread;
+	uint8_t *map;
+	int fd, i, chunks, indexed, rc;
+
+	if ((fd = open(file, O_RDONLY)) < 0) {
+		perror(file);
+		return -1;
+	}
+	if (fstat(fd, &st) < 0) {
+		perror("fstat");
+		close(fd);
+		return -1;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+	map = (uint8_t *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+
+	all = NULL;
+	chunks = 0;
+	indexed = (_load_index(map, st.st_size, &all, &chunks) == 0);
+	if (!indexed) {
+		for (i = 0; i < chunks; i++)
+			free(all[i]);
+		chunks = 0;
+		if (_scan_index(map, st.st_size, &all, &chunks) < 0) {
+			perror("malloc");
+			return -1;
+		}
+		if (filter->to != UINT64_MAX)
+			fprintf(stderr, "No index in %s, ignoring time range\n",
+				file);
+	}
+
+	if (list) {
+		for (i = 0; i < chunks; i++) {
+			printf("chunk %d: offset=0x%" PRIx64 " bytes=%" PRIu64
+			       " records=%d", i, all[i]->index.start,
+			       all[i]->end - all[i]->index.start,
+			       all[i]->index.records);
+			if (indexed)
+				printf(" time=%.6fs",
+				       all[i]->index.time / 1000000000.0);
+			if (all[i]->index.context_min <=
+			    all[i]->index.context_max)
+				printf(" contexts=%d-%d",
+				       all[i]->index.context_min,
+				       all[i]->index.context_max);
+			printf("\n");
+		}
+	}
+
+	// Keep only chunks the filter could match
+	chunk = (struct chunk **)malloc((chunks + 1) * sizeof(struct chunk *));
+	memset(&job, 0, sizeof(job));
+	for (i = 0; i < chunks; i++) {
+		if (list || !_chunk_match(all[i], filter, indexed))
+			continue;
+		chunk[job.chunks++] = all[i];
+	}
+	job.chunk = chunk;
+	job.filter = filter;
+	job.map = map;
+	job.window = 4 * threads;
+	pthread_mutex_init(&(job.lock), NULL);
+	pthread_cond_init(&(job.cond), NULL);
+
+	thread = (pthread_t *) calloc(threads, sizeof(pthread_t));
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&(thread[i]), NULL, _worker, &job)) {
+			perror("pthread_create");
+			threads = i;
+			break;
+		}
+	}
+
+	// Print chunks in file order as they are decoded
+	rc = 0;
+	pthread_mutex_lock(&(job.lock));
+	while ((rc == 0) && (job.printed < job.chunks) && threads) {
+		if (!chunk[job.printed]->done) {
+			pthread_cond_wait(&(job.cond), &(job.lock));
+			continue;
+		}
+		pthread_mutex_unlock(&(job.lock));
+		fwrite(chunk[job.printed]->text, chunk[job.printed]->len, 1,
+		       stdout);
+		rc = chunk[job.printed]->rc;
+		free(chunk[job.printed]->text);
+		chunk[job.printed]->text = NULL;
+		pthread_mutex_lock(&(job.lock));
+		job.printed++;
+		pthread_cond_broadcast(&(job.cond));
+	}
+	job.abort = 1;
+	pthread_cond_broadcast(&(job.cond));
+	pthread_mutex_unlock(&(job.lock));
+	for (i = 0; i < threads; i++)
+		pthread_join(thread[i], NULL);
+
+	for (i = 0; i < chunks; i++) {
+		free(all[i]->text);
+		free(all[i]);
+	}
+	free(all);
+	free(chunk);
+	free(thread);
+	pthread_cond_destroy(&(job.cond));
+	pthread_mutex_destroy(&(job.lock));
+	munmap(map, st.st_size);
+	return rc;
+}
+
+// Parse "afuM.N" or a raw AFU id
+static int _parse_afu_id(char *arg)
+{
+	int major, minor;
+
+	if (sscanf(arg, "afu%d.%d", &major, &minor) == 2)
+		return ((major & 0xf) << 4) | (minor & 0xf);
+	return strtol(arg, NULL, 0) & 0xff;
+}
+
+void usage(char *name)
+{
+	printf("Usage: %s [OPTION]... [FILE]\n\n", name);
+	printf("Decode FILE, debug.log by default.  With any filter or -j\n");
+	printf("the chunks listed in the index pslse writes are decoded\n");
+	printf("in parallel.\n\n");
+	printf("  -a, --afu\t\tonly records for AFU, as afuM.N\n");
+	printf("  -c, --context\t\tonly records for context\n");
+	printf("  -t, --tag\t\tonly command records for tag\n");
+	printf("  -C, --command\t\tonly new commands with this code\n");
+	printf("  -T, --time\t\tonly chunks logged FROM[,TO] seconds\n");
+	printf("  -j, --threads\t\tdecoding threads\n");
+	printf("  -i, --index\t\tlist the chunks in the index\n");
+	printf("      --help\tdisplay this help and exit\n\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct decoder dec;
+	struct filter filter;
+	char *file, *name, *comma;
+	int opt, option_index, threads, list, rc;
+
+	name = strrchr(argv[0], '/');
+	if (name)
+		name++;
+	else
+		name = argv[0];
+
+	static struct option long_options[] = {
+		{"help",	no_argument,		0,		'h'},
+		{"afu",		required_argument,	0,		'a'},
+		{"context",	required_argument,	0,		'c'},
+		{"tag",		required_argument,	0,		't'},
+		{"command",	required_argument,	0,		'C'},
+		{"time",	required_argument,	0,		'T'},
+		{"threads",	required_argument,	0,		'j'},
+		{"index",	no_argument,		0,		'i'},
+		{NULL, 0, 0, 0}
+	};
+
+	memset(&filter, 0, sizeof(filter));
+	filter.afu = ANY;
+	filter.context = ANY;
+	filter.tag = ANY;
+	filter.command = ANY;
+	filter.to = UINT64_MAX;
+	option_index = 0;
+	threads = 0;
+	list = 0;
+	while ((opt = getopt_long (argc, argv, "ha:c:t:C:T:j:i",
+				   long_options, &option_index)) >= 0) {
+		switch (opt)
+		{
+		case 0:
+			break;
+		case 'a':
+			filter.afu = _parse_afu_id(optarg);
+			filter.active = 1;
+			break;
+		case 'c':
+			filter.context = strtol(optarg, NULL, 0) & 0xffff;
+			filter.active = 1;
+			break;
+		case 't':
+			filter.tag = strtol(optarg, NULL, 0) & 0xff;
+			filter.active = 1;
+			break;
+		case 'C':
+			filter.command = strtol(optarg, NULL, 0) & 0xffff;
+			filter.active = 1;
+			break;
+		case 'T':
+			filter.from = strtod(optarg, NULL) * 1000000000.0;
+			if ((comma = strchr(optarg, ',')) != NULL)
+				filter.to = strtod(comma + 1, NULL) *
+				    1000000000.0;
+			break;
+		case 'j':
+			threads = strtol(optarg, NULL, 0);
+			break;
+		case 'i':
+			list = 1;
+			break;
+		case 'h':
+		default:
+			usage(name);
+			return 0;
+		}
+	}
+	file = "debug.log";
+	if (optind < argc)
+		file = argv[optind];
+
+	if (filter.active || (filter.to != UINT64_MAX) || filter.from ||
+	    (threads > 0) || list) {
+		if (threads < 1)
+			threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (threads < 1)
+			threads = 1;
+		return _query(file, &filter, threads, list);
+	}
+
+	memset(&dec, 0, sizeof(dec));
+	dec.out = stdout;
+	if ((dec.in = fopen(file, "r")) == NULL) {
+		perror(file);
+		return -1;
+	}
+	rc = _decode(&dec, NULL, 0);
+	fclose(dec.in);
+	return rc;
+}
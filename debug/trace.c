@@ -0,0 +1,554 @@
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/debug.h"
+#include "../common/psl_interface_t.h"
+#include "../common/utils.h"
+
+// Convert debug.log to Chrome trace event JSON for chrome://tracing or
+// ui.perfetto.dev.  Each AFU is a process and each command tag a thread
+// track.  A command is one span from CMD_ADD to CMD_RESPONSE with a nested
+// span for each mem_state its records show it passing through.  MMIO and
+// job control records are instants on two more tracks per AFU.  Timestamps
+// are PSL cycles from the CYCLE records pslse logs.
+
+#define TAGS		256
+#define TRACK_MMIO	TAGS
+#define TRACK_JOB	(TAGS + 1)
+
+struct span {
+	uint64_t start;		// Cycle of CMD_ADD
+	uint64_t phase_start;	// Cycle the current state began
+	const char *phase;
+	uint16_t context;
+	uint16_t command;
+	int resp;
+	int open;
+};
+
+struct afu {
+	uint64_t cycle;		// Last cycle logged for this AFU
+	struct span tag[TAGS];
+	uint8_t named[(TAGS + 2 + 7) / 8];
+};
+
+struct trace {
+	FILE *out;
+	struct afu *afu[256];
+	double scale;		// Cycles per timestamp unit
+	uint64_t events;
+	uint64_t commands;
+	uint64_t unfinished;
+};
+
+static uint16_t _get16(uint8_t * buffer)
+{
+	uint16_t value;
+
+	memcpy(&value, buffer, sizeof(value));
+	return ntohs(value);
+}
+
+static uint32_t _get32(uint8_t * buffer)
+{
+	uint32_t value;
+
+	memcpy(&value, buffer, sizeof(value));
+	return ntohl(value);
+}
+
+static uint64_t _get64(uint8_t * buffer)
+{
+	uint64_t value;
+
+	memcpy(&value, buffer, sizeof(value));
+	return ntohll(value);
+}
+
+static const char *_command_name(uint16_t command)
+{
+	switch (command) {
+	case PSL_COMMAND_READ_CL_NA:
+		return "READ_CL_NA";
+	case PSL_COMMAND_READ_CL_S:
+		return "READ_CL_S";
+	case PSL_COMMAND_READ_CL_M:
+		return "READ_CL_M";
+	case PSL_COMMAND_READ_CL_LCK:
+		return "READ_CL_LCK";
+	case PSL_COMMAND_READ_CL_RES:
+		return "READ_CL_RES";
+	case PSL_COMMAND_READ_PE:
+		return "READ_PE";
+	case PSL_COMMAND_READ_PNA:
+		return "READ_PNA";
+	case PSL_COMMAND_TOUCH_I:
+		return "TOUCH_I";
+	case PSL_COMMAND_TOUCH_S:
+		return "TOUCH_S";
+	case PSL_COMMAND_TOUCH_M:
+		return "TOUCH_M";
+	case PSL_COMMAND_WRITE_MI:
+		return "WRITE_MI";
+	case PSL_COMMAND_WRITE_MS:
+		return "WRITE_MS";
+	case PSL_COMMAND_WRITE_UNLOCK:
+		return "WRITE_UNLOCK";
+	case PSL_COMMAND_WRITE_C:
+		return "WRITE_C";
+	case PSL_COMMAND_WRITE_NA:
+		return "WRITE_NA";
+	case PSL_COMMAND_WRITE_INJ:
+		return "WRITE_INJ";
+	case PSL_COMMAND_PUSH_I:
+		return "PUSH_I";
+	case PSL_COMMAND_PUSH_S:
+		return "PUSH_S";
+	case PSL_COMMAND_EVICT_I:
+		return "EVICT_I";
+	case PSL_COMMAND_FLUSH:
+		return "FLUSH";
+	case PSL_COMMAND_INTREQ:
+		return "INTREQ";
+	case PSL_COMMAND_LOCK:
+		return "LOCK";
+	case PSL_COMMAND_UNLOCK:
+		return "UNLOCK";
+	case PSL_COMMAND_RESTART:
+		return "RESTART";
+	default:
+		return "UNKNOWN";
+	}
+}
+
+static const char *_resp_name(int resp)
+{
+	switch (resp) {
+	case PSL_RESPONSE_DONE:
+		return "DONE";
+	case PSL_RESPONSE_AERROR:
+		return "AERROR";
+	case PSL_RESPONSE_DERROR:
+		return "DERROR";
+	case PSL_RESPONSE_NLOCK:
+		return "NLOCK";
+	case PSL_RESPONSE_NRES:
+		return "NRES";
+	case PSL_RESPONSE_FLUSHED:
+		return "FLUSHED";
+	case PSL_RESPONSE_FAULT:
+		return "FAULT";
+	case PSL_RESPONSE_FAILED:
+		return "FAILED";
+	case PSL_RESPONSE_PAGED:
+		return "PAGED";
+	case PSL_RESPONSE_CONTEXT:
+		return "CONTEXT";
+	default:
+		return "UNKNOWN";
+	}
+}
+
+static double _ts(struct trace *trace, uint64_t cycle)
+{
+	return cycle / trace->scale;
+}
+
+// Start the next event, separating it from the one before
+static void _event(struct trace *trace)
+{
+	if (trace->events++)
+		fprintf(trace->out, ",\n");
+}
+
+static struct afu *_afu(struct trace *trace, uint8_t id)
+{
+	struct afu *afu;
+
+	if ((afu = trace->afu[id]) != NULL)
+		return afu;
+	if ((afu = (struct afu *)calloc(1, sizeof(struct afu))) == NULL) {
+		perror("calloc");
+		exit(-1);
+	}
+	trace->afu[id] = afu;
+	_event(trace);
+	fprintf(trace->out, "{\"name\":\"process_name\",\"ph\":\"M\","
+		"\"pid\":%d,\"args\":{\"name\":\"afu%d.%d\"}}", id, id >> 4,
+		id & 0xf);
+	return afu;
+}
+
+// Name a track the first time an event lands on it
+static void _track(struct trace *trace, uint8_t id, int track)
+{
+	struct afu *afu = _afu(trace, id);
+
+	if (afu->named[track / 8] & (1 << (track % 8)))
+		return;
+	afu->named[track / 8] |= 1 << (track % 8);
+	_event(trace);
+	fprintf(trace->out, "{\"name\":\"thread_name\",\"ph\":\"M\","
+		"\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"", id, track);
+	if (track == TRACK_MMIO)
+		fprintf(trace->out, "MMIO");
+	else if (track == TRACK_JOB)
+		fprintf(trace->out, "Job");
+	else
+		fprintf(trace->out, "tag 0x%02x", track);
+	fprintf(trace->out, "\"}}");
+	_event(trace);
+	fprintf(trace->out, "{\"name\":\"thread_sort_index\",\"ph\":\"M\","
+		"\"pid\":%d,\"tid\":%d,\"args\":{\"sort_index\":%d}}", id,
+		track, track);
+}
+
+static void _instant(struct trace *trace, uint8_t id, int track,
+		     const char *name, const char *args)
+{
+	_track(trace, id, track);
+	_event(trace);
+	fprintf(trace->out, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\","
+		"\"pid\":%d,\"tid\":%d,\"ts\":%.3f", name, id, track,
+		_ts(trace, trace->afu[id]->cycle));
+	if (args != NULL)
+		fprintf(trace->out, ",\"args\":{%s}", args);
+	fprintf(trace->out, "}");
+}
+
+static void _complete(struct trace *trace, uint8_t id, int track,
+		      const char *name, const char *cat, uint64_t start,
+		      uint64_t end)
+{
+	_event(trace);
+	fprintf(trace->out, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+		"\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", name, cat,
+		id, track, _ts(trace, start), _ts(trace, end - start));
+}
+
+// End the current state span of a command and begin the next, if any
+static void _phase(struct trace *trace, uint8_t id, uint8_t tag,
+		   const char *phase)
+{
+	struct afu *afu = trace->afu[id];
+	struct span *span = &(afu->tag[tag]);
+
+	if (!span->open)
+		return;
+	if (span->phase != NULL) {
+		_complete(trace, id, tag, span->phase, "state",
+			  span->phase_start, afu->cycle);
+		fprintf(trace->out, "}");
+	}
+	span->phase = phase;
+	span->phase_start = afu->cycle;
+}
+
+static void _close(struct trace *trace, uint8_t id, uint8_t tag,
+		   int unfinished)
+{
+	struct afu *afu = trace->afu[id];
+	struct span *span = &(afu->tag[tag]);
+
+	if (!span->open)
+		return;
+	_phase(trace, id, tag, NULL);
+	_complete(trace, id, tag, _command_name(span->command), "cmd",
+		  span->start, afu->cycle);
+	fprintf(trace->out, ",\"args\":{\"context\":%d,\"code\":\"0x%04x\"",
+		span->context, span->command);
+	if (span->resp >= 0)
+		fprintf(trace->out, ",\"resp\":\"%s\"", _resp_name(span->resp));
+	if (unfinished)
+		fprintf(trace->out, ",\"unfinished\":true");
+	fprintf(trace->out, "}}");
+	span->open = 0;
+	trace->commands++;
+	if (unfinished)
+		trace->unfinished++;
+}
+
+static void _cmd(struct trace *trace, uint8_t * record)
+{
+	struct span *span;
+	uint8_t id, tag;
+
+	id = record[1];
+	tag = record[2];
+	span = &(_afu(trace, id)->tag[tag]);
+	switch (record[0]) {
+	case DBG_HEADER_CMD_ADD:
+		_close(trace, id, tag, 1);
+		_track(trace, id, tag);
+		span->open = 1;
+		span->start = trace->afu[id]->cycle;
+		span->context = _get16(record + 3);
+		span->command = _get16(record + 5);
+		span->resp = -1;
+		span->phase = NULL;
+		_phase(trace, id, tag, "MEM_IDLE");
+		break;
+	case DBG_HEADER_CMD_BUFFER_READ:
+		_phase(trace, id, tag, "MEM_BUFFER");
+		break;
+	case DBG_HEADER_CMD_CLIENT_REQ:
+		_phase(trace, id, tag, "MEM_REQUEST");
+		break;
+	case DBG_HEADER_CMD_CLIENT_ACK:
+		_phase(trace, id, tag, "MEM_RECEIVED");
+		break;
+	case DBG_HEADER_CMD_BUFFER_WRITE:
+		if (span->open)
+			_instant(trace, id, tag, "buffer write", NULL);
+		break;
+	case DBG_HEADER_CMD_UPDATE:
+		span->resp = _get16(record + 5);
+		_phase(trace, id, tag, "MEM_DONE");
+		break;
+	case DBG_HEADER_CMD_RESPONSE:
+		_close(trace, id, tag, 0);
+		break;
+	default:
+		break;
+	}
+}
+
+static void _mmio(struct trace *trace, uint8_t * record)
+{
+	char args[64];
+	const char *name;
+	uint16_t context;
+	uint8_t id;
+
+	id = record[1];
+	_afu(trace, id);
+	switch (record[0]) {
+	case DBG_HEADER_MMIO_MAP:
+		snprintf(args, sizeof(args), "\"context\":%d",
+			 _get16(record + 2));
+		_instant(trace, id, TRACK_MMIO, "map", args);
+		break;
+	case DBG_HEADER_MMIO_ADD:
+	case DBG_HEADER_MMIO_SEND:
+		if (record[2])
+			name = record[3] ? "read64" : "read32";
+		else
+			name = record[3] ? "write64" : "write32";
+		context = _get16(record + 4);
+		snprintf(args, sizeof(args),
+			 "\"context\":%d,\"addr\":\"0x%06x\",\"%s\":true",
+			 (int16_t) context, _get32(record + 6),
+			 (record[0] == DBG_HEADER_MMIO_ADD) ? "add" : "send");
+		_instant(trace, id, TRACK_MMIO, name, args);
+		break;
+	case DBG_HEADER_MMIO_ACK:
+		_instant(trace, id, TRACK_MMIO, "ack", NULL);
+		break;
+	case DBG_HEADER_MMIO_RETURN:
+		snprintf(args, sizeof(args), "\"context\":%d",
+			 _get16(record + 2));
+		_instant(trace, id, TRACK_MMIO, "return", args);
+		break;
+	default:
+		break;
+	}
+}
+
+static void _job(struct trace *trace, uint8_t * record)
+{
+	char args[64], name[32];
+	uint32_t code;
+	uint8_t id;
+
+	id = record[1];
+	_afu(trace, id);
+	switch (record[0]) {
+	case DBG_HEADER_JOB_ADD:
+	case DBG_HEADER_JOB_SEND:
+		code = _get32(record + 2);
+		if (code == PSL_JOB_START)
+			sprintf(name, "START");
+		else if (code == PSL_JOB_RESET)
+			sprintf(name, "RESET");
+		else
+			sprintf(name, "0x%08x", code);
+		snprintf(args, sizeof(args), "\"%s\":true",
+			 (record[0] == DBG_HEADER_JOB_ADD) ? "add" : "send");
+		_instant(trace, id, TRACK_JOB, name, args);
+		break;
+	case DBG_HEADER_JOB_AUX2:
+		snprintf(args, sizeof(args), "\"aux2\":\"0x%02x\"", record[2]);
+		_instant(trace, id, TRACK_JOB, "aux2", args);
+		break;
+	case DBG_HEADER_CONTEXT_ADD:
+	case DBG_HEADER_CONTEXT_REMOVE:
+		snprintf(args, sizeof(args), "\"context\":%d",
+			 _get16(record + 2));
+		_instant(trace, id, TRACK_JOB,
+			 (record[0] == DBG_HEADER_CONTEXT_ADD) ?
+			 "context add" : "context remove", args);
+		break;
+	case DBG_HEADER_AFU_CONNECT:
+		_instant(trace, id, TRACK_JOB, "connect", NULL);
+		break;
+	case DBG_HEADER_AFU_DROP:
+		_instant(trace, id, TRACK_JOB, "disconnect", NULL);
+		break;
+	default:
+		break;
+	}
+}
+
+static int _convert(struct trace *trace, FILE * in)
+{
+	uint8_t record[DBG_INDEX_SIZE];
+	DBG_HEADER header;
+	uint32_t size;
+	int id, tag, cycles;
+
+	cycles = 0;
+	while ((header = debug_get_header(in)) != (DBG_HEADER) - 1) {
+		if ((size = debug_record_size(header)) == 0) {
+			error_msg("Bad header: %d", header);
+			return -1;
+		}
+		record[0] = header;
+		if (fread(record + 1, size - 1, 1, in) != 1) {
+			warn_msg("Log ends in a partial record");
+			break;
+		}
+		switch (header) {
+		case DBG_HEADER_CYCLE:
+			_afu(trace, record[1])->cycle = _get64(record + 2);
+			cycles++;
+			break;
+		case DBG_HEADER_CMD_ADD:
+		case DBG_HEADER_CMD_UPDATE:
+		case DBG_HEADER_CMD_CLIENT_REQ:
+		case DBG_HEADER_CMD_CLIENT_ACK:
+		case DBG_HEADER_CMD_BUFFER_WRITE:
+		case DBG_HEADER_CMD_BUFFER_READ:
+		case DBG_HEADER_CMD_RESPONSE:
+			_cmd(trace, record);
+			break;
+		case DBG_HEADER_MMIO_MAP:
+		case DBG_HEADER_MMIO_ADD:
+		case DBG_HEADER_MMIO_SEND:
+		case DBG_HEADER_MMIO_ACK:
+		case DBG_HEADER_MMIO_RETURN:
+			_mmio(trace, record);
+			break;
+		case DBG_HEADER_JOB_ADD:
+		case DBG_HEADER_JOB_SEND:
+		case DBG_HEADER_JOB_AUX2:
+		case DBG_HEADER_CONTEXT_ADD:
+		case DBG_HEADER_CONTEXT_REMOVE:
+		case DBG_HEADER_AFU_CONNECT:
+		case DBG_HEADER_AFU_DROP:
+			_job(trace, record);
+			break;
+		default:
+			break;
+		}
+	}
+	if (!cycles)
+		warn_msg("No CYCLE records, all events will be at cycle 0");
+
+	// Commands still outstanding run to the last cycle seen
+	for (id = 0; id < 256; id++) {
+		if (trace->afu[id] == NULL)
+			continue;
+		for (tag = 0; tag < TAGS; tag++)
+			_close(trace, id, tag, 1);
+		free(trace->afu[id]);
+	}
+	return 0;
+}
+
+void usage(char *name)
+{
+	printf("Usage: %s [OPTION]... [FILE]\n\n", name);
+	printf("Convert FILE, debug.log by default, to Chrome trace event\n");
+	printf("JSON.  Load it in chrome://tracing or ui.perfetto.dev.\n\n");
+	printf("  -o, --output\t\twrite to file instead of stdout\n");
+	printf("  -f, --freq\t\tPSL clock in MHz to convert cycles to us,\n");
+	printf("\t\t\tone cycle per us by default\n");
+	printf("      --help\tdisplay this help and exit\n\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct trace trace;
+	char *file, *output, *name;
+	FILE *in;
+	int opt, option_index, rc;
+
+	name = strrchr(argv[0], '/');
+	if (name)
+		name++;
+	else
+		name = argv[0];
+
+	static struct option long_options[] = {
+		{"help",	no_argument,		0,		'h'},
+		{"output",	required_argument,	0,		'o'},
+		{"freq",	required_argument,	0,		'f'},
+		{NULL, 0, 0, 0}
+	};
+
+	memset(&trace, 0, sizeof(trace));
+	trace.scale = 1.0;
+	output = NULL;
+	option_index = 0;
+	while ((opt = getopt_long (argc, argv, "ho:f:",
+				   long_options, &option_index)) >= 0) {
+		switch (opt)
+		{
+		case 0:
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'f':
+			trace.scale = strtod(optarg, NULL);
+			if (trace.scale <= 0.0)
+				trace.scale = 1.0;
+			break;
+		case 'h':
+		default:
+			usage(name);
+			return 0;
+		}
+	}
+	file = "debug.log";
+	if (optind < argc)
+		file = argv[optind];
+
+	if ((in = fopen(file, "r")) == NULL) {
+		perror(file);
+		return -1;
+	}
+	trace.out = stdout;
+	if ((output != NULL) && ((trace.out = fopen(output, "w")) == NULL)) {
+		perror(output);
+		fclose(in);
+		return -1;
+	}
+
+	fprintf(trace.out, "{\"displayTimeUnit\":\"ns\",\"otherData\":{"
+		"\"source\":\"%s\",\"clock\":\"PSL cycles\",\"cycles_per_us\":"
+		"%g},\n\"traceEvents\":[\n", file, trace.scale);
+	rc = _convert(&trace, in);
+	fprintf(trace.out, "\n]}\n");
+	fclose(in);
+	if (output != NULL)
+		fclose(trace.out);
+	// Keep stdout pure JSON when the trace goes there
+	if ((rc == 0) && (output != NULL))
+		info_msg("%" PRIu64 " commands, %" PRIu64 " unfinished",
+			 trace.commands, trace.unfinished);
+	return rc;
+}
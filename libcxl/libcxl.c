@@ -17,6 +17,7 @@
 #include <arpa/inet.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <netdb.h>
 #include <netinet/in.h>
@@ -26,11 +27,13 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "libcxl.h"
 #include "libcxl_internal.h"
+#include "../common/psl_interface.h"
 #include "../common/utils.h"
 
 #define API_VERSION            1
@@ -52,14 +55,6 @@
 
 #define DSISR 0x4000000040000000L
 
-static int _delay_1ms()
-{
-	struct timespec ts;
-	ts.tv_sec = 0;
-	ts.tv_nsec = 1000000;
-	return nanosleep(&ts, &ts);
-}
-
 static int _testmemaddr(uint8_t * memaddr)
 {
 	int fd[2];
@@ -75,10 +70,62 @@ static int _testmemaddr(uint8_t * memaddr)
 	return ret;
 }
 
+// Release what _new_afu() set up for talking to _psl_loop
+static void _free_afu_sync(struct cxl_afu_h *afu)
+{
+	pthread_mutex_destroy(&(afu->event_lock));
+	pthread_mutex_destroy(&(afu->req_lock));
+	pthread_cond_destroy(&(afu->req_cond));
+	close(afu->wake[0]);
+	close(afu->wake[1]);
+	close(afu->pipe[0]);
+	close(afu->pipe[1]);
+	free(afu->events.slot);
+	free((void *)afu->events.irq_pending);
+}
+
+// Wake _psl_loop from its poll() so it sends a new request right away
+static void _wake(struct cxl_afu_h *afu)
+{
+	uint8_t byte = 0;
+
+	if (write(afu->wake[1], &byte, 1) < 0)
+		warn_msg("Failed to wake libcxl PSL thread");
+}
+
+// Hand a request to _psl_loop
+static void _req_post(struct cxl_afu_h *afu,
+		      volatile enum libcxl_req_state *state)
+{
+	*state = LIBCXL_REQ_REQUEST;
+	_wake(afu);
+}
+
+// Block until _psl_loop has completed a request
+static void _req_wait(struct cxl_afu_h *afu,
+		      volatile enum libcxl_req_state *state)
+{
+	pthread_mutex_lock(&(afu->req_lock));
+	while (*state != LIBCXL_REQ_IDLE)
+		pthread_cond_wait(&(afu->req_cond), &(afu->req_lock));
+	pthread_mutex_unlock(&(afu->req_lock));
+}
+
+// Complete a request and release the caller waiting on it
+static void _req_done(struct cxl_afu_h *afu,
+		      volatile enum libcxl_req_state *state)
+{
+	pthread_mutex_lock(&(afu->req_lock));
+	*state = LIBCXL_REQ_IDLE;
+	pthread_cond_broadcast(&(afu->req_cond));
+	pthread_mutex_unlock(&(afu->req_lock));
+}
+
 static void _all_idle(struct cxl_afu_h *afu)
 {
 	if (!afu)
 		fatal_msg("NULL afu passed to libcxl.c:_all_idle");
+	pthread_mutex_lock(&(afu->req_lock));
 	afu->int_req.state = LIBCXL_REQ_IDLE;
 	afu->open.state = LIBCXL_REQ_IDLE;
 	afu->attach.state = LIBCXL_REQ_IDLE;
@@ -86,49 +133,166 @@ static void _all_idle(struct cxl_afu_h *afu)
 	afu->mapped = 0;
 	afu->attached = 0;
 	afu->opened = 0;
+	pthread_cond_broadcast(&(afu->req_cond));
+	pthread_mutex_unlock(&(afu->req_lock));
 }
 
-static int _handle_dsi(struct cxl_afu_h *afu, uint64_t addr)
+// Wait for input from PSLSE or a wake up from _req_post().  Returns 1 when
+// the socket has data, 0 on wake up or timeout and -1 on disconnect.
+static int _psl_wait(struct cxl_afu_h *afu, int timeout)
 {
-	uint16_t size;
-	int i;
+	struct pollfd pfd[2];
+	uint8_t drain[16];
+	int rc;
 
-	if (!afu)
-		fatal_msg("NULL afu passed to libcxl.c:_handle_dsi");
-	// Only track a single DSI at a time
-	pthread_mutex_lock(&(afu->event_lock));
-	i = 0;
-	while (afu->events[i] != NULL) {
-		if (afu->events[i]->header.type == CXL_EVENT_DATA_STORAGE) {
-			pthread_mutex_unlock(&(afu->event_lock));
-			return 0;
-		}
-		++i;
+	pfd[0].fd = afu->fd;
+	pfd[0].events = POLLIN | POLLHUP;
+	pfd[0].revents = 0;
+	pfd[1].fd = afu->wake[0];
+	pfd[1].events = POLLIN;
+	pfd[1].revents = 0;
+	do {
+		rc = poll(pfd, 2, timeout);
+	}
+	while ((rc < 0) && (errno == EINTR));
+	if (rc < 0)
+		return -1;
+	if (pfd[1].revents & POLLIN) {
+		while (read(afu->wake[0], drain, sizeof(drain)) > 0) ;
 	}
-	assert(i < EVENT_QUEUE_MAX);
+	if (pfd[0].revents & POLLHUP)
+		return -1;
+	if (pfd[0].revents & POLLIN)
+		return 1;
+	return 0;
+}
 
-	size = sizeof(struct cxl_event_header) +
-	    sizeof(struct cxl_event_data_storage);
-	afu->events[i] = (struct cxl_event *)calloc(1, size);
-	afu->events[i]->header.type = CXL_EVENT_DATA_STORAGE;
-	afu->events[i]->header.size = size;
-	afu->events[i]->header.process_element = afu->context;
-	afu->events[i]->fault.addr = addr & FOURK_MASK;
-	afu->events[i]->fault.dsisr = DSISR;
+// Size the event ring for the IRQs this context can raise.  Called by
+// _psl_loop before attaching so no events can be in flight.
+static int _event_ring_init(struct cxl_afu_h *afu)
+{
+	struct event_ring *ring = &(afu->events);
+	uint32_t slots;
+
+	slots = 4;
+	while (slots < (uint32_t) afu->irqs_max + 3)
+		slots <<= 1;
+	if ((ring->slot != NULL) && (ring->mask + 1 >= slots) &&
+	    (ring->irqs >= afu->irqs_max))
+		return 0;
+	free(ring->slot);
+	free((void *)ring->irq_pending);
+	ring->slot = (struct cxl_event *)calloc(slots, sizeof(struct cxl_event));
+	ring->irq_pending = (uint8_t *) calloc(afu->irqs_max + 1, 1);
+	if ((ring->slot == NULL) || (ring->irq_pending == NULL)) {
+		free(ring->slot);
+		free((void *)ring->irq_pending);
+		ring->slot = NULL;
+		ring->irq_pending = NULL;
+		errno = ENOMEM;
+		return -1;
+	}
+	ring->mask = slots - 1;
+	ring->irqs = afu->irqs_max;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->dsi_pending = 0;
+	ring->error_pending = 0;
+	return 0;
+}
+
+static volatile uint8_t *_event_pending(struct event_ring *ring,
+					struct cxl_event *event)
+{
+	switch (event->header.type) {
+	case CXL_EVENT_AFU_INTERRUPT:
+		if (event->irq.irq > ring->irqs)
+			return &(ring->irq_pending[0]);
+		return &(ring->irq_pending[event->irq.irq]);
+	case CXL_EVENT_DATA_STORAGE:
+		return &(ring->dsi_pending);
+	case CXL_EVENT_AFU_ERROR:
+		return &(ring->error_pending);
+	default:
+		return NULL;
+	}
+}
+
+// Queue event for cxl_read_event() and make cxl_afu_fd() readable.  An event
+// of the same kind that is still unread absorbs this one.  Only _psl_loop
+// adds events so no lock is needed here.
+static int _event_post(struct cxl_afu_h *afu, struct cxl_event *event)
+{
+	struct event_ring *ring = &(afu->events);
+	volatile uint8_t *pending;
+	uint32_t tail;
+	uint8_t type;
+	int rc;
 
+	if ((ring->slot == NULL) || ((pending = _event_pending(ring, event)) ==
+				     NULL)) {
+		warn_msg("Dropping AFU event type %d",
+			 event->header.type);
+		return 0;
+	}
+	if (__atomic_exchange_n(pending, 1, __ATOMIC_SEQ_CST)) {
+		++ring->coalesced;
+		return 0;
+	}
+	tail = ring->tail;
+	if (tail - __atomic_load_n(&(ring->head), __ATOMIC_ACQUIRE) > ring->mask)
+		fatal_msg("libcxl event ring overflow");
+	memcpy(&(ring->slot[tail & ring->mask]), event, event->header.size);
+	__atomic_store_n(&(ring->tail), tail + 1, __ATOMIC_RELEASE);
+
+	type = event->header.type;
 	do {
-		i = write(afu->pipe[1], &(afu->events[i]->header.type), 1);
+		rc = write(afu->pipe[1], &type, 1);
 	}
-	while ((i == 0) || (errno == EINTR));
-	pthread_mutex_unlock(&(afu->event_lock));
-	return i;
+	while ((rc < 0) && (errno == EINTR));
+	return rc;
+}
+
+// Take the oldest event off the ring, caller holds event_lock.  The pending
+// flag is cleared before the copy so an event arriving during the copy is
+// queued again rather than coalesced into one already read.
+static int _event_get(struct cxl_afu_h *afu, struct cxl_event *event)
+{
+	struct event_ring *ring = &(afu->events);
+	struct cxl_event *slot;
+	uint32_t head;
+
+	head = ring->head;
+	if (head == __atomic_load_n(&(ring->tail), __ATOMIC_ACQUIRE))
+		return 0;
+	slot = &(ring->slot[head & ring->mask]);
+	__atomic_store_n(_event_pending(ring, slot), 0, __ATOMIC_SEQ_CST);
+	memcpy(event, slot, slot->header.size);
+	__atomic_store_n(&(ring->head), head + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+static int _handle_dsi(struct cxl_afu_h *afu, uint64_t addr)
+{
+	struct cxl_event event;
+
+	if (!afu)
+		fatal_msg("NULL afu passed to libcxl.c:_handle_dsi");
+	memset(&event, 0, sizeof(event));
+	event.header.type = CXL_EVENT_DATA_STORAGE;
+	event.header.size = sizeof(struct cxl_event_header) +
+	    sizeof(struct cxl_event_data_storage);
+	event.header.process_element = afu->context;
+	event.fault.addr = addr & FOURK_MASK;
+	event.fault.dsisr = DSISR;
+	return _event_post(afu, &event);
 }
 
 static int _handle_interrupt(struct cxl_afu_h *afu)
 {
-	uint16_t size, irq;
+	struct cxl_event event;
+	uint16_t irq;
 	uint8_t data[sizeof(irq)];
-	int i;
 
 	if (!afu)
 		fatal_msg("NULL afu passed to libcxl.c:_handle_interrupt");
@@ -140,41 +304,24 @@ static int _handle_interrupt(struct cxl_afu_h *afu)
 	}
 	memcpy(&irq, data, sizeof(irq));
 	irq = ntohs(irq);
+	if (!irq || (irq > afu->irqs_max))
+		warn_msg("AFU interrupt %d outside of 1 to %ld", irq,
+			 afu->irqs_max);
 
-	// Only track a single interrupt at a time
-	pthread_mutex_lock(&(afu->event_lock));
-	i = 0;
-	while (afu->events[i] != NULL) {
-		if (afu->events[i]->header.type == CXL_EVENT_AFU_INTERRUPT) {
-			pthread_mutex_unlock(&(afu->event_lock));
-			return 0;
-		}
-		++i;
-	}
-	assert(i < EVENT_QUEUE_MAX);
-
-	size = sizeof(struct cxl_event_header) +
+	memset(&event, 0, sizeof(event));
+	event.header.type = CXL_EVENT_AFU_INTERRUPT;
+	event.header.size = sizeof(struct cxl_event_header) +
 	    sizeof(struct cxl_event_afu_interrupt);
-	afu->events[i] = (struct cxl_event *)calloc(1, size);
-	afu->events[i]->header.type = CXL_EVENT_AFU_INTERRUPT;
-	afu->events[i]->header.size = size;
-	afu->events[i]->header.process_element = afu->context;
-	afu->events[i]->irq.irq = irq;
-
-	do {
-		i = write(afu->pipe[1], &(afu->events[i]->header.type), 1);
-	}
-	while ((i == 0) || (errno == EINTR));
-	pthread_mutex_unlock(&(afu->event_lock));
-	return i;
+	event.header.process_element = afu->context;
+	event.irq.irq = irq;
+	return _event_post(afu, &event);
 }
 
 static int _handle_afu_error(struct cxl_afu_h *afu)
 {
+	struct cxl_event event;
 	uint64_t error;
-	uint16_t size;
 	uint8_t data[sizeof(error)];
-	int i;
 
 	if (!afu)
 		fatal_msg("NULL afu passed to libcxl.c:_handle_afu_error");
@@ -187,35 +334,17 @@ static int _handle_afu_error(struct cxl_afu_h *afu)
 	memcpy(&error, data, sizeof(error));
 	error = ntohll(error);
 
-	// Only track a single AFU error at a time
-	pthread_mutex_lock(&(afu->event_lock));
-	i = 0;
-	while (afu->events[i] != NULL) {
-		if (afu->events[i]->header.type == CXL_EVENT_AFU_ERROR) {
-			pthread_mutex_unlock(&(afu->event_lock));
-			return 0;
-		}
-		++i;
-	}
-	assert(i < EVENT_QUEUE_MAX);
-
-	size = sizeof(struct cxl_event_header) +
+	memset(&event, 0, sizeof(event));
+	event.header.type = CXL_EVENT_AFU_ERROR;
+	event.header.size = sizeof(struct cxl_event_header) +
 	    sizeof(struct cxl_event_afu_error);
-	afu->events[i] = (struct cxl_event *)calloc(1, size);
-	afu->events[i]->header.type = CXL_EVENT_AFU_ERROR;
-	afu->events[i]->header.size = size;
-	afu->events[i]->header.process_element = afu->context;
-	afu->events[i]->afu_error.error = error;
-
-	do {
-		i = write(afu->pipe[1], &(afu->events[i]->header.type), 1);
-	}
-	while ((i == 0) || (errno == EINTR));
-	pthread_mutex_unlock(&(afu->event_lock));
-	return i;
+	event.header.process_element = afu->context;
+	event.afu_error.error = error;
+	return _event_post(afu, &event);
 }
 
-static void _handle_read(struct cxl_afu_h *afu, uint64_t addr, uint8_t size)
+static void _handle_read(struct cxl_afu_h *afu, uint8_t tag, uint64_t addr,
+			 uint8_t size)
 {
 	uint8_t buffer[MAX_LINE_CHARS];
 
@@ -228,25 +357,27 @@ static void _handle_read(struct cxl_afu_h *afu, uint64_t addr, uint8_t size)
 		}
 		DPRINTF("READ from invalid addr @ 0x%016" PRIx64 "\n", addr);
 		buffer[0] = (uint8_t) PSLSE_MEM_FAILURE;
-		if (put_bytes_silent(afu->fd, 1, buffer) != 1) {
+		buffer[1] = tag;
+		if (put_bytes_silent(afu->fd, 2, buffer) != 2) {
 			afu->opened = 0;
 			afu->attached = 0;
 		}
 		return;
 	}
 	buffer[0] = PSLSE_MEM_SUCCESS;
-	memcpy(&(buffer[1]), (void *)addr, size);
-	if (put_bytes_silent(afu->fd, size + 1, buffer) != size + 1) {
+	buffer[1] = tag;
+	memcpy(&(buffer[2]), (void *)addr, size);
+	if (put_bytes_silent(afu->fd, size + 2, buffer) != size + 2) {
 		afu->opened = 0;
 		afu->attached = 0;
 	}
 	DPRINTF("READ from addr @ 0x%016" PRIx64 "\n", addr);
 }
 
-static void _handle_write(struct cxl_afu_h *afu, uint64_t addr, uint8_t size,
-			  uint8_t * data)
+static void _handle_write(struct cxl_afu_h *afu, uint8_t tag, uint64_t addr,
+			  uint8_t size, uint8_t * data)
 {
-	uint8_t buffer;
+	uint8_t buffer[2];
 
 	if (!afu)
 		fatal_msg("NULL afu passed to libcxl.c:_handle_write");
@@ -256,25 +387,28 @@ static void _handle_write(struct cxl_afu_h *afu, uint64_t addr, uint8_t size,
 			return;
 		}
 		DPRINTF("WRITE to invalid addr @ 0x%016" PRIx64 "\n", addr);
-		buffer = PSLSE_MEM_FAILURE;
-		if (put_bytes_silent(afu->fd, 1, &buffer) != 1) {
+		buffer[0] = PSLSE_MEM_FAILURE;
+		buffer[1] = tag;
+		if (put_bytes_silent(afu->fd, 2, buffer) != 2) {
 			afu->opened = 0;
 			afu->attached = 0;
 		}
 		return;
 	}
 	memcpy((void *)addr, data, size);
-	buffer = PSLSE_MEM_SUCCESS;
-	if (put_bytes_silent(afu->fd, 1, &buffer) != 1) {
+	buffer[0] = PSLSE_MEM_SUCCESS;
+	buffer[1] = tag;
+	if (put_bytes_silent(afu->fd, 2, buffer) != 2) {
 		afu->opened = 0;
 		afu->attached = 0;
 	}
 	DPRINTF("WRITE to addr @ 0x%016" PRIx64 "\n", addr);
 }
 
-static void _handle_touch(struct cxl_afu_h *afu, uint64_t addr, uint8_t size)
+static void _handle_touch(struct cxl_afu_h *afu, uint8_t tag, uint64_t addr,
+			  uint8_t size)
 {
-	uint8_t buffer;
+	uint8_t buffer[2];
 
 	if (!afu)
 		fatal_msg("NULL afu passed to libcxl.c:_handle_touch");
@@ -284,15 +418,17 @@ static void _handle_touch(struct cxl_afu_h *afu, uint64_t addr, uint8_t size)
 			return;
 		}
 		DPRINTF("TOUCH of invalid addr @ 0x%016" PRIx64 "\n", addr);
-		buffer = (uint8_t) PSLSE_MEM_FAILURE;
-		if (put_bytes_silent(afu->fd, 1, &buffer) != 1) {
+		buffer[0] = (uint8_t) PSLSE_MEM_FAILURE;
+		buffer[1] = tag;
+		if (put_bytes_silent(afu->fd, 2, buffer) != 2) {
 			afu->opened = 0;
 			afu->attached = 0;
 		}
 		return;
 	}
-	buffer = PSLSE_MEM_SUCCESS;
-	if (put_bytes_silent(afu->fd, 1, &buffer) != 1) {
+	buffer[0] = PSLSE_MEM_SUCCESS;
+	buffer[1] = tag;
+	if (put_bytes_silent(afu->fd, 2, buffer) != 2) {
 		afu->opened = 0;
 		afu->attached = 0;
 	}
@@ -302,10 +438,29 @@ static void _handle_touch(struct cxl_afu_h *afu, uint64_t addr, uint8_t size)
 static void _handle_ack(struct cxl_afu_h *afu)
 {
 	uint8_t data[sizeof(uint64_t)];
+	uint64_t value;
+	int i;
 
 	if (!afu)
 		fatal_msg("NULL afu passed to libcxl.c:_handle_ack");
 	DPRINTF("MMIO ACK\n");
+	if (afu->mmio.type == PSLSE_MMIO_BATCH) {
+		// 8 bytes per access, only used for reads
+		for (i = 0; i < afu->mmio.count; i++) {
+			if (get_bytes_silent(afu->fd, sizeof(uint64_t), data,
+					     1000, 0) < 0) {
+				warn_msg("Socket failure getting MMIO batch Ack");
+				_all_idle(afu);
+				return;
+			}
+			memcpy(&value, data, sizeof(uint64_t));
+			value = ntohll(value);
+			if (afu->mmio.ops[i].op == CXL_MMIO_OP_READ64)
+				afu->mmio.ops[i].data = value;
+			if (afu->mmio.ops[i].op == CXL_MMIO_OP_READ32)
+				afu->mmio.ops[i].data = (uint32_t) value;
+		}
+	}
 	if (afu->mmio.type == PSLSE_MMIO_READ64) {
 		if (get_bytes_silent(afu->fd, sizeof(uint64_t), data, 1000, 0) <
 		    0) {
@@ -330,7 +485,7 @@ static void _handle_ack(struct cxl_afu_h *afu)
 			debug_msg("KEM:0x%08x", afu->mmio.data);
 		}
 	}
-	afu->mmio.state = LIBCXL_REQ_IDLE;
+	_req_done(afu, &(afu->mmio.state));
 }
 
 static void _req_max_int(struct cxl_afu_h *afu)
@@ -357,6 +512,39 @@ static void _req_max_int(struct cxl_afu_h *afu)
 	afu->int_req.state = LIBCXL_REQ_PENDING;
 }
 
+// Offer PSLSE direct access to our memory when it runs on the same host.
+// PSLSE reads mem_token back through our pid to prove it can.  Set
+// PSLSE_MEM_DIRECT=0 to keep all memory traffic on the socket.
+static void _pslse_mem_direct(struct cxl_afu_h *afu)
+{
+	uint8_t buffer[1 + sizeof(uint32_t) + 2 * sizeof(uint64_t)];
+	struct timespec now;
+	uint64_t value;
+	uint32_t pid;
+	char *env;
+
+	env = getenv("PSLSE_MEM_DIRECT");
+	if (env && (strcmp(env, "0") == 0))
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	afu->mem_token = ((uint64_t) now.tv_sec << 32) ^ now.tv_nsec ^
+	    (uint64_t) afu;
+	buffer[0] = PSLSE_MEM_DIRECT;
+	pid = htonl((uint32_t) getpid());
+	memcpy(&(buffer[1]), &pid, sizeof(pid));
+	value = htonll((uint64_t) & (afu->mem_token));
+	memcpy(&(buffer[1 + sizeof(pid)]), &value, sizeof(value));
+	value = htonll(afu->mem_token);
+	memcpy(&(buffer[1 + sizeof(pid) + sizeof(value)]), &value,
+	       sizeof(value));
+	if (put_bytes_silent(afu->fd, sizeof(buffer), buffer) !=
+	    sizeof(buffer)) {
+		afu->opened = 0;
+		afu->attached = 0;
+	}
+}
+
 static void _pslse_attach(struct cxl_afu_h *afu)
 {
 	uint8_t *buffer;
@@ -365,6 +553,15 @@ static void _pslse_attach(struct cxl_afu_h *afu)
 
 	if (!afu)
 		fatal_msg("NULL afu passed to libcxl.c:_pslse_attach");
+	if (_event_ring_init(afu) < 0) {
+		warn_msg("Unable to allocate event ring for %ld IRQs",
+			 afu->irqs_max);
+		close_socket(&(afu->fd));
+		afu->opened = 0;
+		afu->attached = 0;
+		_req_done(afu, &(afu->attach.state));
+		return;
+	}
 	size = 1 + sizeof(uint64_t);
 	buffer = (uint8_t *) malloc(size);
 	buffer[0] = PSLSE_ATTACH;
@@ -376,11 +573,12 @@ static void _pslse_attach(struct cxl_afu_h *afu)
 		close_socket(&(afu->fd));
 		afu->opened = 0;
 		afu->attached = 0;
-		afu->attach.state = LIBCXL_REQ_IDLE;
+		_req_done(afu, &(afu->attach.state));
 		return;
 	}
 	free(buffer);
 	afu->attach.state = LIBCXL_REQ_PENDING;
+	_pslse_mem_direct(afu);
 }
 
 static void _mmio_map(struct cxl_afu_h *afu)
@@ -403,7 +601,7 @@ static void _mmio_map(struct cxl_afu_h *afu)
 		close_socket(&(afu->fd));
 		afu->opened = 0;
 		afu->attached = 0;
-		afu->mmio.state = LIBCXL_REQ_IDLE;
+		_req_done(afu, &(afu->mmio.state));
 		return;
 	}
 	free(buffer);
@@ -433,7 +631,7 @@ static void _mmio_write64(struct cxl_afu_h *afu)
 		close_socket(&(afu->fd));
 		afu->opened = 0;
 		afu->attached = 0;
-		afu->mmio.state = LIBCXL_REQ_IDLE;
+		_req_done(afu, &(afu->mmio.state));
 		return;
 	}
 	free(buffer);
@@ -463,7 +661,59 @@ static void _mmio_write32(struct cxl_afu_h *afu)
 		close_socket(&(afu->fd));
 		afu->opened = 0;
 		afu->attached = 0;
-		afu->mmio.state = LIBCXL_REQ_IDLE;
+		_req_done(afu, &(afu->mmio.state));
+		return;
+	}
+	free(buffer);
+	afu->mmio.state = LIBCXL_REQ_PENDING;
+}
+
+static void _mmio_batch(struct cxl_afu_h *afu)
+{
+	uint8_t *buffer;
+	uint64_t data;
+	uint32_t addr;
+	uint16_t count;
+	int size, offset, i;
+
+	if (!afu)
+		fatal_msg("NULL afu passed to libcxl.c:_mmio_batch");
+	size = 1 + sizeof(count) + afu->mmio.count * (1 + sizeof(addr) +
+						       sizeof(data));
+	buffer = (uint8_t *) malloc(size);
+	buffer[0] = PSLSE_MMIO_BATCH;
+	count = htons((uint16_t) afu->mmio.count);
+	memcpy((char *)&(buffer[1]), (char *)&count, sizeof(count));
+	offset = 1 + sizeof(count);
+	for (i = 0; i < afu->mmio.count; i++) {
+		switch (afu->mmio.ops[i].op) {
+		case CXL_MMIO_OP_WRITE64:
+			buffer[offset] = PSLSE_MMIO_WRITE64;
+			break;
+		case CXL_MMIO_OP_READ64:
+			buffer[offset] = PSLSE_MMIO_READ64;
+			break;
+		case CXL_MMIO_OP_WRITE32:
+			buffer[offset] = PSLSE_MMIO_WRITE32;
+			break;
+		default:
+			buffer[offset] = PSLSE_MMIO_READ32;
+			break;
+		}
+		offset++;
+		addr = htonl(afu->mmio.ops[i].offset);
+		memcpy((char *)&(buffer[offset]), (char *)&addr, sizeof(addr));
+		offset += sizeof(addr);
+		data = htonll(afu->mmio.ops[i].data);
+		memcpy((char *)&(buffer[offset]), (char *)&data, sizeof(data));
+		offset += sizeof(data);
+	}
+	if (put_bytes_silent(afu->fd, size, buffer) != size) {
+		free(buffer);
+		close_socket(&(afu->fd));
+		afu->opened = 0;
+		afu->attached = 0;
+		_req_done(afu, &(afu->mmio.state));
 		return;
 	}
 	free(buffer);
@@ -490,7 +740,7 @@ static void _mmio_read(struct cxl_afu_h *afu)
 		close_socket(&(afu->fd));
 		afu->opened = 0;
 		afu->attached = 0;
-		afu->mmio.state = LIBCXL_REQ_IDLE;
+		_req_done(afu, &(afu->mmio.state));
 		afu->mmio.data = 0xFEEDB00FFEEDB00FL;
 		return;
 	}
@@ -502,7 +752,7 @@ static void *_psl_loop(void *ptr)
 {
 	struct cxl_afu_h *afu = (struct cxl_afu_h *)ptr;
 	uint8_t buffer[MAX_LINE_CHARS];
-	uint8_t size;
+	uint8_t size, tag;
 	uint64_t addr;
 	uint16_t value;
 	uint32_t lvalue;
@@ -512,7 +762,6 @@ static void *_psl_loop(void *ptr)
 		fatal_msg("NULL afu passed to libcxl.c:_psl_loop");
 	afu->opened = 1;
 	while (afu->opened) {
-		_delay_1ms();
 		// Send any requests to PSLSE over socket
 		if (afu->int_req.state == LIBCXL_REQ_REQUEST)
 			_req_max_int(afu);
@@ -533,16 +782,19 @@ static void *_psl_loop(void *ptr)
 			case PSLSE_MMIO_READ32:	/*fall through */
 				_mmio_read(afu);
 				break;
+			case PSLSE_MMIO_BATCH:
+				_mmio_batch(afu);
+				break;
 			default:
 				break;
 			}
 		}
 		// Process socket input from PSLSE
-		rc = bytes_ready(afu->fd, 1000, 0);
+		rc = _psl_wait(afu, 1000);
 		if (rc == 0)
 			continue;
 		if (rc < 0) {
-			warn_msg("Socket failure testing bytes_ready");
+			warn_msg("Socket disconnect on poll");
 			_all_idle(afu);
 			break;
 		}
@@ -560,20 +812,14 @@ static void *_psl_loop(void *ptr)
 				break;
 			}
 			afu->context = (uint16_t) buffer[0];
-			afu->open.state = LIBCXL_REQ_IDLE;
+			_req_done(afu, &(afu->open.state));
 			break;
 		case PSLSE_ATTACH:
-			afu->attach.state = LIBCXL_REQ_IDLE;
+			_req_done(afu, &(afu->attach.state));
 			break;
 		case PSLSE_DETACH:
 		        info_msg("detach response from from pslse");
-			afu->mapped = 0;
-			afu->attached = 0;
-			afu->opened = 0;
-			afu->open.state = LIBCXL_REQ_IDLE;
-			afu->attach.state = LIBCXL_REQ_IDLE;
-			afu->mmio.state = LIBCXL_REQ_IDLE;
-			afu->int_req.state = LIBCXL_REQ_IDLE;
+			_all_idle(afu);
 			break;
 		case PSLSE_MAX_INT:
 			size = sizeof(uint16_t);
@@ -587,7 +833,7 @@ static void *_psl_loop(void *ptr)
 			memcpy((char *)&value, (char *)buffer,
 			       sizeof(uint16_t));
 			afu->irqs_max = ntohs(value);
-			afu->int_req.state = LIBCXL_REQ_IDLE;
+			_req_done(afu, &(afu->int_req.state));
 			break;
 		case PSLSE_QUERY:
 			size = sizeof(uint16_t) + sizeof(uint16_t) + sizeof(uint16_t) 
@@ -611,13 +857,14 @@ static void *_psl_loop(void *ptr)
 			break;
 		case PSLSE_MEMORY_READ:
 			DPRINTF("AFU MEMORY READ\n");
-			if (get_bytes_silent(afu->fd, 1, buffer, 1000, 0) < 0) {
+			if (get_bytes_silent(afu->fd, 2, buffer, 1000, 0) < 0) {
 				warn_msg
 				    ("Socket failure getting memory read size");
 				_all_idle(afu);
 				break;
 			}
-			size = (uint8_t) buffer[0];
+			tag = (uint8_t) buffer[0];
+			size = (uint8_t) buffer[1];
 			if (get_bytes_silent(afu->fd, sizeof(uint64_t), buffer,
 					     -1, 0) < 0) {
 				warn_msg
@@ -627,17 +874,18 @@ static void *_psl_loop(void *ptr)
 			}
 			memcpy((char *)&addr, (char *)buffer, sizeof(uint64_t));
 			addr = ntohll(addr);
-			_handle_read(afu, addr, size);
+			_handle_read(afu, tag, addr, size);
 			break;
 		case PSLSE_MEMORY_WRITE:
 			DPRINTF("AFU MEMORY WRITE\n");
-			if (get_bytes_silent(afu->fd, 1, buffer, 1000, 0) < 0) {
+			if (get_bytes_silent(afu->fd, 2, buffer, 1000, 0) < 0) {
 				warn_msg
 				    ("Socket failure getting memory write size");
 				_all_idle(afu);
 				break;
 			}
-			size = (uint8_t) buffer[0];
+			tag = (uint8_t) buffer[0];
+			size = (uint8_t) buffer[1];
 			if (get_bytes_silent(afu->fd, sizeof(uint64_t), buffer,
 					     -1, 0) < 0) {
 				_all_idle(afu);
@@ -652,17 +900,18 @@ static void *_psl_loop(void *ptr)
 				_all_idle(afu);
 				break;
 			}
-			_handle_write(afu, addr, size, buffer);
+			_handle_write(afu, tag, addr, size, buffer);
 			break;
 		case PSLSE_MEMORY_TOUCH:
 			DPRINTF("AFU MEMORY TOUCH\n");
-			if (get_bytes_silent(afu->fd, 1, buffer, 1000, 0) < 0) {
+			if (get_bytes_silent(afu->fd, 2, buffer, 1000, 0) < 0) {
 				warn_msg
 				    ("Socket failure getting memory touch size");
 				_all_idle(afu);
 				break;
 			}
-			size = buffer[0];
+			tag = buffer[0];
+			size = buffer[1];
 			if (get_bytes_silent(afu->fd, sizeof(uint64_t), buffer,
 					     -1, 0) < 0) {
 				warn_msg
@@ -672,11 +921,16 @@ static void *_psl_loop(void *ptr)
 			}
 			memcpy((char *)&addr, (char *)buffer, sizeof(uint64_t));
 			addr = ntohll(addr);
-			_handle_touch(afu, addr, size);
+			_handle_touch(afu, tag, addr, size);
 			break;
 		case PSLSE_MMIO_ACK:
 			_handle_ack(afu);
 			break;
+		case PSLSE_MMIO_FAIL:
+			DPRINTF("MMIO FAIL\n");
+			afu->mmio.failed = 1;
+			_req_done(afu, &(afu->mmio.state));
+			break;
 		case PSLSE_INTERRUPT:
 			if (_handle_interrupt(afu) < 0) {
 				perror("Interrupt Failure");
@@ -704,6 +958,9 @@ static int _pslse_connect(uint16_t * afu_map, int *fd)
 	FILE *fp;
 	uint8_t buffer[MAX_LINE_CHARS];
 	struct sockaddr_in ssadr;
+	struct sockaddr_un sunadr;
+	struct sockaddr *adr;
+	socklen_t adrlen;
 	struct hostent *he;
 	char *host, *port_str;
 	int port;
@@ -726,37 +983,53 @@ static int _pslse_connect(uint16_t * afu_map, int *fd)
 	fclose(fp);
 	host = (char *)buffer;
 	port_str = strchr((char *)buffer, ':');
-	*port_str = '\0';
-	port_str++;
-	if (!host || !port_str) {
+	if (!port_str) {
 		warn_msg
 		    ("cxl_afu_open_dev:Invalid format in pslse_server.data");
 		goto connect_fail;
 	}
-	port = atoi(port_str);
+	*port_str = '\0';
+	port_str++;
 
-	info_msg("Connecting to host '%s' port %d", host, port);
+	if (strcmp(host, PSL_UNIX_HOST) == 0) {
+		// unix:<path> for a PSLSE server on this host
+		port_str[strcspn(port_str, " \t\r\n")] = '\0';
+		info_msg("Connecting to %s:%s", host, port_str);
+		memset(&sunadr, 0, sizeof(sunadr));
+		sunadr.sun_family = AF_UNIX;
+		if (strlen(port_str) >= sizeof(sunadr.sun_path)) {
+			warn_msg("cxl_afu_open_dev:Socket path too long");
+			goto connect_fail;
+		}
+		strcpy(sunadr.sun_path, port_str);
+		adr = (struct sockaddr *)&sunadr;
+		adrlen = sizeof(sunadr);
+	} else {
+		port = atoi(port_str);
+		info_msg("Connecting to host '%s' port %d", host, port);
+		if ((he = gethostbyname(host)) == NULL) {
+			herror("gethostbyname");
+			puts(host);
+			goto connect_fail;
+		}
+		memset(&ssadr, 0, sizeof(ssadr));
+		memcpy(&ssadr.sin_addr, he->h_addr_list[0], he->h_length);
+		ssadr.sin_family = AF_INET;
+		ssadr.sin_port = htons(port);
+		adr = (struct sockaddr *)&ssadr;
+		adrlen = sizeof(ssadr);
+	}
 
 	// Connect to PSLSE server
-	if ((he = gethostbyname(host)) == NULL) {
-		herror("gethostbyname");
-		puts(host);
-		goto connect_fail;
-	}
-	memset(&ssadr, 0, sizeof(ssadr));
-	memcpy(&ssadr.sin_addr, he->h_addr_list[0], he->h_length);
-	ssadr.sin_family = AF_INET;
-	ssadr.sin_port = htons(port);
-	if ((*fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+	if ((*fd = socket(adr->sa_family, SOCK_STREAM, 0)) < 0) {
 		perror("socket");
 		goto connect_fail;
 	}
-	ssadr.sin_family = AF_INET;
-	ssadr.sin_port = htons(port);
-	if (connect(*fd, (struct sockaddr *)&ssadr, sizeof(ssadr)) < 0) {
+	if (connect(*fd, adr, adrlen) < 0) {
 		perror("connect");
 		goto connect_fail;
 	}
+	psl_tune_socket(*fd);
 	strcpy((char *)buffer, "PSLSE");
 	buffer[5] = (uint8_t) PSLSE_VERSION_MAJOR;
 	buffer[6] = (uint8_t) PSLSE_VERSION_MINOR;
@@ -845,8 +1118,13 @@ static struct cxl_afu_h *_new_afu(uint16_t afu_map, uint16_t position, int fd)
 
 	if (pipe(afu->pipe) < 0)
 		return NULL;
+	if (pipe(afu->wake) < 0)
+		return NULL;
+	fcntl(afu->wake[0], F_SETFL, O_NONBLOCK);
 
 	pthread_mutex_init(&(afu->event_lock), NULL);
+	pthread_mutex_init(&(afu->req_lock), NULL);
+	pthread_cond_init(&(afu->req_cond), NULL);
 	afu->fd = fd;
 	afu->map = afu_map;
 	afu->dbg_id = (major << 4) | minor;
@@ -898,7 +1176,7 @@ static void _release_afus(struct cxl_afu_h *afu)
 		}
 		if (afu->id)
 			free(afu->id);
-		pthread_mutex_destroy(&(afu->event_lock));
+		_free_afu_sync(afu);
 		free(afu);
 	}
 }
@@ -972,8 +1250,7 @@ static struct cxl_afu_h *_pslse_open(int *fd, uint16_t afu_map, uint8_t major,
 		goto open_fail;
 	}
 	// Wait for open acknowledgement
-	while (afu->open.state != LIBCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_req_wait(afu, &(afu->open.state));
 
 	if (!afu->opened) {
 		pthread_join(afu->thread, NULL);
@@ -985,7 +1262,7 @@ static struct cxl_afu_h *_pslse_open(int *fd, uint16_t afu_map, uint8_t major,
 	return afu;
 
  open_fail:
-	pthread_mutex_destroy(&(afu->event_lock));
+	_free_afu_sync(afu);
 	free(afu);
 	errno = ENODEV;
 	return NULL;
@@ -1290,19 +1567,22 @@ void cxl_afu_free(struct cxl_afu_h *afu)
 	rc = put_bytes_silent(afu->fd, 1, &buffer);
 	if (rc == 1) {
 	        debug_msg("detach request sent from from host on socket %d", afu->fd);
-		while (afu->attached)	/*infinite loop */
-			_delay_1ms();
+		pthread_mutex_lock(&(afu->req_lock));
+		while (afu->attached)
+			pthread_cond_wait(&(afu->req_cond), &(afu->req_lock));
+		pthread_mutex_unlock(&(afu->req_lock));
 	}
 	debug_msg("closing host side socket %d", afu->fd);
 	close_socket(&(afu->fd));
 	afu->opened = 0;
+	_wake(afu);
 	pthread_join(afu->thread, NULL);
 
  free_done:
 	if (afu->id != NULL)
 		free(afu->id);
  free_done_no_afu:
-	pthread_mutex_destroy(&(afu->event_lock));
+	_free_afu_sync(afu);
 	free(afu);
 }
 
@@ -1335,9 +1615,8 @@ int cxl_afu_attach(struct cxl_afu_h *afu, uint64_t wed)
 	}
 	// Perform PSLSE attach
 	afu->attach.wed = wed;
-	afu->attach.state = LIBCXL_REQ_REQUEST;
-	while (afu->attach.state != LIBCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_req_post(afu, &(afu->attach.state));
+	_req_wait(afu, &(afu->attach.state));
 	afu->attached = 1;
 
 	return 0;
@@ -1417,7 +1696,8 @@ int cxl_get_irqs_min(struct cxl_afu_h *afu, long *valp)
 
 int cxl_event_pending(struct cxl_afu_h *afu)
 {
-	if (afu->events[0] != NULL)
+	if (__atomic_load_n(&(afu->events.head), __ATOMIC_ACQUIRE) !=
+	    __atomic_load_n(&(afu->events.tail), __ATOMIC_ACQUIRE))
 		return 1;
 
 	return 0;
@@ -1425,8 +1705,9 @@ int cxl_event_pending(struct cxl_afu_h *afu)
 
 int cxl_read_event(struct cxl_afu_h *afu, struct cxl_event *event)
 {
+	struct pollfd pfd;
 	uint8_t type;
-	int i;
+	int rc;
 
 	if (afu == NULL || event == NULL) {
 		errno = EINVAL;
@@ -1434,21 +1715,27 @@ int cxl_read_event(struct cxl_afu_h *afu, struct cxl_event *event)
 	}
 	// Function will block until event occurs
 	pthread_mutex_lock(&(afu->event_lock));
-	while (afu->opened && !afu->events[0]) {	/*infinite loop */
+	while (!_event_get(afu, event)) {
 		pthread_mutex_unlock(&(afu->event_lock));
-		if (_delay_1ms() < 0)
+		if (!afu->opened) {
+			errno = ENODEV;
+			return -1;
+		}
+		// Recheck opened every 100ms in case PSLSE goes away
+		pfd.fd = afu->pipe[0];
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if ((poll(&pfd, 1, 100) < 0) && (errno != EINTR))
 			return -1;
 		pthread_mutex_lock(&(afu->event_lock));
 	}
-
-	// Copy event data, free and move remaining events in queue
-	memcpy(event, afu->events[0], afu->events[0]->header.size);
-	free(afu->events[0]);
-	for (i = 1; i < EVENT_QUEUE_MAX; i++)
-		afu->events[i - 1] = afu->events[i];
-	afu->events[EVENT_QUEUE_MAX - 1] = NULL;
+	// Consume the byte that made cxl_afu_fd() readable for this event
+	do {
+		rc = read(afu->pipe[0], &type, 1);
+	}
+	while ((rc < 0) && (errno == EINTR));
 	pthread_mutex_unlock(&(afu->event_lock));
-	if (read(afu->pipe[0], &type, 1) > 0)
+	if (rc > 0)
 		return 0;
 	return -1;
 }
@@ -1491,9 +1778,8 @@ int cxl_mmio_map(struct cxl_afu_h *afu, uint32_t flags)
 	// Send MMIO map to PSLSE
 	afu->mmio.type = PSLSE_MMIO_MAP;
 	afu->mmio.data = (uint64_t) flags;
-	afu->mmio.state = LIBCXL_REQ_REQUEST;
-	while (afu->mmio.state != LIBCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_req_post(afu, &(afu->mmio.state));
+	_req_wait(afu, &(afu->mmio.state));
 	afu->mapped = 1;
 
 	return 0;
@@ -1517,15 +1803,18 @@ int cxl_mmio_write64(struct cxl_afu_h *afu, uint64_t offset, uint64_t data)
 	if ((afu == NULL) || !afu->mapped)
 		goto write64_fail;
 
+	// Let any batch from cxl_mmio_submit() finish first
+	_req_wait(afu, &(afu->mmio.state));
+
 	// Send MMIO map to PSLSE
 	afu->mmio.type = PSLSE_MMIO_WRITE64;
+	afu->mmio.failed = 0;
 	afu->mmio.addr = (uint32_t) offset;
 	afu->mmio.data = data;
-	afu->mmio.state = LIBCXL_REQ_REQUEST;
-	while (afu->mmio.state != LIBCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_req_post(afu, &(afu->mmio.state));
+	_req_wait(afu, &(afu->mmio.state));
 
-	if (!afu->opened)
+	if (!afu->opened || afu->mmio.failed)
 		goto write64_fail;
 
 	return 0;
@@ -1544,15 +1833,18 @@ int cxl_mmio_read64(struct cxl_afu_h *afu, uint64_t offset, uint64_t * data)
 	if ((afu == NULL) || !afu->mapped)
 		goto read64_fail;
 
+	// Let any batch from cxl_mmio_submit() finish first
+	_req_wait(afu, &(afu->mmio.state));
+
 	// Send MMIO map to PSLSE
 	afu->mmio.type = PSLSE_MMIO_READ64;
+	afu->mmio.failed = 0;
 	afu->mmio.addr = (uint32_t) offset;
-	afu->mmio.state = LIBCXL_REQ_REQUEST;
-	while (afu->mmio.state != LIBCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_req_post(afu, &(afu->mmio.state));
+	_req_wait(afu, &(afu->mmio.state));
 	*data = afu->mmio.data;
 
-	if (!afu->opened)
+	if (!afu->opened || afu->mmio.failed)
 		goto read64_fail;
 
 	return 0;
@@ -1571,15 +1863,18 @@ int cxl_mmio_write32(struct cxl_afu_h *afu, uint64_t offset, uint32_t data)
 	if ((afu == NULL) || !afu->mapped)
 		goto write32_fail;
 
+	// Let any batch from cxl_mmio_submit() finish first
+	_req_wait(afu, &(afu->mmio.state));
+
 	// Send MMIO map to PSLSE
 	afu->mmio.type = PSLSE_MMIO_WRITE32;
+	afu->mmio.failed = 0;
 	afu->mmio.addr = (uint32_t) offset;
 	afu->mmio.data = (uint64_t) data;
-	afu->mmio.state = LIBCXL_REQ_REQUEST;
-	while (afu->mmio.state != LIBCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_req_post(afu, &(afu->mmio.state));
+	_req_wait(afu, &(afu->mmio.state));
 
-	if (!afu->opened)
+	if (!afu->opened || afu->mmio.failed)
 		goto write32_fail;
 
 	return 0;
@@ -1598,15 +1893,18 @@ int cxl_mmio_read32(struct cxl_afu_h *afu, uint64_t offset, uint32_t * data)
 	if ((afu == NULL) || !afu->mapped)
 		goto read32_fail;
 
+	// Let any batch from cxl_mmio_submit() finish first
+	_req_wait(afu, &(afu->mmio.state));
+
 	// Send MMIO map to PSLSE
 	afu->mmio.type = PSLSE_MMIO_READ32;
+	afu->mmio.failed = 0;
 	afu->mmio.addr = (uint32_t) offset;
-	afu->mmio.state = LIBCXL_REQ_REQUEST;
-	while (afu->mmio.state != LIBCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_req_post(afu, &(afu->mmio.state));
+	_req_wait(afu, &(afu->mmio.state));
 	*data = (uint32_t) afu->mmio.data;
 
-	if (!afu->opened)
+	if (!afu->opened || afu->mmio.failed)
 		goto read32_fail;
 
 	return 0;
@@ -1616,6 +1914,60 @@ int cxl_mmio_read32(struct cxl_afu_h *afu, uint64_t offset, uint32_t * data)
 	return -1;
 }
 
+int cxl_mmio_submit(struct cxl_afu_h *afu, struct cxl_mmio_op *ops, int count)
+{
+	int i;
+
+	if ((ops == NULL) || (count <= 0) || (count > CXL_MMIO_BATCH_MAX)) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (i = 0; i < count; i++) {
+		if (ops[i].op > CXL_MMIO_OP_READ32)
+			goto submit_inval;
+		if ((ops[i].op <= CXL_MMIO_OP_READ64) && (ops[i].offset & 0x7))
+			goto submit_inval;
+		if (ops[i].offset & 0x3)
+			goto submit_inval;
+	}
+	if ((afu == NULL) || !afu->mapped) {
+		errno = ENODEV;
+		return -1;
+	}
+	if (afu->mmio.state != LIBCXL_REQ_IDLE) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	// Send MMIO batch to PSLSE, cxl_mmio_wait() collects the result
+	afu->mmio.type = PSLSE_MMIO_BATCH;
+	afu->mmio.ops = ops;
+	afu->mmio.count = count;
+	afu->mmio.failed = 0;
+	_req_post(afu, &(afu->mmio.state));
+
+	return 0;
+
+ submit_inval:
+	errno = EINVAL;
+	return -1;
+}
+
+int cxl_mmio_wait(struct cxl_afu_h *afu)
+{
+	if (afu == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	_req_wait(afu, &(afu->mmio.state));
+	if (!afu->opened || afu->mmio.failed) {
+		errno = ENODEV;
+		return -1;
+	}
+
+	return 0;
+}
+
 int cxl_get_cr_device(struct cxl_afu_h *afu, long cr_num, long *valp)
 {
 	if (afu == NULL) 
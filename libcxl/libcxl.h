@@ -201,6 +201,25 @@ int cxl_mmio_read64(struct cxl_afu_h *afu, uint64_t offset, uint64_t * data);
 int cxl_mmio_write32(struct cxl_afu_h *afu, uint64_t offset, uint32_t data);
 int cxl_mmio_read32(struct cxl_afu_h *afu, uint64_t offset, uint32_t * data);
 
+/* Batched MMIO, PSL Simulation Engine only.  cxl_mmio_submit() hands up to
+ * CXL_MMIO_BATCH_MAX accesses to PSLSE in one message and returns without
+ * waiting.  PSLSE drives them to the AFU in order.  cxl_mmio_wait() blocks
+ * until the whole batch is done and fills in data for each read.  Only one
+ * batch can be in flight per AFU handle and the ops array must stay valid
+ * until cxl_mmio_wait() returns. */
+#define CXL_MMIO_OP_WRITE64 0
+#define CXL_MMIO_OP_READ64 1
+#define CXL_MMIO_OP_WRITE32 2
+#define CXL_MMIO_OP_READ32 3
+#define CXL_MMIO_BATCH_MAX 256
+struct cxl_mmio_op {
+	uint32_t op;
+	uint32_t offset;
+	uint64_t data;
+};
+int cxl_mmio_submit(struct cxl_afu_h *afu, struct cxl_mmio_op *ops, int count);
+int cxl_mmio_wait(struct cxl_afu_h *afu);
+
 /*
  * Calling this function will install the libcxl SIGBUS handler. This will
  * catch bad MMIO accesses (e.g. due to hardware failures) that would otherwise
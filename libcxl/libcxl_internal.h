@@ -22,8 +22,6 @@
 #include <poll.h>
 #include <pthread.h>
 
-#define EVENT_QUEUE_MAX 3
-
 enum libcxl_req_state {
 	LIBCXL_REQ_IDLE,
 	LIBCXL_REQ_REQUEST,
@@ -50,12 +48,32 @@ struct mmio_req {
 	volatile uint8_t type;
 	volatile uint32_t addr;
 	uint64_t data;
+	struct cxl_mmio_op *ops;
+	int count;
+	int failed;
+};
+
+// Ring of preallocated events filled by _psl_loop and drained by
+// cxl_read_event().  At most one unread event is kept per IRQ number, DSI and
+// AFU error, so the ring never needs more than irqs + 3 slots.
+struct event_ring {
+	struct cxl_event *slot;
+	volatile uint8_t *irq_pending;	// [0] is shared by IRQs out of range
+	volatile uint8_t dsi_pending;
+	volatile uint8_t error_pending;
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	uint32_t mask;
+	uint16_t irqs;
+	uint64_t coalesced;
 };
 
 struct cxl_afu_h {
 	pthread_t thread;
 	pthread_mutex_t event_lock;
-	struct cxl_event *events[EVENT_QUEUE_MAX];
+	pthread_mutex_t req_lock;
+	pthread_cond_t req_cond;
+	struct event_ring events;
 	int adapter;
 	char *id;
 	uint16_t context;
@@ -67,6 +85,7 @@ struct cxl_afu_h {
 	int attached;
 	int mapped;
 	int pipe[2];
+	int wake[2];
 	long irqs_max;
 	long irqs_min;
 	long mode;
@@ -77,6 +96,7 @@ struct cxl_afu_h {
 	long cr_device;
 	long cr_vendor;
 	long cr_class;
+	uint64_t mem_token;
 	struct int_req int_req;
 	struct open_req open;
 	struct attach_req attach;
@@ -17,9 +17,16 @@
 /*
  * Description: client.c
  *
- * This file contains code for handling client disconnect.
+ * This file contains code for handling client disconnect and direct access
+ * to the memory of clients running on the same host.
  */
 
+#define _GNU_SOURCE
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
 #include "client.h"
 
 void client_drop(struct client *client, int cycles, enum client_state state)
@@ -27,5 +34,70 @@ void client_drop(struct client *client, int cycles, enum client_state state)
 	client->idle_cycles = cycles;
 	client->pending = 0;
 	client->state = state;
-	client->mem_access = NULL;
+}
+
+// Pid the client may be accessed through, 0 if none.  The kernel names the
+// peer of a unix socket.  A TCP peer is only trusted to name its own pid
+// when it connected over loopback, anyone else is not on this host.
+pid_t client_peer_pid(struct client *client, pid_t claimed)
+{
+	struct sockaddr_storage addr;
+	struct sockaddr_in6 *in6;
+	struct sockaddr_in *in;
+	struct ucred cred;
+	socklen_t len;
+
+	len = sizeof(addr);
+	if (getpeername(client->fd, (struct sockaddr *)&addr, &len) < 0)
+		return 0;
+	switch (addr.ss_family) {
+	case AF_UNIX:
+		len = sizeof(cred);
+		if ((getsockopt(client->fd, SOL_SOCKET, SO_PEERCRED, &cred,
+				&len) < 0) || (cred.pid != claimed))
+			return 0;
+		return cred.pid;
+	case AF_INET:
+		in = (struct sockaddr_in *)&addr;
+		if ((ntohl(in->sin_addr.s_addr) >> 24) != IN_LOOPBACKNET)
+			return 0;
+		return claimed;
+	case AF_INET6:
+		in6 = (struct sockaddr_in6 *)&addr;
+		if (IN6_IS_ADDR_LOOPBACK(&(in6->sin6_addr)) ||
+		    (IN6_IS_ADDR_V4MAPPED(&(in6->sin6_addr)) &&
+		     (in6->sin6_addr.s6_addr[12] == IN_LOOPBACKNET)))
+			return claimed;
+		return 0;
+	default:
+		return 0;
+	}
+}
+
+// Copy directly to or from client memory.  Returns 0 on success and -1 if the
+// caller should fall back to a memory request over the socket.
+int client_mem_copy(struct client *client, uint64_t addr, void *data,
+		    uint32_t size, int write)
+{
+	struct iovec local, remote;
+	ssize_t bytes;
+
+	if (client->pid == 0)
+		return -1;
+
+	local.iov_base = data;
+	local.iov_len = size;
+	remote.iov_base = (void *)addr;
+	remote.iov_len = size;
+	if (write)
+		bytes = process_vm_writev(client->pid, &local, 1, &remote, 1, 0);
+	else
+		bytes = process_vm_readv(client->pid, &local, 1, &remote, 1, 0);
+	if (bytes == size)
+		return 0;
+
+	// Bad address is left to the socket path, anything else disables
+	if ((bytes < 0) && (errno != EFAULT))
+		client->pid = 0;
+	return -1;
 }
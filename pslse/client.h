@@ -18,6 +18,7 @@
 
 #include <pthread.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 enum client_state {
 	CLIENT_NONE,
@@ -42,10 +43,10 @@ struct client {
 	enum client_state state;
 	uint16_t max_irqs;
 	char type;
+	pid_t pid;
 	uint64_t wed;
 	uint32_t mmio_offset;
 	uint32_t mmio_size;
-	void *mem_access;
 	void *mmio_access;
 	char *ip;
 	pthread_t thread;
@@ -55,4 +56,9 @@ struct client {
 
 void client_drop(struct client *client, int cycles, enum client_state state);
 
+pid_t client_peer_pid(struct client *client, pid_t claimed);
+
+int client_mem_copy(struct client *client, uint64_t addr, void *data,
+		    uint32_t size, int write);
+
 #endif				/* _CLIENT_H_ */
@@ -21,18 +21,22 @@
  *  includes parity checking the command, generating buffer writes or reads as
  *  well as the final response for the command.  The handle_cmd() function is
  *  periodically called by psl code.  If a command is received from the AFU
- *  then parity and credits check will occur to see if the command is valid.
+ *  then tag, parity and credits check will occur to see if it is valid.
  *  If those checks pass then _parse_cmd() is called to determine the command
  *  type.  Depending on command type either _add_interrupt(), _add_touch(),
  *  _add_unlock(), _add_read(), _add_write() or _add_other() will be called to
  *  format the tracking event properly.  Each of these functions calls
- *  _add_cmd() which will randomly insert the command in the list.
+ *  _add_cmd() which will record the command in the table indexed by tag.
  *
- *  Once an event is in the list then the event will be service in random order
- *  by the periodic calling by psl code of the functions: handle_interrupt(),
- *  handle_response(), handle_buffer_write(), handle_buffer_data() and
- *  handle_touch().  The state field is used to track the progress of each
- *  event until is fully completed and removed from the list completely.
+ *  Once an event is in the table then the event will be service in random
+ *  order by the periodic calling by psl code of the functions:
+ *  handle_interrupt(), handle_response(), handle_buffer_write(),
+ *  handle_buffer_data() and handle_touch().  The state field is used to track
+ *  the progress of each event until is fully completed and removed from the
+ *  table completely.  Each event also sits in the queue for the handler that
+ *  will service it next, so handlers never look at events waiting on
+ *  someone else.  Events are inserted at a random position whenever they
+ *  move to a new queue which provides the reordering.
  */
 
 #include <assert.h>
@@ -53,7 +57,7 @@ struct cmd *cmd_init(struct AFU_EVENT *afu_event, struct parms *parms,
 		     struct mmio *mmio, volatile enum pslse_state *state,
 		     char *afu_name, FILE * dbg_fp, uint8_t dbg_id)
 {
-	int i, j;
+	int i;
 	struct cmd *cmd;
 
 	cmd = (struct cmd *)calloc(1, sizeof(struct cmd));
@@ -67,24 +71,72 @@ struct cmd *cmd_init(struct AFU_EVENT *afu_event, struct parms *parms,
 	cmd->parms = parms;
 	cmd->psl_state = state;
 	cmd->credits = parms->credits;
-	cmd->page_entries.page_filter = ~((uint64_t) PAGE_MASK);
-	cmd->page_entries.entry_filter = 0;
-	for (i = 0; i < LOG2_ENTRIES; i++) {
-		cmd->page_entries.entry_filter <<= 1;
-		cmd->page_entries.entry_filter += 1;
-	}
-	cmd->page_entries.entry_filter <<= PAGE_ADDR_BITS;
-	for (i = 0; i < PAGE_ENTRIES; i++) {
-		for (j = 0; j < PAGE_WAYS; j++) {
-			cmd->page_entries.valid[i][j] = 0;
-		}
-	}
+	cmd->erat = erat_init(parms->erat_sets, parms->erat_ways,
+			      parms->erat_page_shift, parms->erat_policy,
+			      ((uint64_t) dbg_id << 32) | parms->seed);
 	cmd->afu_name = afu_name;
 	cmd->dbg_fp = dbg_fp;
 	cmd->dbg_id = dbg_id;
+	if ((cmd->stats = stats_init(afu_name, cmd->credits)) == NULL)
+		warn_msg("Unable to keep command statistics for %s", afu_name);
+	cmd->sched = schedule_init(afu_name, parms->seed, dbg_id);
+	cmd->timing = timing_init(&(parms->timing),
+				  ((uint64_t) parms->seed << 8) | dbg_id);
+
+	// Preallocate a command slot for each credit
+	cmd->pool.use.slots = cmd->credits;
+	if (posix_memalign((void **)&(cmd->pool.slab), CACHELINE_BYTES,
+			   cmd->pool.use.slots * sizeof(struct cmd_event))) {
+		perror("posix_memalign");
+		exit(-1);
+	}
+	for (i = cmd->pool.use.slots - 1; i >= 0; i--) {
+		cmd->pool.slab[i]._next = cmd->pool.free;
+		cmd->pool.free = &(cmd->pool.slab[i]);
+	}
+	stats_pool(cmd->stats, &(cmd->pool.use));
 	return cmd;
 }
 
+// Get command slot from pool
+static struct cmd_event *_alloc_event(struct cmd *cmd)
+{
+	struct cmd_event *event;
+
+	event = cmd->pool.free;
+	if (event != NULL) {
+		cmd->pool.free = event->_next;
+	} else {
+		// AFU issued more commands than credits, which only happens
+		// when it is misbehaving.  Those commands are failed but still
+		// need a slot until they are responded to.
+		if (posix_memalign((void **)&event, CACHELINE_BYTES,
+				   sizeof(struct cmd_event))) {
+			perror("posix_memalign");
+			return NULL;
+		}
+		cmd->pool.use.overflows++;
+	}
+	memset(event, 0, sizeof(struct cmd_event));
+	cmd->pool.use.allocs++;
+	if (++cmd->pool.use.in_use > cmd->pool.use.peak)
+		cmd->pool.use.peak = cmd->pool.use.in_use;
+	return event;
+}
+
+// Return command slot to pool
+static void _free_event(struct cmd *cmd, struct cmd_event *event)
+{
+	cmd->pool.use.in_use--;
+	if ((event < cmd->pool.slab) ||
+	    (event >= cmd->pool.slab + cmd->pool.use.slots)) {
+		free(event);
+		return;
+	}
+	event->_next = cmd->pool.free;
+	cmd->pool.free = event;
+}
+
 static void _print_event(struct cmd_event *event)
 {
 	printf("Command event: client=");
@@ -142,19 +194,142 @@ static void _print_event(struct cmd_event *event)
 	       event->unlock, (event->command == PSL_COMMAND_RESTART));
 }
 
+// Determine which handler queue an event waits in for its type and state
+static enum cmd_queue _queue_for(struct cmd_event *event)
+{
+	if (event->state == MEM_DONE)
+		return CMD_QUEUE_RESPONSE;
+	switch (event->type) {
+	case CMD_READ:
+	case CMD_READ_PE:	/*fall through */
+		if ((event->state == MEM_IDLE) ||
+		    (event->state == MEM_RECEIVED))
+			return CMD_QUEUE_BUFFER_WRITE;
+		break;
+	case CMD_WRITE:
+		if (event->state == MEM_IDLE)
+			return CMD_QUEUE_TOUCH;
+		if (event->state == MEM_TOUCHED)
+			return CMD_QUEUE_BUFFER_READ;
+		if (event->state == MEM_RECEIVED)
+			return CMD_QUEUE_MEM_WRITE;
+		break;
+	case CMD_TOUCH:
+		if (event->state == MEM_IDLE)
+			return CMD_QUEUE_TOUCH;
+		break;
+	case CMD_INTERRUPT:
+		if (event->state == MEM_IDLE)
+			return CMD_QUEUE_INTERRUPT;
+		break;
+	default:
+		break;
+	}
+	return CMD_QUEUE_NONE;
+}
+
+// Insert event at random position in queue for its current state
+static void _enqueue(struct cmd *cmd, struct cmd_event *event)
+{
+	struct cmd_event **head;
+	struct cmd_event *prev;
+
+	event->queue = _queue_for(event);
+	prev = NULL;
+	head = &(cmd->queue[event->queue]);
+	while ((*head != NULL) && !allow_reorder(cmd->parms, cmd->sched)) {
+		prev = *head;
+		head = &((*head)->_next);
+	}
+	event->_prev = prev;
+	event->_next = *head;
+	if (*head != NULL)
+		(*head)->_prev = event;
+	*head = event;
+}
+
+// Remove event from its queue
+static void _dequeue(struct cmd *cmd, struct cmd_event *event)
+{
+	if (event->_prev != NULL)
+		event->_prev->_next = event->_next;
+	else
+		cmd->queue[event->queue] = event->_next;
+	if (event->_next != NULL)
+		event->_next->_prev = event->_prev;
+	event->_prev = NULL;
+	event->_next = NULL;
+}
+
+// Read sent to the client but its data not yet written to the AFU
+static int _read_in_flight(struct cmd_event *event)
+{
+	return (event->type == CMD_READ) &&
+	    ((event->state == MEM_REQUEST) || (event->state == MEM_RECEIVED));
+}
+
+// Change event state and move it to the queue for the new state
+static void _set_state(struct cmd *cmd, struct cmd_event *event,
+		       enum mem_state state)
+{
+	int in_flight = _read_in_flight(event);
+
+	// Time client memory round trips, touches included
+	if ((state == MEM_REQUEST) || (state == MEM_TOUCH)) {
+		if (state != event->state)
+			event->mem_ns = stats_ns();
+	} else if ((event->state == MEM_REQUEST) ||
+		   (event->state == MEM_TOUCH)) {
+		stats_mem(cmd->stats, event->context,
+			  stats_ns() - event->mem_ns);
+	}
+	event->state = state;
+	if (cmd->timing != NULL)
+		cmd->timing->reads += _read_in_flight(event) - in_flight;
+	if (_queue_for(event) == event->queue)
+		return;
+	_dequeue(cmd, event);
+	_enqueue(cmd, event);
+}
+
+// Outstanding command count for context, NULL if context is out of range
+static int *_context_cmds(struct cmd *cmd, int32_t context)
+{
+	if ((cmd->context_cmds == NULL) || (context < 0) ||
+	    (context >= cmd->max_clients))
+		return NULL;
+	return &(cmd->context_cmds[context]);
+}
+
+// Remove command from table and free it
+static void _remove_cmd(struct cmd *cmd, struct cmd_event *event)
+{
+	int *count;
+
+	_dequeue(cmd, event);
+	if ((cmd->timing != NULL) && _read_in_flight(event))
+		cmd->timing->reads--;
+	cmd->tag[event->tag] = NULL;
+	cmd->outstanding--;
+	if ((count = _context_cmds(cmd, event->context)) != NULL)
+		(*count)--;
+	_free_event(cmd, event);
+}
+
 // Update all pending responses at once to new state
 static void _update_pending_resps(struct cmd *cmd, uint32_t resp)
 {
 	struct cmd_event *event;
-	event = cmd->list;
-	while (event) {
-		if (event->state == MEM_IDLE) {
-			event->state = MEM_DONE;
+	int i;
+
+	for (i = 0; i < CMD_TAGS; i++) {
+		event = cmd->tag[i];
+		if ((event != NULL) && (event->state == MEM_IDLE)) {
 			event->resp = resp;
+			_set_state(cmd, event, MEM_DONE);
 			debug_cmd_update(cmd->dbg_fp, cmd->dbg_id, event->tag,
 					 event->context, event->resp);
 		}
-		event = event->_next;
 	}
 }
 
@@ -166,28 +341,25 @@ static struct client *_get_client(struct cmd *cmd, struct cmd_event *event)
 		return NULL;
 
 	// Abort if client disconnected
-	if (cmd->client[event->context] == NULL) {
-		event->resp = PSL_RESPONSE_FAILED;
-		event->state = MEM_DONE;
-		debug_cmd_update(cmd->dbg_fp, cmd->dbg_id, event->tag,
-				 event->context, event->resp);
-	}
+	if (cmd->client[event->context] == NULL)
+		handle_failed(cmd, event);
 	return cmd->client[event->context];
 }
 
-// Add new command to list
+// Add new command to table
 static void _add_cmd(struct cmd *cmd, uint32_t context, uint32_t tag,
 		     uint32_t command, uint32_t abort, enum cmd_type type,
 		     uint64_t addr, uint32_t size, enum mem_state state,
 		     uint32_t resp, uint8_t unlock)
 {
-	struct cmd_event **head;
 	struct cmd_event *event;
+	int *count;
 
 	if (cmd == NULL)
 		return;
 
-	event = (struct cmd_event *)calloc(1, sizeof(struct cmd_event));
+	if ((event = _alloc_event(cmd)) == NULL)
+		return;
 	event->context = context;
 	event->command = command;
 	event->tag = tag;
@@ -198,22 +370,25 @@ static void _add_cmd(struct cmd *cmd, uint32_t context, uint32_t tag,
 	event->state = state;
 	event->resp = resp;
 	event->unlock = unlock;
-	event->data = (uint8_t *) malloc(CACHELINE_BYTES);
+	event->start_cycle = cmd->cycle;
+	event->start_ns = stats_ns();
+	event->ready_cycle = cmd->cycle;
 	memset(event->data, 0xFF, CACHELINE_BYTES);
-	event->parity = (uint8_t *) malloc(DWORDS_PER_CACHELINE / 8);
 	memset(event->parity, 0xFF, DWORDS_PER_CACHELINE / 8);
 
 	// Test for client disconnect
-	if (_get_client(cmd, event) == NULL) {
+	if ((cmd->client == NULL) || (context >= cmd->max_clients) ||
+	    (cmd->client[context] == NULL)) {
 		event->resp = PSL_RESPONSE_FAILED;
 		event->state = MEM_DONE;
 	}
 
-	head = &(cmd->list);
-	while ((*head != NULL) && !allow_reorder(cmd->parms))
-		head = &((*head)->_next);
-	event->_next = *head;
-	*head = event;
+	cmd->tag[tag] = event;
+	cmd->outstanding++;
+	if ((count = _context_cmds(cmd, context)) != NULL)
+		(*count)++;
+	_enqueue(cmd, event);
+	stats_command(cmd->stats, context, command);
 	debug_cmd_add(cmd->dbg_fp, cmd->dbg_id, tag, context, command);
 }
 
@@ -223,19 +398,16 @@ static void _add_interrupt(struct cmd *cmd, uint32_t handle, uint32_t tag,
 {
 	uint32_t resp = PSL_RESPONSE_DONE;
 	enum cmd_type type = CMD_INTERRUPT;
+	enum mem_state state = MEM_IDLE;
 
 	if (!irq || (irq > cmd->client[handle]->max_irqs)) {
 		warn_msg("AFU issued interrupt with illegal source id");
 		resp = PSL_RESPONSE_FAILED;
 		type = CMD_OTHER;
-		goto int_done;
+		state = MEM_DONE;
 	}
-	// Only track first interrupt until software reads event
-	if (!cmd->irq)
-		cmd->irq = irq;
- int_done:
 	_add_cmd(cmd, handle, tag, command, abort, type, (uint64_t) irq, 0,
-		 MEM_IDLE, resp, 0);
+		 state, resp, 0);
 }
 
 // Format and add misc. command to list
@@ -437,6 +609,39 @@ static void _parse_cmd(struct cmd *cmd, uint32_t command, uint32_t tag,
 	}
 }
 
+// Check parity of write data from the AFU
+static void _buffer_parity(struct cmd_event *event)
+{
+	uint8_t parity_check[DWORDS_PER_CACHELINE / 8];
+
+	generate_cl_parity(event->data, parity_check);
+	if (strncmp((char *)event->parity, (char *)parity_check,
+		    DWORDS_PER_CACHELINE / 8)) {
+		error_msg("Buffer read parity error tag=0x%02x", event->tag);
+	}
+}
+
+// Take write data the AFU sent with the command, sparing a buffer read
+static void _command_data(struct cmd *cmd, uint32_t tag,
+			  uint32_t parity_enabled)
+{
+	struct cmd_event *event = cmd->tag[tag];
+
+	if ((event == NULL) || (event->type != CMD_WRITE) ||
+	    (event->state != MEM_IDLE))
+		return;
+	if (psl_get_command_data(cmd->afu_event, event->data,
+				 event->parity) != PSL_SUCCESS)
+		return;
+	debug_msg("%s:COMMAND DATA tag=0x%02x", cmd->afu_name, tag);
+	stats_buffer(cmd->stats, event->context, CACHELINE_BYTES, 0);
+	if (cmd->timing != NULL)
+		timing_transfer(cmd->timing, TIMING_FROM_AFU, CACHELINE_BYTES);
+	if (parity_enabled)
+		_buffer_parity(event);
+	event->with_data = 1;
+}
+
 // Report parity error on some command bus
 static void _cmd_parity_error(const char *msg, uint64_t value, uint8_t parity)
 {
@@ -447,7 +652,6 @@ static void _cmd_parity_error(const char *msg, uint64_t value, uint8_t parity)
 // See if a command was sent by AFU and process if so
 void handle_cmd(struct cmd *cmd, uint32_t parity_enabled, uint32_t latency)
 {
-	struct cmd_event *event;
 	uint64_t address, address_parity;
 	uint32_t command, command_parity, tag, tag_parity, size, abort, handle;
 	uint8_t parity, fail;
@@ -476,6 +680,11 @@ void handle_cmd(struct cmd *cmd, uint32_t parity_enabled, uint32_t latency)
 		warn_msg("Command without jrunning, tag=0x%02x", tag);
 		return;
 	}
+	// Check for duplicate tag before any state or credit is touched
+	if ((tag >= CMD_TAGS) || (cmd->tag[tag] != NULL)) {
+		error_msg("Duplicate tag 0x%02x", tag);
+		return;
+	}
 	// Check parity
 	fail = 0;
 	if (parity_enabled) {
@@ -527,18 +736,76 @@ void handle_cmd(struct cmd *cmd, uint32_t parity_enabled, uint32_t latency)
 			   PSL_RESPONSE_FLUSHED);
 		return;
 	}
-	// Check for duplicate tag
-	event = cmd->list;
-	while (event != NULL) {
-		if (event->tag == tag) {
-			error_msg("Duplicate tag 0x%02x", tag);
-			return;
+	// Parse command
+	_parse_cmd(cmd, command, tag, address, size, abort, handle, latency);
+	_command_data(cmd, tag, parity_enabled);
+}
+
+// Timing model: first read whose data is due and fits on the link, or that
+// can be sent to the client.  Reads of a client that has gone are taken
+// right away so they fail.
+static struct cmd_event *_timed_buffer_write(struct cmd *cmd,
+					     struct cmd_event *event)
+{
+	for (; event != NULL; event = event->_next) {
+		if ((cmd->client == NULL) ||
+		    (event->context >= cmd->max_clients) ||
+		    (cmd->client[event->context] == NULL))
+			return event;
+		if (event->state == MEM_RECEIVED) {
+			if ((event->ready_cycle <= cmd->cycle) &&
+			    timing_link(cmd->timing, TIMING_TO_AFU,
+					CACHELINE_BYTES))
+				return event;
+		} else if ((event->type != CMD_READ) ||
+			   timing_read_slot(cmd->timing)) {
+			return event;
 		}
-		event = event->_next;
 	}
+	return NULL;
+}
 
-	// Parse command
-	_parse_cmd(cmd, command, tag, address, size, abort, handle, latency);
+// Drive response for event to AFU and retire the command
+static void _respond(struct cmd *cmd, struct cmd_event *event,
+		     struct client *client)
+{
+	int rc;
+
+	// Check for pending buffer activity
+	while (event == cmd->buffer_read) {
+		if (cmd->afu_event->buffer_rdata_valid) {
+			warn_msg("Application terminated while AFU write still active");
+			_print_event(event);
+			cmd->afu_event->buffer_rdata_valid = 0;
+			cmd->buffer_read = NULL;
+		}
+		else {
+			psl_signal_afu_model(cmd->afu_event);
+			psl_get_afu_events(cmd->afu_event);
+		}
+	}
+
+	rc = psl_response(cmd->afu_event, event->tag, event->resp, 1, 0, 0);
+	if (rc == PSL_SUCCESS) {
+		debug_msg("%s:RESPONSE tag=0x%02x code=0x%x", cmd->afu_name,
+			  event->tag, event->resp);
+		debug_cmd_response(cmd->dbg_fp, cmd->dbg_id, event->tag);
+		stats_response(cmd->stats, event->context, event->resp,
+			       cmd->cycle - event->start_cycle,
+			       stats_ns() - event->start_ns);
+		if ((client != NULL) && (event->command == PSL_COMMAND_RESTART))
+			client->flushing = FLUSH_NONE;
+		_remove_cmd(cmd, event);
+		cmd->credits++;
+	}
+}
+
+// Random delays and out of order picks only exercise the AFU.  The timing
+// model sets its own delays and AFUs taking whole transactions get each
+// command as soon as it is ready.
+static int _delays(struct cmd *cmd)
+{
+	return (cmd->timing == NULL) && !cmd->afu_event->transactions;
 }
 
 // Handle randomly selected pending read by either generating early buffer
@@ -548,8 +815,8 @@ void handle_buffer_write(struct cmd *cmd)
 {
 	struct cmd_event *event;
 	struct client *client;
-	uint8_t buffer[10];
-	uint64_t *addr;
+	uint8_t buffer[11];
+	uint64_t addr;
 	int quadrant, byte;
 
 	// Make sure cmd structure is valid
@@ -557,12 +824,12 @@ void handle_buffer_write(struct cmd *cmd)
 		return;
 
 	// Randomly select a pending read or read_pe (or none)
-	event = cmd->list;
-	while (event != NULL) {
-	        if (((event->type == CMD_READ) || (event->type == CMD_READ_PE) )&&
-		    (event->state != MEM_DONE) &&
-		    ((event->client_state != CLIENT_VALID) ||
-		     !allow_reorder(cmd->parms))) {
+	event = cmd->queue[CMD_QUEUE_BUFFER_WRITE];
+	if (cmd->timing != NULL)
+		event = _timed_buffer_write(cmd, event);
+	while (_delays(cmd) && (event != NULL)) {
+		if ((event->client_state != CLIENT_VALID) ||
+		    !allow_reorder(cmd->parms, cmd->sched)) {
 			break;
 		}
 		event = event->_next;
@@ -582,6 +849,11 @@ void handle_buffer_write(struct cmd *cmd)
 				     event->parity) == PSL_SUCCESS) {
 			debug_msg("%s:BUFFER WRITE tag=0x%02x", cmd->afu_name,
 				  event->tag);
+			stats_buffer(cmd->stats, event->context,
+				     CACHELINE_BYTES, 1);
+			if (cmd->timing != NULL)
+				timing_transfer(cmd->timing, TIMING_TO_AFU,
+						CACHELINE_BYTES);
 			for (quadrant = 0; quadrant < 4; quadrant++) {
 				DPRINTF("DEBUG: Q%d 0x", quadrant);
 				for (byte = 0; byte < CACHELINE_BYTES / 4;
@@ -591,49 +863,70 @@ void handle_buffer_write(struct cmd *cmd)
 				DPRINTF("\n");
 			}
 			event->resp = PSL_RESPONSE_DONE;
-			event->state = MEM_DONE;
+			_set_state(cmd, event, MEM_DONE);
 			debug_cmd_buffer_write(cmd->dbg_fp, cmd->dbg_id,
 					       event->tag);
 			debug_cmd_update(cmd->dbg_fp, cmd->dbg_id, event->tag,
 					 event->context, event->resp);
+			// Send the response with the data when AFU takes
+			// whole transactions
+			if (cmd->afu_event->transactions)
+				_respond(cmd, event, client);
+			return;
 		}
 	}
 
 	if (event->state != MEM_IDLE)
 		return;
 
-	if (!event->buffer_activity && allow_buffer(cmd->parms)) {
+	if (_delays(cmd) && !event->buffer_activity &&
+	    allow_buffer(cmd->parms, cmd->sched)) {
 		// Buffer write with bogus data, but only once
 	        // should I skip this in the case of read_pe?
 		debug_cmd_buffer_write(cmd->dbg_fp, cmd->dbg_id, event->tag);
-		psl_buffer_write(cmd->afu_event, event->tag, event->addr,
-				 CACHELINE_BYTES, event->data, event->parity);
+		if (psl_buffer_write(cmd->afu_event, event->tag, event->addr,
+				     CACHELINE_BYTES, event->data,
+				     event->parity) == PSL_SUCCESS)
+			stats_buffer(cmd->stats, event->context,
+				     CACHELINE_BYTES, 1);
 		event->buffer_activity = 1;
-	} else if (client->mem_access == NULL) {
+	} else {
 	        // if read:
-		// Send read request to client, set client->mem_access
-		// to point to this event blocking any other memory
-		// accesses to client until data is returned by call
-		// to the _handle_mem_read() function.
+		// Send read request to client tagged with the AFU tag.
+		// Other memory requests can be sent to the client before
+		// data is returned by call to the _handle_mem_read()
+		// function.
 	        // if read_pe:
 		// build data and parity to represent pe
 	        // set event->state to mem_received
-                if (event->type == CMD_READ) {
+                if ((event->type == CMD_READ) &&
+		    (client_mem_copy(client, event->addr,
+				     &(event->data[event->addr & ~CACHELINE_MASK]),
+				     event->size, 0) == 0)) {
+		  // Same host client, data is already in place
+		  event->abort = &(client->abort);
+		  debug_msg("%s:MEMORY READ tag=0x%02x size=%d addr=0x%016"PRIx64" direct",
+			    cmd->afu_name, event->tag, event->size, event->addr);
+		  _set_state(cmd, event, MEM_REQUEST);
+		  debug_cmd_client(cmd->dbg_fp, cmd->dbg_id, event->tag,
+				   event->context);
+		  handle_mem_return(cmd, event, -1);
+		} else if (event->type == CMD_READ) {
 		  buffer[0] = (uint8_t) PSLSE_MEMORY_READ;
-		  buffer[1] = (uint8_t) event->size;
-		  addr = (uint64_t *) & (buffer[2]);
-		  *addr = htonll(event->addr);
+		  buffer[1] = (uint8_t) event->tag;
+		  buffer[2] = (uint8_t) event->size;
+		  addr = htonll(event->addr);
+		  memcpy(&(buffer[3]), &addr, sizeof(addr));
 		  event->abort = &(client->abort);
 		  debug_msg("%s:MEMORY READ tag=0x%02x size=%d addr=0x%016"PRIx64,
 			    cmd->afu_name, event->tag, event->size, event->addr);
-		  if (put_bytes(client->fd, 10, buffer, cmd->dbg_fp,
+		  if (put_bytes(client->fd, 11, buffer, cmd->dbg_fp,
 				cmd->dbg_id, event->context) < 0) {
 		    client_drop(client, PSL_IDLE_CYCLES, CLIENT_NONE);
 		  }
-		  event->state = MEM_REQUEST;
+		  _set_state(cmd, event, MEM_REQUEST);
 		  debug_cmd_client(cmd->dbg_fp, cmd->dbg_id, event->tag,
 				   event->context);
-		  client->mem_access = (void *)event;
 		}
                 if (event->type == CMD_READ_PE) {
 		  // init data
@@ -643,7 +936,7 @@ void handle_buffer_write(struct cmd *cmd)
 		  // client->wed uint64
 		  // event->data[116:123] is wed portion
 		  memcpy((void *)&(event->data[116]),(void *)&(client->wed), 8);
-		  event->state = MEM_RECEIVED;
+		  _set_state(cmd, event, MEM_RECEIVED);
 		  debug_msg("%s:PROCESS ELEMENT READ tag=0x%02x handle=%d",
 			    cmd->afu_name, event->tag, event->context);
 		}
@@ -660,12 +953,10 @@ void handle_buffer_read(struct cmd *cmd)
 		return;
 
 	// Randomly select a pending write (or none)
-	event = cmd->list;
-	while (event != NULL) {
-		if ((event->type == CMD_WRITE) &&
-		    (event->state == MEM_TOUCHED) &&
-		    ((event->client_state != CLIENT_VALID) ||
-		     !allow_reorder(cmd->parms))) {
+	event = cmd->queue[CMD_QUEUE_BUFFER_READ];
+	while (_delays(cmd) && (event != NULL)) {
+		if ((event->client_state != CLIENT_VALID) ||
+		    !allow_reorder(cmd->parms, cmd->sched)) {
 			break;
 		}
 		event = event->_next;
@@ -675,6 +966,11 @@ void handle_buffer_read(struct cmd *cmd)
 	if ((event == NULL) || (_get_client(cmd, event) == NULL))
 		return;
 
+	// Timing model: wait for room on the link
+	if ((cmd->timing != NULL) &&
+	    !timing_link(cmd->timing, TIMING_FROM_AFU, CACHELINE_BYTES))
+		return;
+
 	// Send buffer read request to AFU.  Setting cmd->buffer_read
 	// will block any more buffer read requests until buffer read
 	// data is returned and handled in handle_buffer_data().
@@ -683,8 +979,11 @@ void handle_buffer_read(struct cmd *cmd)
 	if (psl_buffer_read(cmd->afu_event, event->tag, event->addr,
 			    CACHELINE_BYTES) == PSL_SUCCESS) {
 		cmd->buffer_read = event;
+		if (cmd->timing != NULL)
+			timing_transfer(cmd->timing, TIMING_FROM_AFU,
+					CACHELINE_BYTES);
 		debug_cmd_buffer_read(cmd->dbg_fp, cmd->dbg_id, event->tag);
-		event->state = MEM_BUFFER;
+		_set_state(cmd, event, MEM_BUFFER);
 	}
 }
 
@@ -693,20 +992,18 @@ void handle_touch(struct cmd *cmd)
 {
 	struct cmd_event *event;
 	struct client *client;
-	uint8_t buffer[10];
-	uint64_t *addr;
+	uint8_t buffer[11];
+	uint64_t addr;
 
 	// Make sure cmd structure is valid
 	if (cmd == NULL)
 		return;
 
 	// Randomly select a pending touch (or none)
-	event = cmd->list;
-	while (event != NULL) {
-		if (((event->type == CMD_TOUCH) || (event->type == CMD_WRITE))
-		    && (event->state == MEM_IDLE)
-		    && ((event->client_state != CLIENT_VALID)
-			|| !allow_reorder(cmd->parms))) {
+	event = cmd->queue[CMD_QUEUE_TOUCH];
+	while (_delays(cmd) && (event != NULL)) {
+		if ((event->client_state != CLIENT_VALID) ||
+		    !allow_reorder(cmd->parms, cmd->sched)) {
 			break;
 		}
 		event = event->_next;
@@ -716,31 +1013,38 @@ void handle_touch(struct cmd *cmd)
 	if ((event == NULL) || ((client = _get_client(cmd, event)) == NULL))
 		return;
 
-	// Check that memory request can be driven to client
-	if (client->mem_access != NULL)
+	// Touch directly when the client shares this host
+	event->abort = &(client->abort);
+	if (client_mem_copy(client, event->addr & CACHELINE_MASK, buffer, 1,
+			    0) == 0) {
+		debug_msg("%s:MEMORY TOUCH tag=0x%02x addr=0x%016"PRIx64" direct",
+			  cmd->afu_name, event->tag, event->addr);
+		_set_state(cmd, event, MEM_TOUCH);
+		debug_cmd_client(cmd->dbg_fp, cmd->dbg_id, event->tag,
+				 event->context);
+		handle_mem_return(cmd, event, -1);
 		return;
+	}
 
 	// Send memory touch request to client
 	buffer[0] = (uint8_t) PSLSE_MEMORY_TOUCH;
-	buffer[1] = (uint8_t) event->size;
-	addr = (uint64_t *) & (buffer[2]);
-	*addr = htonll(event->addr & CACHELINE_MASK);
-	event->abort = &(client->abort);
+	buffer[1] = (uint8_t) event->tag;
+	buffer[2] = (uint8_t) event->size;
+	addr = htonll(event->addr & CACHELINE_MASK);
+	memcpy(&(buffer[3]), &addr, sizeof(addr));
 	debug_msg("%s:MEMORY TOUCH tag=0x%02x addr=0x%016"PRIx64, cmd->afu_name,
 		  event->tag, event->addr);
-	if (put_bytes(client->fd, 10, buffer, cmd->dbg_fp, cmd->dbg_id,
+	if (put_bytes(client->fd, 11, buffer, cmd->dbg_fp, cmd->dbg_id,
 		      event->context) < 0) {
 		client_drop(client, PSL_IDLE_CYCLES, CLIENT_NONE);
 	}
-	event->state = MEM_TOUCH;
-	client->mem_access = (void *)event;
+	_set_state(cmd, event, MEM_TOUCH);
 	debug_cmd_client(cmd->dbg_fp, cmd->dbg_id, event->tag, event->context);
 }
 
 // Send pending interrupt to client as soon as possible
 void handle_interrupt(struct cmd *cmd)
 {
-	struct cmd_event **head;
 	struct cmd_event *event;
 	struct client *client;
 	uint16_t irq;
@@ -751,14 +1055,7 @@ void handle_interrupt(struct cmd *cmd)
 		return;
 
 	// Send any interrupts to client immediately
-	head = &cmd->list;
-	while (*head != NULL) {
-		if (((*head)->type == CMD_INTERRUPT) &&
-		    ((*head)->state == MEM_IDLE))
-			break;
-		head = &((*head)->_next);
-	}
-	event = *head;
+	event = cmd->queue[CMD_QUEUE_INTERRUPT];
 
 	// Test for client disconnect
 	if ((event == NULL) || ((client = _get_client(cmd, event)) == NULL))
@@ -766,21 +1063,20 @@ void handle_interrupt(struct cmd *cmd)
 
 	// Send interrupt to client
 	buffer[0] = PSLSE_INTERRUPT;
-	irq = htons(cmd->irq);
+	irq = htons((uint16_t) event->addr);
 	memcpy(&(buffer[1]), &irq, 2);
 	event->abort = &(client->abort);
-	debug_msg("%s:INTERRUPT irq=%d", cmd->afu_name, cmd->irq);
+	debug_msg("%s:INTERRUPT irq=%d", cmd->afu_name, (int)event->addr);
 	if (put_bytes(client->fd, 3, buffer, cmd->dbg_fp, cmd->dbg_id,
 		      event->context) < 0) {
 		client_drop(client, PSL_IDLE_CYCLES, CLIENT_NONE);
 	}
 	debug_cmd_client(cmd->dbg_fp, cmd->dbg_id, event->tag, event->context);
-	event->state = MEM_DONE;
+	_set_state(cmd, event, MEM_DONE);
 }
 
 void handle_buffer_data(struct cmd *cmd, uint32_t parity_enable)
 {
-	uint8_t *parity_check;
 	int rc;
 	struct cmd_event *event;
 	int quadrant, byte;
@@ -796,6 +1092,7 @@ void handle_buffer_data(struct cmd *cmd, uint32_t parity_enable)
 	if (rc == PSL_SUCCESS) {
 		debug_msg("%s:BUFFER READ tag=0x%02x", cmd->afu_name,
 			  event->tag);
+		stats_buffer(cmd->stats, event->context, CACHELINE_BYTES, 0);
 		for (quadrant = 0; quadrant < 4; quadrant++) {
 			DPRINTF("DEBUG: Q%d 0x", quadrant);
 			for (byte = 0; byte < CACHELINE_BYTES / 4; byte++) {
@@ -803,39 +1100,29 @@ void handle_buffer_data(struct cmd *cmd, uint32_t parity_enable)
 			}
 			DPRINTF("\n");
 		}
-		if (parity_enable) {
-			parity_check =
-			    (uint8_t *) malloc(DWORDS_PER_CACHELINE / 8);
-			generate_cl_parity(event->data, parity_check);
-			if (strncmp((char *)event->parity,
-				    (char *)parity_check,
-				    DWORDS_PER_CACHELINE / 8)) {
-				error_msg("Buffer read parity error tag=0x%02x",
-					  event->tag);
-			}
-			free(parity_check);
-		}
+		if (parity_enable)
+			_buffer_parity(event);
 		// Free buffer interface for another event
 		cmd->buffer_read = NULL;
 
 		// Randomly decide to not send data to client yet
-		if (!event->buffer_activity && allow_buffer(cmd->parms)) {
-			event->state = MEM_TOUCHED;
+		if (_delays(cmd) && !event->buffer_activity &&
+		    allow_buffer(cmd->parms, cmd->sched)) {
+			_set_state(cmd, event, MEM_TOUCHED);
 			event->buffer_activity = 1;
 			return;
 		}
 
-		event->state = MEM_RECEIVED;
+		_set_state(cmd, event, MEM_RECEIVED);
 	}
 
 }
 
 void handle_mem_write(struct cmd *cmd)
 {
-	struct cmd_event **head;
 	struct cmd_event *event;
 	struct client *client;
-	uint64_t *addr;
+	uint64_t addr;
 	uint8_t *buffer;
 	uint64_t offset;
 
@@ -844,147 +1131,83 @@ void handle_mem_write(struct cmd *cmd)
 		return;
 
 	// Send any ready write data to client immediately
-	head = &cmd->list;
-	while (*head != NULL) {
-		if (((*head)->type == CMD_WRITE) &&
-		    ((*head)->state == MEM_RECEIVED))
-			break;
-		head = &((*head)->_next);
-	}
-	event = *head;
+	event = cmd->queue[CMD_QUEUE_MEM_WRITE];
 
 	// Test for client disconnect
 	if ((event == NULL) || ((client = _get_client(cmd, event)) == NULL))
 		return;
 
-	// Check that memory request can be driven to client
-	if (client->mem_access != NULL)
-		return;
-
 	// Send data to client and clear event to allow
 	// the next buffer read to occur.  The request will now await
 	// confirmation from the client that the memory write was
 	// successful before generating a response.  The client
 	// response will cause a call to either handle_aerror() or
-	// handle_mem_return().
-	buffer = (uint8_t *) malloc(event->size + 10);
+	// handle_mem_return().  Clients on the same host are written
+	// directly.
 	offset = event->addr & ~CACHELINE_MASK;
-	buffer[0] = (uint8_t) PSLSE_MEMORY_WRITE;
-	buffer[1] = (uint8_t) event->size;
-	addr = (uint64_t *) & (buffer[2]);
-	*addr = htonll(event->addr);
-	memcpy(&(buffer[10]), &(event->data[offset]), event->size);
 	event->abort = &(client->abort);
+	if (client_mem_copy(client, event->addr, &(event->data[offset]),
+			    event->size, 1) == 0) {
+		debug_msg("%s:MEMORY WRITE tag=0x%02x size=%d addr=0x%016"PRIx64" direct",
+			  cmd->afu_name, event->tag, event->size, event->addr);
+		debug_cmd_client(cmd->dbg_fp, cmd->dbg_id, event->tag,
+				 event->context);
+		_set_state(cmd, event, MEM_REQUEST);
+		handle_mem_return(cmd, event, -1);
+		return;
+	}
+	buffer = (uint8_t *) malloc(event->size + 11);
+	buffer[0] = (uint8_t) PSLSE_MEMORY_WRITE;
+	buffer[1] = (uint8_t) event->tag;
+	buffer[2] = (uint8_t) event->size;
+	addr = htonll(event->addr);
+	memcpy(&(buffer[3]), &addr, sizeof(addr));
+	memcpy(&(buffer[11]), &(event->data[offset]), event->size);
 	debug_msg("%s:MEMORY WRITE tag=0x%02x size=%d addr=0x%016"PRIx64,
 		  cmd->afu_name, event->tag, event->size, event->addr);
-	if (put_bytes(client->fd, event->size + 10, buffer, cmd->dbg_fp,
+	if (put_bytes(client->fd, event->size + 11, buffer, cmd->dbg_fp,
 		      cmd->dbg_id, client->context) < 0) {
 		client_drop(client, PSL_IDLE_CYCLES, CLIENT_NONE);
 	}
+	free(buffer);
 	debug_cmd_client(cmd->dbg_fp, cmd->dbg_id, event->tag, event->context);
-	event->state = MEM_REQUEST;
-	client->mem_access = (void *)event;
+	_set_state(cmd, event, MEM_REQUEST);
 }
 
-// Handle data returning from client for memory read
+// Handle data returning from client for memory read, fd is -1 when the data
+// was already read directly from client memory
 static void _handle_mem_read(struct cmd *cmd, struct cmd_event *event, int fd)
 {
 	uint8_t data[MAX_LINE_CHARS];
 	uint64_t offset = event->addr & ~CACHELINE_MASK;
 
+	if (fd < 0) {
+		generate_cl_parity(event->data, event->parity);
+		_set_state(cmd, event, MEM_RECEIVED);
+		return;
+	}
+
 	// Client is returning data from memory read
 	if (get_bytes_silent(fd, event->size, data, cmd->parms->timeout,
 			     event->abort) < 0) {
 	        debug_msg("%s:_handle_mem_read failed tag=0x%02x size=%d addr=0x%016"PRIx64,
 			  cmd->afu_name, event->tag, event->size, event->addr);
 		event->resp = PSL_RESPONSE_DERROR;
-		event->state = MEM_DONE;
+		_set_state(cmd, event, MEM_DONE);
 		debug_cmd_update(cmd->dbg_fp, cmd->dbg_id, event->tag,
 				 event->context, event->resp);
 		return;
 	}
 	memcpy((void *)&(event->data[offset]), (void *)&data, event->size);
 	generate_cl_parity(event->data, event->parity);
-	event->state = MEM_RECEIVED;
-}
-
-// Calculate page address in cached index for translation
-static void _calc_index(struct cmd *cmd, uint64_t * addr, uint64_t * index)
-{
-	*addr &= cmd->page_entries.page_filter;
-	*index = *addr & cmd->page_entries.entry_filter;
-	*index >>= PAGE_ADDR_BITS;
-}
-
-// Update age of translation entries and create new entry if needed
-static void _update_age(struct cmd *cmd, uint64_t addr)
-{
-	uint64_t index;
-	int i, set, age, oldest, empty;
-
-	_calc_index(cmd, &addr, &index);
-	set = age = oldest = 0;
-	empty = PAGE_WAYS;
-	for (i = 0; i < PAGE_WAYS; i++) {
-		if (cmd->page_entries.valid[index][i] &&
-		    (cmd->page_entries.entry[index][i] != addr)) {
-			cmd->page_entries.age[index][i]++;
-			if (cmd->page_entries.age[index][i] > age) {
-				age = cmd->page_entries.age[index][i];
-				oldest = i;
-			}
-		}
-		if (!cmd->page_entries.valid[index][i] && (empty == PAGE_WAYS)) {
-			empty = i;
-		}
-		if (cmd->page_entries.valid[index][i] &&
-		    (cmd->page_entries.entry[index][i] == addr)) {
-			cmd->page_entries.age[index][i] = 0;
-			set = 1;
-		}
-	}
-
-	// Entry found and updated
-	if (set)
-		return;
-
-	// Empty slot exists
-	if (empty < PAGE_WAYS) {
-		cmd->page_entries.entry[index][empty] = addr;
-		cmd->page_entries.valid[index][empty] = 1;
-		cmd->page_entries.age[index][empty] = 0;
-		return;
-	}
-	// Evict oldest entry and replace with new entry
-	cmd->page_entries.entry[index][oldest] = addr;
-	cmd->page_entries.valid[index][oldest] = 1;
-	cmd->page_entries.age[index][oldest] = 0;
-}
-
-// Determine if page translation is already cached
-static int _page_cached(struct cmd *cmd, uint64_t addr)
-{
-	uint64_t index;
-	int i, hit;
-
-	_calc_index(cmd, &addr, &index);
-	i = hit = 0;
-	while ((i < PAGE_WAYS) && cmd->page_entries.valid[index][i] &&
-	       (cmd->page_entries.entry[index][i] != addr)) {
-		i++;
-	}
-
-	// Hit entry
-	if ((i < PAGE_WAYS) && cmd->page_entries.valid[index][i])
-		hit = 1;
-
-	return hit;
+	_set_state(cmd, event, MEM_RECEIVED);
 }
 
 // Decide what to do with a client memory acknowledgement
 void handle_mem_return(struct cmd *cmd, struct cmd_event *event, int fd)
 {
 	struct client *client;
+	int hit;
 
 	// Test for client disconnect
 	if ((event == NULL) || ((client = _get_client(cmd, event)) == NULL))
@@ -993,73 +1216,133 @@ void handle_mem_return(struct cmd *cmd, struct cmd_event *event, int fd)
 	debug_msg("%s:MEMORY ACK tag=0x%02x addr=0x%016"PRIx64, cmd->afu_name,
 		  event->tag, event->addr);
 
-	// Randomly cause paged response
+	// Randomly cause paged response on translation miss
+	hit = erat_lookup(cmd->erat, event->context, event->addr);
+	if ((cmd->timing != NULL) && !event->timed) {
+		event->ready_cycle = event->start_cycle +
+		    timing_latency(cmd->timing, hit);
+		event->timed = 1;
+	}
 	if (((event->type != CMD_WRITE) || (event->state != MEM_REQUEST)) &&
-	    (client->flushing == FLUSH_NONE) && !_page_cached(cmd, event->addr)
-	    && allow_paged(cmd->parms)) {
+	    (client->flushing == FLUSH_NONE) && !hit &&
+	    allow_paged(cmd->parms, cmd->sched)) {
+		stats_erat(cmd->stats, event->context, 0, 0);
 		if (event->type == CMD_READ)
 			_handle_mem_read(cmd, event, fd);
 		event->resp = PSL_RESPONSE_PAGED;
-		event->state = MEM_DONE;
+		_set_state(cmd, event, MEM_DONE);
 		client->flushing = FLUSH_PAGED;
 		debug_cmd_update(cmd->dbg_fp, cmd->dbg_id, event->tag,
 				 event->context, event->resp);
 		return;
 	}
 
-	_update_age(cmd, event->addr);
+	if (hit)
+		stats_erat(cmd->stats, event->context, 1, 0);
+	else
+		stats_erat(cmd->stats, event->context, 0,
+			   erat_fill(cmd->erat, event->context, event->addr));
 
 	if (event->type == CMD_READ)
 		_handle_mem_read(cmd, event, fd);
 	else if (event->type == CMD_TOUCH)
-		event->state = MEM_DONE;
+		_set_state(cmd, event, MEM_DONE);
 	else if (event->state == MEM_TOUCH)	// Touch before write
-		event->state = MEM_TOUCHED;
+		_set_state(cmd, event,
+			   event->with_data ? MEM_RECEIVED : MEM_TOUCHED);
 	else			// Write after touch
-		event->state = MEM_DONE;
+		_set_state(cmd, event, MEM_DONE);
 	debug_cmd_return(cmd->dbg_fp, cmd->dbg_id, event->tag, event->context);
 }
 
+// Find command a client memory acknowledgement is for
+struct cmd_event *handle_mem_ack(struct cmd *cmd, struct client *client,
+				 uint8_t tag)
+{
+	struct cmd_event *event;
+
+	event = cmd->tag[tag];
+	if ((event == NULL) || (event->context != client->context) ||
+	    ((event->state != MEM_REQUEST) && (event->state != MEM_TOUCH))) {
+		warn_msg("%s:Unexpected memory ack tag=0x%02x context=%d",
+			 cmd->afu_name, tag, client->context);
+		return NULL;
+	}
+	return event;
+}
+
+// Fail any memory requests still waiting on a client
+void handle_mem_abort(struct cmd *cmd, int32_t context)
+{
+	struct cmd_event *event;
+	int i;
+
+	for (i = 0; i < CMD_TAGS; i++) {
+		event = cmd->tag[i];
+		if ((event == NULL) || (event->context != context))
+			continue;
+		if ((event->state == MEM_REQUEST) || (event->state == MEM_TOUCH))
+			handle_failed(cmd, event);
+	}
+}
+
 // Mark memory event as address error in preparation for response
 void handle_aerror(struct cmd *cmd, struct cmd_event *event)
 {
 	event->resp = PSL_RESPONSE_AERROR;
-	event->state = MEM_DONE;
+	_set_state(cmd, event, MEM_DONE);
 	debug_cmd_update(cmd->dbg_fp, cmd->dbg_id, event->tag,
 			 event->context, event->resp);
 }
 
+// Mark memory event as failed in preparation for response
+void handle_failed(struct cmd *cmd, struct cmd_event *event)
+{
+	event->resp = PSL_RESPONSE_FAILED;
+	_set_state(cmd, event, MEM_DONE);
+	debug_cmd_update(cmd->dbg_fp, cmd->dbg_id, event->tag,
+			 event->context, event->resp);
+}
+
+// Error responses are driven without delay
+static int _fast_resp(struct cmd_event *event)
+{
+	return (event->resp == PSL_RESPONSE_PAGED) ||
+	    (event->resp == PSL_RESPONSE_NRES) ||
+	    (event->resp == PSL_RESPONSE_NLOCK) ||
+	    (event->resp == PSL_RESPONSE_FAILED) ||
+	    (event->resp == PSL_RESPONSE_FLUSHED);
+}
+
 // Send a randomly selected pending response back to AFU
 void handle_response(struct cmd *cmd)
 {
-	struct cmd_event **head;
 	struct cmd_event *event;
 	struct client *client;
-	int rc;
 
 	// Select a random pending response (or none)
 	client = NULL;
-	head = &cmd->list;
-	while (*head != NULL) {
+	event = cmd->queue[CMD_QUEUE_RESPONSE];
+	if (cmd->timing != NULL) {
+		// Timing model: respond to the first command that is due
+		while ((event != NULL) && (event->ready_cycle > cmd->cycle))
+			event = event->_next;
+		if ((event != NULL) && _fast_resp(event))
+			goto drive_resp;
+	}
+	while (_delays(cmd) && (event != NULL)) {
 		// Fast track error responses
-		if (((*head)->resp == PSL_RESPONSE_PAGED) ||
-		    ((*head)->resp == PSL_RESPONSE_NRES) ||
-		    ((*head)->resp == PSL_RESPONSE_NLOCK) ||
-		    ((*head)->resp == PSL_RESPONSE_FAILED) ||
-		    ((*head)->resp == PSL_RESPONSE_FLUSHED)) {
-			event = *head;
+		if (_fast_resp(event))
 			goto drive_resp;
-		}
-		if (((*head)->state == MEM_DONE) && !allow_reorder(cmd->parms)) {
+		if (!allow_reorder(cmd->parms, cmd->sched))
 			break;
-		}
-		head = &((*head)->_next);
+		event = event->_next;
 	}
 
 	// Randomly decide not to drive response yet
-	event = *head;
-	if ((event == NULL) || ((event->client_state == CLIENT_VALID)
-				&& !allow_resp(cmd->parms))) {
+	if ((event == NULL) || (_delays(cmd) &&
+				(event->client_state == CLIENT_VALID) &&
+				!allow_resp(cmd->parms, cmd->sched))) {
 		return;
 	}
 	// Test for client disconnect
@@ -1075,63 +1358,154 @@ void handle_response(struct cmd *cmd)
 	}
 
  drive_resp:
-	// Check for pending buffer activity
-	while (event == cmd->buffer_read) {
-		if (cmd->afu_event->buffer_rdata_valid) {
-			warn_msg("Application terminated while AFU write still active");
-			_print_event(event);
-			cmd->afu_event->buffer_rdata_valid = 0;
-			cmd->buffer_read = NULL;
-		}
-		else {
-			psl_signal_afu_model(cmd->afu_event);
-			psl_get_afu_events(cmd->afu_event);
+	_respond(cmd, event, client);
+}
+
+int client_cmd(struct cmd *cmd, struct client *client)
+{
+	struct cmd_event *event;
+	int *count, i;
+
+	// No events for this client
+	count = _context_cmds(cmd, client->context);
+	if ((count == NULL) || (*count == 0))
+		return 0;
+
+	// Event is for client in valid state
+	if (client->state == CLIENT_VALID)
+		return 1;
+
+	if (client->state != CLIENT_NONE)
+		return 0;
+
+	// Client dropped, terminate events
+	for (i = 0; i < CMD_TAGS; i++) {
+		event = cmd->tag[i];
+		if ((event == NULL) || (event->context != client->context) ||
+		    (event->state == MEM_DONE))
+			continue;
+		if ((event->type == CMD_READ) ||
+		    (event->type == CMD_WRITE) ||
+		    (event->type == CMD_TOUCH)) {
+			event->resp = PSL_RESPONSE_FAILED;
 		}
+		_set_state(cmd, event, MEM_DONE);
 	}
+	return 0;
+}
 
-	rc = psl_response(cmd->afu_event, event->tag, event->resp, 1, 0, 0);
-	if (rc == PSL_SUCCESS) {
-		debug_msg("%s:RESPONSE tag=0x%02x code=0x%x", cmd->afu_name,
-			  event->tag, event->resp);
-		debug_cmd_response(cmd->dbg_fp, cmd->dbg_id, event->tag);
-		if ((client != NULL) && (event->command == PSL_COMMAND_RESTART))
-			client->flushing = FLUSH_NONE;
-		*head = event->_next;
-		free(event->data);
-		free(event->parity);
-		free(event);
-		cmd->credits++;
+// Count commands still outstanding for context
+int cmd_pending(struct cmd *cmd, int32_t context)
+{
+	int *count;
+
+	if ((cmd == NULL) || ((count = _context_cmds(cmd, context)) == NULL))
+		return 0;
+	return *count;
+}
+
+// Drop all outstanding commands when AFU is reset
+// Call handler until it stops taking events from the head of queue
+static void _drain(struct cmd *cmd, enum cmd_queue queue,
+		   void (*handler) (struct cmd *))
+{
+	struct cmd_event *head;
+
+	do {
+		head = cmd->queue[queue];
+		handler(cmd);
+	} while ((cmd->queue[queue] != NULL) && (cmd->queue[queue] != head));
+}
+
+// Clients are not paced by AFU cycles, so for AFUs taking whole transactions
+// send everything ready for clients now instead of one event per cycle
+void cmd_drain(struct cmd *cmd)
+{
+	if ((cmd == NULL) || !cmd->afu_event->transactions)
+		return;
+	_drain(cmd, CMD_QUEUE_TOUCH, handle_touch);
+	_drain(cmd, CMD_QUEUE_MEM_WRITE, handle_mem_write);
+	_drain(cmd, CMD_QUEUE_BUFFER_WRITE, handle_buffer_write);
+	_drain(cmd, CMD_QUEUE_INTERRUPT, handle_interrupt);
+}
+
+// Return 1 if any command is waiting on PSL rather than on a client
+int cmd_queued(struct cmd *cmd)
+{
+	int i;
+
+	if (cmd == NULL)
+		return 0;
+	for (i = CMD_QUEUE_NONE + 1; i < CMD_QUEUES; i++) {
+		if (cmd->queue[i] != NULL)
+			return 1;
 	}
+	return 0;
 }
 
-int client_cmd(struct cmd *cmd, struct client *client)
+void cmd_reset(struct cmd *cmd)
 {
-	int rc = 0;
-	struct cmd_event *event = cmd->list;
+	struct cmd_event *event;
+	int i;
 
-	while (event != NULL) {
-		if (event->context != client->context) {
-			// Event is not for this client
-			event = event->_next;
+	cmd->buffer_read = NULL;
+	if (cmd->outstanding)
+		warn_msg("Client dropped context before AFU completed");
+	for (i = 0; i < CMD_TAGS; i++) {
+		if ((event = cmd->tag[i]) == NULL)
 			continue;
-		}
-		if ((client->state == CLIENT_NONE) &&
-		    (event->state != MEM_DONE)) {
-			// Client dropped, terminate event
-			event->state = MEM_DONE;
-			if ((event->type == CMD_READ) ||
-			    (event->type == CMD_WRITE) ||
-			    (event->type == CMD_TOUCH)) {
-				event->resp = PSL_RESPONSE_FAILED;
-			}
-			event = event->_next;
-			continue;
-		}
-		if (client->state == CLIENT_VALID) {
-			// Event is for client in valid state
-			return 1;
-		}
-		event = event->_next;
+		info_msg("Dumping command tag=0x%02x", event->tag);
+		_remove_cmd(cmd, event);
+	}
+
+	// Any slot still in use now was lost track of, rebuild pool
+	if (cmd->pool.use.in_use)
+		warn_msg("%s: %d command slots leaked", cmd->afu_name,
+			 cmd->pool.use.in_use);
+	cmd->pool.use.in_use = 0;
+	cmd->pool.free = NULL;
+	for (i = cmd->pool.use.slots - 1; i >= 0; i--) {
+		cmd->pool.slab[i]._next = cmd->pool.free;
+		cmd->pool.free = &(cmd->pool.slab[i]);
+	}
+}
+
+// Account cycles the PSL clocked the AFU for
+void cmd_clock(struct cmd *cmd, uint64_t cycle, int cycles)
+{
+	if (cmd == NULL)
+		return;
+	cmd->cycle = cycle;
+	stats_clock(cmd->stats, cmd->outstanding, cycles);
+	timing_clock(cmd->timing, cycle, cycles);
+}
+
+// Account cycles skipped while the AFU's clocks were stopped
+void cmd_skip(struct cmd *cmd, uint64_t cycle, uint64_t cycles)
+{
+	if (cmd == NULL)
+		return;
+	cmd->cycle = cycle;
+	stats_skip(cmd->stats, cmd->outstanding, cycles);
+	timing_skip(cmd->timing, cycle);
+}
+
+// Free cmd structure and its command slots
+void cmd_free(struct cmd *cmd)
+{
+	int i;
+
+	for (i = 0; i < CMD_TAGS; i++) {
+		if (cmd->tag[i] != NULL)
+			_remove_cmd(cmd, cmd->tag[i]);
 	}
-	return rc;
+	stats_report(cmd->stats, "shutdown");
+	timing_report(cmd->timing, cmd->afu_name);
+	timing_free(cmd->timing);
+	stats_free(cmd->stats);
+	schedule_free(cmd->sched);
+	erat_free(cmd->erat);
+	free(cmd->context_cmds);
+	free(cmd->pool.slab);
+	free(cmd);
 }
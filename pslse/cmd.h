@@ -22,16 +22,14 @@
 
 #include "client.h"
 #include "mmio.h"
+#include "erat.h"
 #include "parms.h"
+#include "stats.h"
+#include "timing.h"
 #include "../common/psl_interface.h"
+#include "../common/utils.h"
 
-#define TOTAL_PAGES_CACHED 64
-#define PAGE_WAYS 4
-#define LOG2_WAYS 2		// log2(PAGE_WAYS) = log2(4) = 2
-#define PAGE_ENTRIES (TOTAL_PAGES_CACHED / PAGE_WAYS)
-#define LOG2_ENTRIES 4		// log2(PAGE_ENTRIES) = log2(64/4) = log2(16) = 4
-#define PAGE_ADDR_BITS 12
-#define PAGE_MASK 0xFFF
+#define CMD_TAGS 256		// ha_rtag is 8 bits
 
 enum cmd_type {
 	CMD_READ,
@@ -42,6 +40,18 @@ enum cmd_type {
 	CMD_OTHER
 };
 
+// Queue of events waiting on each per-cycle handler
+enum cmd_queue {
+	CMD_QUEUE_NONE,		// Waiting on client or AFU
+	CMD_QUEUE_BUFFER_WRITE,	// Read needing client request or buffer write
+	CMD_QUEUE_BUFFER_READ,	// Touched write needing buffer read
+	CMD_QUEUE_TOUCH,	// Touch or write needing client touch
+	CMD_QUEUE_MEM_WRITE,	// Write data ready for client
+	CMD_QUEUE_INTERRUPT,	// Interrupt ready for client
+	CMD_QUEUE_RESPONSE,	// Ready to respond to AFU
+	CMD_QUEUES
+};
+
 enum mem_state {
 	MEM_IDLE,
 	MEM_TOUCH,
@@ -52,16 +62,14 @@ enum mem_state {
 	MEM_DONE
 };
 
-struct pages {
-	uint64_t entry[PAGE_ENTRIES][PAGE_WAYS];
-	uint64_t entry_filter;
-	uint64_t page_filter;
-	int age[PAGE_ENTRIES][PAGE_WAYS];
-	uint8_t valid[PAGE_ENTRIES][PAGE_WAYS];
-};
-
 struct cmd_event {
+	uint8_t data[CACHELINE_BYTES] __attribute__ ((aligned(CACHELINE_BYTES)));
+	uint8_t parity[DWORDS_PER_CACHELINE / 8];
 	uint64_t addr;
+	uint64_t start_cycle;
+	uint64_t start_ns;
+	uint64_t mem_ns;	// Time the client memory request was sent
+	uint64_t ready_cycle;	// Timing model: earliest data or response
 	int32_t context;
 	uint32_t command;
 	uint32_t tag;
@@ -70,32 +78,48 @@ struct cmd_event {
 	uint32_t resp;
 	uint8_t unlock;
 	uint8_t buffer_activity;
-	uint8_t *data;
-	uint8_t *parity;
+	uint8_t timed;		// ready_cycle set by the timing model
+	uint8_t with_data;	// Write data came with the command
 	int *abort;
 	enum cmd_type type;
 	enum mem_state state;
 	enum client_state client_state;
+	enum cmd_queue queue;
+	struct cmd_event *_prev;
 	struct cmd_event *_next;
 };
 
+// Preallocated cmd_event slots, one per credit
+struct cmd_pool {
+	struct cmd_event *slab;
+	struct cmd_event *free;
+	struct stats_pool use;	// Also shown in stats reports
+};
+
 struct cmd {
 	struct AFU_EVENT *afu_event;
-	struct cmd_event *list;
+	struct cmd_event *tag[CMD_TAGS];
+	struct cmd_event *queue[CMD_QUEUES];
 	struct cmd_event *buffer_read;
 	struct mmio *mmio;
 	struct parms *parms;
 	struct client **client;
-	struct pages page_entries;
+	struct erat *erat;
+	struct cmd_pool pool;
+	struct stats *stats;
+	struct schedule *sched;
+	struct timing *timing;	// NULL unless TIMING is set in pslse.parms
 	volatile enum pslse_state *psl_state;
 	char *afu_name;
 	FILE *dbg_fp;
 	uint8_t dbg_id;
 	uint64_t lock_addr;
 	uint64_t res_addr;
+	uint64_t cycle;		// PSL cycle count as of last cmd_clock()
 	uint32_t credits;
+	int *context_cmds;
+	int outstanding;
 	int max_clients;
-	uint16_t irq;
 	int locked;
 };
 
@@ -119,10 +143,31 @@ void handle_interrupt(struct cmd *cmd);
 
 void handle_mem_return(struct cmd *cmd, struct cmd_event *event, int fd);
 
+struct cmd_event *handle_mem_ack(struct cmd *cmd, struct client *client,
+				 uint8_t tag);
+
+void handle_mem_abort(struct cmd *cmd, int32_t context);
+
 void handle_aerror(struct cmd *cmd, struct cmd_event *event);
 
+void handle_failed(struct cmd *cmd, struct cmd_event *event);
+
 void handle_response(struct cmd *cmd);
 
 int client_cmd(struct cmd *cmd, struct client *client);
 
+int cmd_pending(struct cmd *cmd, int32_t context);
+
+void cmd_drain(struct cmd *cmd);
+
+int cmd_queued(struct cmd *cmd);
+
+void cmd_reset(struct cmd *cmd);
+
+void cmd_clock(struct cmd *cmd, uint64_t cycle, int cycles);
+
+void cmd_skip(struct cmd *cmd, uint64_t cycle, uint64_t cycles);
+
+void cmd_free(struct cmd *cmd);
+
 #endif				/* _CMD_H_ */
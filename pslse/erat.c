@@ -0,0 +1,208 @@
+/*
+ * Copyright 2014,2015 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: erat.c
+ *
+ *  This file contains the model of the PSL's effective to real address
+ *  translation cache.  The number of sets, the ways in each set, the page
+ *  size and the replacement policy come from pslse.parms.  Entries are
+ *  tagged with the context as well as the page, so contexts only hit on
+ *  their own translations and a detaching context drops its entries.  The
+ *  set is chosen by the low bits of the page number.  PSL only uses the
+ *  model to decide when a PAGED response may be given and to count hits,
+ *  misses and evictions, since the simulation has no real translation.
+ */
+
+#include <stdlib.h>
+#include <strings.h>
+
+#include "erat.h"
+#include "../common/utils.h"
+
+static const char *_policies[] = { "LRU", "PLRU", "RANDOM" };
+
+struct erat *erat_init(uint32_t sets, uint32_t ways, uint32_t page_shift,
+		       enum erat_policy policy, uint64_t seed)
+{
+	struct erat *erat;
+
+	erat = (struct erat *)calloc(1, sizeof(struct erat));
+	if (!erat) {
+		perror("malloc");
+		exit(-1);
+	}
+	erat->entry = (struct erat_entry *)calloc(sets * ways,
+						  sizeof(struct erat_entry));
+	erat->plru = (uint64_t *) calloc(sets, sizeof(uint64_t));
+	if (!erat->entry || !erat->plru) {
+		perror("malloc");
+		exit(-1);
+	}
+	erat->sets = sets;
+	erat->ways = ways;
+	erat->page_shift = page_shift;
+	erat->policy = policy;
+	erat->rand = seed ? seed : 1;
+	return erat;
+}
+
+static struct erat_entry *_set(struct erat *erat, uint64_t page,
+			       uint32_t * set)
+{
+	*set = page & (erat->sets - 1);
+	return &(erat->entry[*set * erat->ways]);
+}
+
+// Point every PLRU node on the way's path away from it
+static void _plru_touch(struct erat *erat, uint32_t set, uint32_t way)
+{
+	uint64_t *tree = &(erat->plru[set]);
+	uint32_t node, bit, level;
+
+	node = 1;
+	for (level = erat->ways >> 1; level; level >>= 1) {
+		bit = (way & level) ? 1 : 0;
+		if (bit)
+			*tree &= ~(1ull << node);
+		else
+			*tree |= 1ull << node;
+		node = 2 * node + bit;
+	}
+}
+
+// Follow the PLRU nodes to the way they point at
+static uint32_t _plru_victim(struct erat *erat, uint32_t set)
+{
+	uint32_t node;
+
+	node = 1;
+	while (node < erat->ways)
+		node = 2 * node + ((erat->plru[set] >> node) & 1);
+	return node - erat->ways;
+}
+
+static uint32_t _victim(struct erat *erat, uint32_t set,
+			struct erat_entry *entry)
+{
+	uint32_t way, oldest;
+
+	switch (erat->policy) {
+	case ERAT_PLRU:
+		return _plru_victim(erat, set);
+	case ERAT_RANDOM:
+		erat->rand ^= erat->rand << 13;
+		erat->rand ^= erat->rand >> 7;
+		erat->rand ^= erat->rand << 17;
+		return erat->rand % erat->ways;
+	default:
+		oldest = 0;
+		for (way = 1; way < erat->ways; way++) {
+			if (entry[way].used < entry[oldest].used)
+				oldest = way;
+		}
+		return oldest;
+	}
+}
+
+static void _touch(struct erat *erat, uint32_t set, uint32_t way,
+		   struct erat_entry *entry)
+{
+	if (erat->policy == ERAT_PLRU)
+		_plru_touch(erat, set, way);
+	else
+		entry[way].used = ++erat->clock;
+}
+
+int erat_lookup(struct erat *erat, int32_t context, uint64_t addr)
+{
+	struct erat_entry *entry;
+	uint64_t page;
+	uint32_t set, way;
+
+	page = addr >> erat->page_shift;
+	entry = _set(erat, page, &set);
+	for (way = 0; way < erat->ways; way++) {
+		if (entry[way].valid && (entry[way].page == page) &&
+		    (entry[way].context == context)) {
+			_touch(erat, set, way, entry);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int erat_fill(struct erat *erat, int32_t context, uint64_t addr)
+{
+	struct erat_entry *entry;
+	uint64_t page;
+	uint32_t set, way;
+	int evicted;
+
+	page = addr >> erat->page_shift;
+	entry = _set(erat, page, &set);
+	for (way = 0; way < erat->ways; way++) {
+		if (!entry[way].valid)
+			break;
+	}
+	evicted = 0;
+	if (way == erat->ways) {
+		way = _victim(erat, set, entry);
+		evicted = 1;
+	}
+	entry[way].page = page;
+	entry[way].context = context;
+	entry[way].valid = 1;
+	_touch(erat, set, way, entry);
+	return evicted;
+}
+
+void erat_invalidate(struct erat *erat, int32_t context)
+{
+	uint32_t i;
+
+	for (i = 0; i < erat->sets * erat->ways; i++) {
+		if (erat->entry[i].context == context)
+			erat->entry[i].valid = 0;
+	}
+}
+
+int erat_policy_parse(const char *name)
+{
+	int i;
+
+	for (i = 0; i < sizeof(_policies) / sizeof(_policies[0]); i++) {
+		if (!strcasecmp(name, _policies[i]))
+			return i;
+	}
+	return -1;
+}
+
+const char *erat_policy_name(enum erat_policy policy)
+{
+	if (policy > ERAT_RANDOM)
+		return "UNKNOWN";
+	return _policies[policy];
+}
+
+void erat_free(struct erat *erat)
+{
+	if (erat == NULL)
+		return;
+	free(erat->entry);
+	free(erat->plru);
+	free(erat);
+}
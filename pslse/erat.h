@@ -0,0 +1,69 @@
+/*
+ * Copyright 2014,2015 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ERAT_H_
+#define _ERAT_H_
+
+#include <stdint.h>
+
+#define ERAT_MAX_SETS 4096
+#define ERAT_MAX_WAYS 64	// PLRU tree bits must fit in a uint64_t
+
+enum erat_policy {
+	ERAT_LRU,
+	ERAT_PLRU,
+	ERAT_RANDOM
+};
+
+struct erat_entry {
+	uint64_t page;
+	uint64_t used;		// LRU stamp
+	int32_t context;
+	int32_t valid;
+};
+
+// Translation cache for one AFU, only touched by its PSL thread
+struct erat {
+	struct erat_entry *entry;	// sets * ways entries
+	uint64_t *plru;		// PLRU tree for each set, node n is bit n
+	uint64_t clock;		// Source of LRU stamps
+	uint64_t rand;		// xorshift64 state for ERAT_RANDOM
+	uint32_t sets;
+	uint32_t ways;
+	uint32_t page_shift;
+	enum erat_policy policy;
+};
+
+struct erat *erat_init(uint32_t sets, uint32_t ways, uint32_t page_shift,
+		       enum erat_policy policy, uint64_t seed);
+
+// Return 1 and mark the entry used if addr is translated for context
+int erat_lookup(struct erat *erat, int32_t context, uint64_t addr);
+
+// Cache the translation for addr, return 1 if a valid entry was evicted
+int erat_fill(struct erat *erat, int32_t context, uint64_t addr);
+
+// Drop every translation for context
+void erat_invalidate(struct erat *erat, int32_t context);
+
+// Return policy for name, or -1 if unknown
+int erat_policy_parse(const char *name);
+
+const char *erat_policy_name(enum erat_policy policy);
+
+void erat_free(struct erat *erat);
+
+#endif				/* _ERAT_H_ */
@@ -33,7 +33,9 @@
  *  However, the event still lives and the client will still point to it.  When
  *  the psl code next calls handle_mmio_done for that client it will return the
  *  acknowledge as well as any data to the client.  At that point the event
- *  memory will be freed.
+ *  memory will be freed.  A client batch (PSLSE_MMIO_BATCH) is added to the
+ *  list as one event per access, chained through _batch, and is acknowledged
+ *  once the last access completes.
  */
 
 #include <arpa/inet.h>
@@ -44,6 +46,9 @@
 #include "../common/debug.h"
 #include "mmio.h"
 
+// Bytes per access in a PSLSE_MMIO_BATCH message
+#define MMIO_BATCH_ACCESS 13
+
 // Initialize MMIO tracking structure
 struct mmio *mmio_init(struct AFU_EVENT *afu_event, int timeout, char *afu_name,
 		       FILE * dbg_fp, uint8_t dbg_id)
@@ -101,8 +106,10 @@ static struct mmio_event *_add_event(struct mmio *mmio, struct client *client,
 	// event->addr = addr;
 	event->desc = desc;
 	event->data = data;
+	event->batch = 0;
 	event->state = PSLSE_IDLE;
 	event->_next = NULL;
+	event->_batch = NULL;
 
 	// debug the mmio and print the input address and the translated address
 	/* debug_msg("_add_event: %s: WRITE%d word=0x%05x (0x%05x) data=0x%s", */
@@ -462,6 +469,120 @@ struct mmio_event *handle_mmio(struct mmio *mmio, struct client *client,
 		return _handle_mmio_write(mmio, client, dw);
 }
 
+// Add a batch of MMIO accesses from client to list in order
+struct mmio_event *handle_mmio_batch(struct mmio *mmio, struct client *client)
+{
+	struct mmio_event *first, *last, *event;
+	uint8_t buffer[PSLSE_MMIO_BATCH_MAX * MMIO_BATCH_ACCESS];
+	uint8_t *access;
+	uint64_t data;
+	uint32_t offset;
+	uint16_t count;
+	uint8_t ack;
+	int i, rnw, dw;
+
+	if (get_bytes_silent(client->fd, 2, buffer, mmio->timeout,
+			     &(client->abort)) < 0)
+		goto batch_fail;
+	memcpy(&count, buffer, sizeof(count));
+	count = ntohs(count);
+	if ((count == 0) || (count > PSLSE_MMIO_BATCH_MAX)) {
+		warn_msg("MMIO batch of %d accesses from client context %d",
+			 count, client->context);
+		goto batch_fail;
+	}
+
+	// Read the whole batch before queuing any of it, so a client dropped
+	// partway through leaves no accesses for the AFU
+	for (i = 0; i < count; i++) {
+		if (get_bytes_silent(client->fd, MMIO_BATCH_ACCESS,
+				     &(buffer[i * MMIO_BATCH_ACCESS]),
+				     mmio->timeout, &(client->abort)) < 0)
+			goto batch_fail;
+	}
+
+	// Only queue accesses once the client is known to be valid
+	first = last = NULL;
+	for (i = 0; (i < count) && (client->state == CLIENT_VALID); i++) {
+		// Each access is [type][offset][data]
+		access = &(buffer[i * MMIO_BATCH_ACCESS]);
+		memcpy(&offset, &(access[1]), sizeof(offset));
+		memcpy(&data, &(access[5]), sizeof(data));
+		offset = ntohl(offset);
+		data = ntohll(data);
+		rnw = (access[0] == PSLSE_MMIO_READ64) ||
+		    (access[0] == PSLSE_MMIO_READ32);
+		dw = (access[0] == PSLSE_MMIO_READ64) ||
+		    (access[0] == PSLSE_MMIO_WRITE64);
+		if (!dw) {
+			data &= 0xFFFFFFFFL;
+			data |= data << 32;
+		}
+		event = _add_mmio(mmio, client, rnw, dw, offset / 4, data);
+		if (first == NULL)
+			first = event;
+		else
+			last->_batch = event;
+		last = event;
+	}
+
+	if (first == NULL) {
+		ack = PSLSE_MMIO_FAIL;
+		if (put_bytes(client->fd, 1, &ack, mmio->dbg_fp, mmio->dbg_id,
+			      client->context) < 0) {
+			client_drop(client, PSL_IDLE_CYCLES, CLIENT_NONE);
+		}
+		return NULL;
+	}
+	first->batch = count;
+	return first;
+
+ batch_fail:
+	// Socket connection is dead or out of step
+	debug_msg("%s:handle_mmio_batch failed context=%d", mmio->afu_name,
+		  client->context);
+	client_drop(client, PSL_IDLE_CYCLES, CLIENT_NONE);
+	return NULL;
+}
+
+// Return acknowledge and 8 bytes of data per access for a completed batch
+static struct mmio_event *_handle_mmio_batch_done(struct mmio *mmio,
+						  struct client *client,
+						  struct mmio_event *first)
+{
+	struct mmio_event *event, *next;
+	uint8_t *buffer;
+	uint64_t data;
+	int size, offset;
+
+	// Batch is done once its last access is
+	event = first;
+	while (event->_batch != NULL)
+		event = event->_batch;
+	if (event->state != PSLSE_DONE)
+		return first;
+
+	size = 1 + first->batch * sizeof(uint64_t);
+	buffer = (uint8_t *) malloc(size);
+	buffer[0] = PSLSE_MMIO_ACK;
+	offset = 1;
+	for (event = first; event != NULL; event = next) {
+		next = event->_batch;
+		data = htonll(event->rnw ? event->data : 0);
+		memcpy(&(buffer[offset]), &data, sizeof(data));
+		offset += sizeof(data);
+		free(event);
+	}
+	if (put_bytes(client->fd, size, buffer, mmio->dbg_fp, mmio->dbg_id,
+		      client->context) < 0) {
+		client_drop(client, PSL_IDLE_CYCLES, CLIENT_NONE);
+	}
+	debug_mmio_return(mmio->dbg_fp, mmio->dbg_id, client->context);
+	free(buffer);
+
+	return NULL;
+}
+
 // Handle MMIO done
 struct mmio_event *handle_mmio_done(struct mmio *mmio, struct client *client)
 {
@@ -476,6 +597,9 @@ struct mmio_event *handle_mmio_done(struct mmio *mmio, struct client *client)
 	if (event == NULL)
 		return NULL;
 
+	if (event->batch)
+		return _handle_mmio_batch_done(mmio, client, event);
+
 	// MMIO event not done yet
 	if (event->state != PSLSE_DONE)
 		return event;
@@ -46,8 +46,10 @@ struct mmio_event {
 	uint32_t desc;
 	uint64_t data;
 	uint32_t parity;
+	uint16_t batch;		// Accesses in batch, set on first only
 	enum pslse_state state;
 	struct mmio_event *_next;
+	struct mmio_event *_batch;	// Next access in same client batch
 };
 
 struct config_record  {
@@ -101,6 +103,8 @@ void handle_mmio_map(struct mmio *mmio, struct client *client);
 struct mmio_event *handle_mmio(struct mmio *mmio, struct client *client,
 			       int rnw, int dw);
 
+struct mmio_event *handle_mmio_batch(struct mmio *mmio, struct client *client);
+
 struct mmio_event *handle_mmio_done(struct mmio *mmio, struct client *client);
 
 int dedicated_mode_support(struct mmio *mmio);
@@ -16,6 +16,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <time.h>
 
 #include "parms.h"
@@ -24,34 +25,29 @@
 
 #define DEFAULT_CREDITS 64
 
-// Randomly decide based on percent chance
-static inline int percent_chance(int chance)
-{
-	return ((rand() % 100) < chance);
-}
 
 // Randomly decide to allow response to AFU
-int allow_resp(struct parms *parms)
+int allow_resp(struct parms *parms, struct schedule *sched)
 {
-	return percent_chance(parms->resp_percent);
+	return schedule_decide(sched, SCHEDULE_RESP, parms->resp_percent);
 }
 
 // Randomly decide to allow PAGED response
-int allow_paged(struct parms *parms)
+int allow_paged(struct parms *parms, struct schedule *sched)
 {
-	return percent_chance(parms->paged_percent);
+	return schedule_decide(sched, SCHEDULE_PAGED, parms->paged_percent);
 }
 
 // Randomly decide to allow command to be handled out of order
-int allow_reorder(struct parms *parms)
+int allow_reorder(struct parms *parms, struct schedule *sched)
 {
-	return percent_chance(parms->reorder_percent);
+	return schedule_decide(sched, SCHEDULE_REORDER, parms->reorder_percent);
 }
 
 // Randomly decide to allow bogus buffer activity
-int allow_buffer(struct parms *parms)
+int allow_buffer(struct parms *parms, struct schedule *sched)
 {
-	return percent_chance(parms->buffer_percent);
+	return schedule_decide(sched, SCHEDULE_BUFFER, parms->buffer_percent);
 }
 
 // Decide a single random percentage value from a percentage range
@@ -75,6 +71,44 @@ static void percent_parm(char *value, int *parm)
 	}
 }
 
+// Return log2 of an ERAT page size of 4K, 64K or 16M, or 0 if unsupported
+static unsigned int page_shift_parm(char *value)
+{
+	if (!strcasecmp(value, "4K"))
+		return 12;
+	if (!strcasecmp(value, "64K"))
+		return 16;
+	if (!strcasecmp(value, "16M"))
+		return 24;
+	return 0;
+}
+
+// Parse a latency range in cycles, a single value is a fixed latency
+static int range_parm(char *value, struct timing_range *range)
+{
+	char *comma;
+	int min, max;
+
+	min = max = atoi(value);
+	comma = strchr(value, ',');
+	if (comma)
+		max = atoi(comma + 1);
+	if (max < min) {
+		max = min;
+		min = atoi(comma + 1);
+	}
+	if ((min < 0) || (max > TIMING_MAX_LATENCY))
+		return -1;
+	range->min = min;
+	range->max = max;
+	return 0;
+}
+
+static uint32_t range_debug(struct timing_range *range)
+{
+	return (range->max << 16) | range->min;
+}
+
 // Open and parse parms file
 struct parms *parse_parms(char *filename, FILE * dbg_fp)
 {
@@ -97,6 +131,18 @@ struct parms *parse_parms(char *filename, FILE * dbg_fp)
 	parms->paged_percent = 5;
 	parms->reorder_percent = 20;
 	parms->buffer_percent = 50;
+	parms->erat_sets = 16;
+	parms->erat_ways = 4;
+	parms->erat_page_shift = 12;
+	parms->erat_policy = ERAT_LRU;
+	memset(&(parms->timing), 0, sizeof(parms->timing));
+	parms->timing.hit.min = 40;
+	parms->timing.hit.max = 60;
+	parms->timing.miss.min = 200;
+	parms->timing.miss.max = 300;
+	parms->timing.xlate.min = 300;
+	parms->timing.xlate.max = 600;
+	parms->timing.link_bytes = 32;
 
 	// Open file and parse contents
 	fp = fopen(filename, "r");
@@ -184,6 +230,87 @@ struct parms *parse_parms(char *filename, FILE * dbg_fp)
 				parms->buffer_percent = data;
 			debug_parm(dbg_fp, DBG_PARM_BUFFER_PERCENT,
 				   parms->buffer_percent);
+		} else if (!(strcmp(parm, "ERAT_SETS"))) {
+			data = atoi(value);
+			if ((data <= 0) || (data > ERAT_MAX_SETS) ||
+			    (data & (data - 1)))
+				warn_msg("ERAT_SETS must be a power of 2, 1-%d",
+					 ERAT_MAX_SETS);
+			else
+				parms->erat_sets = data;
+			debug_parm(dbg_fp, DBG_PARM_ERAT_SETS,
+				   parms->erat_sets);
+		} else if (!(strcmp(parm, "ERAT_WAYS"))) {
+			data = atoi(value);
+			if ((data <= 0) || (data > ERAT_MAX_WAYS))
+				warn_msg("ERAT_WAYS must be 1-%d",
+					 ERAT_MAX_WAYS);
+			else
+				parms->erat_ways = data;
+			debug_parm(dbg_fp, DBG_PARM_ERAT_WAYS,
+				   parms->erat_ways);
+		} else if (!(strcmp(parm, "ERAT_PAGE_SIZE"))) {
+			data = page_shift_parm(value);
+			if (!data)
+				warn_msg("ERAT_PAGE_SIZE must be 4K/64K/16M");
+			else
+				parms->erat_page_shift = data;
+			debug_parm(dbg_fp, DBG_PARM_ERAT_PAGE_SIZE,
+				   1 << parms->erat_page_shift);
+		} else if (!(strcmp(parm, "ERAT_POLICY"))) {
+			data = erat_policy_parse(value);
+			if (data < 0)
+				warn_msg("ERAT_POLICY must be LRU/PLRU/RANDOM");
+			else
+				parms->erat_policy = data;
+			debug_parm(dbg_fp, DBG_PARM_ERAT_POLICY,
+				   parms->erat_policy);
+		} else if (!(strcmp(parm, "TIMING"))) {
+			parms->timing.enabled = (atoi(value) != 0);
+			debug_parm(dbg_fp, DBG_PARM_TIMING,
+				   parms->timing.enabled);
+		} else if (!(strcmp(parm, "TIMING_HIT_PERCENT"))) {
+			data = atoi(value);
+			if ((data > 100) || (data < 0))
+				warn_msg("TIMING_HIT_PERCENT must be 0-100");
+			else
+				parms->timing.hit_percent = data;
+			debug_parm(dbg_fp, DBG_PARM_TIMING_HIT_PERCENT,
+				   parms->timing.hit_percent);
+		} else if (!(strcmp(parm, "TIMING_HIT_LATENCY"))) {
+			if (range_parm(value, &(parms->timing.hit)) < 0)
+				warn_msg("TIMING_HIT_LATENCY must be 0-%d",
+					 TIMING_MAX_LATENCY);
+			debug_parm(dbg_fp, DBG_PARM_TIMING_HIT_LATENCY,
+				   range_debug(&(parms->timing.hit)));
+		} else if (!(strcmp(parm, "TIMING_MISS_LATENCY"))) {
+			if (range_parm(value, &(parms->timing.miss)) < 0)
+				warn_msg("TIMING_MISS_LATENCY must be 0-%d",
+					 TIMING_MAX_LATENCY);
+			debug_parm(dbg_fp, DBG_PARM_TIMING_MISS_LATENCY,
+				   range_debug(&(parms->timing.miss)));
+		} else if (!(strcmp(parm, "TIMING_XLATE_LATENCY"))) {
+			if (range_parm(value, &(parms->timing.xlate)) < 0)
+				warn_msg("TIMING_XLATE_LATENCY must be 0-%d",
+					 TIMING_MAX_LATENCY);
+			debug_parm(dbg_fp, DBG_PARM_TIMING_XLATE_LATENCY,
+				   range_debug(&(parms->timing.xlate)));
+		} else if (!(strcmp(parm, "TIMING_LINK_BYTES"))) {
+			data = atoi(value);
+			if (data < 0)
+				warn_msg("TIMING_LINK_BYTES must be 0 or more");
+			else
+				parms->timing.link_bytes = data;
+			debug_parm(dbg_fp, DBG_PARM_TIMING_LINK_BYTES,
+				   parms->timing.link_bytes);
+		} else if (!(strcmp(parm, "TIMING_MAX_READS"))) {
+			data = atoi(value);
+			if (data < 0)
+				warn_msg("TIMING_MAX_READS must be 0 or more");
+			else
+				parms->timing.max_reads = data;
+			debug_parm(dbg_fp, DBG_PARM_TIMING_MAX_READS,
+				   parms->timing.max_reads);
 		} else {
 			warn_msg("Ignoring invalid parm in %s: %s\n",
 				 filename, parm);
@@ -191,9 +318,15 @@ struct parms *parse_parms(char *filename, FILE * dbg_fp)
 		}
 	}
 
-	// Close file and set seed
+	// Close file, each PSL seeds its own decisions from parms->seed
 	fclose(fp);
-	srand(parms->seed);
+
+	// PLRU needs a full binary tree over the ways
+	if ((parms->erat_policy == ERAT_PLRU) &&
+	    (parms->erat_ways & (parms->erat_ways - 1))) {
+		warn_msg("PLRU needs power of 2 ERAT_WAYS, using LRU");
+		parms->erat_policy = ERAT_LRU;
+	}
 
 	// Print out parm settings
 	info_msg("PSLSE parm values:");
@@ -208,6 +341,20 @@ struct parms *parse_parms(char *filename, FILE * dbg_fp)
 	printf("\tPaged    = %d%%\n", parms->paged_percent);
 	printf("\tReorder  = %d%%\n", parms->reorder_percent);
 	printf("\tBuffer   = %d%%\n", parms->buffer_percent);
+	printf("\tERAT     = %d sets x %d ways, %dKB pages, %s\n",
+	       parms->erat_sets, parms->erat_ways,
+	       1 << (parms->erat_page_shift - 10),
+	       erat_policy_name(parms->erat_policy));
+	if (parms->timing.enabled) {
+		printf("\tTiming   = hit %d%% %d-%d, miss %d-%d, xlate +%d-%d"
+		       " cycles\n", parms->timing.hit_percent,
+		       parms->timing.hit.min, parms->timing.hit.max,
+		       parms->timing.miss.min, parms->timing.miss.max,
+		       parms->timing.xlate.min, parms->timing.xlate.max);
+		printf("\t           link %d bytes/cycle, max reads %d"
+		       " (0 is no limit)\n", parms->timing.link_bytes,
+		       parms->timing.max_reads);
+	}
 
 	// Adjust timeout to milliseconds
 	parms->timeout *= 1000;
@@ -19,6 +19,10 @@
 
 #include <stdio.h>
 
+#include "erat.h"
+#include "schedule.h"
+#include "timing.h"
+
 struct parms {
 	unsigned int timeout;
 	unsigned int credits;
@@ -27,19 +31,24 @@ struct parms {
 	unsigned int paged_percent;
 	unsigned int reorder_percent;
 	unsigned int buffer_percent;
+	unsigned int erat_sets;
+	unsigned int erat_ways;
+	unsigned int erat_page_shift;
+	enum erat_policy erat_policy;
+	struct timing_parms timing;
 };
 
 // Randomly decide to allow response to AFU
-int allow_resp(struct parms *parms);
+int allow_resp(struct parms *parms, struct schedule *sched);
 
 // Randomly decide to allow PAGED response
-int allow_paged(struct parms *parms);
+int allow_paged(struct parms *parms, struct schedule *sched);
 
 // Randomly decide to allow command to be handled out of order
-int allow_reorder(struct parms *parms);
+int allow_reorder(struct parms *parms, struct schedule *sched);
 
 // Randomly decide to allow bogus buffer activity
-int allow_buffer(struct parms *parms);
+int allow_buffer(struct parms *parms, struct schedule *sched);
 
 // Open and parse parms file
 struct parms *parse_parms(char *filename, FILE * dbg_fp);
@@ -30,7 +30,10 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <poll.h>
+#include <sched.h>
 #include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/types.h>
 
 #include "mmio.h"
@@ -38,28 +41,15 @@
 #include "../common/debug.h"
 #include "../common/psl_interface.h"
 
+#define PSL_WATCH_WAKE 0xFFFFFFFF
+#define PSL_WATCH_AFU 0xFFFFFFFE
+#define PSL_EPOLL_EVENTS 16
+
 // are there any pending commands with this context?
 int _is_cmd_pending(struct psl *psl, int32_t context)
 {
-  struct cmd_event *cmd_event;
-
-  if ( psl->cmd == NULL ) {
-    // no cmd struct
-    return 0;
-  }
-
-  cmd_event = psl->cmd->list;
-  while ( cmd_event != NULL ) {
-    if ( cmd_event->context == context ) {
-      // found a matching element
-      return 1;
-    }
-    cmd_event = cmd_event->_next;
-  }
-
-  // no matching elements found
-  return 0;
-
+  // cmd_pending() copes with no cmd struct
+  return cmd_pending(psl->cmd, context) != 0;
 }
 
 // Attach to AFU
@@ -197,25 +187,25 @@ static void _detach(struct psl *psl, struct client *client)
 // Client release from AFU
 static void _free(struct psl *psl, struct client *client)
 {
-	struct cmd_event *mem_access;
-
 	// DEBUG
 	debug_context_remove(psl->dbg_fp, psl->dbg_id, client->context);
 
 	info_msg("%s client disconnect from %s context %d", client->ip,
 		 psl->name, client->context);
+	// Keep the scheduling record usable if pslse is killed later
+	schedule_flush(psl->cmd->sched);
+	erat_invalidate(psl->cmd->erat, client->context);
+	// Stop watching socket before the fd number can be reused
+	if (psl->watch[client->context] >= 0) {
+		epoll_ctl(psl->epoll_fd, EPOLL_CTL_DEL,
+			  psl->watch[client->context], NULL);
+		psl->watch[client->context] = -1;
+	}
 	close_socket(&(client->fd));
 	if (client->ip)
 		free(client->ip);
 	client->ip = NULL;
-	mem_access = (struct cmd_event *)client->mem_access;
-	if (mem_access != NULL) {
-		if (mem_access->state != MEM_DONE) {
-			mem_access->resp = PSL_RESPONSE_FAILED;
-			mem_access->state = MEM_DONE;
-		}
-	}
-	client->mem_access = NULL;
+	handle_mem_abort(psl->cmd, client->context);
 	client->mmio_access = NULL;
 	client->state = CLIENT_NONE;
 
@@ -436,9 +426,58 @@ static void _handle_afu(struct psl *psl)
 		handle_touch(psl->cmd);
 		handle_cmd(psl->cmd, psl->parity_enabled, psl->latency);
 		handle_interrupt(psl->cmd);
+		cmd_drain(psl->cmd);
 	}
 }
 
+// Get tag of client memory acknowledgement and find its command
+static struct cmd_event *_mem_ack(struct psl *psl, struct client *client)
+{
+	struct cmd_event *cmd;
+	uint8_t tag;
+
+	if (get_bytes_silent(client->fd, 1, &tag, psl->timeout,
+			     &(client->abort)) < 0) {
+		client_drop(client, PSL_IDLE_CYCLES, CLIENT_NONE);
+		return NULL;
+	}
+	// Can't tell how much data follows an unknown tag so drop client
+	if ((cmd = handle_mem_ack(psl->cmd, client, tag)) == NULL)
+		client_drop(client, PSL_IDLE_CYCLES, CLIENT_NONE);
+	return cmd;
+}
+
+// Client offers direct access to its memory.  Only accept it if the client
+// is on this host and a token it put in its own memory can be read back
+// through its pid.
+static void _mem_direct(struct psl *psl, struct client *client)
+{
+	uint8_t buffer[sizeof(uint32_t) + 2 * sizeof(uint64_t)];
+	uint64_t addr, token, probe;
+	uint32_t pid;
+
+	if (get_bytes_silent(client->fd, sizeof(buffer), buffer, psl->timeout,
+			     &(client->abort)) < 0) {
+		client_drop(client, PSL_IDLE_CYCLES, CLIENT_NONE);
+		return;
+	}
+	memcpy(&pid, buffer, sizeof(pid));
+	memcpy(&addr, &(buffer[sizeof(pid)]), sizeof(addr));
+	memcpy(&token, &(buffer[sizeof(pid) + sizeof(addr)]), sizeof(token));
+	client->pid = client_peer_pid(client, (pid_t) ntohl(pid));
+	addr = ntohll(addr);
+	token = ntohll(token);
+	if ((client_mem_copy(client, addr, &probe, sizeof(probe), 0) < 0) ||
+	    (probe != token)) {
+		debug_msg("%s:No direct memory access for context %d",
+			  psl->name, client->context);
+		client->pid = 0;
+		return;
+	}
+	info_msg("Direct memory access to context %d pid %d", client->context,
+		 (int)client->pid);
+}
+
 static void _handle_client(struct psl *psl, struct client *client)
 {
 	struct mmio_event *mmio;
@@ -456,9 +495,8 @@ static void _handle_client(struct psl *psl, struct client *client)
 		return;
 
 	// Check for event from application
-	cmd = (struct cmd_event *)client->mem_access;
 	mmio = NULL;
-	if (bytes_ready(client->fd, 1, &(client->abort))) {
+	if (bytes_ready(client->fd, 0, &(client->abort))) {
 		if (get_bytes(client->fd, 1, buffer, psl->timeout,
 			      &(client->abort), psl->dbg_fp, psl->dbg_id,
 			      client->context) < 0) {
@@ -475,14 +513,15 @@ static void _handle_client(struct psl *psl, struct client *client)
 			_attach(psl, client);
 			break;
 		case PSLSE_MEM_FAILURE:
-			if (client->mem_access != NULL)
+			if ((cmd = _mem_ack(psl, client)) != NULL)
 				handle_aerror(psl->cmd, cmd);
-			client->mem_access = NULL;
 			break;
 		case PSLSE_MEM_SUCCESS:
-			if (client->mem_access != NULL)
+			if ((cmd = _mem_ack(psl, client)) != NULL)
 				handle_mem_return(psl->cmd, cmd, client->fd);
-			client->mem_access = NULL;
+			break;
+		case PSLSE_MEM_DIRECT:
+			_mem_direct(psl, client);
 			break;
 		case PSLSE_MMIO_MAP:
 			handle_mmio_map(psl->mmio, client);
@@ -497,6 +536,9 @@ static void _handle_client(struct psl *psl, struct client *client)
 		case PSLSE_MMIO_READ32:	/*fall through */
 			mmio = handle_mmio(psl->mmio, client, 1, dw);
 			break;
+		case PSLSE_MMIO_BATCH:
+			mmio = handle_mmio_batch(psl->mmio, client);
+			break;
 		default:
 		  error_msg("Unexpected 0x%02x from client on socket", buffer[0], client->fd);
 		}
@@ -509,34 +551,280 @@ static void _handle_client(struct psl *psl, struct client *client)
 	}
 }
 
+// Check that PSL has nothing queued to drive to the AFU.  Anything already
+// sent only completes when the AFU answers, which ends a clock grant early.
+static int _psl_quiet(struct psl *psl)
+{
+	// Commands waiting on a client only hold up AFUs taking whole
+	// transactions until the AFU next answers
+	if (psl->afu_event->transactions) {
+		if (cmd_queued(psl->cmd))
+			return 0;
+	} else if (psl->cmd->outstanding) {
+		return 0;
+	}
+	if ((psl->mmio->list != NULL) &&
+	    (psl->mmio->list->state != PSLSE_PENDING))
+		return 0;
+	if ((psl->job->job != NULL) && (psl->job->job->state != PSLSE_PENDING))
+		return 0;
+	if ((psl->job->pe != NULL) && (psl->job->pe->state != PSLSE_PENDING))
+		return 0;
+	return 1;
+}
+
+// Publish live state when the status server asks for it, see status.c
+static void _psl_publish(struct psl *psl)
+{
+	struct psl_status *status = &(psl->status);
+	struct mmio_event *mmio;
+	struct job_event *job;
+	int32_t mmios, jobs;
+	uint64_t ns;
+
+	if (!status_due(status))
+		return;
+	mmios = 0;
+	for (mmio = psl->mmio->list; mmio != NULL; mmio = mmio->_next)
+		mmios++;
+	jobs = 0;
+	for (job = psl->job->job; job != NULL; job = job->_next)
+		jobs++;
+	for (job = psl->job->pe; job != NULL; job = job->_next)
+		jobs++;
+	if (status->cycles != psl->cycles) {
+		// Stopped clocks were the last time cycles advanced
+		if (!psl->idle_cycles)
+			ns = psl->clock_stop.tv_sec * 1000000000ull +
+			    psl->clock_stop.tv_nsec;
+		else
+			ns = stats_ns();
+		__atomic_store_n(&(status->cycles), psl->cycles,
+				 __ATOMIC_RELAXED);
+		__atomic_store_n(&(status->cycle_ns), ns, __ATOMIC_RELAXED);
+	}
+#define _STORE(field, value) \
+	__atomic_store_n(&(status->field), (value), __ATOMIC_RELAXED)
+	_STORE(commands, psl->cmd->pool.use.allocs);
+	_STORE(state, psl->state);
+	_STORE(idle_cycles, psl->idle_cycles);
+	_STORE(skipped, psl->skipped);
+	_STORE(attached_clients, psl->attached_clients);
+	_STORE(max_clients, psl->max_clients);
+	_STORE(outstanding, psl->cmd->outstanding);
+	_STORE(credits, psl->cmd->credits);
+	_STORE(mmios, mmios);
+	_STORE(jobs, jobs);
+#undef _STORE
+	status_published(status);
+}
+
+// Check if loop needs to run again without waiting for socket activity
+static int _psl_busy(struct psl *psl)
+{
+	int i;
+
+	if (psl->idle_cycles || (psl->client == NULL))
+		return 1;
+	for (i = 0; i < psl->max_clients; i++) {
+		if (psl->client[i] == NULL)
+			continue;
+		// Client still winding down or dedicated detach waiting
+		if (psl->client[i]->idle_cycles)
+			return 1;
+		if ((psl->client[i]->type == 'd') &&
+		    (psl->client[i]->state == CLIENT_NONE))
+			return 1;
+	}
+	return 0;
+}
+
+// Keep epoll watching the socket of every valid client
+static void _watch_clients(struct psl *psl)
+{
+	struct epoll_event ev;
+	int i, fd;
+
+	for (i = 0; i < psl->max_clients; i++) {
+		fd = -1;
+		if ((psl->client[i] != NULL) &&
+		    (psl->client[i]->state != CLIENT_NONE))
+			fd = psl->client[i]->fd;
+		if (psl->watch[i] == fd)
+			continue;
+		if (psl->watch[i] >= 0)
+			epoll_ctl(psl->epoll_fd, EPOLL_CTL_DEL, psl->watch[i],
+				  NULL);
+		psl->watch[i] = -1;
+		if (fd < 0)
+			continue;
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.u32 = i;
+		if (epoll_ctl(psl->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			warn_msg("Unable to watch %s context %d socket",
+				 psl->name, i);
+			continue;
+		}
+		psl->watch[i] = fd;
+	}
+}
+
+// Sleep until a client or the AFU socket has activity or another thread
+// calls psl_wake()
+static void _psl_wait(struct psl *psl)
+{
+	struct epoll_event ev[PSL_EPOLL_EVENTS];
+	uint64_t count;
+	int i, n;
+
+	_watch_clients(psl);
+	pthread_mutex_unlock(&(psl->lock));
+	do {
+		n = epoll_wait(psl->epoll_fd, ev, PSL_EPOLL_EVENTS, -1);
+	} while ((n < 0) && (errno == EINTR));
+	pthread_mutex_lock(&(psl->lock));
+	for (i = 0; i < n; i++) {
+		if (ev[i].data.u32 == PSL_WATCH_WAKE) {
+			if (read(psl->wake_fd, &count, sizeof(count)) < 0)
+				warn_msg("Unable to clear %s wakeup", psl->name);
+		}
+		// AFU hung up, clock it so the loop sees the lost connection
+		if (ev[i].data.u32 == PSL_WATCH_AFU)
+			psl->idle_cycles = 1;
+	}
+}
+
+// Give other threads a turn at the lock without sleeping
+static void _psl_yield(struct psl *psl)
+{
+	pthread_mutex_unlock(&(psl->lock));
+	sched_yield();
+	pthread_mutex_lock(&(psl->lock));
+}
+
+// Report clock rate since clocks were last started
+static void _clock_rate(struct psl *psl)
+{
+	struct timespec now;
+	uint64_t cycles;
+	double secs;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	cycles = psl->cycles - psl->clock_base;
+	secs = (double)(now.tv_sec - psl->clock_start.tv_sec);
+	secs += (double)(now.tv_nsec - psl->clock_start.tv_nsec) / 1e9;
+	if (secs <= 0.0)
+		secs = 1e-9;
+	psl->clock_rate = cycles / secs;
+	info_msg("%s clocked %" PRIu64 " cycles at %.0f cycles/s", psl->name,
+		 cycles, cycles / secs);
+}
+
+// Tell the AFU clocks have stopped so it can sleep until they start again
+static void _clock_stop(struct psl *psl)
+{
+	clock_gettime(CLOCK_MONOTONIC, &(psl->clock_stop));
+	if (psl_clock_stop(psl->afu_event) != PSL_SUCCESS)
+		return;
+	psl->asleep = 1;
+}
+
+// Fast-forward the AFU over the cycles it would have been clocked for while
+// stopped, at the rate it was last clocked, so simulators can advance time
+// in one step instead of running idle cycles
+static void _clock_skip(struct psl *psl)
+{
+	struct timespec now;
+	uint64_t cycles;
+	double secs;
+
+	psl->asleep = 0;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	secs = (double)(now.tv_sec - psl->clock_stop.tv_sec);
+	secs += (double)(now.tv_nsec - psl->clock_stop.tv_nsec) / 1e9;
+	if (secs * psl->clock_rate >= (double)PSL_CLOCK_SKIP_MAX)
+		cycles = PSL_CLOCK_SKIP_MAX;
+	else
+		cycles = secs * psl->clock_rate;
+	if (!cycles || (psl_clock_skip(psl->afu_event, cycles) != PSL_SUCCESS))
+		return;
+	psl->cycles += cycles;
+	psl->clock_base += cycles;
+	psl->skipped += cycles;
+	debug_set_cycle(psl->dbg_id, psl->cycles);
+	cmd_skip(psl->cmd, psl->cycles, cycles);
+	info_msg("%s skipped %" PRIu64 " cycles while clocks were stopped",
+		 psl->name, cycles);
+}
+
+// Wake PSL thread after another thread queues work for it
+void psl_wake(struct psl *psl)
+{
+	uint64_t count = 1;
+
+	if (write(psl->wake_fd, &count, sizeof(count)) < 0)
+		warn_msg("Unable to wake %s thread", psl->name);
+}
+
+// Describe where the AFU simulator is, a unix socket host is the whole path
+static void _endpoint(struct psl *psl, char *endpoint, size_t size)
+{
+	if (psl->port)
+		snprintf(endpoint, size, "%s:%d", psl->host, psl->port);
+	else
+		snprintf(endpoint, size, "%s", psl->host);
+}
+
 // PSL thread loop
 static void *_psl_loop(void *ptr)
 {
 	struct psl *psl = (struct psl *)ptr;
-	struct cmd_event *event, *temp;
-	int events, i, stopped, reset;
+	int events, i, stopped, reset, cycles, idle;
 	uint8_t ack = PSLSE_DETACH;
+	char endpoint[MAX_LINE_CHARS];
 
 	stopped = 1;
-	pthread_mutex_lock(psl->lock);
+	debug_set_cycle(psl->dbg_id, psl->cycles);
+	pthread_mutex_lock(&(psl->lock));
 	while (psl->state != PSLSE_DONE) {
+		// Report statistics when pslse gets SIGUSR1
+		stats_poll(psl->cmd->stats);
+
 		// idle_cycles continues to generate clock cycles for some
 		// time after the AFU has gone idle.  Eventually clocks will
 		// not be presented to an idle AFU to keep simulation
 		// waveforms from getting huge with no activity cycles.
 		if (psl->state != PSLSE_IDLE) {
 			psl->idle_cycles = PSL_IDLE_CYCLES;
-			if (stopped)
+			if (stopped) {
 				info_msg("Clocking %s", psl->name);
+				clock_gettime(CLOCK_MONOTONIC,
+					      &(psl->clock_start));
+				psl->clock_base = psl->cycles;
+			}
 			fflush(stdout);
 			stopped = 0;
 		}
 
 		if (psl->idle_cycles) {
+			if (psl->asleep)
+				_clock_skip(psl);
+			// Let AFU run ahead while PSL has nothing to drive
+			idle = (psl->state == PSLSE_IDLE);
+			if (_psl_quiet(psl)) {
+				if (idle)
+					cycles = psl->idle_cycles;
+				else
+					cycles = PSL_CLOCK_BATCH;
+				psl_clock_grant(psl->afu_event, cycles);
+			}
 			// Clock AFU
 			psl_signal_afu_model(psl->afu_event);
-			// Check for events from AFU
+			// Check for events from AFU, other threads may have
+			// the lock while waiting on the simulator
+			pthread_mutex_unlock(&(psl->lock));
 			events = psl_get_afu_events(psl->afu_event);
+			pthread_mutex_lock(&(psl->lock));
 
 			// Error on socket
 			if (events < 0) {
@@ -552,18 +840,31 @@ static void *_psl_loop(void *ptr)
 			send_pe(psl->job);
 			send_mmio(psl->mmio);
 
-			if (psl->mmio->list == NULL)
-				psl->idle_cycles--;
+			cycles = 1;
+			if (events > 0)
+				cycles = psl->afu_event->clock_cycles;
+			psl->cycles += cycles;
+			debug_set_cycle(psl->dbg_id, psl->cycles);
+			cmd_clock(psl->cmd, psl->cycles, cycles);
+
+			if (psl->mmio->list == NULL) {
+				// Only cycles granted while idle count down
+				if (!idle)
+					cycles = 1;
+				psl->idle_cycles -= cycles;
+			}
 		} else {
-			if (!stopped)
+			if (!stopped) {
 				info_msg("Stopping clocks to %s", psl->name);
+				_clock_rate(psl);
+				_clock_stop(psl);
+			}
 			stopped = 1;
-			lock_delay(psl->lock);
 		}
 
 		// Skip client section if AFU descriptor hasn't been read yet
 		if (psl->client == NULL) {
-			lock_delay(psl->lock);
+			_psl_yield(psl);
 			continue;
 		}
 		// Check for event from application
@@ -606,32 +907,20 @@ static void *_psl_loop(void *ptr)
 
 		// Send reset to AFU
 		if (reset == 1) {
-			psl->cmd->buffer_read = NULL;
-			event = psl->cmd->list;
-			while (event != NULL) {
-				if (reset) {
-					warn_msg
-					    ("Client dropped context before AFU completed");
-					reset = 0;
-				}
-				info_msg("Dumping command tag=0x%02x",
-					 event->tag);
-				if (event->data) {
-					free(event->data);
-				}
-				if (event->parity) {
-					free(event->parity);
-				}
-				temp = event;
-				event = event->_next;
-				free(temp);
-			}
-			psl->cmd->list = NULL;
+			cmd_reset(psl->cmd);
 			info_msg("Sending reset to AFU");
 			add_job(psl->job, PSL_JOB_RESET, 0L);
+			// Refuse commands the AFU issues before it sees the reset
+			psl->state = PSLSE_RESET;
 		}
 
-		lock_delay(psl->lock);
+		_psl_publish(psl);
+
+		// Clock back to back while there is work, otherwise block
+		if (_psl_busy(psl))
+			_psl_yield(psl);
+		else
+			_psl_wait(psl);
 	}
 
 	// Disconnect clients
@@ -648,15 +937,18 @@ static void *_psl_loop(void *ptr)
 	debug_afu_drop(psl->dbg_fp, psl->dbg_id);
 
 	// Disconnect from simulator, free memory and shut down thread
-	info_msg("Disconnecting %s @ %s:%d", psl->name, psl->host, psl->port);
+	_endpoint(psl, endpoint, sizeof(endpoint));
+	info_msg("Disconnecting %s @ %s after %" PRIu64 " cycles", psl->name,
+		 endpoint, psl->cycles);
 	if (psl->client)
 		free(psl->client);
-	if (psl->_prev)
-		psl->_prev->_next = psl->_next;
-	if (psl->_next)
-		psl->_next->_prev = psl->_prev;
+	psl->client = NULL;
+	if (psl->watch)
+		free(psl->watch);
+	close(psl->epoll_fd);
+	close(psl->wake_fd);
 	if (psl->cmd) {
-		free(psl->cmd);
+		cmd_free(psl->cmd);
 	}
 	if (psl->job) {
 		free(psl->job);
@@ -672,9 +964,21 @@ static void *_psl_loop(void *ptr)
 	}
 	if (psl->name)
 		free(psl->name);
+	pthread_mutex_unlock(&(psl->lock));
+
+	// Remove from PSL list, taking list lock before PSL lock so client
+	// threads that found this PSL are done with it before it is freed
+	pthread_mutex_lock(psl->list_lock);
+	pthread_mutex_lock(&(psl->lock));
+	if (psl->_prev)
+		psl->_prev->_next = psl->_next;
+	if (psl->_next)
+		psl->_next->_prev = psl->_prev;
 	if (*(psl->head) == psl)
 		*(psl->head) = psl->_next;
-	pthread_mutex_unlock(psl->lock);
+	pthread_mutex_unlock(&(psl->lock));
+	pthread_mutex_unlock(psl->list_lock);
+	pthread_mutex_destroy(&(psl->lock));
 	free(psl);
 	pthread_exit(NULL);
 }
@@ -685,18 +989,24 @@ static void *_psl_loop(void *ptr)
 // possible adapter.  Then the 4 bits in each adapter represent the 4 possible
 // AFUs on an adapter.  For example: afu0.0 is 0x8000 and afu3.0 is 0x0008.
 uint16_t psl_init(struct psl **head, struct parms *parms, char *id, char *host,
-		  int port, pthread_mutex_t * lock, FILE * dbg_fp)
+		  int port, pthread_mutex_t * list_lock, FILE * dbg_fp)
 {
 	struct psl *psl;
 	struct job_event *reset;
+	struct epoll_event ev;
+	char endpoint[MAX_LINE_CHARS];
 	uint16_t location;
+	int i, locked;
 
 	location = 0x8000;
+	locked = 0;
 	if ((psl = (struct psl *)calloc(1, sizeof(struct psl))) == NULL) {
 		perror("malloc");
 		error_msg("Unable to allocation memory for psl");
 		goto init_fail;
 	}
+	psl->epoll_fd = -1;
+	psl->wake_fd = -1;
 	psl->timeout = parms->timeout;
 	if ((strlen(id) != 6) || strncmp(id, "afu", 3) || (id[4] != '.')) {
 		warn_msg("Invalid afu name: %s", id);
@@ -723,6 +1033,7 @@ uint16_t psl_init(struct psl **head, struct parms *parms, char *id, char *host,
 		goto init_fail;
 	}
 	strcpy(psl->name, id);
+	strcpy(psl->status.name, id);
 	if ((psl->host = (char *)malloc(strlen(host) + 1)) == NULL) {
 		perror("malloc");
 		error_msg("Unable to allocation memory for psl->host");
@@ -732,7 +1043,10 @@ uint16_t psl_init(struct psl **head, struct parms *parms, char *id, char *host,
 	psl->port = port;
 	psl->client = NULL;
 	psl->idle_cycles = PSL_IDLE_CYCLES;
-	psl->lock = lock;
+	psl->list_lock = list_lock;
+	pthread_mutex_init(&(psl->lock), NULL);
+	locked = 1;
+	pthread_mutex_lock(&(psl->lock));
 
 	// Connect to AFU
 	psl->afu_event = (struct AFU_EVENT *)malloc(sizeof(struct AFU_EVENT));
@@ -740,12 +1054,11 @@ uint16_t psl_init(struct psl **head, struct parms *parms, char *id, char *host,
 		perror("malloc");
 		goto init_fail;
 	}
-	info_msg("Attempting to connect AFU: %s @ %s:%d", psl->name,
-		 psl->host, psl->port);
+	_endpoint(psl, endpoint, sizeof(endpoint));
+	info_msg("Attempting to connect AFU: %s @ %s", psl->name, endpoint);
 	if (psl_init_afu_event(psl->afu_event, psl->host, psl->port) !=
 	    PSL_SUCCESS) {
-		warn_msg("Unable to connect AFU: %s @ %s:%d", psl->name,
-			 psl->host, psl->port);
+		warn_msg("Unable to connect AFU: %s @ %s", psl->name, endpoint);
 		goto init_fail;
 	}
 	// DEBUG
@@ -776,6 +1089,28 @@ uint16_t psl_init(struct psl **head, struct parms *parms, char *id, char *host,
 		warn_msg("Unable to set credits");
 		goto init_fail;
 	}
+	// Watch for AFU hang up and wakeups from other threads
+	if ((psl->epoll_fd = epoll_create1(0)) < 0) {
+		perror("epoll_create1");
+		goto init_fail;
+	}
+	if ((psl->wake_fd = eventfd(0, EFD_NONBLOCK)) < 0) {
+		perror("eventfd");
+		goto init_fail;
+	}
+	ev.events = EPOLLIN;
+	ev.data.u32 = PSL_WATCH_WAKE;
+	if (epoll_ctl(psl->epoll_fd, EPOLL_CTL_ADD, psl->wake_fd, &ev) < 0) {
+		perror("epoll_ctl");
+		goto init_fail;
+	}
+	ev.events = EPOLLRDHUP;
+	ev.data.u32 = PSL_WATCH_AFU;
+	if (epoll_ctl(psl->epoll_fd, EPOLL_CTL_ADD, psl->afu_event->sockfd,
+		      &ev) < 0) {
+		perror("epoll_ctl");
+		goto init_fail;
+	}
 	// Start psl loop thread
 	if (pthread_create(&(psl->thread), NULL, _psl_loop, psl)) {
 		perror("pthread_create");
@@ -797,12 +1132,12 @@ uint16_t psl_init(struct psl **head, struct parms *parms, char *id, char *host,
 	// Send reset to AFU
 	reset = add_job(psl->job, PSL_JOB_RESET, 0L);
 	while (psl->job->job == reset) {	/*infinite loop */
-		lock_delay(psl->lock);
+		lock_delay(&(psl->lock));
 	}
 
 	// Read AFU descriptor
 	psl->state = PSLSE_DESC;
-	read_descriptor(psl->mmio, psl->lock);
+	read_descriptor(psl->mmio, &(psl->lock));
 
 	// Finish PSL configuration
 	psl->state = PSLSE_IDLE;
@@ -818,15 +1153,25 @@ uint16_t psl_init(struct psl **head, struct parms *parms, char *id, char *host,
 		error_msg("AFU programming model is invalid");
 		goto init_fail;
 	}
+	psl->watch = (int *)malloc(psl->max_clients * sizeof(int));
+	for (i = 0; i < psl->max_clients; i++)
+		psl->watch[i] = -1;
 	psl->client = (struct client **)calloc(psl->max_clients,
 					       sizeof(struct client *));
+	psl->cmd->context_cmds = (int *)calloc(psl->max_clients, sizeof(int));
+	stats_contexts(psl->cmd->stats, psl->max_clients);
 	psl->cmd->client = psl->client;
 	psl->cmd->max_clients = psl->max_clients;
+	pthread_mutex_unlock(&(psl->lock));
 
 	return location;
 
  init_fail:
 	if (psl) {
+		if (psl->epoll_fd >= 0)
+			close(psl->epoll_fd);
+		if (psl->wake_fd >= 0)
+			close(psl->wake_fd);
 		if (psl->afu_event) {
 			psl_close_afu_event(psl->afu_event);
 			free(psl->afu_event);
@@ -835,8 +1180,11 @@ uint16_t psl_init(struct psl **head, struct parms *parms, char *id, char *host,
 			free(psl->host);
 		if (psl->name)
 			free(psl->name);
+		if (locked) {
+			pthread_mutex_unlock(&(psl->lock));
+			pthread_mutex_destroy(&(psl->lock));
+		}
 		free(psl);
 	}
-	pthread_mutex_unlock(lock);
 	return 0;
 }
@@ -20,18 +20,21 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "client.h"
 #include "cmd.h"
 #include "job.h"
 #include "mmio.h"
 #include "parms.h"
+#include "status.h"
 #include "../common/utils.h"
 
 struct psl {
 	struct AFU_EVENT *afu_event;
 	pthread_t thread;
-	pthread_mutex_t *lock;
+	pthread_mutex_t lock;
+	pthread_mutex_t *list_lock;
 	FILE *dbg_fp;
 	struct client **client;
 	struct cmd *cmd;
@@ -40,6 +43,9 @@ struct psl {
 	struct psl **head;
 	struct psl *_prev;
 	struct psl *_next;
+	struct timespec clock_start;
+	struct timespec clock_stop;
+	struct psl_status status;
 	volatile enum pslse_state state;
 	uint32_t parity_enabled;
 	uint32_t latency;
@@ -48,15 +54,25 @@ struct psl {
 	uint8_t major;
 	uint8_t minor;
 	uint8_t dbg_id;
+	uint64_t cycles;
+	uint64_t clock_base;
+	uint64_t clock_rate;	// Cycles/s while last clocked
+	uint64_t skipped;	// Cycles fast-forwarded while clocks were stopped
+	int *watch;
+	int epoll_fd;
+	int wake_fd;
 	int port;
 	int idle_cycles;
 	int max_clients;
 	int attached_clients;
 	int timeout;
 	int has_been_reset;
+	int asleep;		// AFU was told clocks stopped
 };
 
 uint16_t psl_init(struct psl **head, struct parms *parms, char *id, char *host,
-		  int port, pthread_mutex_t * lock, FILE * dbg_fp);
+		  int port, pthread_mutex_t * list_lock, FILE * dbg_fp);
+
+void psl_wake(struct psl *psl);
 
 #endif				/* _PSL_H_ */
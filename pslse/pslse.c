@@ -44,14 +44,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <termios.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "client.h"
 #include "mmio.h"
 #include "parms.h"
 #include "psl.h"
+#include "schedule.h"
 #include "shim_host.h"
+#include "stats.h"
+#include "status.h"
 #include "../common/debug.h"
 #include "../common/utils.h"
 
@@ -59,20 +64,25 @@
 
 struct psl *psl_list;
 struct client *client_list;
-pthread_mutex_t lock;
+pthread_mutex_t list_lock;
 uint16_t afu_map;
 int timeout;
+char *unix_path;
 FILE *fp;
+static volatile sig_atomic_t _flush_debug;
 
 // Disconnect client connections and stop threads gracefully on Ctrl-C
 static void _INThandler(int sig)
 {
 	pthread_t thread;
-	struct psl *psl;
+	struct psl *psl, *next;
 	int i;
 
-	// Flush debug output
-	fflush(fp);
+	// Main loop flushes debug output, the writer's locks aren't safe here
+	_flush_debug = 1;
+
+	if (unix_path != NULL)
+		unlink(unix_path);
 
 	// Shut down PSL threads
 	psl = psl_list;
@@ -82,14 +92,77 @@ static void _INThandler(int sig)
 			if (psl->client[i] != NULL)
 				psl->client[i]->abort = 1;
 		}
-		psl->state = PSLSE_DONE;
+		// PSL thread frees psl once woken
 		thread = psl->thread;
-		psl = psl->_next;
+		next = psl->_next;
+		psl->state = PSLSE_DONE;
+		psl_wake(psl);
+		psl = next;
 		pthread_join(thread, NULL);
 	}
 }
 
-// Find PSL for specific AFU id
+// Have each PSL thread report its command statistics on SIGUSR1
+static void _USR1handler(int sig)
+{
+	struct psl *psl;
+
+	stats_request();
+	for (psl = psl_list; psl != NULL; psl = psl->_next)
+		psl_wake(psl);
+}
+
+// Toggle debug.log tracing on SIGUSR2
+static void _USR2handler(int sig)
+{
+	debug_log_enable(!debug_log_enabled());
+}
+
+// Write debug.log from a background thread.  PSLSE_DEBUG_MASK selects the
+// DBG_CAT_* record categories, 0 keeps tracing off until SIGUSR2.
+// PSLSE_DEBUG_MMAP=1 writes the file through mmap instead of stdio.
+static void _start_debug_log(FILE * fp)
+{
+	uint32_t mask;
+	char *env;
+	int use_mmap;
+
+	mask = DBG_CAT_ALL;
+	if ((env = getenv("PSLSE_DEBUG_MASK")) != NULL)
+		mask = strtoul(env, NULL, 0);
+	if (mask == 0) {
+		debug_log_enable(0);
+		mask = DBG_CAT_ALL;
+	}
+	use_mmap = 0;
+	if ((env = getenv("PSLSE_DEBUG_MMAP")) != NULL)
+		use_mmap = (atoi(env) != 0);
+	if (debug_log_start(fp, mask, use_mmap) < 0)
+		warn_msg("Unable to start debug log writer, writing directly");
+}
+
+// Serve live PSL state on the unix socket PSLSE_STATUS_SOCKET and/or rewrite
+// it to PSLSE_STATUS_FILE every PSLSE_STATUS_INTERVAL ms
+static void _start_status(void)
+{
+	char *socket_path, *file_path, *env;
+	int interval;
+
+	socket_path = getenv("PSLSE_STATUS_SOCKET");
+	if ((socket_path != NULL) && (*socket_path == '\0'))
+		socket_path = NULL;
+	file_path = getenv("PSLSE_STATUS_FILE");
+	if ((file_path != NULL) && (*file_path == '\0'))
+		file_path = NULL;
+	interval = 1000;
+	if ((env = getenv("PSLSE_STATUS_INTERVAL")) != NULL)
+		interval = atoi(env);
+	if (status_start(socket_path, file_path, interval, &psl_list,
+			 &list_lock) < 0)
+		warn_msg("Unable to start status server");
+}
+
+// Find PSL for specific AFU id, caller must hold list lock
 static struct psl *_find_psl(uint8_t id, uint8_t * major, uint8_t * minor)
 {
 	struct psl *psl;
@@ -105,6 +178,39 @@ static struct psl *_find_psl(uint8_t id, uint8_t * major, uint8_t * minor)
 	return psl;
 }
 
+// Find PSL for specific AFU id and return it with its lock held
+static struct psl *_lock_psl(uint8_t id, uint8_t * major, uint8_t * minor)
+{
+	struct psl *psl;
+
+	pthread_mutex_lock(&list_lock);
+	psl = _find_psl(id, major, minor);
+	if (psl)
+		pthread_mutex_lock(&(psl->lock));
+	pthread_mutex_unlock(&list_lock);
+	return psl;
+}
+
+// Check if any PSL thread still points to client, caller must hold list lock
+static int _client_in_use(struct client *client)
+{
+	struct psl *psl;
+	int i, in_use;
+
+	in_use = 0;
+	psl = psl_list;
+	while (psl && !in_use) {
+		pthread_mutex_lock(&(psl->lock));
+		for (i = 0; psl->client && (i < psl->max_clients); i++) {
+			if (psl->client[i] == client)
+				in_use = 1;
+		}
+		pthread_mutex_unlock(&(psl->lock));
+		psl = psl->_next;
+	}
+	return in_use;
+}
+
 // Query AFU descriptor data
 static void _query(struct client *client, uint8_t id)
 {
@@ -113,7 +219,11 @@ static void _query(struct client *client, uint8_t id)
 	uint8_t major, minor;
 	int size, offset;
 
-	psl = _find_psl(id, &major, &minor);
+	psl = _lock_psl(id, &major, &minor);
+	if (!psl) {
+		client_drop(client, PSL_IDLE_CYCLES, CLIENT_NONE);
+		return;
+	}
 	size = 1 + sizeof(psl->mmio->desc.num_ints_per_process) +
 	    sizeof(client->max_irqs) + sizeof(psl->mmio->desc.crptr->cr_device) +
 	    sizeof(psl->mmio->desc.crptr->cr_vendor) + sizeof(psl->mmio->desc.crptr->cr_class);
@@ -144,6 +254,7 @@ static void _query(struct client *client, uint8_t id)
 		      client->context) < 0) {
 		client_drop(client, PSL_IDLE_CYCLES, CLIENT_NONE);
 	}
+	pthread_mutex_unlock(&(psl->lock));
 	free(buffer);
 }
 
@@ -156,9 +267,13 @@ static void _max_irqs(struct client *client, uint8_t id)
 	uint16_t value;
 
 	// Retrieve requested new maximum interrupts
-	psl = _find_psl(id, &major, &minor);
-	if (get_bytes(client->fd, 2, buffer, psl->timeout, &(client->abort),
-		      psl->dbg_fp, psl->dbg_id, client->context) < 0) {
+	if (get_bytes(client->fd, 2, buffer, timeout, &(client->abort), fp,
+		      id, client->context) < 0) {
+		client_drop(client, PSL_IDLE_CYCLES, CLIENT_NONE);
+		return;
+	}
+	psl = _lock_psl(id, &major, &minor);
+	if (!psl) {
 		client_drop(client, PSL_IDLE_CYCLES, CLIENT_NONE);
 		return;
 	}
@@ -179,6 +294,7 @@ static void _max_irqs(struct client *client, uint8_t id)
 		      client->context) < 0) {
 		client_drop(client, PSL_IDLE_CYCLES, CLIENT_NONE);
 	}
+	pthread_mutex_unlock(&(psl->lock));
 }
 
 static void _free_client(struct client *client)
@@ -253,7 +369,7 @@ static int _client_associate(struct client *client, uint8_t id, char afu_type)
 
 	// Associate with PSL
 	rc[0] = PSLSE_DETACH;
-	psl = _find_psl(id, &major, &minor);
+	psl = _lock_psl(id, &major, &minor);
 	if (!psl) {
 		info_msg("Did not find valid PSL for afu%d.%d\n", major, minor);
 		put_bytes(client->fd, 1, &(rc[0]), fp, -1, -1);
@@ -270,7 +386,7 @@ static int _client_associate(struct client *client, uint8_t id, char afu_type)
 			     major, minor);
 			put_bytes(client->fd, 1, &(rc[0]), fp, psl->dbg_id, -1);
 			close_socket(&(client->fd));
-			return -1;
+			goto associate_fail;
 		}
 		break;
 	case 'm':
@@ -280,14 +396,14 @@ static int _client_associate(struct client *client, uint8_t id, char afu_type)
 				 major, minor);
 			put_bytes(client->fd, 1, &(rc[0]), fp, psl->dbg_id, -1);
 			close_socket(&(client->fd));
-			return -1;
+			goto associate_fail;
 		}
 		break;
 	default:
 		warn_msg("AFU device type '%c' is not valid\n", afu_type);
 		put_bytes(client->fd, 1, &(rc[0]), fp, psl->dbg_id, -1);
 		close_socket(&(client->fd));
-		return -1;
+		goto associate_fail;
 	}
 
 	// check to see if device is already open
@@ -300,7 +416,7 @@ static int _client_associate(struct client *client, uint8_t id, char afu_type)
 			put_bytes(client->fd, 1, &(rc[0]), fp, psl->dbg_id, -1);
 			// should I really close the socket in this case?
 			close_socket(&(client->fd));
-			return -1;
+			goto associate_fail;
 		}
 	}
 
@@ -325,7 +441,7 @@ static int _client_associate(struct client *client, uint8_t id, char afu_type)
 		info_msg("No room for new client on afu%d.%d\n", major, minor);
 		put_bytes(client->fd, 1, &(rc[0]), fp, psl->dbg_id, -1);
 		close_socket(&(client->fd));
-		return -1;
+		goto associate_fail;
 	}
 
 	// Attach to PSL
@@ -375,11 +491,19 @@ static int _client_associate(struct client *client, uint8_t id, char afu_type)
 	// Acknowledge to client
 	if (put_bytes(client->fd, 2, &(rc[0]), fp, psl->dbg_id, context) < 0) {
 		close_socket(&(client->fd));
-		return -1;
+		goto associate_fail;
 	}
 	debug_context_add(fp, psl->dbg_id, context);
 
+	// Have PSL thread start watching the new client
+	psl_wake(psl);
+	pthread_mutex_unlock(&(psl->lock));
+
 	return 0;
+
+ associate_fail:
+	pthread_mutex_unlock(&(psl->lock));
+	return -1;
 }
 
 static void *_client_loop(void *ptr)
@@ -388,13 +512,10 @@ static void *_client_loop(void *ptr)
 	uint8_t data[2];
 	int rc;
 
-	pthread_mutex_lock(&lock);
 	while (client->pending) {
 		rc = bytes_ready(client->fd, client->timeout, &(client->abort));
-		if (rc == 0) {
-			lock_delay(&lock);
+		if (rc == 0)
 			continue;
-		}
 		if ((rc < 0) || get_bytes(client->fd, 1, data, 10,
 					  &(client->abort), fp, -1, -1) < 0) {
 			client_drop(client, PSL_IDLE_CYCLES, CLIENT_NONE);
@@ -409,7 +530,6 @@ static void *_client_loop(void *ptr)
 				break;
 			}
 			_query(client, data[0]);
-			lock_delay(&lock);
 			continue;
 		}
 		if (data[0] == PSLSE_MAX_INT) {
@@ -420,7 +540,6 @@ static void *_client_loop(void *ptr)
 				break;
 			}
 			_max_irqs(client, data[0]);
-			lock_delay(&lock);
 			continue;
 		}
 		if (data[0] == PSLSE_OPEN) {
@@ -435,11 +554,11 @@ static void *_client_loop(void *ptr)
 			debug_msg("_client_loop: client associated");
 			break;
 		}
+		pthread_mutex_lock(&list_lock);
 		client->pending = 0;
+		pthread_mutex_unlock(&list_lock);
 		break;
-		lock_delay(&lock);
 	}
-	pthread_mutex_unlock(&lock);
 
 	// Terminate thread
 	pthread_exit(NULL);
@@ -491,24 +610,112 @@ static int _start_server()
 	return listen_fd;
 }
 
+// Also listen on the unix domain socket named by PSLSE_UNIX_SOCKET, if set.
+// Clients on this host reach it with unix:<path> in pslse_server.dat.
+static int _start_unix_server()
+{
+	struct sockaddr_un serv_addr;
+	int listen_fd;
+
+	unix_path = getenv("PSLSE_UNIX_SOCKET");
+	if ((unix_path == NULL) || (*unix_path == '\0'))
+		return -1;
+	memset(&serv_addr, 0, sizeof(serv_addr));
+	serv_addr.sun_family = AF_UNIX;
+	if (strlen(unix_path) >= sizeof(serv_addr.sun_path)) {
+		warn_msg("PSLSE_UNIX_SOCKET path too long: %s", unix_path);
+		goto unix_fail;
+	}
+	strcpy(serv_addr.sun_path, unix_path);
+	if ((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror("socket");
+		goto unix_fail;
+	}
+	unlink(unix_path);
+	if (bind(listen_fd, (struct sockaddr *)&serv_addr,
+		 sizeof(serv_addr)) < 0) {
+		perror("bind");
+		close(listen_fd);
+		goto unix_fail;
+	}
+	listen(listen_fd, 4);
+	info_msg("Started PSLSE server, listening on %s%s", PSL_UNIX_PREFIX,
+		 unix_path);
+
+	return listen_fd;
+
+ unix_fail:
+	unix_path = NULL;
+	return -1;
+}
+
+// Wait for a client on either listening socket.  Returns the connected fd
+// and sets *ip to a malloc'd name for the peer, or returns -1.
+static int _accept_client(int *listen_fd, int listeners, char **ip)
+{
+	struct sockaddr_in client_addr;
+	struct pollfd pfd[2];
+	socklen_t client_len;
+	int connect_fd, i;
+
+	for (i = 0; i < listeners; i++) {
+		pfd[i].fd = listen_fd[i];
+		pfd[i].events = POLLIN;
+		pfd[i].revents = 0;
+	}
+	if (poll(pfd, listeners, -1) <= 0)
+		return -1;
+	for (i = 0; i < listeners; i++) {
+		if (!(pfd[i].revents & POLLIN))
+			continue;
+		client_len = sizeof(client_addr);
+		connect_fd = accept(listen_fd[i],
+				    (struct sockaddr *)&client_addr,
+				    &client_len);
+		if (connect_fd < 0)
+			return -1;
+		psl_tune_socket(connect_fd);
+		*ip = (char *)malloc(INET_ADDRSTRLEN + 1);
+		if (i == 0)
+			inet_ntop(AF_INET, &(client_addr.sin_addr.s_addr), *ip,
+				  INET_ADDRSTRLEN);
+		else
+			strcpy(*ip, PSL_UNIX_HOST);
+		return connect_fd;
+	}
+	return -1;
+}
+
 //
 // Main
 //
 
 int main(int argc, char **argv)
 {
-	struct sockaddr_in client_addr;
-	struct client *client;
+	struct client *client, *old;
 	struct client **client_ptr;
-	int listen_fd, connect_fd;
-	socklen_t client_len;
+	int listen_fd[2];
+	int listeners, connect_fd;
 	sigset_t set;
 	struct sigaction action;
 	struct parms *parms;
-	char *ip;
+	char *ip, *stats_file;
+
+	// Open debug.log file, readable too so it can be mmap'd
+	fp = fopen("debug.log", "w+");
+	if (fp != NULL)
+		_start_debug_log(fp);
+
+	// Append command statistics reports to pslse_stats.json, or the file
+	// PSLSE_STATS_JSON names, none if it is empty
+	if ((stats_file = getenv("PSLSE_STATS_JSON")) == NULL)
+		stats_file = "pslse_stats.json";
+	if ((*stats_file != '\0') && (stats_open(stats_file) < 0))
+		warn_msg("Unable to open %s", stats_file);
 
-	// Open debug.log file
-	fp = fopen("debug.log", "w");
+	// Record scheduling decisions to, or replay them from, one file per AFU
+	// named by PSLSE_SCHED_RECORD or PSLSE_SCHED_REPLAY plus the AFU name
+	schedule_mode(getenv("PSLSE_SCHED_RECORD"), getenv("PSLSE_SCHED_REPLAY"));
 
 	// Mask SIGPIPE signal for all threads
 	sigemptyset(&set);
@@ -522,6 +729,10 @@ int main(int argc, char **argv)
 	sigemptyset(&(action.sa_mask));
 	action.sa_flags = 0;
 	sigaction(SIGINT, &action, NULL);
+	action.sa_handler = _USR1handler;
+	sigaction(SIGUSR1, &action, NULL);
+	action.sa_handler = _USR2handler;
+	sigaction(SIGUSR2, &action, NULL);
 
 	// Report version
 	info_msg("PSLSE version %d.%03d compiled @ %s %s", PSLSE_VERSION_MAJOR,
@@ -537,54 +748,63 @@ int main(int argc, char **argv)
 	timeout = parms->timeout;
 
 	// Connect to simulator(s) and start psl thread(s)
-	pthread_mutex_init(&lock, NULL);
-	pthread_mutex_lock(&lock);
-	afu_map = parse_host_data(&psl_list, parms, "shim_host.dat", &lock, fp);
+	pthread_mutex_init(&list_lock, NULL);
+	pthread_mutex_lock(&list_lock);
+	afu_map = parse_host_data(&psl_list, parms, "shim_host.dat", &list_lock,
+				  fp);
 	if (psl_list == NULL) {
 		free(parms);
+		debug_log_stop();
 		fclose(fp);
 		warn_msg("Unable to connect to any simulators");
 		return -1;
 	}
 	// Start server
-	if ((listen_fd = _start_server()) < 0) {
+	if ((listen_fd[0] = _start_server()) < 0) {
 		free(parms);
+		debug_log_stop();
 		fclose(fp);
 		return -1;
 	}
+	listeners = 1;
+	if ((listen_fd[1] = _start_unix_server()) >= 0)
+		listeners = 2;
+	_start_status();
 	// Watch for client connections
 	while (psl_list != NULL) {
-		// Wait for next client to connect
-		client_len = sizeof(client_addr);
-		pthread_mutex_unlock(&lock);
-		connect_fd = accept(listen_fd, (struct sockaddr *)&client_addr,
-				    &client_len);
-		pthread_mutex_lock(&lock);
+		// Flush debug output after SIGINT, then wait for next client
+		pthread_mutex_unlock(&list_lock);
+		if (_flush_debug) {
+			_flush_debug = 0;
+			debug_log_flush();
+		}
+		connect_fd = _accept_client(listen_fd, listeners, &ip);
 		if (connect_fd < 0) {
-			lock_delay(&lock);
+			pthread_mutex_lock(&list_lock);
+			lock_delay(&list_lock);
 			continue;
 		}
-		ip = (char *)malloc(INET_ADDRSTRLEN + 1);
-		inet_ntop(AF_INET, &(client_addr.sin_addr.s_addr), ip,
-			  INET_ADDRSTRLEN);
+		// Handshake outside the list lock so PSL threads can keep going
+		info_msg("Connection from %s", ip);
+		client = _client_connect(&connect_fd, ip);
+		pthread_mutex_lock(&list_lock);
 		// Clean up disconnected clients
 		client_ptr = &client_list;
 		while (*client_ptr != NULL) {
-			client = *client_ptr;
-			if ((client->pending == 0)
-			    && (client->state == CLIENT_NONE)) {
-				*client_ptr = client->_next;
-				if (client->_next != NULL)
-					client->_next->_prev = client->_prev;
-				_free_client(client);
-				lock_delay(&lock);
+			old = *client_ptr;
+			if ((old->pending == 0) && (old->state == CLIENT_NONE)
+			    && !_client_in_use(old)) {
+				*client_ptr = old->_next;
+				if (old->_next != NULL)
+					old->_next->_prev = old->_prev;
+				pthread_join(old->thread, NULL);
+				_free_client(old);
+				lock_delay(&list_lock);
 				continue;
 			}
 			client_ptr = &((*client_ptr)->_next);
 		}
 		// Add new client
-		info_msg("Connection from %s", ip);
-		client = _client_connect(&connect_fd, ip);
 		if (client != NULL) {
 			if (client_list != NULL)
 				client_list->_prev = client;
@@ -596,10 +816,14 @@ int main(int argc, char **argv)
 				break;
 			}
 		}
-		lock_delay(&lock);
+		lock_delay(&list_lock);
 	}
 	info_msg("No AFUs connected, Shutting down PSLSE\n");
-	close_socket(&listen_fd);
+	close_socket(&(listen_fd[0]));
+	if (listeners > 1) {
+		close(listen_fd[1]);
+		unlink(unix_path);
+	}
 
 	// Shutdown unassociated client connections
 	while (client_list != NULL) {
@@ -607,17 +831,20 @@ int main(int argc, char **argv)
 		client_list = client->_next;
 		if (client->pending)
 			client->pending = 0;
-		pthread_mutex_unlock(&lock);
+		pthread_mutex_unlock(&list_lock);
 		pthread_join(client->thread, NULL);
-		pthread_mutex_lock(&lock);
+		pthread_mutex_lock(&list_lock);
 		close_socket(&(client->fd));
 		_free_client(client);
 	}
-	pthread_mutex_unlock(&lock);
+	pthread_mutex_unlock(&list_lock);
 
+	status_stop();
 	free(parms);
+	stats_close();
+	debug_log_stop();
 	fclose(fp);
-	pthread_mutex_destroy(&lock);
+	pthread_mutex_destroy(&list_lock);
 
 	return 0;
 }
@@ -0,0 +1,286 @@
+/*
+ * Copyright 2014,2015 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: schedule.c
+ *
+ *  This file contains the random scheduling decisions pslse makes for each
+ *  AFU: whether to respond, inject PAGED, reorder commands or add bogus
+ *  buffer activity.  Each PSL thread draws from its own xoshiro256** stream
+ *  seeded from SEED and the AFU, so other threads cannot disturb it.  Every
+ *  decision can also be recorded to a file and a later run can replay the
+ *  file to take the same decisions.  A decision is stored as one nibble:
+ *  bit 3 is always set, bits 2:1 are the schedule_decision and bit 0 is the
+ *  outcome.  Two decisions are packed per byte, low nibble first, and a zero
+ *  nibble pads the last byte.  How many decisions of one type are taken
+ *  between those of another depends on when clients answer memory requests,
+ *  so a replay follows a separate cursor through the record for each type.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "schedule.h"
+#include "../common/utils.h"
+
+#define SCHEDULE_MAGIC "PSLSCHD"
+#define SCHEDULE_VERSION 1
+#define SCHEDULE_HEADER_BYTES 12	// Magic, version, be32 seed
+
+static const char *_decisions[] = { "resp", "paged", "reorder", "buffer" };
+
+static enum schedule_mode _schedule_mode;
+static char *_schedule_prefix;
+
+void schedule_mode(char *record_prefix, char *replay_prefix)
+{
+	_schedule_mode = SCHEDULE_RANDOM;
+	_schedule_prefix = NULL;
+	if ((record_prefix != NULL) && (*record_prefix == '\0'))
+		record_prefix = NULL;
+	if ((replay_prefix != NULL) && (*replay_prefix == '\0'))
+		replay_prefix = NULL;
+	if (replay_prefix != NULL) {
+		if (record_prefix != NULL)
+			warn_msg("Replaying decisions, so not recording");
+		_schedule_mode = SCHEDULE_REPLAY;
+		_schedule_prefix = replay_prefix;
+	} else if (record_prefix != NULL) {
+		_schedule_mode = SCHEDULE_RECORD;
+		_schedule_prefix = record_prefix;
+	}
+}
+
+static uint64_t _splitmix64(uint64_t * x)
+{
+	uint64_t z;
+
+	z = (*x += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+static inline uint64_t _rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+static uint64_t _next(struct schedule *sched)
+{
+	uint64_t *s = sched->s;
+	uint64_t result, t;
+
+	result = _rotl(s[1] * 5, 7) * 9;
+	t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = _rotl(s[3], 45);
+	return result;
+}
+
+static int _open_record(struct schedule *sched, uint32_t seed)
+{
+	uint8_t header[SCHEDULE_HEADER_BYTES];
+
+	if ((sched->fp = fopen(sched->path, "w")) == NULL)
+		return -1;
+	memcpy(header, SCHEDULE_MAGIC, 7);
+	header[7] = SCHEDULE_VERSION;
+	header[8] = seed >> 24;
+	header[9] = seed >> 16;
+	header[10] = seed >> 8;
+	header[11] = seed;
+	if (fwrite(header, sizeof(header), 1, sched->fp) != 1)
+		return -1;
+	return 0;
+}
+
+// Read the whole record so each decision type can be replayed on its own
+static int _open_replay(struct schedule *sched, uint32_t seed)
+{
+	uint8_t header[SCHEDULE_HEADER_BYTES];
+	uint32_t recorded;
+	long size;
+
+	if ((sched->fp = fopen(sched->path, "r")) == NULL)
+		return -1;
+	if ((fread(header, sizeof(header), 1, sched->fp) != 1) ||
+	    memcmp(header, SCHEDULE_MAGIC, 7) ||
+	    (header[7] != SCHEDULE_VERSION)) {
+		warn_msg("%s is not a scheduling record", sched->path);
+		return -1;
+	}
+	recorded = ((uint32_t) header[8] << 24) | (header[9] << 16) |
+	    (header[10] << 8) | header[11];
+	if (recorded != seed)
+		warn_msg("%s was recorded with seed %u, not %u", sched->path,
+			 recorded, seed);
+	if ((fseek(sched->fp, 0, SEEK_END) < 0) ||
+	    ((size = ftell(sched->fp)) < 0) ||
+	    (fseek(sched->fp, SCHEDULE_HEADER_BYTES, SEEK_SET) < 0))
+		return -1;
+	size -= SCHEDULE_HEADER_BYTES;
+	if ((size > 0) && ((sched->record = (uint8_t *) malloc(size)) == NULL))
+		return -1;
+	if ((size > 0) && (fread(sched->record, size, 1, sched->fp) != 1))
+		return -1;
+	sched->record_nibbles = 2 * (uint64_t) size;
+	fclose(sched->fp);
+	sched->fp = NULL;
+	return 0;
+}
+
+struct schedule *schedule_init(char *afu_name, uint32_t seed, uint8_t dbg_id)
+{
+	struct schedule *sched;
+	uint64_t x;
+	int i, rc;
+
+	sched = (struct schedule *)calloc(1, sizeof(struct schedule));
+	if (!sched) {
+		perror("malloc");
+		exit(-1);
+	}
+	sched->afu_name = afu_name;
+
+	// Give each AFU its own stream for the same seed
+	x = ((uint64_t) dbg_id << 32) | seed;
+	for (i = 0; i < 4; i++)
+		sched->s[i] = _splitmix64(&x);
+
+	if (_schedule_mode == SCHEDULE_RANDOM)
+		return sched;
+	sched->path = (char *)malloc(strlen(_schedule_prefix) +
+				     strlen(afu_name) + 2);
+	if (!sched->path) {
+		perror("malloc");
+		exit(-1);
+	}
+	sprintf(sched->path, "%s.%s", _schedule_prefix, afu_name);
+	if (_schedule_mode == SCHEDULE_RECORD)
+		rc = _open_record(sched, seed);
+	else
+		rc = _open_replay(sched, seed);
+	if (rc < 0) {
+		warn_msg("%s: Unable to %s scheduling decisions with %s",
+			 afu_name, (_schedule_mode == SCHEDULE_RECORD) ?
+			 "record" : "replay", sched->path);
+		if (sched->fp)
+			fclose(sched->fp);
+		sched->fp = NULL;
+		free(sched->record);
+		sched->record = NULL;
+		return sched;
+	}
+	sched->mode = _schedule_mode;
+	info_msg("%s: %s scheduling decisions %s %s", afu_name,
+		 (sched->mode == SCHEDULE_RECORD) ? "Recording" : "Replaying",
+		 (sched->mode == SCHEDULE_RECORD) ? "to" : "from", sched->path);
+	return sched;
+}
+
+static void _record(struct schedule *sched, uint8_t nibble)
+{
+	sched->byte |= nibble << (4 * sched->nibbles);
+	if (++sched->nibbles < 2)
+		return;
+	if (fputc(sched->byte, sched->fp) == EOF) {
+		warn_msg("%s: Unable to record scheduling decisions to %s",
+			 sched->afu_name, sched->path);
+		fclose(sched->fp);
+		sched->fp = NULL;
+		sched->mode = SCHEDULE_RANDOM;
+	}
+	sched->byte = 0;
+	sched->nibbles = 0;
+}
+
+// Return the next recorded nibble of this type, or 0 once there are none
+static uint8_t _replay(struct schedule *sched, enum schedule_decision type)
+{
+	uint64_t *cursor;
+	uint8_t nibble;
+
+	cursor = &(sched->cursor[type]);
+	while (*cursor < sched->record_nibbles) {
+		nibble = sched->record[*cursor / 2] >> (4 * (*cursor & 1));
+		nibble &= 0xf;
+		++*cursor;
+		if ((nibble & 0x8) && (((nibble >> 1) & 0x3) == type))
+			return nibble;
+	}
+	if (!(sched->exhausted & (1 << type))) {
+		warn_msg("%s: Replay ran out of %s decisions after %" PRIu64
+			 ", deciding them randomly from here",
+			 sched->afu_name, _decisions[type], sched->decisions);
+		sched->exhausted |= 1 << type;
+	}
+	return 0;
+}
+
+int schedule_decide(struct schedule *sched, enum schedule_decision type,
+		    int chance)
+{
+	uint8_t nibble;
+	int decision;
+
+	// Always draw so the stream is in step if a replay runs out
+	decision = (int)((_next(sched) >> 32) % 100) < chance;
+	if (sched->mode == SCHEDULE_RECORD) {
+		_record(sched, 0x8 | (type << 1) | decision);
+	} else if (sched->mode == SCHEDULE_REPLAY) {
+		if ((nibble = _replay(sched, type)) != 0) {
+			decision = nibble & 0x1;
+			++sched->replayed;
+		}
+	}
+	++sched->decisions;
+	return decision;
+}
+
+void schedule_flush(struct schedule *sched)
+{
+	if ((sched->mode == SCHEDULE_RECORD) && (sched->fp != NULL))
+		fflush(sched->fp);
+}
+
+void schedule_free(struct schedule *sched)
+{
+	if (sched == NULL)
+		return;
+	if (sched->fp != NULL) {
+		if ((sched->mode == SCHEDULE_RECORD) && sched->nibbles)
+			fputc(sched->byte, sched->fp);
+		fclose(sched->fp);
+		if (sched->mode == SCHEDULE_RECORD)
+			info_msg("%s: Recorded %" PRIu64
+				 " scheduling decisions to %s",
+				 sched->afu_name, sched->decisions,
+				 sched->path);
+	}
+	if (sched->mode == SCHEDULE_REPLAY)
+		info_msg("%s: Replayed %" PRIu64 " of %" PRIu64
+			 " scheduling decisions from %s", sched->afu_name,
+			 sched->replayed, sched->decisions, sched->path);
+	free(sched->record);
+	free(sched->path);
+	free(sched);
+}
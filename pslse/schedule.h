@@ -0,0 +1,68 @@
+/*
+ * Copyright 2014,2015 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SCHEDULE_H_
+#define _SCHEDULE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+enum schedule_decision {
+	SCHEDULE_RESP,
+	SCHEDULE_PAGED,
+	SCHEDULE_REORDER,
+	SCHEDULE_BUFFER
+};
+
+enum schedule_mode {
+	SCHEDULE_RANDOM,
+	SCHEDULE_RECORD,
+	SCHEDULE_REPLAY
+};
+
+// Scheduling decisions for one AFU, only touched by its PSL thread
+struct schedule {
+	uint64_t s[4];		// xoshiro256** state
+	uint64_t decisions;
+	uint64_t replayed;
+	uint64_t cursor[4];	// Next nibble to replay for each decision type
+	uint64_t record_nibbles;
+	uint8_t *record;	// Whole record when replaying
+	enum schedule_mode mode;
+	FILE *fp;		// Record being written
+	char *path;
+	char *afu_name;
+	uint8_t byte;		// Decisions packed but not yet written
+	uint8_t nibbles;
+	uint8_t exhausted;	// Decision types the replay has run out of
+};
+
+// Record decisions to, or replay them from, files named prefix.<afu>.
+// Call before the first schedule_init().
+void schedule_mode(char *record_prefix, char *replay_prefix);
+
+struct schedule *schedule_init(char *afu_name, uint32_t seed, uint8_t dbg_id);
+
+// Decide true with percent chance, or as recorded when replaying
+int schedule_decide(struct schedule *sched, enum schedule_decision type,
+		    int chance);
+
+// Write out what has been recorded so far
+void schedule_flush(struct schedule *sched);
+
+void schedule_free(struct schedule *sched);
+
+#endif				/* _SCHEDULE_H_ */
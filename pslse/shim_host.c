@@ -19,16 +19,18 @@
  *
  *  This file contains parse_host_data() which reads the file with the
  *  hostname and ports of each AFU simulator and calls psl_init for each.
+ *  An AFU simulator on this host can be given as unix:<path> instead.
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "shim_host.h"
 #include "../common/utils.h"
 
 // Parse file to find hostname and ports for AFU simulator(s)
 uint16_t parse_host_data(struct psl ** head, struct parms * parms,
-			 char *filename, pthread_mutex_t * lock, FILE * dbg_fp)
+			 char *filename, pthread_mutex_t * list_lock, FILE * dbg_fp)
 {
 	FILE *fp;
 	struct psl *psl;
@@ -66,28 +68,27 @@ uint16_t parse_host_data(struct psl ** head, struct parms * parms,
 				  filename, hostdata);
 			continue;
 		}
-		port_str = strchr(host, ':');
-		if (port_str) {
+		if (strncmp(host, PSL_UNIX_PREFIX, strlen(PSL_UNIX_PREFIX)) ==
+		    0) {
+			// Pass "unix:<path>" through whole as host
+			host[strcspn(host, " \t\r\n")] = '\0';
+			port = 0;
+		} else {
+			port_str = strchr(host, ':');
+			if (!port_str) {
+				error_msg
+				    ("Invalid format in %s: Expected ':' :%s\n",
+				     filename, host);
+				continue;
+			}
 			*port_str = '\0';
 			++port_str;
-		} else {
-			error_msg("Invalid format in %s: Expected ':' :%s\n",
-				  filename, host);
-			continue;
-		}
-		if (!host) {
-			error_msg("Invalid format in %s, hostname not found\n");
-			continue;
-		}
-		if (!port_str) {
-			error_msg("Invalid format in %s, Port not found\n");
-			continue;
+			port = atoi(port_str);
 		}
-		port = atoi(port_str);
 
 		// Initialize PSL
 		if ((location = psl_init(head, parms, afu_id, host, port,
-					 lock, dbg_fp)) == 0) {
+					 list_lock, dbg_fp)) == 0) {
 			continue;
 		}
 		afu_map |= location;
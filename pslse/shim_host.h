@@ -25,6 +25,6 @@
 #include "psl.h"
 
 uint16_t parse_host_data(struct psl ** head, struct parms * parms,
-			 char *filename, pthread_mutex_t * lock, FILE * dbg_fp);
+			 char *filename, pthread_mutex_t * list_lock, FILE * dbg_fp);
 
 #endif				/* _SHIM_HOST_H_ */
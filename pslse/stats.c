@@ -0,0 +1,548 @@
+/*
+ * Copyright 2014,2015 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: stats.c
+ *
+ *  This file contains the command statistics kept for each AFU: command and
+ *  response counts, command and client memory latency histograms, buffer
+ *  bytes moved and how many credits were in use each cycle.  Counters are
+ *  kept for the AFU as a whole and for each context.  Each PSL thread owns
+ *  the statistics for its AFU so updates take no locks.  A report is printed
+ *  when the AFU disconnects and whenever pslse gets SIGUSR1, and each report
+ *  is also appended as one line of JSON to the stats file.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+#include "../common/psl_interface_t.h"
+#include "../common/utils.h"
+
+static const struct {
+	uint32_t code;
+	const char *name;
+} _commands[STATS_COMMANDS - 1] = {
+	{PSL_COMMAND_READ_CL_NA, "READ_CL_NA"},
+	{PSL_COMMAND_READ_CL_S, "READ_CL_S"},
+	{PSL_COMMAND_READ_CL_M, "READ_CL_M"},
+	{PSL_COMMAND_READ_CL_LCK, "READ_CL_LCK"},
+	{PSL_COMMAND_READ_CL_RES, "READ_CL_RES"},
+	{PSL_COMMAND_READ_PE, "READ_PE"},
+	{PSL_COMMAND_READ_PNA, "READ_PNA"},
+	{PSL_COMMAND_TOUCH_I, "TOUCH_I"},
+	{PSL_COMMAND_TOUCH_S, "TOUCH_S"},
+	{PSL_COMMAND_TOUCH_M, "TOUCH_M"},
+	{PSL_COMMAND_WRITE_MI, "WRITE_MI"},
+	{PSL_COMMAND_WRITE_MS, "WRITE_MS"},
+	{PSL_COMMAND_WRITE_UNLOCK, "WRITE_UNLOCK"},
+	{PSL_COMMAND_WRITE_C, "WRITE_C"},
+	{PSL_COMMAND_WRITE_NA, "WRITE_NA"},
+	{PSL_COMMAND_WRITE_INJ, "WRITE_INJ"},
+	{PSL_COMMAND_PUSH_I, "PUSH_I"},
+	{PSL_COMMAND_PUSH_S, "PUSH_S"},
+	{PSL_COMMAND_EVICT_I, "EVICT_I"},
+	{PSL_COMMAND_FLUSH, "FLUSH"},
+	{PSL_COMMAND_INTREQ, "INTREQ"},
+	{PSL_COMMAND_LOCK, "LOCK"},
+	{PSL_COMMAND_UNLOCK, "UNLOCK"},
+	{PSL_COMMAND_RESTART, "RESTART"}
+};
+
+static const char *_responses[STATS_RESPONSES] = {
+	"DONE", "AERROR", "2", "DERROR", "NLOCK", "NRES", "FLUSHED", "FAULT",
+	"FAILED", "9", "PAGED", "CONTEXT", "12", "13", "14", "UNKNOWN"
+};
+
+static volatile sig_atomic_t _stats_requests;
+static pthread_mutex_t _stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *_stats_fp;
+
+struct stats *stats_init(char *afu_name, uint32_t credits)
+{
+	struct stats *stats;
+
+	if ((stats = (struct stats *)calloc(1, sizeof(struct stats))) == NULL)
+		return NULL;
+	stats->occupancy = (uint64_t *) calloc(credits + 1, sizeof(uint64_t));
+	if (stats->occupancy == NULL) {
+		free(stats);
+		return NULL;
+	}
+	stats->credits = credits;
+	stats->afu_name = afu_name;
+	stats->start_ns = stats_ns();
+	stats->request_seen = _stats_requests;
+	return stats;
+}
+
+// Allocate per context counters once the AFU descriptor is read
+int stats_contexts(struct stats *stats, int contexts)
+{
+	if (stats == NULL)
+		return -1;
+	free(stats->context);
+	stats->context = (struct stats_counts *)calloc(contexts,
+						       sizeof(*stats->context));
+	if (stats->context == NULL) {
+		stats->contexts = 0;
+		return -1;
+	}
+	stats->contexts = contexts;
+	return 0;
+}
+
+// Include pool usage in reports, pool stays owned by the caller
+void stats_pool(struct stats *stats, struct stats_pool *pool)
+{
+	if (stats == NULL)
+		return;
+	stats->pool = pool;
+}
+
+uint64_t stats_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static struct stats_counts *_context(struct stats *stats, int32_t context)
+{
+	if ((context < 0) || (context >= stats->contexts))
+		return NULL;
+	return &(stats->context[context]);
+}
+
+static int _command_index(uint32_t command)
+{
+	int i;
+
+	for (i = 0; i < STATS_COMMANDS - 1; i++) {
+		if (_commands[i].code == command)
+			return i;
+	}
+	return STATS_COMMANDS - 1;
+}
+
+static void _hist_add(struct stats_hist *hist, uint64_t value)
+{
+	int n;
+
+	n = value ? 64 - __builtin_clzll(value) : 0;
+	if (n >= STATS_BUCKETS)
+		n = STATS_BUCKETS - 1;
+	hist->bucket[n]++;
+	if (!hist->count || (value < hist->min))
+		hist->min = value;
+	if (value > hist->max)
+		hist->max = value;
+	hist->count++;
+	hist->sum += value;
+}
+
+// Upper bound of the bucket holding percentile p
+static uint64_t _hist_percentile(struct stats_hist *hist, double p)
+{
+	uint64_t seen, limit;
+	int n;
+
+	if (!hist->count)
+		return 0;
+	limit = (uint64_t) (p * hist->count);
+	seen = 0;
+	for (n = 0; n < STATS_BUCKETS - 1; n++) {
+		seen += hist->bucket[n];
+		if (seen > limit)
+			break;
+	}
+	if (((1ull << n) - 1) > hist->max)
+		return hist->max;
+	return (1ull << n) - 1;
+}
+
+static double _hist_mean(struct stats_hist *hist)
+{
+	if (!hist->count)
+		return 0.0;
+	return (double)hist->sum / hist->count;
+}
+
+void stats_command(struct stats *stats, int32_t context, uint32_t command)
+{
+	struct stats_counts *counts;
+	int i;
+
+	if (stats == NULL)
+		return;
+	i = _command_index(command);
+	stats->afu.commands[i]++;
+	if ((counts = _context(stats, context)) != NULL)
+		counts->commands[i]++;
+}
+
+void stats_response(struct stats *stats, int32_t context, uint32_t resp,
+		    uint64_t cycles, uint64_t ns)
+{
+	struct stats_counts *counts;
+
+	if (stats == NULL)
+		return;
+	if (resp >= STATS_RESPONSES)
+		resp = STATS_RESPONSES - 1;
+	stats->afu.responses[resp]++;
+	_hist_add(&(stats->afu.cycles), cycles);
+	_hist_add(&(stats->afu.ns), ns);
+	if ((counts = _context(stats, context)) == NULL)
+		return;
+	counts->responses[resp]++;
+	_hist_add(&(counts->cycles), cycles);
+	_hist_add(&(counts->ns), ns);
+}
+
+void stats_mem(struct stats *stats, int32_t context, uint64_t ns)
+{
+	struct stats_counts *counts;
+
+	if (stats == NULL)
+		return;
+	_hist_add(&(stats->afu.mem_ns), ns);
+	if ((counts = _context(stats, context)) != NULL)
+		_hist_add(&(counts->mem_ns), ns);
+}
+
+void stats_buffer(struct stats *stats, int32_t context, uint32_t bytes,
+		  int write)
+{
+	struct stats_counts *counts;
+
+	if (stats == NULL)
+		return;
+	counts = _context(stats, context);
+	if (write) {
+		stats->afu.bytes_written += bytes;
+		if (counts != NULL)
+			counts->bytes_written += bytes;
+	} else {
+		stats->afu.bytes_read += bytes;
+		if (counts != NULL)
+			counts->bytes_read += bytes;
+	}
+}
+
+static void _erat_add(struct stats_counts *counts, int hit, int evicted)
+{
+	if (hit)
+		counts->erat_hits++;
+	else
+		counts->erat_misses++;
+	if (evicted)
+		counts->erat_evictions++;
+}
+
+void stats_erat(struct stats *stats, int32_t context, int hit, int evicted)
+{
+	struct stats_counts *counts;
+
+	if (stats == NULL)
+		return;
+	_erat_add(&(stats->afu), hit, evicted);
+	if ((counts = _context(stats, context)) != NULL)
+		_erat_add(counts, hit, evicted);
+}
+
+// Account cycles clocked with outstanding commands holding credits
+void stats_clock(struct stats *stats, int outstanding, int cycles)
+{
+	if (stats == NULL)
+		return;
+	if (outstanding < 0)
+		outstanding = 0;
+	if (outstanding > (int)stats->credits)
+		outstanding = stats->credits;
+	stats->occupancy[outstanding] += cycles;
+	stats->cycles += cycles;
+}
+
+// Skipped cycles count as cycles too, the AFU's time still passed
+void stats_skip(struct stats *stats, int outstanding, uint64_t cycles)
+{
+	if (stats == NULL)
+		return;
+	if (outstanding < 0)
+		outstanding = 0;
+	if (outstanding > (int)stats->credits)
+		outstanding = stats->credits;
+	stats->occupancy[outstanding] += cycles;
+	stats->cycles += cycles;
+	stats->skipped += cycles;
+}
+
+void stats_request(void)
+{
+	_stats_requests++;
+}
+
+void stats_poll(struct stats *stats)
+{
+	uint32_t requests = _stats_requests;
+
+	if ((stats == NULL) || (stats->request_seen == requests))
+		return;
+	stats->request_seen = requests;
+	stats_report(stats, "signal");
+}
+
+static uint64_t _counts_total(uint64_t * count, int n)
+{
+	uint64_t total;
+	int i;
+
+	total = 0;
+	for (i = 0; i < n; i++)
+		total += count[i];
+	return total;
+}
+
+static void _print_hist(struct stats *stats, const char *name,
+			struct stats_hist *hist)
+{
+	if (!hist->count)
+		return;
+	info_msg("%s   %s: mean=%.1f p50=%" PRIu64 " p99=%" PRIu64 " min=%"
+		 PRIu64 " max=%" PRIu64, stats->afu_name, name,
+		 _hist_mean(hist), _hist_percentile(hist, 0.5),
+		 _hist_percentile(hist, 0.99), hist->min, hist->max);
+}
+
+static void _print_counts(struct stats *stats, struct stats_counts *counts,
+			  double secs)
+{
+	uint64_t lookups;
+	char line[256];
+	int i, len;
+
+	len = 0;
+	line[0] = '\0';
+	for (i = 0; i < STATS_COMMANDS; i++) {
+		if (!counts->commands[i] || (len >= sizeof(line)))
+			continue;
+		len += snprintf(line + len, sizeof(line) - len, " %s=%" PRIu64,
+				(i < STATS_COMMANDS - 1) ? _commands[i].name :
+				"UNKNOWN", counts->commands[i]);
+	}
+	info_msg("%s   commands:%s", stats->afu_name, line);
+	len = 0;
+	line[0] = '\0';
+	for (i = 0; i < STATS_RESPONSES; i++) {
+		if (!counts->responses[i] || (len >= sizeof(line)))
+			continue;
+		len += snprintf(line + len, sizeof(line) - len, " %s=%" PRIu64,
+				_responses[i], counts->responses[i]);
+	}
+	info_msg("%s   responses:%s", stats->afu_name, line);
+	info_msg("%s   buffer bytes: read=%" PRIu64 " (%.2f MB/s) written=%"
+		 PRIu64 " (%.2f MB/s)", stats->afu_name, counts->bytes_read,
+		 counts->bytes_read / secs / 1e6, counts->bytes_written,
+		 counts->bytes_written / secs / 1e6);
+	lookups = counts->erat_hits + counts->erat_misses;
+	if (lookups)
+		info_msg("%s   ERAT: hits=%" PRIu64 " misses=%" PRIu64
+			 " (%.1f%% hit) evictions=%" PRIu64, stats->afu_name,
+			 counts->erat_hits, counts->erat_misses,
+			 100.0 * counts->erat_hits / lookups,
+			 counts->erat_evictions);
+	_print_hist(stats, "latency cycles", &(counts->cycles));
+	_print_hist(stats, "latency ns", &(counts->ns));
+	_print_hist(stats, "memory round trip ns", &(counts->mem_ns));
+}
+
+static void _print(struct stats *stats, const char *reason, double secs)
+{
+	uint64_t weighted, full;
+	int i, peak;
+
+	weighted = 0;
+	peak = 0;
+	for (i = 0; i <= stats->credits; i++) {
+		weighted += stats->occupancy[i] * i;
+		if (stats->occupancy[i])
+			peak = i;
+	}
+	full = stats->occupancy[stats->credits];
+	info_msg("%s stats (%s): %" PRIu64 " commands over %" PRIu64
+		 " cycles (%" PRIu64 " skipped) in %.3f s", stats->afu_name,
+		 reason, _counts_total(stats->afu.commands, STATS_COMMANDS),
+		 stats->cycles, stats->skipped, secs);
+	info_msg("%s   credits: mean=%.2f peak=%d of %d, all in use %.1f%%"
+		 " of cycles", stats->afu_name, stats->cycles ?
+		 (double)weighted / stats->cycles : 0.0, peak, stats->credits,
+		 stats->cycles ? 100.0 * full / stats->cycles : 0.0);
+	if (stats->pool != NULL)
+		info_msg("%s   command pool: slots=%u in use=%u peak=%u hits=%"
+			 PRIu64 " misses=%" PRIu64, stats->afu_name,
+			 stats->pool->slots, stats->pool->in_use,
+			 stats->pool->peak,
+			 stats->pool->allocs - stats->pool->overflows,
+			 stats->pool->overflows);
+	_print_counts(stats, &(stats->afu), secs);
+	for (i = 0; i < stats->contexts; i++) {
+		if (!_counts_total(stats->context[i].commands, STATS_COMMANDS))
+			continue;
+		info_msg("%s context %d:", stats->afu_name, i);
+		_print_counts(stats, &(stats->context[i]), secs);
+	}
+}
+
+static void _json_hist(FILE * fp, const char *name, struct stats_hist *hist)
+{
+	int i, last;
+
+	fprintf(fp, ",\"%s\":{\"count\":%" PRIu64 ",\"sum\":%" PRIu64
+		",\"min\":%" PRIu64 ",\"max\":%" PRIu64 ",\"p50\":%" PRIu64
+		",\"p99\":%" PRIu64 ",\"log2_buckets\":[", name, hist->count,
+		hist->sum, hist->min, hist->max, _hist_percentile(hist, 0.5),
+		_hist_percentile(hist, 0.99));
+	last = -1;
+	for (i = 0; i < STATS_BUCKETS; i++) {
+		if (hist->bucket[i])
+			last = i;
+	}
+	for (i = 0; i <= last; i++)
+		fprintf(fp, "%s%" PRIu64, i ? "," : "", hist->bucket[i]);
+	fprintf(fp, "]}");
+}
+
+static void _json_counts(FILE * fp, struct stats_counts *counts)
+{
+	const char *sep;
+	int i;
+
+	fprintf(fp, "\"commands\":{");
+	sep = "";
+	for (i = 0; i < STATS_COMMANDS; i++) {
+		if (!counts->commands[i])
+			continue;
+		fprintf(fp, "%s\"%s\":%" PRIu64, sep,
+			(i < STATS_COMMANDS - 1) ? _commands[i].name :
+			"UNKNOWN", counts->commands[i]);
+		sep = ",";
+	}
+	fprintf(fp, "},\"responses\":{");
+	sep = "";
+	for (i = 0; i < STATS_RESPONSES; i++) {
+		if (!counts->responses[i])
+			continue;
+		fprintf(fp, "%s\"%s\":%" PRIu64, sep, _responses[i],
+			counts->responses[i]);
+		sep = ",";
+	}
+	fprintf(fp, "},\"bytes_read\":%" PRIu64 ",\"bytes_written\":%" PRIu64,
+		counts->bytes_read, counts->bytes_written);
+	fprintf(fp, ",\"erat\":{\"hits\":%" PRIu64 ",\"misses\":%" PRIu64
+		",\"evictions\":%" PRIu64 "}", counts->erat_hits,
+		counts->erat_misses, counts->erat_evictions);
+	_json_hist(fp, "latency_cycles", &(counts->cycles));
+	_json_hist(fp, "latency_ns", &(counts->ns));
+	_json_hist(fp, "mem_ns", &(counts->mem_ns));
+}
+
+static void _json(struct stats *stats, FILE * fp, const char *reason,
+		  uint64_t ns)
+{
+	int i;
+
+	fprintf(fp, "{\"afu\":\"%s\",\"reason\":\"%s\",\"time\":%ld,"
+		"\"ns\":%" PRIu64 ",\"cycles\":%" PRIu64 ",\"skipped\":%" PRIu64
+		",\"credits\":%d,\"occupancy\":[", stats->afu_name, reason,
+		(long)time(NULL), ns, stats->cycles, stats->skipped,
+		stats->credits);
+	for (i = 0; i <= stats->credits; i++)
+		fprintf(fp, "%s%" PRIu64, i ? "," : "", stats->occupancy[i]);
+	fprintf(fp, "],");
+	if (stats->pool != NULL)
+		fprintf(fp, "\"pool\":{\"slots\":%u,\"in_use\":%u,\"peak\":%u,"
+			"\"hits\":%" PRIu64 ",\"misses\":%" PRIu64 "},",
+			stats->pool->slots, stats->pool->in_use,
+			stats->pool->peak,
+			stats->pool->allocs - stats->pool->overflows,
+			stats->pool->overflows);
+	_json_counts(fp, &(stats->afu));
+	fprintf(fp, ",\"contexts\":[");
+	for (i = 0; i < stats->contexts; i++) {
+		fprintf(fp, "%s{\"context\":%d,", i ? "," : "", i);
+		_json_counts(fp, &(stats->context[i]));
+		fprintf(fp, "}");
+	}
+	fprintf(fp, "]}\n");
+}
+
+void stats_report(struct stats *stats, const char *reason)
+{
+	uint64_t ns;
+	double secs;
+
+	if (stats == NULL)
+		return;
+	ns = stats_ns() - stats->start_ns;
+	secs = ns / 1e9;
+	if (secs <= 0.0)
+		secs = 1e-9;
+	_print(stats, reason, secs);
+	pthread_mutex_lock(&_stats_lock);
+	if (_stats_fp != NULL) {
+		_json(stats, _stats_fp, reason, ns);
+		fflush(_stats_fp);
+	}
+	pthread_mutex_unlock(&_stats_lock);
+}
+
+// Append reports to path, one JSON object per line
+int stats_open(char *path)
+{
+	FILE *fp;
+
+	if ((fp = fopen(path, "a")) == NULL)
+		return -1;
+	pthread_mutex_lock(&_stats_lock);
+	_stats_fp = fp;
+	pthread_mutex_unlock(&_stats_lock);
+	return 0;
+}
+
+void stats_close(void)
+{
+	pthread_mutex_lock(&_stats_lock);
+	if (_stats_fp != NULL)
+		fclose(_stats_fp);
+	_stats_fp = NULL;
+	pthread_mutex_unlock(&_stats_lock);
+}
+
+void stats_free(struct stats *stats)
+{
+	if (stats == NULL)
+		return;
+	free(stats->context);
+	free(stats->occupancy);
+	free(stats);
+}
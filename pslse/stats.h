@@ -0,0 +1,113 @@
+/*
+ * Copyright 2014,2015 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define STATS_BUCKETS 48	// Bucket n holds values of n significant bits
+#define STATS_COMMANDS 25	// Known PSL_COMMAND_* codes plus unknown
+#define STATS_RESPONSES 16	// PSL_RESPONSE_* codes, last is unknown
+
+// Log2 histogram of a latency
+struct stats_hist {
+	uint64_t bucket[STATS_BUCKETS];
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+};
+
+// Counters kept for the whole AFU and for each context
+struct stats_counts {
+	uint64_t commands[STATS_COMMANDS];
+	uint64_t responses[STATS_RESPONSES];
+	uint64_t bytes_read;	// Buffer reads, AFU to PSL
+	uint64_t bytes_written;	// Buffer writes, PSL to AFU
+	uint64_t erat_hits;
+	uint64_t erat_misses;
+	uint64_t erat_evictions;
+	struct stats_hist cycles;	// Command to response
+	struct stats_hist ns;
+	struct stats_hist mem_ns;	// MEM_REQUEST to MEM_RECEIVED
+};
+
+// Command slot pool usage, kept by cmd.c
+struct stats_pool {
+	uint64_t allocs;
+	uint64_t overflows;	// Allocations no preallocated slot was left for
+	uint32_t slots;
+	uint32_t in_use;
+	uint32_t peak;
+};
+
+// Statistics for one AFU, only touched by its PSL thread
+struct stats {
+	struct stats_counts afu;
+	struct stats_counts *context;
+	struct stats_pool *pool;	// NULL until stats_pool() is called
+	uint64_t *occupancy;	// Cycles clocked with n credits in use
+	uint64_t cycles;
+	uint64_t skipped;	// Cycles fast-forwarded while clocks were stopped
+	uint64_t start_ns;
+	uint32_t credits;
+	uint32_t request_seen;
+	int contexts;
+	char *afu_name;
+};
+
+struct stats *stats_init(char *afu_name, uint32_t credits);
+
+int stats_contexts(struct stats *stats, int contexts);
+
+uint64_t stats_ns(void);
+
+void stats_pool(struct stats *stats, struct stats_pool *pool);
+
+void stats_command(struct stats *stats, int32_t context, uint32_t command);
+
+void stats_response(struct stats *stats, int32_t context, uint32_t resp,
+		    uint64_t cycles, uint64_t ns);
+
+void stats_mem(struct stats *stats, int32_t context, uint64_t ns);
+
+void stats_buffer(struct stats *stats, int32_t context, uint32_t bytes,
+		  int write);
+
+void stats_erat(struct stats *stats, int32_t context, int hit, int evicted);
+
+void stats_clock(struct stats *stats, int outstanding, int cycles);
+
+void stats_skip(struct stats *stats, int outstanding, uint64_t cycles);
+
+// Ask every PSL thread for a report, safe to call from a signal handler
+void stats_request(void);
+
+// Report if stats_request() was called since the last check
+void stats_poll(struct stats *stats);
+
+// Print summary and append a JSON line to the file given to stats_open()
+void stats_report(struct stats *stats, const char *reason);
+
+int stats_open(char *path);
+
+void stats_close(void);
+
+void stats_free(struct stats *stats);
+
+#endif				/* _STATS_H_ */
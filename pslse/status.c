@@ -0,0 +1,434 @@
+/*
+ * Copyright 2014,2015 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: status.c
+ *
+ *  This file contains the status server, a thread that serves a snapshot of
+ *  every PSL's live state to monitoring tools.  Before each snapshot the
+ *  server raises a request and wakes the PSL threads, which publish their
+ *  state in their struct psl_status on the next loop.  The server waits up
+ *  to STATUS_REQUEST_MS for them and copies the state out holding only the
+ *  PSL list lock, so a stuck PSL thread shows what it last published.
+ *  A client connecting to the unix socket gets a JSON snapshot, or
+ *  plain text if it sends "text" first.  The snapshot can also be rewritten
+ *  to a file at a fixed interval.
+ */
+
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "psl.h"
+#include "stats.h"
+#include "status.h"
+#include "../common/utils.h"
+
+#define STATUS_REQUEST_MS 100
+
+struct status_server {
+	pthread_t thread;
+	struct psl **list;
+	pthread_mutex_t *list_lock;
+	char *socket_path;
+	char *file_path;
+	char *tmp_path;
+	uint64_t start_ns;
+	int interval_ms;
+	int listen_fd;
+	int stop_fd[2];
+};
+
+static struct status_server *_status;
+static uint32_t _status_requests;
+
+static const char *_state_name(int32_t state)
+{
+	switch (state) {
+	case PSLSE_IDLE:
+		return "IDLE";
+	case PSLSE_RESET:
+		return "RESET";
+	case PSLSE_DESC:
+		return "DESC";
+	case PSLSE_PENDING:
+		return "PENDING";
+	case PSLSE_RUNNING:
+		return "RUNNING";
+	case PSLSE_DONE:
+		return "DONE";
+	default:
+		return "UNKNOWN";
+	}
+}
+
+int status_due(struct psl_status *status)
+{
+	return __atomic_load_n(&_status_requests, __ATOMIC_RELAXED) !=
+	    status->request_seen;
+}
+
+void status_published(struct psl_status *status)
+{
+	__atomic_store_n(&(status->request_seen),
+			 __atomic_load_n(&_status_requests, __ATOMIC_RELAXED),
+			 __ATOMIC_RELEASE);
+}
+
+// Ask every PSL thread to publish and give them a moment to do it
+static void _refresh(struct status_server *server)
+{
+	struct timespec delay;
+	struct psl *psl;
+	uint32_t request;
+	uint64_t deadline;
+	int pending;
+
+	request = __atomic_add_fetch(&_status_requests, 1, __ATOMIC_RELAXED);
+	pthread_mutex_lock(server->list_lock);
+	for (psl = *(server->list); psl != NULL; psl = psl->_next)
+		psl_wake(psl);
+	pthread_mutex_unlock(server->list_lock);
+
+	delay.tv_sec = 0;
+	delay.tv_nsec = 1000000;
+	deadline = stats_ns() + STATUS_REQUEST_MS * 1000000ull;
+	do {
+		pending = 0;
+		pthread_mutex_lock(server->list_lock);
+		for (psl = *(server->list); psl != NULL; psl = psl->_next) {
+			if (__atomic_load_n(&(psl->status.request_seen),
+					    __ATOMIC_ACQUIRE) != request)
+				pending++;
+		}
+		pthread_mutex_unlock(server->list_lock);
+		if (pending)
+			nanosleep(&delay, NULL);
+	} while (pending && (stats_ns() < deadline));
+}
+
+// Copy each PSL's published state, returns count and sets *snap
+static int _snapshot(struct status_server *server, struct psl_status **snap)
+{
+	struct psl_status *copy, *status;
+	struct psl *psl;
+	int count, i;
+
+	pthread_mutex_lock(server->list_lock);
+	count = 0;
+	for (psl = *(server->list); psl != NULL; psl = psl->_next)
+		count++;
+	copy = (struct psl_status *)calloc(count + 1, sizeof(*copy));
+	i = 0;
+	for (psl = *(server->list); (copy != NULL) && (psl != NULL);
+	     psl = psl->_next) {
+		status = &(psl->status);
+		memcpy(copy[i].name, status->name, sizeof(copy[i].name));
+#define _LOAD(field) \
+		copy[i].field = __atomic_load_n(&(status->field), __ATOMIC_RELAXED)
+		_LOAD(cycles);
+		_LOAD(cycle_ns);
+		_LOAD(commands);
+		_LOAD(state);
+		_LOAD(idle_cycles);
+		_LOAD(skipped);
+		_LOAD(attached_clients);
+		_LOAD(max_clients);
+		_LOAD(outstanding);
+		_LOAD(credits);
+		_LOAD(mmios);
+		_LOAD(jobs);
+#undef _LOAD
+		i++;
+	}
+	pthread_mutex_unlock(server->list_lock);
+	*snap = copy;
+	return (copy == NULL) ? -1 : count;
+}
+
+static uint64_t _since_ms(uint64_t now, uint64_t then)
+{
+	if (!then || (then > now))
+		return 0;
+	return (now - then) / 1000000;
+}
+
+static void _write_json(struct status_server *server, FILE * fp,
+			struct psl_status *snap, int count, uint64_t now)
+{
+	struct psl_status total;
+	int i;
+
+	memset(&total, 0, sizeof(total));
+	fprintf(fp, "{\"pid\":%d,\"time\":%ld,\"uptime_ms\":%" PRIu64
+		",\"afus\":[", getpid(), (long)time(NULL),
+		_since_ms(now, server->start_ns));
+	for (i = 0; i < count; i++) {
+		fprintf(fp, "%s\n{\"name\":\"%s\",\"state\":\"%s\","
+			"\"cycles\":%" PRIu64 ",\"since_cycle_ms\":%" PRIu64
+			",\"skipped\":%" PRIu64 ",\"idle_cycles\":%d,"
+			"\"attached_clients\":%d,"
+			"\"max_clients\":%d,\"outstanding\":%d,\"credits\":%d,"
+			"\"mmios\":%d,\"jobs\":%d,\"commands\":%" PRIu64 "}",
+			i ? "," : "", snap[i].name,
+			_state_name(snap[i].state), snap[i].cycles,
+			_since_ms(now, snap[i].cycle_ns), snap[i].skipped,
+			snap[i].idle_cycles,
+			snap[i].attached_clients, snap[i].max_clients,
+			snap[i].outstanding, snap[i].credits, snap[i].mmios,
+			snap[i].jobs, snap[i].commands);
+		total.cycles += snap[i].cycles;
+		total.commands += snap[i].commands;
+		total.attached_clients += snap[i].attached_clients;
+		total.outstanding += snap[i].outstanding;
+		total.mmios += snap[i].mmios;
+		total.jobs += snap[i].jobs;
+	}
+	fprintf(fp, "],\n\"total\":{\"cycles\":%" PRIu64 ",\"attached_clients\""
+		":%d,\"outstanding\":%d,\"mmios\":%d,\"jobs\":%d,\"commands\":%"
+		PRIu64 "}}\n", total.cycles, total.attached_clients,
+		total.outstanding, total.mmios, total.jobs, total.commands);
+}
+
+static void _write_text(struct status_server *server, FILE * fp,
+			struct psl_status *snap, int count, uint64_t now)
+{
+	int i;
+
+	fprintf(fp, "pslse pid %d up %" PRIu64 " ms, %d AFU%s\n", getpid(),
+		_since_ms(now, server->start_ns), count, (count == 1) ? "" : "s");
+	for (i = 0; i < count; i++) {
+		fprintf(fp, "%s %s cycles=%" PRIu64 " (last %" PRIu64 " ms ago)"
+			" skipped=%" PRIu64 " idle_cycles=%d clients=%d/%d"
+			" outstanding=%d credits=%d mmios=%d jobs=%d commands=%"
+			PRIu64 "\n", snap[i].name, _state_name(snap[i].state),
+			snap[i].cycles, _since_ms(now, snap[i].cycle_ns),
+			snap[i].skipped, snap[i].idle_cycles,
+			snap[i].attached_clients, snap[i].max_clients,
+			snap[i].outstanding, snap[i].credits, snap[i].mmios,
+			snap[i].jobs, snap[i].commands);
+	}
+}
+
+static void _write(struct status_server *server, FILE * fp, int text)
+{
+	struct psl_status *snap;
+	int count;
+
+	_refresh(server);
+	if ((count = _snapshot(server, &snap)) < 0)
+		return;
+	if (text)
+		_write_text(server, fp, snap, count, stats_ns());
+	else
+		_write_json(server, fp, snap, count, stats_ns());
+	free(snap);
+}
+
+// Rewrite the status file, renaming it into place so readers never see a
+// partial snapshot
+static void _write_file(struct status_server *server)
+{
+	FILE *fp;
+
+	if ((fp = fopen(server->tmp_path, "w")) == NULL) {
+		warn_msg("Unable to write %s", server->tmp_path);
+		return;
+	}
+	_write(server, fp, 0);
+	fclose(fp);
+	if (rename(server->tmp_path, server->file_path) < 0)
+		warn_msg("Unable to rename %s", server->tmp_path);
+}
+
+// Answer one connection, waiting briefly for an optional "text" request
+static void _serve(struct status_server *server, int fd)
+{
+	struct pollfd pfd;
+	char request[16];
+	ssize_t bytes;
+	FILE *fp;
+	int text;
+
+	text = 0;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, STATUS_REQUEST_MS) > 0) {
+		bytes = read(fd, request, sizeof(request) - 1);
+		if (bytes > 0) {
+			request[bytes] = '\0';
+			text = (strncmp(request, "text", 4) == 0);
+		}
+	}
+	if ((fp = fdopen(fd, "w")) == NULL) {
+		close(fd);
+		return;
+	}
+	_write(server, fp, text);
+	fclose(fp);
+}
+
+static void *_status_loop(void *ptr)
+{
+	struct status_server *server = (struct status_server *)ptr;
+	struct pollfd pfd[2];
+	uint64_t next, now;
+	int timeout, fd;
+
+	next = stats_ns();
+	pfd[0].fd = server->stop_fd[0];
+	pfd[0].events = POLLIN;
+	pfd[1].fd = server->listen_fd;
+	pfd[1].events = POLLIN;
+	while (1) {
+		timeout = -1;
+		if (server->file_path != NULL) {
+			now = stats_ns();
+			if (now >= next) {
+				_write_file(server);
+				next = now + server->interval_ms * 1000000ull;
+			}
+			timeout = (next - now) / 1000000 + 1;
+		}
+		pfd[0].revents = 0;
+		pfd[1].revents = 0;
+		if (poll(pfd, (server->listen_fd < 0) ? 1 : 2, timeout) < 0)
+			continue;
+		if (pfd[0].revents)
+			break;
+		if (pfd[1].revents & POLLIN) {
+			if ((fd = accept(server->listen_fd, NULL, NULL)) >= 0)
+				_serve(server, fd);
+		}
+	}
+	if (server->file_path != NULL)
+		_write_file(server);
+	return NULL;
+}
+
+static int _listen(char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		warn_msg("Status socket path too long: %s", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror("socket");
+		return -1;
+	}
+	unlink(path);
+	if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+	    (listen(fd, 4) < 0)) {
+		perror("bind");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int status_start(char *socket_path, char *file_path, int interval_ms,
+		 struct psl **list, pthread_mutex_t * list_lock)
+{
+	struct status_server *server;
+
+	if ((socket_path == NULL) && (file_path == NULL))
+		return 0;
+	server = (struct status_server *)calloc(1, sizeof(*server));
+	if (server == NULL)
+		return -1;
+	server->list = list;
+	server->list_lock = list_lock;
+	server->start_ns = stats_ns();
+	server->interval_ms = (interval_ms > 0) ? interval_ms : 1000;
+	server->listen_fd = -1;
+	server->stop_fd[0] = -1;
+	server->stop_fd[1] = -1;
+	if (pipe(server->stop_fd) < 0) {
+		perror("pipe");
+		goto start_fail;
+	}
+	if (socket_path != NULL) {
+		if ((server->listen_fd = _listen(socket_path)) < 0)
+			goto start_fail;
+		server->socket_path = strdup(socket_path);
+	}
+	if (file_path != NULL) {
+		server->file_path = strdup(file_path);
+		server->tmp_path = (char *)malloc(strlen(file_path) + 5);
+		sprintf(server->tmp_path, "%s.tmp", file_path);
+	}
+	if (pthread_create(&(server->thread), NULL, _status_loop, server)) {
+		perror("pthread_create");
+		goto start_fail;
+	}
+	if (socket_path != NULL)
+		info_msg("Serving status on %s", socket_path);
+	if (file_path != NULL)
+		info_msg("Writing status to %s every %d ms", file_path,
+			 server->interval_ms);
+	_status = server;
+	return 0;
+
+ start_fail:
+	if (server->listen_fd >= 0) {
+		close(server->listen_fd);
+		unlink(socket_path);
+	}
+	if (server->stop_fd[0] >= 0) {
+		close(server->stop_fd[0]);
+		close(server->stop_fd[1]);
+	}
+	free(server->socket_path);
+	free(server->file_path);
+	free(server->tmp_path);
+	free(server);
+	return -1;
+}
+
+void status_stop(void)
+{
+	struct status_server *server = _status;
+	char stop = 1;
+
+	if (server == NULL)
+		return;
+	_status = NULL;
+	if (write(server->stop_fd[1], &stop, 1) != 1)
+		warn_msg("Unable to stop status server");
+	pthread_join(server->thread, NULL);
+	if (server->listen_fd >= 0) {
+		close(server->listen_fd);
+		unlink(server->socket_path);
+	}
+	close(server->stop_fd[0]);
+	close(server->stop_fd[1]);
+	free(server->socket_path);
+	free(server->file_path);
+	free(server->tmp_path);
+	free(server);
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2014,2015 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _STATUS_H_
+#define _STATUS_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#define STATUS_NAME_CHARS 16
+
+// Live state a PSL thread publishes for the status server when asked.  Only
+// the PSL thread stores to it, with relaxed atomics, so the server reads it
+// without the PSL lock.
+struct psl_status {
+	char name[STATUS_NAME_CHARS];	// Set before the PSL thread starts
+	uint64_t cycles;
+	uint64_t cycle_ns;	// When cycles last advanced
+	uint64_t commands;	// Commands taken from the AFU
+	uint64_t skipped;	// Cycles fast-forwarded while clocks were stopped
+	int32_t state;
+	int32_t idle_cycles;
+	int32_t attached_clients;
+	int32_t max_clients;
+	int32_t outstanding;
+	int32_t credits;
+	int32_t mmios;		// MMIOs queued for the AFU
+	int32_t jobs;		// Job control events queued for the AFU
+	uint32_t request_seen;	// Last request published for
+};
+
+struct psl;
+
+// Serve snapshots on a unix socket and/or rewrite them to a file every
+// interval_ms.  Either path may be NULL.
+int status_start(char *socket_path, char *file_path, int interval_ms,
+		 struct psl **list, pthread_mutex_t * list_lock);
+
+void status_stop(void);
+
+// Check from a PSL thread if the server wants its state published since it
+// last did, then mark it published once the state is stored
+int status_due(struct psl_status *status);
+void status_published(struct psl_status *status);
+
+#endif				/* _STATUS_H_ */
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2014,2015 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: timing.c
+ *
+ *  This file contains the optional PSL timing model.  Without it pslse
+ *  responds after random delays that only exercise the AFU's handling of
+ *  reordering.  With TIMING:1 in pslse.parms each memory command is given a
+ *  latency in cycles from the time the AFU issued it, drawn from the PSL
+ *  cache hit or miss range plus the translation range when the ERAT misses.
+ *  Read data is not written to the AFU, and no response is given, before
+ *  that cycle.  Buffer data is throttled to a number of bytes per cycle
+ *  in each direction and only so many reads are sent to the client at once.
+ *  When the client takes longer than the model the command is simply late,
+ *  so throughput estimates are only as good as the host running the
+ *  application.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "timing.h"
+#include "../common/utils.h"
+
+#define TIMING_STALL_READS 2
+
+struct timing *timing_init(struct timing_parms *parms, uint64_t seed)
+{
+	struct timing *timing;
+
+	if (!parms->enabled)
+		return NULL;
+	timing = (struct timing *)calloc(1, sizeof(struct timing));
+	if (!timing) {
+		perror("malloc");
+		exit(-1);
+	}
+	timing->parms = *parms;
+	timing->rand = seed ? seed : 1;
+	return timing;
+}
+
+static uint64_t _next(struct timing *timing)
+{
+	timing->rand ^= timing->rand << 13;
+	timing->rand ^= timing->rand >> 7;
+	timing->rand ^= timing->rand << 17;
+	return timing->rand;
+}
+
+static uint32_t _draw(struct timing *timing, struct timing_range *range)
+{
+	if (range->max <= range->min)
+		return range->min;
+	return range->min + _next(timing) % (1 + range->max - range->min);
+}
+
+uint32_t timing_latency(struct timing *timing, int erat_hit)
+{
+	uint32_t latency;
+
+	if ((_next(timing) % 100) < timing->parms.hit_percent)
+		latency = _draw(timing, &(timing->parms.hit));
+	else
+		latency = _draw(timing, &(timing->parms.miss));
+	if (!erat_hit)
+		latency += _draw(timing, &(timing->parms.xlate));
+	return latency;
+}
+
+// Let the link carry link_bytes more each cycle, holding up to a cacheline
+// more than one cycle's worth so transfers larger than that still go
+void timing_clock(struct timing *timing, uint64_t cycle, int cycles)
+{
+	uint64_t limit;
+	int i;
+
+	if (timing == NULL)
+		return;
+	timing->cycle = cycle;
+	if (!timing->parms.link_bytes)
+		return;
+	limit = timing->parms.link_bytes + CACHELINE_BYTES;
+	for (i = 0; i < 2; i++) {
+		timing->link[i] += (uint64_t) timing->parms.link_bytes * cycles;
+		if (timing->link[i] > limit)
+			timing->link[i] = limit;
+	}
+}
+
+void timing_skip(struct timing *timing, uint64_t cycle)
+{
+	if (timing == NULL)
+		return;
+	timing->cycle = cycle;
+	timing->link[TIMING_TO_AFU] = timing->parms.link_bytes + CACHELINE_BYTES;
+	timing->link[TIMING_FROM_AFU] = timing->link[TIMING_TO_AFU];
+}
+
+// Count each kind of stall at most once a cycle
+static void _stall(struct timing *timing, int kind, uint64_t * count)
+{
+	if (timing->stall_cycle[kind] == timing->cycle)
+		return;
+	timing->stall_cycle[kind] = timing->cycle;
+	(*count)++;
+}
+
+int timing_link(struct timing *timing, int direction, uint32_t bytes)
+{
+	if (!timing->parms.link_bytes || (timing->link[direction] >= bytes))
+		return 1;
+	_stall(timing, direction, &(timing->link_stalls[direction]));
+	return 0;
+}
+
+void timing_transfer(struct timing *timing, int direction, uint32_t bytes)
+{
+	if (timing->link[direction] < bytes)
+		timing->link[direction] = 0;
+	else
+		timing->link[direction] -= bytes;
+}
+
+int timing_read_slot(struct timing *timing)
+{
+	if (!timing->parms.max_reads ||
+	    (timing->reads < timing->parms.max_reads))
+		return 1;
+	_stall(timing, TIMING_STALL_READS, &(timing->read_stalls));
+	return 0;
+}
+
+void timing_report(struct timing *timing, char *afu_name)
+{
+	if (timing == NULL)
+		return;
+	info_msg("%s timing: link stalls to AFU=%" PRIu64 " from AFU=%" PRIu64
+		 " cycles, max reads stalls=%" PRIu64 " cycles", afu_name,
+		 timing->link_stalls[TIMING_TO_AFU],
+		 timing->link_stalls[TIMING_FROM_AFU], timing->read_stalls);
+}
+
+void timing_free(struct timing *timing)
+{
+	free(timing);
+}
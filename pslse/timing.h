@@ -0,0 +1,79 @@
+/*
+ * Copyright 2014,2015 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TIMING_H_
+#define _TIMING_H_
+
+#include <stdint.h>
+
+#define TIMING_MAX_LATENCY 65535
+
+// Latency in cycles drawn uniformly from min to max for each command
+struct timing_range {
+	uint32_t min;
+	uint32_t max;
+};
+
+struct timing_parms {
+	uint32_t enabled;
+	uint32_t hit_percent;	// Chance an access hits in the PSL cache
+	struct timing_range hit;
+	struct timing_range miss;
+	struct timing_range xlate;	// Added when the ERAT misses
+	uint32_t link_bytes;	// Per cycle each way, 0 for no limit
+	uint32_t max_reads;	// Reads in flight, 0 for no limit
+};
+
+// Timing model for one AFU, only touched by its PSL thread
+struct timing {
+	struct timing_parms parms;
+	uint64_t rand;		// xorshift64 state for latency draws
+	uint64_t link[2];	// Bytes that may cross the link, by direction
+	uint64_t link_stalls[2];	// Cycles data waited on the link
+	uint64_t read_stalls;	// Cycles a read waited on max_reads
+	uint64_t cycle;
+	uint64_t stall_cycle[3];	// Last cycle each stall was counted
+	uint32_t reads;
+};
+
+#define TIMING_TO_AFU 0		// Buffer writes of read data
+#define TIMING_FROM_AFU 1	// Buffer reads of write data
+
+// Return NULL when the model is disabled
+struct timing *timing_init(struct timing_parms *parms, uint64_t seed);
+
+// Cycles from command to response for a memory access
+uint32_t timing_latency(struct timing *timing, int erat_hit);
+
+void timing_clock(struct timing *timing, uint64_t cycle, int cycles);
+
+// Move to cycle after clocks were stopped, leaving the link idle
+void timing_skip(struct timing *timing, uint64_t cycle);
+
+// Return 1 if the link can carry bytes this cycle
+int timing_link(struct timing *timing, int direction, uint32_t bytes);
+
+// Account bytes sent over the link
+void timing_transfer(struct timing *timing, int direction, uint32_t bytes);
+
+// Return 1 if another read may be sent to the client
+int timing_read_slot(struct timing *timing);
+
+void timing_report(struct timing *timing, char *afu_name);
+
+void timing_free(struct timing *timing);
+
+#endif				/* _TIMING_H_ */
@@ -15,13 +15,19 @@ using std::vector;
 #define CONTEXT_SIZE 0x400
 #define CONTEXT_MASK (CONTEXT_SIZE - 1)
 
-AFU::AFU (int port, string filename, bool parity):
+AFU::AFU (int port, string filename, bool parity, const char *unix_path,
+          bool transactions):
     descriptor (filename),
     context_to_mc ()
 {
+    int rc;
 
     // initializes AFU socket connection as server
-    if (psl_serv_afu_event (&afu_event, port) == PSL_BAD_SOCKET)
+    if (unix_path)
+        rc = psl_serv_afu_event_unix (&afu_event, (char *) unix_path);
+    else
+        rc = psl_serv_afu_event (&afu_event, port);
+    if (rc == PSL_BAD_SOCKET)
         error_msg ("AFU: unable to create socket");
 
     if (psl_afu_aux2_change
@@ -31,6 +37,14 @@ AFU::AFU (int port, string filename, bool parity):
         error_msg ("AFU: failed to set parity_enable and latency");
     }
 
+    // accept multi-cycle clock grants while PSL has nothing to drive
+    psl_afu_clock_batch (&afu_event, PSL_CLOCK_BATCH_MAX);
+
+    // take read data with responses and send write data with commands
+    if (transactions
+            && psl_afu_transactions (&afu_event) != PSL_SUCCESS)
+        warn_msg ("AFU: PSL does not support transactions");
+
     set_seed ();
 
     state = IDLE;
@@ -46,9 +60,12 @@ AFU::start ()
     while (1) {
         fd_set watchset;
 
-        FD_ZERO (&watchset);
-        FD_SET (afu_event.sockfd, &watchset);
-        select (afu_event.sockfd + 1, &watchset, NULL, NULL, NULL);
+        // granted cycles run without waiting for PSL
+        if (afu_event.clock_grant == 0) {
+            FD_ZERO (&watchset);
+            FD_SET (afu_event.sockfd, &watchset);
+            select (afu_event.sockfd + 1, &watchset, NULL, NULL, NULL);
+        }
         int rc = psl_get_psl_events (&afu_event);
 
         //info_msg("Cycle: %d", cycle);
@@ -62,6 +79,11 @@ AFU::start ()
         if (rc <= 0)		// no events to be processed
             continue;
 
+        // time passed while PSL had clocks stopped
+        uint64_t skipped;
+        psl_afu_clock_skip (&afu_event, &skipped);
+        cycle += skipped;
+
         // job done should only be asserted for one cycle
         if (afu_event.job_done)
             afu_event.job_done = 0;
@@ -73,6 +95,18 @@ AFU::start ()
             afu_event.job_valid = 0;
         }
 
+        // read data may come with the response for the same tag
+        if (afu_event.buffer_write == 1) {
+            if (state != RUNNING && state != WAITING_FOR_LAST_RESPONSES
+                    && state != RESET) {
+                error_msg
+                ("AFU: received buffer write when AFU is not running");
+            }
+            debug_msg ("AFU: Received buffer write event");
+            resolve_buffer_write_event ();
+            afu_event.buffer_write = 0;
+        }
+
         if (afu_event.response_valid == 1) {
             if (state != RUNNING && state != WAITING_FOR_LAST_RESPONSES
                     && state != RESET) {
@@ -107,17 +141,6 @@ AFU::start ()
             afu_event.mmio_valid = 0;
         }
 
-        if (afu_event.buffer_write == 1) {
-            if (state != RUNNING && state != WAITING_FOR_LAST_RESPONSES
-                    && state != RESET) {
-                error_msg
-                ("AFU: received buffer write when AFU is not running");
-            }
-            debug_msg ("AFU: Received buffer write event");
-            resolve_buffer_write_event ();
-            afu_event.buffer_write = 0;
-        }
-
         if (afu_event.buffer_read == 1) {
             if (state != RUNNING && state != WAITING_FOR_LAST_RESPONSES
                     && state != RESET) {
@@ -53,7 +53,8 @@ private:
 public:
     /* constructor sets up descriptor from config file, establishes server socket connection
        and waits for client to connect */
-    AFU (int port, std::string filename, bool parity);
+    AFU (int port, std::string filename, bool parity,
+         const char *unix_path = NULL, bool transactions = false);
 
     /* starts the main loop of the afu test platform */
     void start ();
@@ -30,7 +30,8 @@ OtherCommand::OtherCommand (uint16_t c, bool comm_addr_par,
 void
 OtherCommand::send_command (AFU_EVENT * afu_event, uint32_t new_tag,
                             uint64_t address, uint16_t command_size,
-                            uint8_t abort, uint16_t context)
+                            uint8_t abort, uint16_t context,
+                            uint8_t * cache_line)
 {
     if (Command::state != IDLE)
         error_msg
@@ -101,7 +102,8 @@ LoadCommand::LoadCommand (uint16_t c, bool comm_addr_par, bool comm_code_par,
 void
 LoadCommand::send_command (AFU_EVENT * afu_event, uint32_t new_tag,
                            uint64_t address, uint16_t command_size,
-                           uint8_t abort, uint16_t context)
+                           uint8_t abort, uint16_t context,
+                           uint8_t * cache_line)
 {
     if (Command::state != IDLE)
         error_msg
@@ -228,7 +230,8 @@ StoreCommand::StoreCommand (uint16_t c, bool comm_addr_par,
 void
 StoreCommand::send_command (AFU_EVENT * afu_event, uint32_t new_tag,
                             uint64_t address, uint16_t command_size,
-                            uint8_t abort, uint16_t context)
+                            uint8_t abort, uint16_t context,
+                            uint8_t * cache_line)
 {
     if (Command::state != IDLE)
         error_msg
@@ -261,6 +264,22 @@ StoreCommand::send_command (AFU_EVENT * afu_event, uint32_t new_tag,
     debug_msg ("StoreCommand: command sent");
     Command::state = WAITING_READ;
     Command::tag = new_tag;
+
+    // send the data with the command when taking whole transactions
+    if (afu_event->transactions) {
+        uint8_t parity[2];
+
+        generate_cl_parity (cache_line, parity);
+
+        if (buffer_read_parity)
+            parity[rand () % 2] += rand () % 256;
+
+        if (psl_afu_command_data (afu_event, cache_line, parity) ==
+                PSL_SUCCESS) {
+            debug_msg ("StoreCommand: sent data with command");
+            Command::state = WAITING_RESPONSE;
+        }
+    }
 }
 
 void
@@ -36,7 +36,8 @@ public:
 
     virtual void send_command (AFU_EVENT *, uint32_t new_tag,
                                uint64_t address, uint16_t command_size,
-                               uint8_t abort, uint16_t context) = 0;
+                               uint8_t abort, uint16_t context,
+                               uint8_t * cache_line) = 0;
 
     virtual void process_command (AFU_EVENT *, uint8_t * cache_line) = 0;
 
@@ -62,7 +63,7 @@ public:
 
     void send_command (AFU_EVENT * afu_event, uint32_t new_tag,
                        uint64_t address, uint16_t command_size, uint8_t abort,
-                       uint16_t context);
+                       uint16_t context, uint8_t * cache_line);
 
     void process_command (AFU_EVENT * afu_event, uint8_t *);
 
@@ -83,7 +84,7 @@ public:
 
     void send_command (AFU_EVENT * afu_event, uint32_t new_tag,
                        uint64_t address, uint16_t command_size, uint8_t abort,
-                       uint16_t context);
+                       uint16_t context, uint8_t * cache_line);
 
     void process_command (AFU_EVENT * afu_event, uint8_t * cache_line);
 
@@ -103,7 +104,7 @@ public:
 
     void send_command (AFU_EVENT * afu_event, uint32_t new_tag,
                        uint64_t address, uint16_t command_size, uint8_t abort,
-                       uint16_t context);
+                       uint16_t context, uint8_t * cache_line);
 
     void process_command (AFU_EVENT * afu_event, uint8_t * cache_line);
 
@@ -154,6 +154,11 @@ MachineController::Machine::get_buffer_read_parity () const
     return (uint8_t) ((config[1] & 0x100000000000) >> 44);
 }
 
+bool MachineController::Machine::is_tag_duplicate () const
+{
+    return ((config[1] >> 63) & 0x1) == 1;
+}
+
 void
 MachineController::Machine::change_machine_config (uint32_t offset,
         uint32_t data)
@@ -220,7 +225,7 @@ bool MachineController::Machine::attempt_new_command (AFU_EVENT * afu_event,
 
         command->send_command (afu_event, tag,
                                memory_base_address + address_offset,
-                               command_size, abort, context);
+                               command_size, abort, context, cache_line);
 
         record_command (error_state, cycle);
         clear_response ();
@@ -122,6 +122,10 @@ public:
     /* returns true if the current command is a restart command */
     bool is_restart ()const;
 
+    /* returns true if the next command should reuse a tag that is still
+     * outstanding to inject a duplicate tag error */
+    bool is_tag_duplicate ()const;
+
     /* resets the machine, clears the config space and cache line */
     void reset ();
 
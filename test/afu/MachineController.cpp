@@ -38,8 +38,20 @@ bool MachineController::send_command (AFU_EVENT * afu_event, uint32_t cycle)
 
     // attempt to send a command with the allocated tag
     for (uint32_t i = 0; i < machines.size (); ++i) {
+        uint32_t
+        command_tag = tag;
+
+        // duplicate tag injection reuses an outstanding tag, waiting for one
+        bool
+        duplicate = try_send && machines[i]->is_enabled ()
+                    && machines[i]->is_tag_duplicate ();
+
+        if (duplicate && !tag_to_machine.empty ())
+            command_tag = tag_to_machine.begin ()->first;
+
         if (try_send && machines[i]->is_enabled ()
-                && machines[i]->attempt_new_command (afu_event, tag,
+                && (!duplicate || command_tag != tag)
+                && machines[i]->attempt_new_command (afu_event, command_tag,
                         flushed_state,
                         (uint16_t) (cycle & 0x7FFF)))
         {
@@ -47,7 +59,10 @@ bool MachineController::send_command (AFU_EVENT * afu_event, uint32_t cycle)
             ("MachineController::send_command: machine id %d sent new command",
              i);
             try_send = false;
-            tag_to_machine[tag] = machines[i];
+            if (duplicate)
+                TagManager::release_tag (tag);
+            else
+                tag_to_machine[tag] = machines[i];
         }
 
         // regardless if a command is sent, notify machine to advanced one cycle in delaying phase
@@ -1,5 +1,6 @@
 #include <sstream>
 #include <stdlib.h>
+#include <string.h>
 
 #include "AFU.h"
 
@@ -11,7 +12,7 @@ main (int argc, char *argv[])
 {
     if (argc < 3) {
         fprintf (stderr,
-                 "Not eneough arguments. Usage: ./afu port_number descriptor_file [parity]\n");
+                 "Not eneough arguments. Usage: ./afu port_number|unix:path descriptor_file [parity] [transactions]\n");
         exit (1);
     }
 
@@ -20,18 +21,29 @@ main (int argc, char *argv[])
 
     string descriptor_file (argv[2]);
     bool parity = false;
+    bool transactions = false;
 
     stringstream ss;
+    string endpoint (argv[1]);
+    const char *path = NULL;
 
+    if (endpoint.compare (0, strlen (PSL_UNIX_PREFIX), PSL_UNIX_PREFIX) == 0)
+        path = argv[1] + strlen (PSL_UNIX_PREFIX);
     ss << argv[1];
     ss >> port;
 
-    if (argc == 4 && string (argv[3]) == "parity") {
-        printf ("MAIN: AFU parity enabled\n");
-        parity = true;
+    for (int i = 3; i < argc; ++i) {
+        if (string (argv[i]) == "parity") {
+            printf ("MAIN: AFU parity enabled\n");
+            parity = true;
+        }
+        else if (string (argv[i]) == "transactions") {
+            printf ("MAIN: AFU transactions enabled\n");
+            transactions = true;
+        }
     }
 
-    AFU afu (port, descriptor_file, parity);
+    AFU afu (port, descriptor_file, parity, path, transactions);
 
     afu.start ();
     debug_msg ("main: AFU quitting");
@@ -0,0 +1,304 @@
+/*
+ * Copyright 2014,2015 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Description : debug_log.c
+ *
+ * Several threads log CMD_ADD records as fast as they can, each with its own
+ * AFU id and a running tag.  The run is repeated writing straight to the
+ * FILE, through the background writer and through the mmap writer.  Each
+ * resulting file is read back to check that every thread's records are all
+ * there and in order and that each index block summarizes exactly the chunk
+ * before it, as the decoder's -a/-t/-c filters skip chunks by their index.
+ * Then the record rates are compared.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "psl_interface_t.h"
+#include "utils.h"
+
+#define MAX_THREADS 16
+
+enum mode {
+	MODE_DIRECT,
+	MODE_WRITER,
+	MODE_MMAP,
+	MODES
+};
+
+static const char *_mode_name[MODES] = { "direct", "writer", "mmap" };
+
+struct worker {
+	pthread_t thread;
+	FILE *fp;
+	long records;
+	uint8_t id;
+};
+
+static double _now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *_worker(void *ptr)
+{
+	struct worker *worker = (struct worker *)ptr;
+	long n;
+
+	for (n = 0; n < worker->records; n++)
+		debug_cmd_add(worker->fp, worker->id, n & 0xFF, n >> 8,
+			      PSL_COMMAND_READ_CL_NA);
+	return NULL;
+}
+
+// Does an index block summarize the records read since the last one?
+static int _index_match(struct debug_index *index, struct debug_index *chunk)
+{
+	return (index->records == chunk->records) &&
+	    (index->context_min == chunk->context_min) &&
+	    (index->context_max == chunk->context_max) &&
+	    !memcmp(index->afu, chunk->afu, sizeof(index->afu)) &&
+	    !memcmp(index->tag, chunk->tag, sizeof(index->tag));
+}
+
+// Read back a log, 0 if each thread's records are complete and in order and
+// any index blocks account for every record in the chunk they follow
+static int _check(char *path, int threads, long records, int indexed)
+{
+	long expect[MAX_THREADS];
+	struct debug_index index, chunk;
+	struct debug_fields fields;
+	uint8_t block[DBG_INDEX_SIZE];
+	DBG_HEADER header;
+	uint64_t last, end;
+	uint16_t context, command;
+	uint8_t major, minor, id, tag;
+	long seen, total, summarized;
+	FILE *fp;
+	int rc;
+
+	if ((fp = fopen(path, "r")) == NULL) {
+		perror("fopen");
+		return -1;
+	}
+	rc = -1;
+	memset(expect, 0, sizeof(expect));
+	header = debug_get_header(fp);
+	if ((header != DBG_HEADER_VERSION) || (debug_get_8(fp, &major) != 1)
+	    || (debug_get_8(fp, &minor) != 1)) {
+		printf("FAILED: %s does not start with a version record\n",
+		       path);
+		goto check_done;
+	}
+	total = 1;
+	summarized = 0;
+	debug_index_reset(&chunk, 0, 0);
+	chunk.records = 1;
+	last = DBG_INDEX_NONE;
+	end = DBG_INDEX_NONE;
+	while ((header = debug_get_header(fp)) != (DBG_HEADER) - 1) {
+		if (header == DBG_HEADER_INDEX) {
+			block[0] = header;
+			if ((fread(block + 1, sizeof(block) - 1, 1, fp) != 1) ||
+			    (debug_index_decode(block, &index) < 0) ||
+			    (index.prev != last))
+				break;
+			last = ftell(fp) - sizeof(block);
+			if (!_index_match(&index, &chunk)) {
+				printf("FAILED: index block at %" PRIu64
+				       " lists %u records, chunk has %u\n",
+				       last, index.records, chunk.records);
+				goto check_done;
+			}
+			summarized += index.records;
+			debug_index_reset(&chunk, 0, 0);
+			continue;
+		}
+		if (header == DBG_HEADER_INDEX_END) {
+			if (debug_get_64(fp, &end) != 1)
+				break;
+			continue;
+		}
+		if ((header != DBG_HEADER_CMD_ADD) ||
+		    (debug_get_8(fp, &id) != 1) || (debug_get_8(fp, &tag) != 1)
+		    || (debug_get_16(fp, &context) != 1)
+		    || (debug_get_16(fp, &command) != 1))
+			break;
+		seen = ((long)context << 8) | tag;
+		if ((id >= threads) || (seen != expect[id])) {
+			printf("FAILED: thread %d record %ld out of order\n", id,
+			       seen);
+			goto check_done;
+		}
+		expect[id]++;
+		total++;
+		fields.afu = id;
+		fields.context = context;
+		fields.tag = tag;
+		fields.command = command;
+		fields.aux2 = -1;
+		debug_index_add(&chunk, &fields);
+	}
+	if (!feof(fp)) {
+		printf("FAILED: unexpected record 0x%02x\n", header);
+		goto check_done;
+	}
+	for (id = 0; id < threads; id++) {
+		if (expect[id] != records) {
+			printf("FAILED: thread %d logged %ld of %ld records\n",
+			       id, expect[id], records);
+			goto check_done;
+		}
+	}
+	if (indexed && ((summarized != total) || (end != last))) {
+		printf("FAILED: index covers %ld of %ld records\n", summarized,
+		       total);
+		goto check_done;
+	}
+	rc = 0;
+
+ check_done:
+	fclose(fp);
+	return rc;
+}
+
+// Returns records per second, negative on failure
+static double _run(enum mode mode, char *path, int threads, long records)
+{
+	struct worker worker[MAX_THREADS];
+	double start, ns;
+	FILE *fp;
+	int i;
+
+	if ((fp = fopen(path, "w+")) == NULL) {
+		perror("fopen");
+		return -1.0;
+	}
+	if ((mode != MODE_DIRECT) &&
+	    (debug_log_start(fp, DBG_CAT_ALL, mode == MODE_MMAP) < 0)) {
+		printf("FAILED: debug_log_start\n");
+		fclose(fp);
+		return -1.0;
+	}
+	debug_send_version(fp, PSLSE_VERSION_MAJOR, PSLSE_VERSION_MINOR);
+
+	start = _now_ns();
+	for (i = 0; i < threads; i++) {
+		worker[i].fp = fp;
+		worker[i].id = i;
+		worker[i].records = records;
+		if (pthread_create(&(worker[i].thread), NULL, _worker,
+				   &(worker[i]))) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < threads; i++)
+		pthread_join(worker[i].thread, NULL);
+	ns = _now_ns() - start;
+	debug_log_stop();
+	fclose(fp);
+
+	if (_check(path, threads, records, mode != MODE_DIRECT))
+		return -1.0;
+	return (threads * records) / (ns / 1e9);
+}
+
+void usage(char *name)
+{
+	printf("Usage: %s [OPTION]...\n\n", name);
+	printf("  -r, --records\t\trecords logged per thread\n");
+	printf("  -t, --threads\t\tlogging threads, at most %d\n",
+	       MAX_THREADS);
+	printf("      --help\tdisplay this help and exit\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+	double rate[MODES];
+	char path[64];
+	char *name;
+	long records;
+	int opt, option_index, threads;
+	int i;
+
+	name = strrchr(argv[0], '/');
+	if (name)
+		name++;
+	else
+		name = argv[0];
+
+	static struct option long_options[] = {
+		{"help",	no_argument,		0,		'h'},
+		{"records",	required_argument,	0,		'r'},
+		{"threads",	required_argument,	0,		't'},
+		{NULL, 0, 0, 0}
+	};
+
+	option_index = 0;
+	records = 1000000;
+	threads = 4;
+	while ((opt = getopt_long (argc, argv, "hr:t:",
+				   long_options, &option_index)) >= 0) {
+		switch (opt)
+		{
+		case 0:
+			break;
+		case 'r':
+			records = strtol(optarg, NULL, 0);
+			break;
+		case 't':
+			threads = strtol(optarg, NULL, 0);
+			break;
+		case 'h':
+		default:
+			usage(name);
+			return 0;
+		}
+	}
+	if (records < 1)
+		records = 1;
+	if ((threads < 1) || (threads > MAX_THREADS))
+		threads = 4;
+
+	snprintf(path, sizeof(path), "/tmp/debug_log.%d", getpid());
+	printf("%s: %d threads x %ld records\n", name, threads, records);
+	for (i = 0; i < MODES; i++) {
+		rate[i] = _run(i, path, threads, records);
+		if (rate[i] < 0.0) {
+			printf("FAILED: %s\n", _mode_name[i]);
+			unlink(path);
+			return 1;
+		}
+		printf("%-8s %8.2f M records/s\n", _mode_name[i], rate[i] / 1e6);
+	}
+	unlink(path);
+	printf("writer is %.1fx direct, mmap is %.1fx direct\n",
+	       rate[MODE_WRITER] / rate[MODE_DIRECT],
+	       rate[MODE_MMAP] / rate[MODE_DIRECT]);
+	return 0;
+}
@@ -0,0 +1,628 @@
+/*
+ * Copyright 2014,2015 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Description : frame_codec.c
+ *
+ * Microbenchmark for the PSL/AFU frame codec in psl_interface.c.  Frames with
+ * every section present are encoded and decoded with the codec and with the
+ * original byte at a time loops kept below for reference.  Both must produce
+ * identical frames and events.  Prints ns per frame for each.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Build against the codec's static functions directly
+#include "psl_interface.c"
+
+// Reference: PSL to AFU encode from psl_signal_afu_model() before the codec
+static int _legacy_psl_encode(struct AFU_EVENT *event)
+{
+	int i;
+	int bp = 1;
+	uint32_t grant;
+	event->tbuf[0] = 0x40;
+	grant = event->clock_grant;
+	if (grant > event->clock_batch)
+		grant = event->clock_batch;
+	if ((grant > 1) && _proto_supports(event, PROTOCOL_TERTIARY_BATCH)) {
+		event->tbuf[0] = event->tbuf[0] | 0x80;
+		event->tbuf[bp++] = (grant >> 8) & 0xFF;
+		event->tbuf[bp++] = grant & 0xFF;
+	}
+	event->clock_grant = 0;
+	if (event->aux1_change != 0) {
+		event->tbuf[0] = event->tbuf[0] | 0x20;
+		event->tbuf[bp++] = event->room;
+		event->aux1_change = 0;
+	}
+	if (event->job_valid != 0) {
+		event->tbuf[0] = event->tbuf[0] | 0x10;
+		event->tbuf[bp++] = event->job_code;
+		for (i = 0; i < 8; i++) {
+			event->tbuf[bp++] =
+			    ((event->job_address) >> ((7 - i) * 8)) & 0xFF;
+		}
+		event->tbuf[bp++] = (((event->job_address_parity) << 1) & 0x2) |
+		    ((event->job_code_parity) & 0x1);
+		event->job_valid = 0;
+	}
+	if (event->mmio_valid != 0) {
+		event->tbuf[0] = event->tbuf[0] | 0x08;
+		if (event->mmio_read != 0) {
+			event->tbuf[bp] = 0x01;
+		} else {
+			event->tbuf[bp] = 0x00;
+		}
+		if (event->mmio_double != 0) {
+			event->tbuf[bp] = event->tbuf[bp] | 0x02;
+		}
+		if (event->mmio_afudescaccess != 0) {
+			event->tbuf[bp] = event->tbuf[bp] | 0x04;
+		}
+		if (event->mmio_address_parity != 0) {
+			event->tbuf[bp] = event->tbuf[bp] | 0x08;
+		}
+		if (event->mmio_wdata_parity != 0) {
+			event->tbuf[bp] = event->tbuf[bp] | 0x10;
+		}
+		bp++;
+		for (i = 0; i < 3; i++) {
+			event->tbuf[bp++] =
+			    ((event->mmio_address) >> ((2 - i) * 8)) & 0xFF;
+		}
+		for (i = 0; i < 8; i++) {
+			event->tbuf[bp++] =
+			    ((event->mmio_wdata) >> ((7 - i) * 8)) & 0xFF;
+		}
+		event->mmio_valid = 0;
+	}
+	if (event->response_valid != 0) {
+		event->tbuf[0] = event->tbuf[0] | 0x04;
+		event->tbuf[bp++] = event->response_tag;
+		event->tbuf[bp++] = event->response_tag_parity;
+		event->tbuf[bp++] = event->response_code;
+		event->tbuf[bp++] = ((event->cache_position) >> 5) & 0xFF;
+		event->tbuf[bp++] = ((event->cache_position) << 3) |
+		    (((event->cache_state) << 1) & 0x6) |
+		    (((event->credits) >> 8) & 1);
+		event->tbuf[bp++] = event->credits & 0xFF;
+		event->response_valid = 0;
+	}
+	if (event->buffer_read != 0) {
+		event->tbuf[0] = event->tbuf[0] | 0x02;
+		event->tbuf[bp++] = event->buffer_read_tag;
+		event->tbuf[bp++] = event->buffer_read_tag_parity;
+		if (event->buffer_read_length > 64) {
+			event->tbuf[bp++] =
+			    0x80 | (event->buffer_read_address & 0x3F);
+		} else {
+			event->tbuf[bp++] =
+			    0x00 | (event->buffer_read_address & 0x3F);
+		}
+		event->buffer_read = 0;
+	}
+	if (event->buffer_write != 0) {
+		event->tbuf[0] = event->tbuf[0] | 0x01;
+		event->tbuf[bp++] = event->buffer_write_tag;
+		event->tbuf[bp++] = event->buffer_write_tag_parity;
+		if (event->buffer_write_length > 64) {
+			event->tbuf[bp++] =
+			    0x80 | (event->buffer_write_address & 0x3F);
+		} else {
+			event->tbuf[bp++] =
+			    0x00 | (event->buffer_write_address & 0x3F);
+		}
+		for (i = 0; i < 128; i++) {
+			event->tbuf[bp++] = event->buffer_wdata[i];
+		}
+		for (i = 0; i < 2; i++) {
+			event->tbuf[bp++] = event->buffer_wparity[i];
+		}
+		event->buffer_write = 0;
+	}
+	return bp;
+}
+
+// Reference: PSL to AFU decode from psl_get_psl_events() before the codec
+static void _legacy_psl_decode(struct AFU_EVENT *event)
+{
+	int bc;
+	uint32_t rbc = 1;
+	if (event->rbuf[0] & 0x80) {
+		event->clock_grant = event->rbuf[rbc++] << 8;
+		event->clock_grant = event->clock_grant | event->rbuf[rbc++];
+		if (event->clock_grant == 0)
+			event->clock_grant = 1;
+		event->clock_cycles = 0;
+	}
+	if (event->rbuf[0] & 0x20) {
+		event->aux1_change = 1;
+		event->room = event->rbuf[rbc++];
+	} else {
+		event->aux1_change = 0;
+	}
+	if (event->rbuf[0] & 0x10) {
+		event->job_valid = 1;
+		event->job_code = event->rbuf[rbc++];
+		event->job_address = 0;
+		for (bc = 0; bc < 8; bc++) {
+			event->job_address =
+			    ((event->job_address) << 8) | event->rbuf[rbc++];
+		}
+		event->job_address_parity = (event->rbuf[rbc] >> 1) & 0x01;
+		event->job_code_parity = event->rbuf[rbc++] & 0x01;
+	} else {
+		event->job_valid = 0;
+	}
+	if (event->rbuf[0] & 0x08) {
+		event->mmio_valid = 1;
+		event->mmio_wdata_parity = ((event->rbuf[rbc]) >> 4) & 1;
+		event->mmio_address_parity = ((event->rbuf[rbc]) >> 3) & 1;
+		event->mmio_afudescaccess = ((event->rbuf[rbc]) >> 2) & 1;
+		event->mmio_double = ((event->rbuf[rbc]) >> 1) & 1;
+		event->mmio_read = (event->rbuf[rbc++]) & 1;
+		event->mmio_address = 0;
+		for (bc = 0; bc < 3; bc++) {
+			event->mmio_address =
+			    ((event->mmio_address) << 8) | event->rbuf[rbc++];
+		}
+		event->mmio_wdata = 0;
+		for (bc = 0; bc < 8; bc++) {
+			event->mmio_wdata =
+			    ((event->mmio_wdata) << 8) | event->rbuf[rbc++];
+		}
+	} else {
+		event->mmio_valid = 0;
+	}
+	if (event->rbuf[0] & 0x04) {
+		event->response_valid = 1;
+		event->response_tag = event->rbuf[rbc++];
+		event->response_tag_parity = event->rbuf[rbc++];
+		event->response_code = event->rbuf[rbc++];
+		event->cache_position = event->rbuf[rbc++] << 5;
+		event->cache_position =
+		    event->cache_position | (((event->rbuf[rbc]) >> 3) & 0x1F);
+		event->cache_state = ((event->rbuf[rbc]) >> 2) & 0x3;
+		event->credits = (event->rbuf[rbc++] << 8) & 0x100;
+		event->credits = event->credits | event->rbuf[rbc++];
+	} else {
+		event->response_valid = 0;
+	}
+	if (event->rbuf[0] & 0x02) {
+		event->buffer_read = 1;
+		event->buffer_read_tag = event->rbuf[rbc++];
+		event->buffer_read_tag_parity = event->rbuf[rbc++];
+		if ((event->rbuf[rbc]) >> 7) {
+			event->buffer_read_length = 128;
+		} else {
+			event->buffer_read_length = 64;
+		}
+		event->buffer_read_address = (event->rbuf[rbc++]) & 0x3F;
+	} else {
+		event->buffer_read = 0;
+	}
+	if (event->rbuf[0] & 0x01) {
+		event->buffer_write = 1;
+		event->buffer_write_tag = event->rbuf[rbc++];
+		event->buffer_write_tag_parity = event->rbuf[rbc++];
+		if ((event->rbuf[rbc]) >> 7) {
+			event->buffer_write_length = 128;
+		} else {
+			event->buffer_write_length = 64;
+		}
+		event->buffer_write_address = (event->rbuf[rbc++]) & 0x3F;
+		for (bc = 0; bc < 128; bc++) {
+			event->buffer_wdata[bc] = event->rbuf[rbc++];
+		}
+		for (bc = 0; bc < 2; bc++) {
+			event->buffer_wparity[bc] = event->rbuf[rbc++];
+		}
+	} else {
+		event->buffer_write = 0;
+	}
+}
+
+// Reference: AFU to PSL encode from psl_signal_psl_model() before the codec
+static int _legacy_afu_encode(struct AFU_EVENT *event)
+{
+	int i;
+	int bp = 1;
+	event->tbuf[0] = 0x10;
+	if (event->clock_batch &&
+	    _proto_supports(event, PROTOCOL_TERTIARY_BATCH)) {
+		event->tbuf[0] = event->tbuf[0] | 0x20;
+		event->tbuf[bp++] = (event->clock_batch >> 8) & 0xFF;
+		event->tbuf[bp++] = event->clock_batch & 0xFF;
+		event->tbuf[bp++] = (event->clock_cycles >> 8) & 0xFF;
+		event->tbuf[bp++] = event->clock_cycles & 0xFF;
+	}
+	event->clock_cycles = 0;
+	if (event->aux2_change) {
+		event->tbuf[0] = event->tbuf[0] | 0x08;
+		event->tbuf[bp++] =
+		    (((event->buffer_read_latency) << 4) & 0xF0) |
+		    (((event->job_running)
+		      << 1) & 0x2) | (event->job_done & 1);
+		for (i = 0; i < 8; i++) {
+			event->tbuf[bp++] =
+			    ((event->job_error) >> ((7 - i) * 8)) & 0xFF;
+		}
+		event->tbuf[bp++] = (((event->job_cack_llcmd) << 3) & 0x08) |
+		    (((event->job_yield) << 2) & 0x04) |
+		    (((event->timebase_request) << 1) & 0x03) |
+		    ((event->parity_enable) & 0x01);
+		event->aux2_change = 0;
+	}
+	if (event->mmio_ack) {
+		event->tbuf[0] = event->tbuf[0] | 0x04;
+		for (i = 0; i < 8; i++) {
+			event->tbuf[bp++] =
+			    ((event->mmio_rdata) >> ((7 - i) * 8)) & 0xFF;
+		}
+		event->tbuf[bp++] = event->mmio_rdata_parity;
+		event->mmio_ack = 0;
+	}
+	if (event->buffer_rdata_valid) {
+		event->tbuf[0] = event->tbuf[0] | 0x02;
+		for (i = 0; i < 128; i++) {
+			event->tbuf[bp++] = event->buffer_rdata[i];
+		}
+		for (i = 0; i < 2; i++) {
+			event->tbuf[bp++] = event->buffer_rparity[i];
+		}
+		event->buffer_rdata_valid = 0;
+	}
+	if (event->command_valid) {
+		event->tbuf[0] = event->tbuf[0] | 0x01;
+		event->tbuf[bp++] = event->command_tag;
+		event->tbuf[bp++] = (((event->command_abort) << 5) & 0xE0) |
+		    (((event->command_code) >> 8) & 0x1F);
+		event->tbuf[bp++] = event->command_code & 0xFF;
+		event->tbuf[bp++] =
+		    (((event->command_tag_parity) << 6) & 0x40) |
+		    (((event->command_code_parity)
+		      << 5) & 0x20) | (((event->command_address_parity) << 4) &
+				       0x10) | (((event->command_size)
+						 >> 8) & 0x0F);
+		event->tbuf[bp++] = event->command_size & 0xFF;
+		for (i = 0; i < 8; i++) {
+			event->tbuf[bp++] =
+			    ((event->command_address) >> ((7 - i) * 8)) & 0xFF;
+		}
+		for (i = 0; i < 2; i++) {
+			event->tbuf[bp++] =
+			    ((event->command_handle) >> ((1 - i) * 8)) & 0xFF;
+		}
+		event->command_valid = 0;
+	}
+	return bp;
+}
+
+// Reference: AFU to PSL decode from psl_get_afu_events() before the codec
+static void _legacy_afu_decode(struct AFU_EVENT *event)
+{
+	int bc;
+	uint32_t rbc = 1;
+	if ((event->rbuf[0] & 0x20) != 0) {
+		event->clock_batch = event->rbuf[rbc++] << 8;
+		event->clock_batch = event->clock_batch | event->rbuf[rbc++];
+		event->clock_cycles = event->rbuf[rbc++] << 8;
+		event->clock_cycles = event->clock_cycles | event->rbuf[rbc++];
+	} else {
+		event->clock_cycles = 1;
+	}
+	if ((event->rbuf[0] & 0x08) != 0) {
+		event->aux2_change = 1;
+		event->buffer_read_latency = (event->rbuf[rbc]) >> 4;
+		event->job_running = ((event->rbuf[rbc]) >> 1) & 0x01;
+		event->job_done = (event->rbuf[rbc++]) & 0x01;
+		event->job_error = 0;
+		for (bc = 0; bc < 8; bc++) {
+			event->job_error =
+			    ((event->job_error) << 8) | event->rbuf[rbc++];
+		}
+		event->job_cack_llcmd = ((event->rbuf[rbc]) >> 3) & 0x01;
+		event->job_yield = ((event->rbuf[rbc]) >> 2) & 0x01;
+		event->timebase_request = ((event->rbuf[rbc]) >> 1) & 0x01;
+		event->parity_enable = (event->rbuf[rbc++]) & 0x01;
+	} else {
+		event->aux2_change = 0;
+	}
+	if ((event->rbuf[0] & 0x04) != 0) {
+		event->mmio_ack = 1;
+		event->mmio_rdata = 0;
+		for (bc = 0; bc < 8; bc++) {
+			event->mmio_rdata =
+			    ((event->mmio_rdata) << 8) | event->rbuf[rbc++];
+		}
+		event->mmio_rdata_parity = event->rbuf[rbc++];
+	} else {
+		event->mmio_ack = 0;
+	}
+	if ((event->rbuf[0] & 0x02) != 0) {
+		event->buffer_rdata_valid = 1;
+		for (bc = 0; bc < 128; bc++) {
+			event->buffer_rdata[bc] = event->rbuf[rbc++];
+		}
+		for (bc = 0; bc < 2; bc++) {
+			event->buffer_rparity[bc] = event->rbuf[rbc++];
+		}
+	} else {
+		event->buffer_rdata_valid = 0;
+	}
+	if ((event->rbuf[0] & 0x01) != 0) {
+		event->command_valid = 1;
+		event->command_tag = event->rbuf[rbc++];
+		event->command_abort = (event->rbuf[rbc] >> 5) & 0x7;
+		event->command_code = (event->rbuf[rbc++] & 0x1F) << 8;
+		event->command_code = event->command_code | event->rbuf[rbc++];
+		event->command_tag_parity = (event->rbuf[rbc] >> 6) & 0x01;
+		event->command_code_parity = (event->rbuf[rbc] >> 5) & 0x01;
+		event->command_address_parity = (event->rbuf[rbc] >> 4) & 0x01;
+		event->command_size = (event->rbuf[rbc++] & 0x0F) << 8;
+		event->command_size = event->command_size | event->rbuf[rbc++];
+		event->command_address = 0;
+		for (bc = 0; bc < 8; bc++) {
+			event->command_address =
+			    ((event->command_address) << 8) |
+			    event->rbuf[rbc++];
+		}
+		event->command_handle = 0;
+		for (bc = 0; bc < 2; bc++) {
+			event->command_handle =
+			    ((event->command_handle) << 8) | event->rbuf[rbc++];
+		}
+	} else {
+		event->command_valid = 0;
+	}
+}
+
+static uint64_t _rand64(void)
+{
+	return ((uint64_t) rand() << 42) ^ ((uint64_t) rand() << 21) ^ rand();
+}
+
+// Random PSL side event with every PSL to AFU section flagged
+static void _fill_psl(struct AFU_EVENT *event)
+{
+	int i;
+
+	psl_event_reset(event);
+	event->clock_batch = PSL_CLOCK_BATCH_MAX;
+	event->clock_grant = 2 + rand() % 1000;
+	event->aux1_change = 1;
+	event->room = rand() & 0xFF;
+	event->job_valid = 1;
+	event->job_code = rand() & 0xFF;
+	event->job_address = _rand64();
+	event->job_address_parity = rand() & 1;
+	event->job_code_parity = rand() & 1;
+	event->mmio_valid = 1;
+	event->mmio_read = rand() & 1;
+	event->mmio_double = rand() & 1;
+	event->mmio_afudescaccess = rand() & 1;
+	event->mmio_address_parity = rand() & 1;
+	event->mmio_wdata_parity = rand() & 1;
+	event->mmio_address = rand() & 0xFFFFFF;
+	event->mmio_wdata = _rand64();
+	event->response_valid = 1;
+	event->response_tag = rand() & 0xFF;
+	event->response_tag_parity = rand() & 1;
+	event->response_code = rand() & 0xFF;
+	event->cache_position = rand() & 0x1FFF;
+	event->cache_state = rand() & 0x3;
+	event->credits = rand() & 0x1FF;
+	event->buffer_read = 1;
+	event->buffer_read_tag = rand() & 0xFF;
+	event->buffer_read_tag_parity = rand() & 1;
+	event->buffer_read_length = (rand() & 1) ? 128 : 64;
+	event->buffer_read_address = rand() & 0x3F;
+	event->buffer_write = 1;
+	event->buffer_write_tag = rand() & 0xFF;
+	event->buffer_write_tag_parity = rand() & 1;
+	event->buffer_write_length = (rand() & 1) ? 128 : 64;
+	event->buffer_write_address = rand() & 0x3F;
+	for (i = 0; i < 128; i++)
+		event->buffer_wdata[i] = rand();
+	event->buffer_wparity[0] = rand();
+	event->buffer_wparity[1] = rand();
+}
+
+// Random AFU side event with every AFU to PSL section flagged
+static void _fill_afu(struct AFU_EVENT *event)
+{
+	int i;
+
+	psl_event_reset(event);
+	event->clock_batch = 1 + rand() % PSL_CLOCK_BATCH_MAX;
+	event->clock_cycles = rand() & 0xFFFF;
+	event->aux2_change = 1;
+	event->buffer_read_latency = rand() & 0xF;
+	event->job_running = rand() & 1;
+	event->job_done = rand() & 1;
+	event->job_error = _rand64();
+	event->job_cack_llcmd = rand() & 1;
+	event->job_yield = rand() & 1;
+	event->timebase_request = rand() & 1;
+	event->parity_enable = rand() & 1;
+	event->mmio_ack = 1;
+	event->mmio_rdata = _rand64();
+	event->mmio_rdata_parity = rand() & 0xFF;
+	event->buffer_rdata_valid = 1;
+	for (i = 0; i < 128; i++)
+		event->buffer_rdata[i] = rand();
+	event->buffer_rparity[0] = rand();
+	event->buffer_rparity[1] = rand();
+	event->command_valid = 1;
+	event->command_tag = rand() & 0xFF;
+	event->command_abort = rand() & 0x7;
+	event->command_code = rand() & 0x1FFF;
+	event->command_tag_parity = rand() & 1;
+	event->command_code_parity = rand() & 1;
+	event->command_address_parity = rand() & 1;
+	event->command_size = rand() & 0xFFF;
+	event->command_address = _rand64();
+	event->command_handle = rand() & 0xFFFF;
+}
+
+static double _now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Check codec against reference for one random event, 0 when they agree
+static int _check(void (*fill) (struct AFU_EVENT *),
+		  int (*encode) (struct AFU_EVENT *),
+		  void (*decode) (struct AFU_EVENT *),
+		  int (*ref_encode) (struct AFU_EVENT *),
+		  void (*ref_decode) (struct AFU_EVENT *))
+{
+	static struct AFU_EVENT src, ref, out, ref_out;
+	int len, ref_len;
+
+	fill(&src);
+	memcpy(&ref, &src, sizeof(src));
+	len = encode(&src);
+	ref_len = ref_encode(&ref);
+	if ((len != ref_len) || memcmp(src.tbuf, ref.tbuf, len))
+		return -1;
+	psl_event_reset(&out);
+	psl_event_reset(&ref_out);
+	memcpy(out.rbuf, src.tbuf, len);
+	memcpy(ref_out.rbuf, src.tbuf, len);
+	decode(&out);
+	ref_decode(&ref_out);
+	return memcmp(&out, &ref_out, sizeof(out));
+}
+
+// Time iterations of encode then decode, returns ns per frame
+static double _time(struct AFU_EVENT *src, long iterations,
+		    int (*encode) (struct AFU_EVENT *),
+		    void (*decode) (struct AFU_EVENT *))
+{
+	static struct AFU_EVENT event, out;
+	double start;
+	long i;
+	int len;
+
+	psl_event_reset(&out);
+	start = _now_ns();
+	for (i = 0; i < iterations; i++) {
+		memcpy(&event, src, sizeof(event));
+		len = encode(&event);
+		memcpy(out.rbuf, event.tbuf, len);
+		decode(&out);
+	}
+	return (_now_ns() - start) / iterations;
+}
+
+void usage(char *name)
+{
+	printf("Usage: %s [OPTION]...\n\n", name);
+	printf("  -i, --iterations\tframes to time in each direction\n");
+	printf("  -s, --seed\t\tseed for random number generation\n");
+	printf("      --help\tdisplay this help and exit\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+	static struct AFU_EVENT psl_src, afu_src;
+	double codec, ref;
+	char *name;
+	unsigned seed;
+	long iterations;
+	int opt, option_index;
+	int i;
+
+	name = strrchr(argv[0], '/');
+	if (name)
+		name++;
+	else
+		name = argv[0];
+
+	static struct option long_options[] = {
+		{"help",	no_argument,		0,		'h'},
+		{"iterations",	required_argument,	0,		'i'},
+		{"seed",	required_argument,	0,		's'},
+		{NULL, 0, 0, 0}
+	};
+
+	option_index = 0;
+	seed = time(NULL);
+	iterations = 2000000;
+	while ((opt = getopt_long (argc, argv, "hi:s:",
+				   long_options, &option_index)) >= 0) {
+		switch (opt)
+		{
+		case 0:
+			break;
+		case 'i':
+			iterations = strtol(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+		default:
+			usage(name);
+			return 0;
+		}
+	}
+	if (iterations < 1)
+		iterations = 1;
+
+	srand(seed);
+	printf("%s: seed=%d\n", name, seed);
+
+	// Codec must match the reference bit for bit
+	for (i = 0; i < 1000; i++) {
+		if (_check(_fill_psl, _psl_frame_encode, _psl_frame_decode,
+			   _legacy_psl_encode, _legacy_psl_decode)) {
+			printf("FAILED: PSL to AFU frame mismatch\n");
+			return 1;
+		}
+		if (_check(_fill_afu, _afu_frame_encode, _afu_frame_decode,
+			   _legacy_afu_encode, _legacy_afu_decode)) {
+			printf("FAILED: AFU to PSL frame mismatch\n");
+			return 1;
+		}
+	}
+
+	_fill_psl(&psl_src);
+	_fill_afu(&afu_src);
+	ref = _time(&psl_src, iterations, _legacy_psl_encode,
+		    _legacy_psl_decode);
+	codec = _time(&psl_src, iterations, _psl_frame_encode,
+		      _psl_frame_decode);
+	printf("PSL to AFU frame: loops %.1f ns, codec %.1f ns (%.2fx)\n",
+	       ref, codec, ref / codec);
+	ref = _time(&afu_src, iterations, _legacy_afu_encode,
+		    _legacy_afu_decode);
+	codec = _time(&afu_src, iterations, _afu_frame_encode,
+		      _afu_frame_decode);
+	printf("AFU to PSL frame: loops %.1f ns, codec %.1f ns (%.2fx)\n",
+	       ref, codec, ref / codec);
+
+	printf("PASSED\n");
+	return 0;
+}
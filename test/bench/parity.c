@@ -0,0 +1,229 @@
+/*
+ * Copyright 2014,2015 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Description : parity.c
+ *
+ * Validates generate_parity() and every generate_cl_parity() implementation
+ * the CPU supports against the original bit at a time code kept below, on
+ * random data and on single bit patterns.  Then times each cacheline
+ * implementation.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Build against the static implementations directly
+#include "utils.c"
+
+// Reference: generate_parity() before popcount
+static uint8_t _legacy_parity(uint64_t data, uint8_t odd)
+{
+	uint8_t parity = odd;
+	// While at least 1 bit is set
+	while (data) {
+		// Invert parity bit
+		parity = 1 - parity;
+		// Zero out least significant bit that is set to 1
+		data &= data - 1;
+	}
+	return parity;
+}
+
+// Reference: generate_cl_parity() before vectorizing
+static void _legacy_cl_parity(uint8_t * data, uint8_t * parity)
+{
+	int i;
+	uint64_t dw;
+	uint8_t p;
+
+	// Walk each double word (dword) in cacheline
+	for (i = 0; i < DWORDS_PER_CACHELINE; i++) {
+		// Copy dword of data into uint64_t dw
+		memcpy(&dw, &(data[BYTES_PER_DWORD * i]), BYTES_PER_DWORD);
+		// Initialize parity entry to 0 when starting parity byte
+		if ((i % BYTES_PER_DWORD) == 0)
+			parity[i / BYTES_PER_DWORD] = 0;
+		// Shift previously calculated parity bits left
+		parity[i / BYTES_PER_DWORD] <<= 1;
+		// Generate parity bit for this dword
+		p = _legacy_parity(dw, ODD_PARITY);
+		parity[i / BYTES_PER_DWORD] += p;
+	}
+}
+
+struct cl_impl {
+	const char *name;
+	void (*fn) (uint8_t *, uint8_t *);
+};
+
+static double _now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Compare one cacheline implementation to the reference, 0 on match
+static int _check_cl(struct cl_impl *impl, uint8_t * data)
+{
+	uint8_t expect[DWORDS_PER_CACHELINE / 8];
+	uint8_t got[DWORDS_PER_CACHELINE / 8];
+
+	_legacy_cl_parity(data, expect);
+	impl->fn(data, got);
+	if (memcmp(expect, got, sizeof(got)) == 0)
+		return 0;
+	printf("FAILED: %s cacheline parity 0x%02x%02x expected 0x%02x%02x\n",
+	       impl->name, got[0], got[1], expect[0], expect[1]);
+	return -1;
+}
+
+void usage(char *name)
+{
+	printf("Usage: %s [OPTION]...\n\n", name);
+	printf("  -i, --iterations\tcachelines to time per implementation\n");
+	printf("  -s, --seed\t\tseed for random number generation\n");
+	printf("      --help\tdisplay this help and exit\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct cl_impl impl[3];
+	uint8_t data[64 * CACHELINE_BYTES];
+	uint8_t parity[DWORDS_PER_CACHELINE / 8];
+	uint64_t value;
+	double start, ns;
+	char *name;
+	unsigned seed;
+	long iterations, n;
+	int impls, opt, option_index;
+	int i, j;
+
+	name = strrchr(argv[0], '/');
+	if (name)
+		name++;
+	else
+		name = argv[0];
+
+	static struct option long_options[] = {
+		{"help",	no_argument,		0,		'h'},
+		{"iterations",	required_argument,	0,		'i'},
+		{"seed",	required_argument,	0,		's'},
+		{NULL, 0, 0, 0}
+	};
+
+	option_index = 0;
+	seed = time(NULL);
+	iterations = 10000000;
+	while ((opt = getopt_long (argc, argv, "hi:s:",
+				   long_options, &option_index)) >= 0) {
+		switch (opt)
+		{
+		case 0:
+			break;
+		case 'i':
+			iterations = strtol(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+		default:
+			usage(name);
+			return 0;
+		}
+	}
+	if (iterations < 1)
+		iterations = 1;
+
+	srand(seed);
+	printf("%s: seed=%d\n", name, seed);
+
+	impls = 0;
+	impl[impls].name = "legacy";
+	impl[impls++].fn = _legacy_cl_parity;
+	impl[impls].name = "scalar";
+	impl[impls++].fn = _cl_parity_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		impl[impls].name = "avx2";
+		impl[impls++].fn = _cl_parity_avx2;
+	} else {
+		printf("No AVX2 support, skipping avx2\n");
+	}
+#endif
+
+	// Single values, both polarities
+	for (i = 0; i < 100000; i++) {
+		value = ((uint64_t) rand() << 42) ^ ((uint64_t) rand() << 21) ^
+		    rand();
+		if (i < 64)
+			value = 1ull << i;
+		for (j = 0; j < 2; j++) {
+			if (generate_parity(value, j) !=
+			    _legacy_parity(value, j)) {
+				printf("FAILED: parity of 0x%016llx\n",
+				       (unsigned long long)value);
+				return 1;
+			}
+		}
+	}
+
+	// Random cachelines, then each bit of a zero cacheline in turn
+	for (i = 0; i < (int)sizeof(data); i++)
+		data[i] = rand();
+	for (n = 0; n < 100000; n++) {
+		for (i = 0; i < CACHELINE_BYTES; i++)
+			data[i] = rand();
+		for (j = 1; j < impls; j++)
+			if (_check_cl(&impl[j], data))
+				return 1;
+		generate_cl_parity(data, parity);
+		_legacy_cl_parity(data, data + CACHELINE_BYTES);
+		if (memcmp(parity, data + CACHELINE_BYTES, sizeof(parity))) {
+			printf("FAILED: generate_cl_parity\n");
+			return 1;
+		}
+	}
+	for (n = 0; n < CACHELINE_BYTES * 8; n++) {
+		memset(data, 0, CACHELINE_BYTES);
+		data[n / 8] = 1 << (n % 8);
+		for (j = 1; j < impls; j++)
+			if (_check_cl(&impl[j], data))
+				return 1;
+	}
+
+	// Time each implementation over a working set of 64 cachelines
+	for (i = 0; i < (int)sizeof(data); i++)
+		data[i] = rand();
+	for (j = 0; j < impls; j++) {
+		start = _now_ns();
+		for (n = 0; n < iterations; n++) {
+			impl[j].fn(data + CACHELINE_BYTES * (n & 63), parity);
+			__asm__ __volatile__("" : : "r" (parity) : "memory");
+		}
+		ns = (_now_ns() - start) / iterations;
+		printf("%-8s %6.2f ns per cacheline\n", impl[j].name, ns);
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
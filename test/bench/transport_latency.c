@@ -0,0 +1,275 @@
+/*
+ * Copyright 2014,2015 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Description : transport_latency.c
+ *
+ * Measures round trip latency of the request pattern pslse and libcxl use on
+ * their sockets: a command byte written on its own followed by the payload,
+ * answered with a single reply.  Each run forks an echo server and compares
+ * TCP loopback without TCP_NODELAY, TCP loopback tuned by psl_tune_socket()
+ * and a unix domain socket.  Nagle's algorithm stalls each plain TCP round trip for
+ * a delayed ACK, so that transport is only run for a few round trips.
+ */
+
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Build against the static implementations directly
+#include "utils.c"
+#include "psl_interface.h"
+
+enum transport {
+	TRANSPORT_TCP,
+	TRANSPORT_TCP_NODELAY,
+	TRANSPORT_UNIX,
+	TRANSPORTS
+};
+
+// Round trips timed on plain TCP, each one waits on a delayed ACK
+#define NAGLE_ITERATIONS 25
+
+static const char *_transport_name[TRANSPORTS] = {
+	"tcp", "tcp+nodelay", "unix"
+};
+
+static double _now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int _read_all(int fd, uint8_t * buffer, int size)
+{
+	int bytes;
+
+	while (size > 0) {
+		bytes = read(fd, buffer, size);
+		if (bytes <= 0)
+			return -1;
+		buffer += bytes;
+		size -= bytes;
+	}
+	return 0;
+}
+
+// Echo server: read command byte and payload, answer in one write
+static void _echo(int fd, int payload)
+{
+	uint8_t buffer[1 + payload];
+
+	while (_read_all(fd, buffer, 1 + payload) == 0) {
+		if (write(fd, buffer, 1 + payload) != 1 + payload)
+			break;
+	}
+	close(fd);
+	exit(0);
+}
+
+// Open a listening socket for the transport, returns fd or -1
+static int _listen(enum transport transport, struct sockaddr_storage *addr,
+		   socklen_t * len, char *path)
+{
+	struct sockaddr_in *in = (struct sockaddr_in *)addr;
+	struct sockaddr_un *un = (struct sockaddr_un *)addr;
+	int fd;
+
+	memset(addr, 0, sizeof(*addr));
+	if (transport == TRANSPORT_UNIX) {
+		un->sun_family = AF_UNIX;
+		strncpy(un->sun_path, path, sizeof(un->sun_path) - 1);
+		*len = sizeof(*un);
+		unlink(path);
+	} else {
+		in->sin_family = AF_INET;
+		in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		in->sin_port = 0;
+		*len = sizeof(*in);
+	}
+	if ((fd = socket(addr->ss_family, SOCK_STREAM, 0)) < 0) {
+		perror("socket");
+		return -1;
+	}
+	if (bind(fd, (struct sockaddr *)addr, *len) < 0) {
+		perror("bind");
+		goto listen_fail;
+	}
+	if (listen(fd, 1) < 0) {
+		perror("listen");
+		goto listen_fail;
+	}
+	if (getsockname(fd, (struct sockaddr *)addr, len) < 0) {
+		perror("getsockname");
+		goto listen_fail;
+	}
+	return fd;
+
+ listen_fail:
+	close(fd);
+	return -1;
+}
+
+// Time round trips over one transport, returns mean ns or negative on error
+static double _run(enum transport transport, long iterations, int payload)
+{
+	struct sockaddr_storage addr;
+	socklen_t len;
+	uint8_t buffer[1 + payload];
+	char path[64];
+	double start, ns;
+	pid_t pid;
+	long n;
+	int listen_fd, fd, status;
+
+	snprintf(path, sizeof(path), "/tmp/transport_latency.%d", getpid());
+	if ((listen_fd = _listen(transport, &addr, &len, path)) < 0)
+		return -1.0;
+	fflush(stdout);
+	if ((pid = fork()) < 0) {
+		perror("fork");
+		close(listen_fd);
+		return -1.0;
+	}
+	if (pid == 0) {
+		if ((fd = accept(listen_fd, NULL, NULL)) < 0)
+			exit(1);
+		close(listen_fd);
+		if (transport == TRANSPORT_TCP_NODELAY)
+			psl_tune_socket(fd);
+		_echo(fd, payload);
+	}
+	close(listen_fd);
+
+	ns = -1.0;
+	if ((fd = socket(addr.ss_family, SOCK_STREAM, 0)) < 0) {
+		perror("socket");
+		goto run_done;
+	}
+	if (connect(fd, (struct sockaddr *)&addr, len) < 0) {
+		perror("connect");
+		goto run_close;
+	}
+	if (transport != TRANSPORT_TCP)
+		psl_tune_socket(fd);
+
+	memset(buffer, 0x5A, sizeof(buffer));
+	start = _now_ns();
+	for (n = 0; n < iterations; n++) {
+		if ((write(fd, buffer, 1) != 1) ||
+		    (write(fd, buffer + 1, payload) != payload) ||
+		    (_read_all(fd, buffer, 1 + payload) < 0)) {
+			perror("round trip");
+			goto run_close;
+		}
+	}
+	ns = (_now_ns() - start) / iterations;
+
+ run_close:
+	close(fd);
+ run_done:
+	if (ns < 0.0)
+		kill(pid, SIGTERM);
+	waitpid(pid, &status, 0);
+	if (transport == TRANSPORT_UNIX)
+		unlink(path);
+	return ns;
+}
+
+void usage(char *name)
+{
+	printf("Usage: %s [OPTION]...\n\n", name);
+	printf("  -i, --iterations\tround trips to time per transport\n");
+	printf("  -p, --payload\t\tbytes sent after the command byte\n");
+	printf("      --help\tdisplay this help and exit\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+	double ns[TRANSPORTS];
+	char *name;
+	long iterations;
+	int opt, option_index, payload;
+	int i;
+
+	name = strrchr(argv[0], '/');
+	if (name)
+		name++;
+	else
+		name = argv[0];
+
+	static struct option long_options[] = {
+		{"help",	no_argument,		0,		'h'},
+		{"iterations",	required_argument,	0,		'i'},
+		{"payload",	required_argument,	0,		'p'},
+		{NULL, 0, 0, 0}
+	};
+
+	option_index = 0;
+	iterations = 20000;
+	payload = 17;
+	while ((opt = getopt_long (argc, argv, "hi:p:",
+				   long_options, &option_index)) >= 0) {
+		switch (opt)
+		{
+		case 0:
+			break;
+		case 'i':
+			iterations = strtol(optarg, NULL, 0);
+			break;
+		case 'p':
+			payload = strtol(optarg, NULL, 0);
+			break;
+		case 'h':
+		default:
+			usage(name);
+			return 0;
+		}
+	}
+	if (iterations < 1)
+		iterations = 1;
+	if ((payload < 1) || (payload > 4096))
+		payload = 17;
+
+	printf("%s: %ld round trips of 1+%d bytes\n", name, iterations,
+	       payload);
+	for (i = 0; i < TRANSPORTS; i++) {
+		if ((i == TRANSPORT_TCP) && (iterations > NAGLE_ITERATIONS))
+			ns[i] = _run(i, NAGLE_ITERATIONS, payload);
+		else
+			ns[i] = _run(i, iterations, payload);
+		if (ns[i] < 0.0) {
+			printf("FAILED: %s\n", _transport_name[i]);
+			return 1;
+		}
+		printf("%-12s %10.0f ns/round trip\n", _transport_name[i],
+		       ns[i]);
+	}
+	printf("tcp+nodelay is %.1fx tcp, unix is %.1fx tcp+nodelay\n",
+	       ns[TRANSPORT_TCP] / ns[TRANSPORT_TCP_NODELAY],
+	       ns[TRANSPORT_TCP_NODELAY] / ns[TRANSPORT_UNIX]);
+	return 0;
+}
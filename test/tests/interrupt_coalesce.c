@@ -0,0 +1,207 @@
+/*
+ * Copyright 2015 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Description : interrupt_coalesce.c
+ *
+ * This test has the AFU raise interrupts on two different IRQs and then on
+ * the first IRQ again before any event is read.  It waits on cxl_afu_fd()
+ * with epoll and ensures both IRQs are delivered once each, with the repeat
+ * coalesced into the first event.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <time.h>
+
+#include "libcxl.h"
+#include "psl_interface_t.h"
+#include "TestAFU_config.h"
+#include "utils.h"
+
+void usage(char *name)
+{
+	printf("Usage: %s [OPTION]...\n\n", name);
+	printf("  -s, --seed\t\tseed for random number generation\n");
+	printf("      --help\tdisplay this help and exit\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+	MachineConfig machine;
+	struct cxl_event event;
+	struct epoll_event ev;
+	char *name;
+	uint64_t wed;
+	unsigned seed;
+	long max_irqs, irq[3];
+	int opt, option_index;
+	int response;
+	int i, efd;
+
+	name = strrchr(argv[0], '/');
+	if (name)
+		name++;
+	else
+		name = argv[0];
+
+	static struct option long_options[] = {
+		{"help",	no_argument,		0,		'h'},
+		{"seed",	required_argument,	0,		's'},
+		{NULL, 0, 0, 0}
+	};
+
+	option_index = 0;
+	seed = time(NULL);
+	while ((opt = getopt_long (argc, argv, "hs:",
+				   long_options, &option_index)) >= 0) {
+		switch (opt)
+		{
+		case 0:
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+		default:
+			usage(name);
+			return 0;
+		}
+	}
+
+	// Seed random number generator
+	srand(seed);
+	printf("%s: seed=%d\n", name, seed);
+
+	efd = -1;
+
+	// Open first AFU found
+	struct cxl_afu_h *afu_h;
+	afu_h = cxl_afu_next(NULL);
+	if (!afu_h) {
+		fprintf(stderr, "\nNo AFU found!\n\n");
+		goto done;
+	}
+	afu_h = cxl_afu_open_h(afu_h, CXL_VIEW_DEDICATED);
+	if (!afu_h) {
+		perror("cxl_afu_open_h");
+		goto done;
+	}
+	max_irqs = 2000;
+	irq[0] = 1 + rand() % max_irqs;
+	do {
+		irq[1] = 1 + rand() % max_irqs;
+	} while (irq[1] == irq[0]);
+	irq[2] = irq[0];
+
+	// Set WED to random value
+	wed = rand();
+	wed <<= 32;
+	wed |= rand();
+	// Start AFU
+	cxl_afu_attach(afu_h, wed);
+
+	// Watch the AFU event fd
+	if ((efd = epoll_create1(0)) < 0) {
+		perror("epoll_create1");
+		goto done;
+	}
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	if (epoll_ctl(efd, EPOLL_CTL_ADD, cxl_afu_fd(afu_h), &ev) < 0) {
+		perror("epoll_ctl");
+		goto done;
+	}
+
+	// Map AFU MMIO registers
+	printf("Mapping AFU registers...\n");
+	if ((cxl_mmio_map(afu_h, CXL_MMIO_BIG_ENDIAN)) < 0) {
+		perror("cxl_mmio_map");
+		goto done;
+
+	}
+
+	// Initialize machine configuration
+	init_machine(&machine);
+
+	// Use AFU Machine 1 to generate each interrupt
+	for (i = 0; i < 3; i++) {
+		if ((response = config_enable_and_run_machine(afu_h, &machine,
+							      1, 0,
+							      PSL_COMMAND_INTREQ,
+							      0, 0, 0,
+							      (uint64_t)irq[i],
+							      1, DEDICATED)) < 0)
+		{
+			printf("FAILED:config_enable_and_run_machine");
+			goto done;
+		}
+
+		// Check for valid response
+		if (response != PSL_RESPONSE_DONE) {
+			printf("FAILED: Unexpected response code 0x%x\n",
+			       response);
+			goto done;
+		}
+	}
+
+	// Both IRQs are delivered in order, the repeat is coalesced
+	for (i = 0; i < 2; i++) {
+		if (epoll_wait(efd, &ev, 1, 1000) != 1) {
+			printf("FAILED: Expected AFU fd to be readable\n");
+			goto done;
+		}
+
+		if (cxl_read_event(afu_h, &event) < 0) {
+			perror("cxl_read_event");
+			goto done;
+		}
+
+		if (event.header.type != CXL_EVENT_AFU_INTERRUPT) {
+			printf("FAILED: Expected AFU interrupt type\n");
+			goto done;
+		}
+
+		if (event.irq.irq != irq[i]) {
+			printf("FAILED: Expected AFU interrupt %ld but got %d\n",
+			       irq[i], event.irq.irq);
+			goto done;
+		}
+	}
+
+	if (cxl_event_pending(afu_h) || (epoll_wait(efd, &ev, 1, 0) != 0)) {
+		printf("FAILED: Unexpected event pending\n");
+		goto done;
+	}
+
+	printf("PASSED\n");
+
+done:
+	if (efd >= 0)
+		close(efd);
+	if (afu_h) {
+		// Unmap AFU MMIO registers
+		cxl_mmio_unmap(afu_h);
+
+		// Free AFU
+		cxl_afu_free(afu_h);
+	}
+
+	return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright 2015 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Description : mmio_batch.c
+ *
+ * This test checks batched MMIO with cxl_mmio_submit() and cxl_mmio_wait()
+ * using the Test AFU for validating pslse
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libcxl.h"
+
+#define SCRATCH_REGS 2
+#define PAIRS (CXL_MMIO_BATCH_MAX / 2)
+
+void usage(char *name)
+{
+	printf("Usage: %s [OPTION]...\n\n", name);
+	printf("  -s, --seed\t\tseed for random number generation\n");
+	printf("      --help\tdisplay this help and exit\n\n");
+}
+
+static uint64_t rand64(void)
+{
+	uint64_t value;
+
+	value = rand();
+	value <<= 32;
+	value |= rand();
+	return value;
+}
+
+int main(int argc, char *argv[])
+{
+	struct cxl_afu_h *afu_h;
+	struct cxl_mmio_op ops[CXL_MMIO_BATCH_MAX];
+	uint64_t wed, expect;
+	unsigned seed;
+	int i, opt, option_index;
+	char *name;
+
+	name = strrchr(argv[0], '/');
+	if (name)
+		name++;
+	else
+		name = argv[0];
+
+	static struct option long_options[] = {
+		{"help",	no_argument,		0,		'h'},
+		{"seed",	required_argument,	0,		's'},
+		{NULL, 0, 0, 0}
+	};
+
+	option_index = 0;
+	seed = time(NULL);
+	while ((opt = getopt_long (argc, argv, "hs:",
+				   long_options, &option_index)) >= 0) {
+		switch (opt)
+		{
+		case 0:
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+		default:
+			usage(name);
+			return 0;
+		}
+	}
+
+	// Seed random number generator
+	srand(seed);
+	printf("%s: seed=%d\n", name, seed);
+
+	// Find first AFU in system
+	afu_h = cxl_afu_next(NULL);
+	if (!afu_h) {
+		fprintf(stderr, "FAILED:No AFU found!\n");
+		goto done;
+	}
+
+	// Open AFU
+	afu_h = cxl_afu_open_h(afu_h, CXL_VIEW_DEDICATED);
+	if (!afu_h) {
+		perror("FAILED:cxl_afu_open_h");
+		goto done;
+	}
+
+	// Start AFU passing random WED value
+	wed = rand64();
+	cxl_afu_attach(afu_h, wed);
+
+	// Map AFU MMIO registers
+	printf("Mapping AFU registers...\n");
+	if ((cxl_mmio_map(afu_h, CXL_MMIO_BIG_ENDIAN)) < 0) {
+		perror("FAILED:cxl_mmio_map");
+		goto done;
+	}
+
+	///////////////////////////////////////////////////////////
+	// CHECK 1 - Mixed widths in one batch complete in order //
+	///////////////////////////////////////////////////////////
+
+	memset(ops, 0, sizeof(ops));
+	ops[0].op = CXL_MMIO_OP_READ64;
+	ops[0].offset = 0x8;
+	ops[1].op = CXL_MMIO_OP_WRITE64;
+	ops[1].offset = 0x17f0;
+	ops[1].data = rand64();
+	ops[2].op = CXL_MMIO_OP_READ32;
+	ops[2].offset = 0x17f0;
+	ops[3].op = CXL_MMIO_OP_READ32;
+	ops[3].offset = 0x17f4;
+	ops[4].op = CXL_MMIO_OP_WRITE32;
+	ops[4].offset = 0x17f8;
+	ops[4].data = (uint32_t) rand();
+	ops[5].op = CXL_MMIO_OP_WRITE32;
+	ops[5].offset = 0x17fc;
+	ops[5].data = (uint32_t) rand();
+	ops[6].op = CXL_MMIO_OP_READ64;
+	ops[6].offset = 0x17f8;
+	if (cxl_mmio_submit(afu_h, ops, 7) < 0) {
+		perror("FAILED:cxl_mmio_submit");
+		goto done;
+	}
+	if (cxl_mmio_wait(afu_h) < 0) {
+		perror("FAILED:cxl_mmio_wait");
+		goto done;
+	}
+	if (ops[0].data != wed) {
+		printf("\nFAILED:WED mismatch!\n");
+		printf("\tExpected:0x%016"PRIx64"\n", wed);
+		printf("\tActual  :0x%016"PRIx64"\n", ops[0].data);
+		goto done;
+	}
+	expect = (ops[2].data << 32) | ops[3].data;
+	if (ops[1].data != expect) {
+		printf("\nFAILED:64-bit write => 32-bit reads mismatch!\n");
+		printf("\tExpected:0x%016"PRIx64"\n", ops[1].data);
+		printf("\tActual  :0x%016"PRIx64"\n", expect);
+		goto done;
+	}
+	expect = (ops[4].data << 32) | ops[5].data;
+	if (ops[6].data != expect) {
+		printf("\nFAILED:32-bit writes => 64-bit read mismatch!\n");
+		printf("\tExpected:0x%016"PRIx64"\n", expect);
+		printf("\tActual  :0x%016"PRIx64"\n", ops[6].data);
+		goto done;
+	}
+	printf("Mixed batch check complete\n");
+
+	/////////////////////////////////////////////////////////
+	// CHECK 2 - Full batch of write/read pairs, in order  //
+	/////////////////////////////////////////////////////////
+
+	for (i = 0; i < PAIRS; i++) {
+		ops[2 * i].op = CXL_MMIO_OP_WRITE64;
+		ops[2 * i].offset = 0x17f0 + 8 * (i % SCRATCH_REGS);
+		ops[2 * i].data = rand64();
+		ops[2 * i + 1].op = CXL_MMIO_OP_READ64;
+		ops[2 * i + 1].offset = ops[2 * i].offset;
+		ops[2 * i + 1].data = 0;
+	}
+	if (cxl_mmio_submit(afu_h, ops, 2 * PAIRS) < 0) {
+		perror("FAILED:cxl_mmio_submit");
+		goto done;
+	}
+	// Only one batch at a time
+	if ((cxl_mmio_submit(afu_h, ops, 1) == 0) || (errno != EBUSY)) {
+		printf("FAILED:second cxl_mmio_submit was not refused\n");
+		goto done;
+	}
+	if (cxl_mmio_wait(afu_h) < 0) {
+		perror("FAILED:cxl_mmio_wait");
+		goto done;
+	}
+	for (i = 0; i < PAIRS; i++) {
+		if (ops[2 * i].data != ops[2 * i + 1].data) {
+			printf("\nFAILED:batch access %d mismatch!\n", 2 * i + 1);
+			printf("\tExpected:0x%016"PRIx64"\n", ops[2 * i].data);
+			printf("\tActual  :0x%016"PRIx64"\n",
+			       ops[2 * i + 1].data);
+			goto done;
+		}
+	}
+	printf("Full batch check complete\n");
+
+	// Report test as passing
+	printf("PASSED\n");
+done:
+	if (afu_h) {
+		// Unmap AFU MMIO registers
+		cxl_mmio_unmap(afu_h);
+		// Free AFU
+		cxl_afu_free(afu_h);
+	}
+
+	return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright 2015 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Description : timing_read.c
+ *
+ * This test needs the PSL timing model with TIMING_MAX_READS:1, no cache
+ * latency and a translation latency of --latency cycles.  AFU Machine 1
+ * reads a page the ERAT has not seen, so its data is not due until latency
+ * cycles after the command.  AFU Machine 2 then reads a page already in the
+ * ERAT.  Its data is due at once, but the only read slot is held until
+ * Machine 1's buffer write, so its response must not come before that.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libcxl.h"
+#include "psl_interface_t.h"
+#include "TestAFU_config.h"
+#include "utils.h"
+
+#define PAGE_BYTES 4096
+#define TIMESTAMP_MASK 0x7FFF
+
+void usage(char *name)
+{
+	printf("Usage: %s [OPTION]...\n\n", name);
+	printf("  -l, --latency\t\tTIMING_XLATE_LATENCY in pslse.parms\n");
+	printf("  -s, --seed\t\tseed for random number generation\n");
+	printf("      --help\tdisplay this help and exit\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+	MachineConfig warm, cold, queued;
+	char *page0, *page1, *name;
+	uint64_t wed;
+	unsigned seed;
+	uint16_t cold_cmd, queued_cmd, queued_resp;
+	int i, opt, option_index;
+	int response, latency;
+
+	name = strrchr(argv[0], '/');
+	if (name)
+		name++;
+	else
+		name = argv[0];
+
+	static struct option long_options[] = {
+		{"help",	no_argument,		0,		'h'},
+		{"latency",	required_argument,	0,		'l'},
+		{"seed",	required_argument,	0,		's'},
+		{NULL, 0, 0, 0}
+	};
+
+	option_index = 0;
+	seed = time(NULL);
+	latency = 10000;
+	while ((opt = getopt_long (argc, argv, "hl:s:",
+				   long_options, &option_index)) >= 0) {
+		switch (opt)
+		{
+		case 0:
+			break;
+		case 'l':
+			latency = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+		default:
+			usage(name);
+			return 0;
+		}
+	}
+	if ((latency <= 0) || (latency > TIMESTAMP_MASK / 2)) {
+		printf("FAILED: latency must be 1-%d cycles\n",
+		       TIMESTAMP_MASK / 2);
+		return 0;
+	}
+
+	// Seed random number generator
+	srand(seed);
+	printf("%s: seed=%d\n", name, seed);
+
+	// Open first AFU found
+	struct cxl_afu_h *afu_h;
+	afu_h = cxl_afu_next(NULL);
+	if (!afu_h) {
+		fprintf(stderr, "\nNo AFU found!\n\n");
+		goto done;
+	}
+	afu_h = cxl_afu_open_h(afu_h, CXL_VIEW_DEDICATED);
+	if (!afu_h) {
+		perror("cxl_afu_open_h");
+		goto done;
+	}
+
+	// Set WED to random value
+	wed = rand();
+	wed <<= 32;
+	wed |= rand();
+	// Start AFU
+	cxl_afu_attach(afu_h, wed);
+
+	// Map AFU MMIO registers
+	printf("Mapping AFU registers...\n");
+	if ((cxl_mmio_map(afu_h, CXL_MMIO_BIG_ENDIAN)) < 0) {
+		perror("cxl_mmio_map");
+		goto done;
+
+	}
+
+	// Allocate a page for each machine so they translate separately
+	if (posix_memalign((void **)&page0, PAGE_BYTES, PAGE_BYTES) != 0) {
+		perror("FAILED:posix_memalign");
+		goto done;
+	}
+	if (posix_memalign((void **)&page1, PAGE_BYTES, PAGE_BYTES) != 0) {
+		perror("FAILED:posix_memalign");
+		goto done;
+	}
+	for (i = 0; i < CACHELINE_BYTES; i++) {
+		page0[i] = rand();
+		page1[i] = rand();
+	}
+
+	// Use AFU Machine 3 to bring the second page into the ERAT
+	init_machine(&warm);
+	if ((response = config_enable_and_run_machine(afu_h, &warm, 3, 0, PSL_COMMAND_READ_CL_NA, CACHELINE_BYTES, 0, 0, (uint64_t)page1, CACHELINE_BYTES, DEDICATED)) < 0)
+	{
+		printf("FAILED:config_enable_and_run_machine");
+		goto done;
+	}
+	if (response != PSL_RESPONSE_DONE)
+	{
+		printf("FAILED: Unexpected response code 0x%x\n", response);
+		goto done;
+	}
+
+	// Start AFU Machine 1 reading the first page, then AFU Machine 2
+	// reading the second while Machine 1 holds the read slot
+	init_machine(&cold);
+	if (config_and_enable_machine(afu_h, &cold, 1, 0, PSL_COMMAND_READ_CL_NA, CACHELINE_BYTES, 0, 0, (uint64_t)page0, CACHELINE_BYTES, 0, DEDICATED) < 0)
+	{
+		printf("FAILED:config_and_enable_machine");
+		goto done;
+	}
+	init_machine(&queued);
+	if (config_and_enable_machine(afu_h, &queued, 2, 0, PSL_COMMAND_READ_CL_NA, CACHELINE_BYTES, 0, 0, (uint64_t)page1, CACHELINE_BYTES, 0, DEDICATED) < 0)
+	{
+		printf("FAILED:config_and_enable_machine");
+		goto done;
+	}
+
+	// Check for valid responses
+	if ((response = get_response(afu_h, &cold, 1, DEDICATED)) !=
+	    PSL_RESPONSE_DONE)
+	{
+		printf("FAILED: Unexpected response code 0x%x\n", response);
+		goto done;
+	}
+	if ((response = get_response(afu_h, &queued, 2, DEDICATED)) !=
+	    PSL_RESPONSE_DONE)
+	{
+		printf("FAILED: Unexpected response code 0x%x\n", response);
+		goto done;
+	}
+
+	// Compare AFU cycle timestamps relative to Machine 1's command
+	get_machine_config_command_timestamp(&cold, &cold_cmd);
+	get_machine_config_command_timestamp(&queued, &queued_cmd);
+	get_machine_config_response_timestamp(&queued, &queued_resp);
+	queued_cmd = (queued_cmd - cold_cmd) & TIMESTAMP_MASK;
+	queued_resp = (queued_resp - cold_cmd) & TIMESTAMP_MASK;
+	printf("Machine 2 command at +%d cycles, response at +%d cycles\n",
+	       queued_cmd, queued_resp);
+	if (queued_cmd >= latency)
+	{
+		printf("FAILED: Machine 2 started after Machine 1's data was due\n");
+		goto done;
+	}
+	if (queued_resp < latency)
+	{
+		printf("FAILED: Machine 2 read overtook the read slot held until +%d cycles\n",
+		       latency);
+		goto done;
+	}
+
+	printf("PASSED\n");
+
+done:
+	if (afu_h) {
+		// Unmap AFU MMIO registers
+		cxl_mmio_unmap(afu_h);
+
+		// Free AFU
+		cxl_afu_free(afu_h);
+	}
+
+	return 0;
+}